@@ -11,7 +11,7 @@ uint32_t mascot_duration_limit(struct mascot* mascot, struct mascot_expression*
             return tick + duration;
         }
         else {
-            WARN("<Mascot:%s:%u> Duration calculation failed for expression id %u", mascot->prototype->name, mascot->id, expr->body->id);
+            WARN("<Mascot:%s:%u> Duration calculation failed for expression id %u", mascot->prototype->name, mascot->id, expr->id);
         }
     }
     return 0;
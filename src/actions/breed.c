@@ -92,7 +92,7 @@ enum mascot_tick_result breed_action_init(struct mascot *mascot, struct mascot_a
     }
 
     // Announce affordance
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
 
     return mascot_tick_ok;
 }
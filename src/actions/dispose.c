@@ -61,7 +61,7 @@ enum mascot_tick_result dispose_action_init(struct mascot *mascot, struct mascot
     mascot->state = mascot_state_animate;
 
     // Announce affordance
-    mascot_announce_affordance(mascot, actionref->action->affordance);
+    mascot_announce_affordance(mascot, actionref->action->affordance_atom);
 
     return mascot_tick_ok;
 }
@@ -59,7 +59,7 @@ enum mascot_tick_result dragging_action_init(struct mascot *mascot, struct masco
 
     mascot->state = mascot_state_drag;
 
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
 
     free(mascot->action_data);
     mascot->action_data = calloc(1, sizeof(struct dragging_aux_data));
@@ -87,7 +87,7 @@ enum mascot_tick_result example_action_init(struct mascot *mascot, struct mascot
     mascot->state = mascot_state_stay;
 
     // Announce affordance of that action
-    mascot_announce_affordance(mascot, actionref->action->affordance);
+    mascot_announce_affordance(mascot, actionref->action->affordance_atom);
 
     return mascot_tick_ok;
 }
@@ -265,5 +265,5 @@ void example_action_clean(struct mascot *mascot)
     mascot->frame_index = 0;
     mascot->next_frame_tick = 0;
     mascot->action_duration = 0;
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
 }
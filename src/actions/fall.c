@@ -102,7 +102,7 @@ enum mascot_tick_result fall_action_init(struct mascot *mascot, struct mascot_ac
 
     mascot->action_duration = tick + 5; // Watchdog
 
-    mascot_announce_affordance(mascot, actionref->action->affordance);
+    mascot_announce_affordance(mascot, actionref->action->affordance_atom);
     return mascot_tick_ok;
 
 }
@@ -274,5 +274,5 @@ void fall_action_clean(struct mascot *mascot)
     mascot->AirDragX->value.f = 0;
     mascot->AirDragY->value.f = 0;
     mascot->Gravity->value.f = 0;
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
 }
@@ -103,7 +103,7 @@ enum mascot_tick_result fallwithie_action_init(struct mascot *mascot, struct mas
 
     mascot->action_duration = tick + 5; // Watchdog
 
-    mascot_announce_affordance(mascot, actionref->action->affordance);
+    mascot_announce_affordance(mascot, actionref->action->affordance_atom);
     return mascot_tick_ok;
 
 }
@@ -337,5 +337,5 @@ void fallwithie_action_clean(struct mascot *mascot)
     mascot->AirDragX->value.f = 0;
     mascot->AirDragY->value.f = 0;
     mascot->Gravity->value.f = 0;
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
 }
@@ -64,7 +64,7 @@ enum mascot_tick_result interact_action_init(struct mascot *mascot, struct masco
     mascot->state = mascot_state_interact;
 
     // Announce affordance
-    mascot_announce_affordance(mascot, actionref->action->affordance);
+    mascot_announce_affordance(mascot, actionref->action->affordance_atom);
 
     return mascot_tick_ok;
 }
@@ -77,5 +77,5 @@ void interact_action_clean(struct mascot *mascot)
     mascot->next_frame_tick = 0;
     mascot->action_duration = 0;
     mascot->state = mascot_state_interact;
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
 }
@@ -79,7 +79,7 @@ enum mascot_tick_result jump_action_init(struct mascot *mascot, struct mascot_ac
 
     mascot->state = mascot_state_jump;
 
-    mascot_announce_affordance(mascot, actionref->action->affordance);
+    mascot_announce_affordance(mascot, actionref->action->affordance_atom);
 
     return mascot_tick_ok;
 }
@@ -198,5 +198,5 @@ void jump_action_clean(struct mascot *mascot)
     mascot->VelocityParam->value.f = 0.0;
     mascot->TargetX->value.i = 0;
     mascot->TargetY->value.i = 0;
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
 }
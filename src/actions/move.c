@@ -89,7 +89,7 @@ enum mascot_tick_result move_action_init(struct mascot *mascot, struct mascot_ac
 
     mascot->state = mascot_state_move;
 
-    mascot_announce_affordance(mascot, actionref->action->affordance);
+    mascot_announce_affordance(mascot, actionref->action->affordance_atom);
 
     return mascot_tick_ok;
 
@@ -284,5 +284,5 @@ void move_action_clean(struct mascot *mascot) {
     mascot->TargetY->value.i = 0;
     mascot->VelocityX->value.f = 0;
     mascot->VelocityY->value.f = 0;
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
 }
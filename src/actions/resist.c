@@ -62,7 +62,7 @@ enum mascot_tick_result resist_action_init(struct mascot *mascot, struct mascot_
     mascot->next_frame_tick = 0;
     mascot->animation_index = 0;
 
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
     mascot->state = mascot_state_drag_resist;
 
     free(mascot->action_data);
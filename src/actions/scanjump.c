@@ -29,7 +29,7 @@ enum mascot_tick_result scanjump_action_init(struct mascot *mascot, struct masco
     }
 
     // FIRST THAT WE NEED TO CHECK: is our target exists?
-    struct mascot* new_target = mascot_get_target_by_affordance(mascot, actionref->action->affordance);
+    struct mascot* new_target = mascot_get_target_by_affordance(mascot, actionref->action->affordance_atom);
     if (!new_target) {
         DEBUG("<Mascot:%s:%u> Scanjump action has no target", mascot->prototype->name, mascot->id);
         return mascot_tick_next;
@@ -66,7 +66,7 @@ enum mascot_tick_result scanjump_action_init(struct mascot *mascot, struct masco
 
     mascot->state = mascot_state_jump;
 
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
     mascot->target_mascot = new_target;
 
     return mascot_tick_ok;
@@ -106,18 +106,18 @@ struct mascot_action_next scanjump_action_next(struct mascot* mascot, struct mas
     }
 
     // Check if our target still have same affordance
-    const char* affordance = mascot->target_mascot->current_affordance;
-    if (affordance) {
-        if (strcasecmp(actionref->action->affordance, affordance) || strlen(affordance) != strlen(actionref->action->affordance)) {
-            affordance = NULL;
+    atom_t affordance = mascot->target_mascot->current_affordance;
+    if (affordance != ATOM_NONE) {
+        if (affordance != actionref->action->affordance_atom) {
+            affordance = ATOM_NONE;
             mascot->target_mascot = NULL;
         }
     }
 
 
-    if (!affordance) {
+    if (affordance == ATOM_NONE) {
         // Try to find new target
-        struct mascot* new_target = mascot_get_target_by_affordance(mascot, actionref->action->affordance);
+        struct mascot* new_target = mascot_get_target_by_affordance(mascot, actionref->action->affordance_atom);
         if (!new_target) {
             result.status = mascot_tick_next;
             return result;
@@ -239,5 +239,5 @@ void scanjump_action_clean(struct mascot *mascot)
     mascot->TargetX->value.i = 0;
     mascot->TargetY->value.i = 0;
     mascot->target_mascot = NULL;
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
 }
@@ -54,7 +54,7 @@ enum mascot_tick_result selector_action_init(struct mascot *mascot, struct masco
     mascot->action_index = 0;
 
     // Unannounce affordance
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
 
     return mascot_tick_ok;
 }
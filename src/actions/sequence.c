@@ -66,7 +66,7 @@ enum mascot_tick_result sequence_action_init(struct mascot *mascot, struct masco
     mascot->action_index = 0;
 
     // Announce affordance
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
 
     return mascot_tick_ok;
 }
@@ -64,7 +64,7 @@ enum mascot_tick_result simple_action_init(struct mascot *mascot, struct mascot_
     mascot->state = mascot_state_stay;
 
     // Announce affordance
-    mascot_announce_affordance(mascot, actionref->action->affordance);
+    mascot_announce_affordance(mascot, actionref->action->affordance_atom);
 
     return mascot_tick_ok;
 }
@@ -200,5 +200,5 @@ void simple_action_clean(struct mascot *mascot)
     mascot->frame_index = 0;
     mascot->next_frame_tick = 0;
     mascot->action_duration = 0;
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
 }
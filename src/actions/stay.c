@@ -65,7 +65,7 @@ enum mascot_tick_result stay_action_init(struct mascot *mascot, struct mascot_ac
     mascot->state = mascot_state_stay;
 
     // Announce affordance
-    mascot_announce_affordance(mascot, actionref->action->affordance);
+    mascot_announce_affordance(mascot, actionref->action->affordance_atom);
 
     return mascot_tick_ok;
 }
@@ -118,7 +118,7 @@ enum mascot_tick_result throwie_action_init(struct mascot *mascot, struct mascot
     // }
 
     // Announce affordance
-    mascot_announce_affordance(mascot, actionref->action->affordance);
+    mascot_announce_affordance(mascot, actionref->action->affordance_atom);
 
     return mascot_tick_ok;
 }
@@ -318,6 +318,6 @@ void throwie_action_clean(struct mascot *mascot)
     mascot->Gravity->value.f = 0;
     free(mascot->action_data);
     mascot->action_data = NULL;
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
     plugins_reactivate_ie();
 }
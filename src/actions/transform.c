@@ -64,7 +64,7 @@ enum mascot_tick_result transform_action_init(struct mascot *mascot, struct masc
     mascot->animation_index = -1;
 
     // Announce affordance
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
 
     return mascot_tick_ok;
 }
@@ -92,7 +92,7 @@ enum mascot_tick_result walkwithie_action_init(struct mascot *mascot, struct mas
 
     mascot->state = mascot_state_ie_walk;
 
-    mascot_announce_affordance(mascot, actionref->action->affordance);
+    mascot_announce_affordance(mascot, actionref->action->affordance_atom);
 
     return mascot_tick_ok;
 }
@@ -0,0 +1,174 @@
+/*
+    atom.c - wl_shimeji's string interning
+
+    Copyright (C) 2025  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "atom.h"
+
+#include <pthread.h>
+#include <string.h>
+
+struct atom_entry {
+    char* string;
+    size_t length;
+    uint32_t hash;
+};
+
+// Open addressing table of atom indices, entries[0] is reserved for ATOM_NONE
+static struct {
+    struct atom_entry* entries;
+    uint32_t entry_count;
+    uint32_t entry_capacity;
+    atom_t* buckets;
+    uint32_t bucket_count; // Always power of two
+    pthread_rwlock_t lock;
+} atoms = {
+    .lock = PTHREAD_RWLOCK_INITIALIZER
+};
+
+static uint32_t atom_hash(const char* str, size_t len)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static atom_t atom_find_locked(const char* str, size_t len, uint32_t hash)
+{
+    if (!atoms.bucket_count) return ATOM_NONE;
+
+    uint32_t mask = atoms.bucket_count - 1;
+    for (uint32_t i = hash & mask; atoms.buckets[i] != ATOM_NONE; i = (i + 1) & mask) {
+        struct atom_entry* entry = &atoms.entries[atoms.buckets[i]];
+        if (entry->hash == hash && entry->length == len && !memcmp(entry->string, str, len)) {
+            return atoms.buckets[i];
+        }
+    }
+    return ATOM_NONE;
+}
+
+static void atom_rehash_locked(uint32_t bucket_count)
+{
+    atom_t* buckets = calloc(bucket_count, sizeof(atom_t));
+    if (!buckets) {
+        ERROR("OOM CONDITION in atom_rehash");
+    }
+
+    uint32_t mask = bucket_count - 1;
+    for (atom_t atom = 1; atom < atoms.entry_count; atom++) {
+        uint32_t i = atoms.entries[atom].hash & mask;
+        while (buckets[i] != ATOM_NONE) i = (i + 1) & mask;
+        buckets[i] = atom;
+    }
+
+    free(atoms.buckets);
+    atoms.buckets = buckets;
+    atoms.bucket_count = bucket_count;
+}
+
+atom_t atom_intern_n(const char* str, size_t len)
+{
+    if (!str) return ATOM_NONE;
+
+    uint32_t hash = atom_hash(str, len);
+
+    pthread_rwlock_rdlock(&atoms.lock);
+    atom_t atom = atom_find_locked(str, len, hash);
+    pthread_rwlock_unlock(&atoms.lock);
+    if (atom != ATOM_NONE) return atom;
+
+    pthread_rwlock_wrlock(&atoms.lock);
+    // Someone may have interned same string while we were waiting for the write lock
+    atom = atom_find_locked(str, len, hash);
+    if (atom != ATOM_NONE) {
+        pthread_rwlock_unlock(&atoms.lock);
+        return atom;
+    }
+
+    if (!atoms.entry_count) atoms.entry_count = 1;
+
+    if (atoms.entry_count >= atoms.entry_capacity) {
+        uint32_t new_capacity = atoms.entry_capacity ? atoms.entry_capacity * 2 : 256;
+        struct atom_entry* entries = realloc(atoms.entries, new_capacity * sizeof(struct atom_entry));
+        if (!entries) {
+            ERROR("OOM CONDITION in atom_intern");
+        }
+        atoms.entries = entries;
+        atoms.entry_capacity = new_capacity;
+    }
+
+    // Keep load factor below 1/2
+    if ((atoms.entry_count + 1) * 2 > atoms.bucket_count) {
+        atom_rehash_locked(atoms.bucket_count ? atoms.bucket_count * 2 : 512);
+    }
+
+    atom = atoms.entry_count++;
+    atoms.entries[atom] = (struct atom_entry){
+        .string = strndup(str, len),
+        .length = len,
+        .hash = hash
+    };
+    if (!atoms.entries[atom].string) {
+        ERROR("OOM CONDITION in atom_intern");
+    }
+
+    uint32_t mask = atoms.bucket_count - 1;
+    uint32_t i = hash & mask;
+    while (atoms.buckets[i] != ATOM_NONE) i = (i + 1) & mask;
+    atoms.buckets[i] = atom;
+
+    pthread_rwlock_unlock(&atoms.lock);
+    return atom;
+}
+
+atom_t atom_intern(const char* str)
+{
+    if (!str) return ATOM_NONE;
+    return atom_intern_n(str, strlen(str));
+}
+
+atom_t atom_lookup_n(const char* str, size_t len)
+{
+    if (!str) return ATOM_NONE;
+
+    uint32_t hash = atom_hash(str, len);
+    pthread_rwlock_rdlock(&atoms.lock);
+    atom_t atom = atom_find_locked(str, len, hash);
+    pthread_rwlock_unlock(&atoms.lock);
+    return atom;
+}
+
+atom_t atom_lookup(const char* str)
+{
+    if (!str) return ATOM_NONE;
+    return atom_lookup_n(str, strlen(str));
+}
+
+const char* atom_name(atom_t atom)
+{
+    if (atom == ATOM_NONE) return NULL;
+
+    const char* name = NULL;
+    pthread_rwlock_rdlock(&atoms.lock);
+    if (atom < atoms.entry_count) name = atoms.entries[atom].string;
+    pthread_rwlock_unlock(&atoms.lock);
+    return name;
+}
@@ -0,0 +1,43 @@
+/*
+    atom.h - wl_shimeji's string interning
+
+    Copyright (C) 2025  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef ATOM_H
+#define ATOM_H
+
+#include "master_header.h"
+
+// Atoms are daemon-wide integer handles for interned names (behaviors, actions, affordances, sprites).
+// Two names are equal if and only if their atoms are equal, so hot paths compare integers instead of strings.
+// Atoms are never released, they stay valid until the daemon exits.
+typedef uint32_t atom_t;
+
+#define ATOM_NONE 0
+
+// Interns string and returns its atom. NULL is mapped to ATOM_NONE
+atom_t atom_intern(const char* str);
+atom_t atom_intern_n(const char* str, size_t len);
+
+// Same as above, but never inserts: returns ATOM_NONE if string was never interned
+atom_t atom_lookup(const char* str);
+atom_t atom_lookup_n(const char* str, size_t len);
+
+// Returns interned string for atom, NULL for ATOM_NONE or unknown atoms
+const char* atom_name(atom_t atom);
+
+#endif
@@ -68,6 +68,21 @@ struct config {
     int32_t allow_dragging_multihead;
     int32_t unified_outputs;
 
+    // Show right-facing sprites by flipping buffers of left-facing ones instead of keeping mirrored copies
+    int32_t mirror_by_transform;
+
+    // Megabytes of sprite pixel data kept resident, 0 means no limit
+    int32_t atlas_memory_budget;
+
+    // Resample sprites to MASCOT_SCALE on load instead of letting compositor scale them every frame
+    int32_t prescale_sprites;
+
+    // Input regions follow opaque pixels of sprites instead of their bounding boxes
+    int32_t precise_input_regions;
+
+    // Compile expressions to native code on load
+    int32_t expression_jit;
+
     float mascot_opacity;
     float mascot_scale;
 
@@ -146,6 +161,10 @@ bool config_parse(const char* path)
     config.allow_dragging_multihead = -1;
     config.allow_throwing_multihead = -1;
     config.unified_outputs = -1;
+    config.mirror_by_transform = -1;
+    config.prescale_sprites = -1;
+    config.precise_input_regions = -1;
+    config.expression_jit = -1;
     config.mascot_opacity = -1.0f;
     config.mascot_scale = -1.0f;
 
@@ -228,6 +247,16 @@ bool config_parse(const char* path)
             config_set_allow_dragging_multihead(parse_bool(value));
         } else if (strcasecmp(key, "unified_outputs") == 0) {
             config_set_unified_outputs(parse_bool(value));
+        } else if (strcasecmp(key, "mirror_by_transform") == 0) {
+            config_set_mirror_by_transform(parse_bool(value));
+        } else if (strcasecmp(key, "atlas_memory_budget") == 0) {
+            config_set_atlas_memory_budget(atoi(value));
+        } else if (strcasecmp(key, "prescale_sprites") == 0) {
+            config_set_prescale_sprites(parse_bool(value));
+        } else if (strcasecmp(key, "precise_input_regions") == 0) {
+            config_set_precise_input_regions(parse_bool(value));
+        } else if (strcasecmp(key, "expression_jit") == 0) {
+            config_set_expression_jit(parse_bool(value));
         } else if (strcasecmp(key, "prototypes_location") == 0) {
             if (config.prototypes_location) {
                 free(config.prototypes_location);
@@ -290,6 +319,11 @@ void config_write(const char* path)
     if (config.allow_throwing_multihead != -1) fprintf(file, "allow_throwing_multihead=%s\n", config.allow_throwing_multihead ? "true" : "false");
     if (config.allow_dragging_multihead != -1) fprintf(file, "allow_dragging_multihead=%s\n", config.allow_dragging_multihead ? "true" : "false");
     if (config.unified_outputs != -1) fprintf(file, "unified_outputs=%s\n", config.unified_outputs ? "true" : "false");
+    if (config.mirror_by_transform != -1) fprintf(file, "mirror_by_transform=%s\n", config.mirror_by_transform ? "true" : "false");
+    if (config.atlas_memory_budget) fprintf(file, "atlas_memory_budget=%d\n", config.atlas_memory_budget);
+    if (config.prescale_sprites != -1) fprintf(file, "prescale_sprites=%s\n", config.prescale_sprites ? "true" : "false");
+    if (config.precise_input_regions != -1) fprintf(file, "precise_input_regions=%s\n", config.precise_input_regions ? "true" : "false");
+    if (config.expression_jit != -1) fprintf(file, "expression_jit=%s\n", config.expression_jit ? "true" : "false");
     if (config.prototypes_location) fprintf(file, "prototypes_location=%s\n", config.prototypes_location);
     if (config.plugins_location) fprintf(file, "plugins_location=%s\n", config.plugins_location);
     if (config.socket_location) fprintf(file, "socket_location=%s\n", config.socket_location);
@@ -696,6 +730,70 @@ int32_t config_get_unified_outputs()
     return config.unified_outputs;
 }
 
+// Only affects atlases loaded after the change
+bool config_set_mirror_by_transform(int32_t value)
+{
+    config.mirror_by_transform = value;
+    return true;
+}
+
+int32_t config_get_mirror_by_transform()
+{
+    if (config.mirror_by_transform == -1) return true;
+    return config.mirror_by_transform;
+}
+
+bool config_set_atlas_memory_budget(int32_t value)
+{
+    if (value < 0) return false;
+    config.atlas_memory_budget = value;
+    return true;
+}
+
+int32_t config_get_atlas_memory_budget()
+{
+    return config.atlas_memory_budget;
+}
+
+// Atlases are resampled on their next use
+bool config_set_prescale_sprites(int32_t value)
+{
+    config.prescale_sprites = value;
+    return true;
+}
+
+int32_t config_get_prescale_sprites()
+{
+    if (config.prescale_sprites == -1) return false;
+    return config.prescale_sprites;
+}
+
+// Applied on next attach of every mascot
+bool config_set_precise_input_regions(int32_t value)
+{
+    config.precise_input_regions = value;
+    return true;
+}
+
+int32_t config_get_precise_input_regions()
+{
+    if (config.precise_input_regions == -1) return true;
+    return config.precise_input_regions;
+}
+
+// Applied to prototypes loaded afterwards
+bool config_set_expression_jit(int32_t value)
+{
+    config.expression_jit = value;
+    return true;
+}
+
+int32_t config_get_expression_jit()
+{
+    if (config.expression_jit == -1) return false;
+    return config.expression_jit;
+}
+
 const char* config_get_prototypes_location()
 {
     return config.prototypes_location;
@@ -795,6 +893,21 @@ bool config_get_by_key(const char* key, char* dest, uint8_t size)
     } else if (!strcmp(key, CONFIG_PARAM_UNIFIED_OUTPUTS)) {
         snprintf(dest, size, "%s", config.unified_outputs ? "true" : "false");
         return true;
+    } else if (!strcmp(key, CONFIG_PARAM_MIRROR_BY_TRANSFORM)) {
+        snprintf(dest, size, "%s", config_get_mirror_by_transform() ? "true" : "false");
+        return true;
+    } else if (!strcmp(key, CONFIG_PARAM_ATLAS_MEMORY_BUDGET)) {
+        snprintf(dest, size, "%d", config.atlas_memory_budget);
+        return true;
+    } else if (!strcmp(key, CONFIG_PARAM_PRESCALE_SPRITES)) {
+        snprintf(dest, size, "%s", config_get_prescale_sprites() ? "true" : "false");
+        return true;
+    } else if (!strcmp(key, CONFIG_PARAM_PRECISE_INPUT_REGIONS)) {
+        snprintf(dest, size, "%s", config_get_precise_input_regions() ? "true" : "false");
+        return true;
+    } else if (!strcmp(key, CONFIG_PARAM_EXPRESSION_JIT)) {
+        snprintf(dest, size, "%s", config_get_expression_jit() ? "true" : "false");
+        return true;
     } else if (!strcmp(key, CONFIG_PARAM_ALLOW_DISMISS_ANIMATIONS)) {
         snprintf(dest, size, "%s", config.dismiss_animations ? "true" : "false");
         return true;
@@ -905,6 +1018,16 @@ bool config_set_by_key(const char* key, const char* value)
         res = config_set_allow_dragging_multihead(parse_bool(value));
     } else if (!strcmp(key, CONFIG_PARAM_UNIFIED_OUTPUTS)) {
         res = config_set_unified_outputs(parse_bool(value));
+    } else if (!strcmp(key, CONFIG_PARAM_MIRROR_BY_TRANSFORM)) {
+        res = config_set_mirror_by_transform(parse_bool(value));
+    } else if (!strcmp(key, CONFIG_PARAM_ATLAS_MEMORY_BUDGET)) {
+        res = config_set_atlas_memory_budget(atoi(value));
+    } else if (!strcmp(key, CONFIG_PARAM_PRESCALE_SPRITES)) {
+        res = config_set_prescale_sprites(parse_bool(value));
+    } else if (!strcmp(key, CONFIG_PARAM_PRECISE_INPUT_REGIONS)) {
+        res = config_set_precise_input_regions(parse_bool(value));
+    } else if (!strcmp(key, CONFIG_PARAM_EXPRESSION_JIT)) {
+        res = config_set_expression_jit(parse_bool(value));
     } else if (!strcmp(key, CONFIG_PARAM_ALLOW_DISMISS_ANIMATIONS)) {
         res = config_set_allow_dismiss_animations(parse_bool(value));
     } else if (!strcmp(key, CONFIG_PARAM_PER_MASCOT_INTERACTIONS)) {
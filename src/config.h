@@ -55,7 +55,12 @@
 #define CONFIG_PARAM_UNIFIED_OUTPUTS "UNIFIED_OUTPUTS"
 #define CONFIG_PARAM_OPACITY "OPACITY"
 #define CONFIG_PARAM_MASCOT_SCALE "MASCOT_SCALE"
-#define CONFIG_PARAM_COUNT 31
+#define CONFIG_PARAM_MIRROR_BY_TRANSFORM "MIRROR_BY_TRANSFORM"
+#define CONFIG_PARAM_ATLAS_MEMORY_BUDGET "ATLAS_MEMORY_BUDGET"
+#define CONFIG_PARAM_PRESCALE_SPRITES "PRESCALE_SPRITES"
+#define CONFIG_PARAM_PRECISE_INPUT_REGIONS "PRECISE_INPUT_REGIONS"
+#define CONFIG_PARAM_EXPRESSION_JIT "EXPRESSION_JIT"
+#define CONFIG_PARAM_COUNT 36
 
 #define POINTER_PRIMARY_BUTTON 0x01
 #define POINTER_SECONDARY_BUTTON 0x02
@@ -96,6 +101,11 @@ bool config_set_allow_dragging_multihead(int32_t value);
 bool config_set_unified_outputs(int32_t value);
 bool config_set_opacity(float value);
 bool config_set_mascot_scale(float value);
+bool config_set_mirror_by_transform(int32_t value);
+bool config_set_atlas_memory_budget(int32_t value);
+bool config_set_prescale_sprites(int32_t value);
+bool config_set_precise_input_regions(int32_t value);
+bool config_set_expression_jit(int32_t value);
 
 int32_t config_get_breeding();
 int32_t config_get_dragging();
@@ -128,6 +138,11 @@ int32_t config_get_allow_dragging_multihead();
 int32_t config_get_unified_outputs();
 float config_get_mascot_scale();
 float config_get_opacity();
+int32_t config_get_mirror_by_transform();
+int32_t config_get_atlas_memory_budget();
+int32_t config_get_prescale_sprites();
+int32_t config_get_precise_input_regions();
+int32_t config_get_expression_jit();
 
 const char* config_get_prototypes_location();
 const char* config_get_plugins_location();
@@ -168,6 +183,11 @@ __attribute((unused)) static const char* config_keys[] = {
     CONFIG_PARAM_ON_TOOL_BUTTON3,
     CONFIG_PARAM_OPACITY,
     CONFIG_PARAM_MASCOT_SCALE,
+    CONFIG_PARAM_MIRROR_BY_TRANSFORM,
+    CONFIG_PARAM_ATLAS_MEMORY_BUDGET,
+    CONFIG_PARAM_PRESCALE_SPRITES,
+    CONFIG_PARAM_PRECISE_INPUT_REGIONS,
+    CONFIG_PARAM_EXPRESSION_JIT,
     NULL
 };
 
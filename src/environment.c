@@ -31,6 +31,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <linux/input-event-codes.h>
+#include <math.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <sys/mman.h>
@@ -164,6 +165,10 @@ struct environment {
     struct mascot_affordance_manager *affordances;
     mascot_prototype_store *prototype_store;
     pthread_mutex_t mutex;
+    // Reused every tick, protected by mutex
+    struct mascot **ticked;
+    uint32_t ticked_capacity;
+    struct mascot_prefetch_scratch *prefetch;
   } mascot_manager;
 
   struct ie_object *ie;
@@ -231,6 +236,9 @@ struct environment_subsurface {
   int32_t x, y;
   int32_t width, height;
   int32_t offset_x, offset_y;
+  bool flipped; // Current buffer transform is WL_OUTPUT_TRANSFORM_FLIPPED
+  bool cropped; // Viewport source rectangle is set
+  int32_t trim_x, trim_y; // Position of buffer contents within sprite frame
 
   struct {
     float new_x, new_y;
@@ -320,21 +328,41 @@ struct environment_buffer_factory {
   uint64_t size;
   int memfd;
   bool done;
+  void *mapping; // Writable mapping of memfd, if factory was filled in place
 };
 
+// Input region of buffer prepared for one scale and orientation
+struct environment_buffer_region {
+  struct wl_region *region;
+  float scale;
+  bool flipped;
+  bool precise;
+};
+
+// Outputs of two scales, each showing sprite facing both ways
+#define ENVIRONMENT_BUFFER_REGION_SLOTS 4
+
 struct environment_buffer {
   struct wl_buffer *buffer;
-  struct wl_region *region;
   uint32_t size;
   uint32_t width;
   uint32_t height;
   uint32_t stride;
 
-  float scale_factor;
+  bool has_input_region;
   struct {
     uint32_t x, y;
     uint32_t width, height;
   } input_region_desc; // In buffer coordinates
+  struct environment_buffer_region regions[ENVIRONMENT_BUFFER_REGION_SLOTS];
+  uint8_t next_region_slot; // Slot to be replaced once all of them are taken
+
+  // Buffer can be a view of a rectangle in another buffer (sheet), then it
+  // shares sheet's wl_buffer and is cropped out of it by viewport
+  struct environment_buffer *sheet;
+  uint32_t src_x, src_y;
+  uint32_t views;  // Views referencing this buffer
+  bool released;   // Destroyed by owner while views still referenced it
 };
 // Pointer with most recent activity
 environment_pointer_t default_active_pointer = {0};
@@ -344,6 +372,15 @@ environment_pointer_t *active_pointer = &default_active_pointer;
 
 static uint32_t yconv(environment_t *env, uint32_t y);
 
+// Frame pixels in [start, end) cover surface pixels [*offset, *offset +
+// *size). Both edges are rounded within the untrimmed frame, so trimmed
+// sprites land exactly where the same pixels of the full frame would
+static void frame_span_to_surface(float start, float end, float scale,
+                                  int32_t *offset, int32_t *size) {
+  *offset = lroundf(start / scale);
+  *size = lroundf(end / scale) - *offset;
+}
+
 // Helper structs -----------------------------------------------------------
 
 struct envs_queue {
@@ -682,6 +719,7 @@ static void environment_dimensions_changed_callback(uint32_t width,
   env->height = height;
   env->workarea_geometry.width = width;
   env->workarea_geometry.height = height;
+  expression_source_changed(EXPRESSION_SOURCE_ENVIRONMENT);
   pthread_mutex_lock(&env->mascot_manager.mutex);
   for (uint32_t i = 0; i < list_size(env->mascot_manager.referenced_mascots);
        i++) {
@@ -2174,6 +2212,7 @@ static void xdg_output_logical_position(void *data,
   env->ly = y;
   env->global_geometry.x = x;
   env->global_geometry.y = y;
+  expression_source_changed(EXPRESSION_SOURCE_ENVIRONMENT);
 }
 
 static void xdg_output_logical_size(void *data,
@@ -2186,6 +2225,7 @@ static void xdg_output_logical_size(void *data,
   env->lheight = height;
   env->global_geometry.width = width;
   env->global_geometry.height = height;
+  expression_source_changed(EXPRESSION_SOURCE_ENVIRONMENT);
 }
 
 static void xdg_output_name(void *data, struct zxdg_output_v1 *xdg_output,
@@ -2299,6 +2339,7 @@ static void handle_output(void *data, uint32_t id, uint32_t version) {
     env->output.output = output;
     env->output.id = display_id++;
     env->mascot_manager.referenced_mascots = list_init(256);
+    env->mascot_manager.prefetch = mascot_prefetch_scratch_new();
     env->neighbors = list_init(4);
     pthread_mutex_init(&env->mascot_manager.mutex, &attrs);
     wl_output_add_listener(output, &wl_output_listener, (void *)env);
@@ -2513,6 +2554,10 @@ void environment_unlink(environment_t *env) {
     }
   }
   list_free(env->mascot_manager.referenced_mascots);
+  free(env->mascot_manager.ticked);
+  mascot_prefetch_scratch_free(env->mascot_manager.prefetch);
+  env->mascot_manager.ticked = NULL;
+  env->mascot_manager.prefetch = NULL;
   pthread_mutex_unlock(&env->mascot_manager.mutex);
 
   protocol_server_environment_widthdraw(env);
@@ -2653,19 +2698,51 @@ void environment_subsurface_attach(environment_subsurface_t *surface,
     return;
   }
 
+  // Sprite without buffer belongs to evicted atlas that couldn't be
+  // materialized again
   struct mascot_sprite *sprite =
       pose->sprite[surface->mascot->LookingRight->value.i];
-  if (!sprite) {
+  if (!sprite || !sprite->buffer) {
     environment_subsurface_unmap(surface);
     return;
   }
 
-  wl_surface_attach(surface->surface, sprite->buffer->buffer, 0, 0);
+  // Mirrored sprites may share buffer with the direct ones, then compositor
+  // flips it for us. Anchors don't care, as they use sprite dimensions only
+  if (surface->flipped != sprite->mirrored) {
+    wl_surface_set_buffer_transform(surface->surface,
+                                    sprite->mirrored
+                                        ? WL_OUTPUT_TRANSFORM_FLIPPED
+                                        : WL_OUTPUT_TRANSFORM_NORMAL);
+    surface->flipped = sprite->mirrored;
+  }
+
+  // Source rectangle is applied after buffer transform, so crop of flipped
+  // sheet is mirrored too
+  environment_buffer_t *buffer = sprite->buffer;
+  if (buffer->sheet && surface->viewport) {
+    uint32_t src_x = sprite->mirrored
+                         ? buffer->sheet->width - buffer->src_x - buffer->width
+                         : buffer->src_x;
+    wp_viewport_set_source(
+        surface->viewport, wl_fixed_from_int(src_x),
+        wl_fixed_from_int(buffer->src_y), wl_fixed_from_int(buffer->width),
+        wl_fixed_from_int(buffer->height));
+    surface->cropped = true;
+  } else if (surface->cropped) {
+    wp_viewport_set_source(surface->viewport, wl_fixed_from_int(-1),
+                           wl_fixed_from_int(-1), wl_fixed_from_int(-1),
+                           wl_fixed_from_int(-1));
+    surface->cropped = false;
+  }
+
+  wl_surface_attach(surface->surface, buffer->buffer, 0, 0);
   wl_surface_damage_buffer(surface->surface, 0, 0, INT32_MAX, INT32_MAX);
   if (!surface->drag_pointer && config_get_dragging()) {
-    environment_buffer_scale_input_region(
-        sprite->buffer, (config_get_mascot_scale() * surface->env->scale));
-    wl_surface_set_input_region(surface->surface, sprite->buffer->region);
+    wl_surface_set_input_region(
+        surface->surface,
+        environment_sprite_input_region(
+            sprite, config_get_mascot_scale() * surface->env->scale));
   } else {
     wl_surface_set_input_region(surface->surface, empty_region);
   }
@@ -2684,16 +2761,30 @@ void environment_subsurface_attach(environment_subsurface_t *surface,
   }
   surface->pose = pose;
 
+  // Frame size is used for anchoring, surface itself only covers trimmed
+  // buffer, shifted by trim offset on positioning
   surface->width = sprite->width;
   surface->height = sprite->height;
+  surface->trim_x = sprite->trim_x;
+  surface->trim_y = sprite->trim_y;
 
   wl_surface_commit(surface->surface);
 
+  // Pre-scaled buffers already have sprite->scale buffer pixels per frame
+  // pixel, so less scaling is left for the surface
+  float scale = config_get_mascot_scale() * surface->env->scale;
   if (viewporter) {
-    wp_viewport_set_destination(
-        surface->viewport,
-        sprite->width / (config_get_mascot_scale() * surface->env->scale),
-        sprite->height / (config_get_mascot_scale() * surface->env->scale));
+    int32_t dst_x, dst_y, dst_width, dst_height;
+    frame_span_to_surface(sprite->trim_x,
+                          sprite->trim_x + buffer->width / sprite->scale,
+                          scale, &dst_x, &dst_width);
+    frame_span_to_surface(sprite->trim_y,
+                          sprite->trim_y + buffer->height / sprite->scale,
+                          scale, &dst_y, &dst_height);
+    // Zero destination is a protocol error, tiny sprites keep a pixel
+    wp_viewport_set_destination(surface->viewport,
+                                dst_width > 0 ? dst_width : 1,
+                                dst_height > 0 ? dst_height : 1);
     wl_surface_commit(surface->surface);
   } else {
     wl_surface_set_buffer_scale(surface->surface, surface->env->scale);
@@ -2919,10 +3010,14 @@ void environment_subsurface_release(environment_subsurface_t *surface) {
 
   surface->is_grabbed = false;
   enable_input_on_environments(false);
-  wl_surface_set_input_region(
-      surface->surface,
-      surface->pose->sprite[surface->mascot->LookingRight->value.i]
-          ->buffer->region);
+  struct mascot_sprite *sprite =
+      surface->pose->sprite[surface->mascot->LookingRight->value.i];
+  if (sprite && sprite->buffer) {
+    wl_surface_set_input_region(
+        surface->surface,
+        environment_sprite_input_region(
+            sprite, config_get_mascot_scale() * surface->env->scale));
+  }
   wl_subsurface_place_below(surface->subsurface,
                             surface->env->root_environment_subsurface->surface);
 
@@ -3061,6 +3156,8 @@ void environment_subsurface_unmap(environment_subsurface_t *surface) {
   surface->env->pending_commit = true;
   surface->width = 0;
   surface->height = 0;
+  surface->trim_x = 0;
+  surface->trim_y = 0;
   surface->x = 0;
   surface->y = 0;
   surface->pose = NULL;
@@ -3312,10 +3409,13 @@ environment_subsurface_set_position(environment_subsurface_t *surface,
     surface_anchor_y += surface->pose->anchor_y;
   }
 
-  surface_anchor_x = (float)surface_anchor_x /
-                     (config_get_mascot_scale() * surface->env->scale);
-  surface_anchor_y = (float)surface_anchor_y /
-                     (config_get_mascot_scale() * surface->env->scale);
+  // Frame origin is rounded as a whole, trimmed buffer is then offset within
+  // it the same way as in frame_span_to_surface
+  float scale = config_get_mascot_scale() * surface->env->scale;
+  surface_anchor_x =
+      lroundf(surface_anchor_x / scale) + lroundf(surface->trim_x / scale);
+  surface_anchor_y =
+      lroundf(surface_anchor_y / scale) + lroundf(surface->trim_y / scale);
 
   wl_subsurface_set_position(surface->subsurface, dx + surface_anchor_x,
                              dy + surface_anchor_y);
@@ -3458,7 +3558,7 @@ bool environment_migrate_subsurface(environment_subsurface_t *surface,
   // Unlink subsurface from the old environment
   struct mascot *mascot = environment_subsurface_get_mascot(surface);
   if (mascot) {
-    mascot_announce_affordance(mascot, NULL);
+    mascot_announce_affordance(mascot, ATOM_NONE);
     uint32_t mascot_index =
         list_find(surface->env->mascot_manager.referenced_mascots, mascot);
     if (mascot_index != UINT32_MAX) {
@@ -3492,6 +3592,8 @@ bool environment_migrate_subsurface(environment_subsurface_t *surface,
   surface->surface = wl_compositor_create_surface(compositor);
   if (!surface->surface)
     ERROR("Failed to create surface!");
+  surface->flipped = false;
+  surface->cropped = false;
 
   surface->subsurface = wl_subcompositor_get_subsurface(
       subcompositor, surface->surface, env->root_surface->surface);
@@ -3573,6 +3675,8 @@ environment_buffer_factory_t *environment_buffer_factory_new() {
 void environment_buffer_factory_destroy(environment_buffer_factory_t *factory) {
   if (!factory)
     return;
+  if (factory->mapping)
+    munmap(factory->mapping, factory->size);
   if (factory->pool)
     wl_shm_pool_destroy(factory->pool);
   close(factory->memfd);
@@ -3583,6 +3687,10 @@ bool environment_buffer_factory_write(environment_buffer_factory_t *factory,
                                       const void *data, size_t size) {
   if (!factory)
     return false;
+  if (factory->mapping) {
+    WARN("Failed to write data to buffer factory: factory is mapped");
+    return false;
+  }
   if (write(factory->memfd, data, size) != (ssize_t)size) {
     WARN("Failed to write data to buffer factory");
     return false;
@@ -3591,12 +3699,57 @@ bool environment_buffer_factory_write(environment_buffer_factory_t *factory,
   return true;
 }
 
+void *environment_buffer_factory_map(environment_buffer_factory_t *factory,
+                                     size_t size) {
+  if (!factory)
+    return NULL;
+  if (factory->done || factory->mapping || factory->size || !size)
+    return NULL;
+
+  if (ftruncate(factory->memfd, size) != 0) {
+    WARN("Failed to map buffer factory: ftruncate failed: %s", strerror(errno));
+    return NULL;
+  }
+  // Compositor maps the same memory, make sure it can't be resized under it
+  fcntl(factory->memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW);
+
+  void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       factory->memfd, 0);
+  if (mapping == MAP_FAILED) {
+    WARN("Failed to map buffer factory: mmap failed: %s", strerror(errno));
+    return NULL;
+  }
+
+  factory->mapping = mapping;
+  factory->size = size;
+  return mapping;
+}
+
+void *environment_buffer_factory_detach_mapping(
+    environment_buffer_factory_t *factory, size_t *size) {
+  if (!factory || !factory->mapping)
+    return NULL;
+
+  // Compositor still reads the same pages, only this process loses write access
+  void *mapping = factory->mapping;
+  mprotect(mapping, factory->size, PROT_READ);
+  factory->mapping = NULL;
+  *size = factory->size;
+  return mapping;
+}
+
 void environment_buffer_factory_done(environment_buffer_factory_t *factory) {
   if (!factory)
     return;
   if (factory->done)
     return;
 
+  // Contents are final, compositor reads them through its own mapping
+  if (factory->mapping) {
+    munmap(factory->mapping, factory->size);
+    factory->mapping = NULL;
+  }
+
   factory->pool =
       wl_shm_create_pool(shm_manager, factory->memfd, factory->size);
   if (!factory->pool)
@@ -3627,9 +3780,22 @@ environment_buffer_factory_create_buffer(environment_buffer_factory_t *factory,
     return NULL;
   }
 
+  buffer->width = width;
+  buffer->height = height;
+  buffer->stride = stride;
+
   return buffer;
 }
 
+static void environment_buffer_drop_regions(environment_buffer_t *buffer) {
+  for (uint8_t i = 0; i < ENVIRONMENT_BUFFER_REGION_SLOTS; i++) {
+    if (buffer->regions[i].region)
+      wl_region_destroy(buffer->regions[i].region);
+    buffer->regions[i].region = NULL;
+  }
+  buffer->next_region_slot = 0;
+}
+
 void environment_buffer_add_to_input_region(environment_buffer_t *buffer,
                                             int32_t x, int32_t y, int32_t width,
                                             int32_t height) {
@@ -3638,77 +3804,179 @@ void environment_buffer_add_to_input_region(environment_buffer_t *buffer,
   if (!buffer->buffer)
     return;
 
-  if (!buffer->region) {
-    buffer->region = wl_compositor_create_region(compositor);
-    if (!buffer->region) {
-      WARN("Failed to add buffer to input region: Failed to create region");
-      return;
-    }
-    buffer->scale_factor = 1;
-  }
-  wl_region_add(buffer->region, x, y, width, height);
+  environment_buffer_drop_regions(buffer);
+  buffer->has_input_region = true;
   buffer->input_region_desc.x = x;
   buffer->input_region_desc.y = y;
   buffer->input_region_desc.width = width;
   buffer->input_region_desc.height = height;
 }
 
-void environment_buffer_subtract_from_input_region(environment_buffer_t *buffer,
-                                                   int32_t x, int32_t y,
-                                                   int32_t width,
-                                                   int32_t height) {
-  if (!buffer)
-    return;
-  if (!buffer->buffer)
-    return;
-
-  if (!buffer->region) {
-    buffer->region = wl_compositor_create_region(compositor);
-    if (!buffer->region) {
-      WARN("Failed to subtract buffer from input region: Failed to create "
-           "region");
-      return;
+// Adds opaque runs of sprite mask to region. Rows with identical runs are
+// merged into one rectangle, which is the common case for sprite bodies
+static void add_mask_to_region(struct wl_region *region,
+                               const struct mascot_sprite *sprite,
+                               float scale) {
+  uint32_t stride = (sprite->ireg.w + 7) / 8;
+  int32_t origin_x = (int32_t)sprite->ireg.x - sprite->trim_x;
+  int32_t origin_y = (int32_t)sprite->ireg.y - sprite->trim_y;
+
+  for (uint32_t y = 0; y < sprite->ireg.h;) {
+    const uint8_t *row = sprite->mask + y * stride;
+    uint32_t rows = 1;
+    while (y + rows < sprite->ireg.h &&
+           !memcmp(row, row + rows * stride, stride))
+      rows++;
+
+    // Edges are rounded outwards, so scaled down runs never vanish
+    int32_t top = floorf((origin_y + (int32_t)y) / scale);
+    int32_t bottom = ceilf((origin_y + (int32_t)(y + rows)) / scale);
+    for (uint32_t x = 0; x < sprite->ireg.w;) {
+      if (!(row[x / 8] & (1 << (x & 7)))) {
+        x++;
+        continue;
+      }
+      uint32_t end = x + 1;
+      while (end < sprite->ireg.w && (row[end / 8] & (1 << (end & 7))))
+        end++;
+      int32_t left = floorf((origin_x + (int32_t)x) / scale);
+      int32_t right = ceilf((origin_x + (int32_t)end) / scale);
+      wl_region_add(region, left, top, right - left, bottom - top);
+      x = end;
     }
-    buffer->scale_factor = 1;
+    y += rows;
   }
-  wl_region_subtract(buffer->region, x, y, width, height);
 }
 
-void environment_buffer_scale_input_region(environment_buffer_t *buffer,
-                                           float scale) {
+struct wl_region *
+environment_sprite_input_region(const struct mascot_sprite *sprite,
+                                float scale) {
+  if (!sprite)
+    return NULL;
+  environment_buffer_t *buffer = sprite->buffer;
   if (!buffer)
-    return;
-  if (!buffer->buffer)
-    return;
-  if (!buffer->region)
-    return;
+    return NULL;
+  if (!buffer->has_input_region)
+    return NULL;
 
-  if (buffer->scale_factor == scale)
-    return;
+  bool flipped = sprite->mirrored;
+  bool precise = sprite->mask && config_get_precise_input_regions();
+  struct environment_buffer_region *slot = NULL;
+  for (uint8_t i = 0; i < ENVIRONMENT_BUFFER_REGION_SLOTS; i++) {
+    struct environment_buffer_region *cached = &buffer->regions[i];
+    if (!cached->region) {
+      if (!slot)
+        slot = cached;
+      continue;
+    }
+    if (cached->scale == scale && cached->flipped == flipped &&
+        cached->precise == precise)
+      return cached->region;
+  }
+  if (!slot) {
+    slot = &buffer->regions[buffer->next_region_slot];
+    buffer->next_region_slot =
+        (buffer->next_region_slot + 1) % ENVIRONMENT_BUFFER_REGION_SLOTS;
+  }
 
-  wl_region_destroy(buffer->region);
-  buffer->region = wl_compositor_create_region(compositor);
-  if (!buffer->region) {
-    WARN("Failed to scale input region: Failed to create region");
-    return;
+  struct wl_region *region = wl_compositor_create_region(compositor);
+  if (!region) {
+    WARN("Failed to create input region for buffer");
+    return NULL;
   }
 
-  wl_region_add(buffer->region, buffer->input_region_desc.x / scale,
-                buffer->input_region_desc.y / scale,
-                buffer->input_region_desc.width / scale,
-                buffer->input_region_desc.height / scale);
+  // Sprites sharing buffer have identical masks, so region built from any of
+  // them is valid for all. Mask of right sprite is already mirrored
+  if (precise) {
+    add_mask_to_region(region, sprite, scale);
+  } else {
+    // Flipped region is the same rectangle mirrored horizontally within
+    // buffer
+    float buffer_scale = scale * sprite->scale;
+    uint32_t x = flipped ? buffer->width - buffer->input_region_desc.x -
+                               buffer->input_region_desc.width
+                         : buffer->input_region_desc.x;
+    wl_region_add(region, x / buffer_scale,
+                  buffer->input_region_desc.y / buffer_scale,
+                  buffer->input_region_desc.width / buffer_scale,
+                  buffer->input_region_desc.height / buffer_scale);
+  }
+
+  // Surfaces keep their own copy of region state, so replaced region may go
+  if (slot->region)
+    wl_region_destroy(slot->region);
+  *slot = (struct environment_buffer_region){.region = region,
+                                             .scale = scale,
+                                             .flipped = flipped,
+                                             .precise = precise};
+  return region;
+}
+
+bool environment_supports_buffer_transform() {
+  return compositor && wl_compositor_get_version(compositor) >=
+                           WL_SURFACE_SET_BUFFER_TRANSFORM_SINCE_VERSION;
+}
+
+bool environment_supports_viewport_crop() { return viewporter != NULL; }
+
+environment_buffer_t *environment_buffer_new_view(environment_buffer_t *sheet,
+                                                  uint32_t x, uint32_t y,
+                                                  uint32_t width,
+                                                  uint32_t height) {
+  if (!sheet)
+    return NULL;
+  if (!sheet->buffer)
+    return NULL;
+  if (!viewporter)
+    return NULL;
+  if (sheet->sheet || sheet->released)
+    return NULL;
+  if (x + width > sheet->width || y + height > sheet->height)
+    return NULL;
+
+  environment_buffer_t *buffer =
+      (environment_buffer_t *)calloc(1, sizeof(environment_buffer_t));
+  if (!buffer)
+    ERROR("Failed to create buffer view: Out of memory");
+
+  buffer->buffer = sheet->buffer;
+  buffer->sheet = sheet;
+  buffer->src_x = x;
+  buffer->src_y = y;
+  buffer->width = width;
+  buffer->height = height;
+  buffer->stride = sheet->stride;
+  sheet->views++;
+
+  return buffer;
+}
 
-  buffer->scale_factor = scale;
+static void environment_buffer_free(environment_buffer_t *buffer) {
+  environment_buffer_drop_regions(buffer);
+  if (buffer->buffer && !buffer->sheet)
+    wl_buffer_destroy(buffer->buffer);
+  free(buffer);
 }
 
 void environment_buffer_destroy(environment_buffer_t *buffer) {
   if (!buffer)
     return;
-  if (buffer->region)
-    wl_region_destroy(buffer->region);
-  if (buffer->buffer)
-    wl_buffer_destroy(buffer->buffer);
-  free(buffer);
+
+  // Sheet's wl_buffer lives until both its owner and every view are gone
+  if (buffer->sheet) {
+    environment_buffer_t *sheet = buffer->sheet;
+    environment_buffer_free(buffer);
+    if (!--sheet->views && sheet->released)
+      environment_buffer_free(sheet);
+    return;
+  }
+
+  if (buffer->views) {
+    buffer->released = true;
+    return;
+  }
+
+  environment_buffer_free(buffer);
 }
 
 uint64_t environment_interpolate(environment_t *env) {
@@ -3814,6 +4082,29 @@ uint32_t environment_tick(environment_t *environment, uint32_t tick) {
   pthread_mutex_lock(&environment->mascot_manager.mutex);
   struct list *mascots = environment->mascot_manager.referenced_mascots;
   struct mascot_tick_return result = {};
+
+  // Mascots sharing prototype mostly evaluate the same conditions
+  uint32_t count = list_count(mascots);
+  if (count > environment->mascot_manager.ticked_capacity) {
+    struct mascot **ticked = realloc(environment->mascot_manager.ticked,
+                                     count * sizeof(struct mascot *));
+    if (ticked) {
+      environment->mascot_manager.ticked = ticked;
+      environment->mascot_manager.ticked_capacity = count;
+    }
+  }
+  if (count <= environment->mascot_manager.ticked_capacity) {
+    struct mascot **ticked = environment->mascot_manager.ticked;
+    uint32_t ticked_count = 0;
+    for (size_t i = 0; i < list_size(mascots) && ticked_count < count; i++) {
+      struct mascot *mascot = list_get(mascots, i);
+      if (mascot)
+        ticked[ticked_count++] = mascot;
+    }
+    mascot_prefetch_conditions(environment->mascot_manager.prefetch, ticked,
+                               ticked_count);
+  }
+
   for (size_t i = 0, c = 0; i < list_size(mascots) && c < list_count(mascots);
        i++) {
     struct mascot *mascot = list_get(mascots, i);
@@ -3822,12 +4113,12 @@ uint32_t environment_tick(environment_t *environment, uint32_t tick) {
     ++c;
     enum mascot_tick_result tick_status = mascot_tick(mascot, tick, &result);
     if (tick_status == mascot_tick_dispose) {
-      mascot_announce_affordance(mascot, NULL);
+      mascot_announce_affordance(mascot, ATOM_NONE);
       mascot_attach_affordance_manager(mascot, NULL);
       mascot_unlink(mascot);
       list_remove(mascots, i);
     } else if (tick_status == mascot_tick_error) {
-      mascot_announce_affordance(mascot, NULL);
+      mascot_announce_affordance(mascot, ATOM_NONE);
       mascot_attach_affordance_manager(mascot, NULL);
       mascot_unlink(mascot);
       list_remove(mascots, i);
@@ -3977,37 +4268,25 @@ struct mascot *environment_mascot_by_coordinates(environment_t *environment,
     c++;
     if (mascot_->dragged)
       continue;
-    if (mascot_->subsurface) {
-      struct bounding_box hitbox = {INNER_COLLISION, -1, -1, -1, -1};
-      if (mascot_->subsurface->pose) {
-        int surface_anchor_x = 0;
-        int surface_anchor_y = 0;
-        if (mascot_->subsurface->pose) {
-          surface_anchor_x +=
-              (mascot_->subsurface->mascot->LookingRight->value.i
-                   ? -mascot_->subsurface->width -
-                         mascot_->subsurface->pose->anchor_x
-                   : mascot_->subsurface->pose->anchor_x);
-          surface_anchor_y += mascot_->subsurface->pose->anchor_y;
-        }
-
-        surface_anchor_x =
-            (float)surface_anchor_x /
-            (config_get_mascot_scale() * mascot_->subsurface->env->scale);
-        surface_anchor_y =
-            (float)surface_anchor_y /
-            (config_get_mascot_scale() * mascot_->subsurface->env->scale);
-
-        struct mascot_sprite *sprite =
-            mascot_->subsurface->pose->sprite[mascot_->LookingRight->value.i];
-        hitbox.x = mascot_->subsurface->x + mascot_->subsurface->pose->anchor_x;
-        hitbox.y = mascot_->subsurface->y + mascot_->subsurface->pose->anchor_y;
-        hitbox.width = sprite->width;
-        hitbox.height = sprite->height;
-      }
-      INFO("Checking hitbox: %d %d %d %d, pointer at (%d, %d)", hitbox.x,
-           hitbox.y, hitbox.width, hitbox.height, x, y);
-      if (is_inside(&hitbox, x, y) || check_collision_at(&hitbox, x, y, 0)) {
+    if (mascot_->subsurface && mascot_->subsurface->pose) {
+      environment_subsurface_t *surface = mascot_->subsurface;
+      struct mascot_sprite *sprite =
+          surface->pose->sprite[mascot_->LookingRight->value.i];
+      if (!sprite)
+        continue;
+
+      // Pointer in frame pixels of shown sprite, frame origin is placed the
+      // same way environment_subsurface_set_position does it
+      float scale = config_get_mascot_scale() * surface->env->scale;
+      int32_t origin_x = surface->offset_x +
+                         (mascot_->LookingRight->value.i
+                              ? -surface->width - surface->pose->anchor_x
+                              : surface->pose->anchor_x);
+      int32_t origin_y = surface->offset_y + surface->pose->anchor_y;
+      int32_t frame_x = floorf((x - surface->x) * scale) - origin_x;
+      int32_t frame_y = floorf((y - surface->y) * scale) - origin_y;
+
+      if (mascot_sprite_hit(sprite, frame_x, frame_y)) {
         INFO("Mascot found by coordinates: %p %d", mascot_, mascot_score);
         if (!mascot_->dragged_tick || mascot_->dragged_tick > mascot_score) {
           mascot = mascot_;
@@ -4207,6 +4486,7 @@ void environment_recalculate_advertised_geometry(environment_t *env) {
 
   // Mask the borders that are touched by neighbors
   env->border_mask = new_border_mask;
+  expression_source_changed(EXPRESSION_SOURCE_ENVIRONMENT);
   INFO("------------[Environment %d recalculate advertised "
        "geometry]---------------",
        env->id);
@@ -4463,9 +4743,16 @@ void environment_recalculate_ie_attachement(environment_t *env, bool is_active,
 }
 
 void environment_set_active_ie(bool is_active, struct bounding_box geometry) {
+  bool changed = is_active != active_ie.is_active ||
+                 geometry.x != active_ie.geometry.x ||
+                 geometry.y != active_ie.geometry.y ||
+                 geometry.width != active_ie.geometry.width ||
+                 geometry.height != active_ie.geometry.height;
   active_ie.is_active = is_active;
   active_ie.geometry = geometry;
   active_ie.geometry.type = OUTER_COLLISION;
+  if (changed)
+    expression_source_changed(EXPRESSION_SOURCE_ENVIRONMENT);
 }
 
 struct bounding_box environment_get_active_ie(environment_t *environment) {
@@ -165,12 +165,27 @@ const char* environment_get_backend_name();
 environment_buffer_factory_t* environment_buffer_factory_new();
 void environment_buffer_factory_destroy(environment_buffer_factory_t* factory);
 bool environment_buffer_factory_write(environment_buffer_factory_t* factory, const void* data, size_t size);
+// Sizes factory to size bytes and returns writable mapping of it, valid until environment_buffer_factory_done.
+// Alternative to environment_buffer_factory_write, can be used only on empty factory
+void* environment_buffer_factory_map(environment_buffer_factory_t* factory, size_t size);
+// Hands writable mapping over to the caller before environment_buffer_factory_done, remapped read-only.
+// Caller unmaps it with munmap(mapping, *size). Returns NULL if factory was not mapped
+void* environment_buffer_factory_detach_mapping(environment_buffer_factory_t* factory, size_t* size);
 void environment_buffer_factory_done(environment_buffer_factory_t* factory);
 environment_buffer_t* environment_buffer_factory_create_buffer(environment_buffer_factory_t* factory, int32_t width, int32_t height, uint32_t stride, uint32_t offset);
 
 void environment_buffer_add_to_input_region(environment_buffer_t* buffer, int32_t x, int32_t y, int32_t width, int32_t height);
-void environment_buffer_subtract_from_input_region(environment_buffer_t* buffer, int32_t x, int32_t y, int32_t width, int32_t height);
-void environment_buffer_scale_input_region(environment_buffer_t* buffer, float scale_factor);
+struct mascot_sprite;
+// Input region of surface showing sprite at scale (frame pixels per surface unit). Follows sprite mask if
+// PRECISE_INPUT_REGIONS is set, bounding box of opaque pixels otherwise.
+// Regions are created on first request and kept by sprite's buffer, NULL if buffer has no input region
+struct wl_region* environment_sprite_input_region(const struct mascot_sprite* sprite, float scale);
+// Whether compositor allows mirroring buffers by wl_surface.set_buffer_transform
+bool environment_supports_buffer_transform();
+// Whether buffers can be cropped out of larger ones by wp_viewport source rectangle
+bool environment_supports_viewport_crop();
+// Creates buffer showing rectangle of sheet. Sheet may be destroyed before its views, it is freed with the last of them
+environment_buffer_t* environment_buffer_new_view(environment_buffer_t* sheet, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
 void environment_buffer_destroy(environment_buffer_t* buffer);
 
 void environment_set_user_data(environment_t* env, void* data);
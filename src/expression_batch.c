@@ -0,0 +1,357 @@
+/*
+    expression_batch.c - wl_shimeji's lane-parallel expression evaluator
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+
+#include "expression_batch.h"
+#include "expression_opcodes.h"
+#include "mascot.h"
+
+#if EXPRESSION_BATCH_LANES > 32
+#error "Lane masks are 32 bit wide"
+#endif
+
+// Stack slot holds value of every lane, compiler maps operations on it to SSE/AVX/NEON
+typedef float batch_lanes __attribute__((vector_size(sizeof(float) * EXPRESSION_BATCH_LANES)));
+typedef int32_t batch_ilanes __attribute__((vector_size(sizeof(int32_t) * EXPRESSION_BATCH_LANES)));
+
+typedef bool (*batch_function)(struct expression_vm_state*);
+
+// Part of lanes that took the same path through program
+struct batch_path {
+    uint16_t pc;
+    uint8_t sp;
+    uint32_t mask;
+};
+
+struct batch_context {
+    const struct expression_prototype* prototype;
+    struct mascot* const* mascots;
+    batch_lanes stack[256];
+    struct batch_path paths[EXPRESSION_BATCH_LANES]; // Paths waiting to be executed, lanes of paths never overlap
+    uint8_t paths_count;
+    uint32_t done;
+    float* results;
+};
+
+static inline batch_ilanes batch_mask_lanes(uint32_t mask)
+{
+    batch_ilanes lanes;
+    for (uint8_t l = 0; l < EXPRESSION_BATCH_LANES; l++) lanes[l] = (mask >> l) & 1 ? -1 : 0;
+    return lanes;
+}
+
+static inline uint32_t batch_lanes_mask(batch_ilanes lanes)
+{
+    uint32_t mask = 0;
+    for (uint8_t l = 0; l < EXPRESSION_BATCH_LANES; l++) if (lanes[l]) mask |= 1u << l;
+    return mask;
+}
+
+// Value in every lane. Subtracting zero keeps -0.0f, adding it would turn it into +0.0f
+static inline batch_lanes batch_splat(float value)
+{
+    return value - (batch_lanes){0};
+}
+
+// Lanes outside of mask belong to other paths and keep their values
+static inline batch_lanes batch_blend(batch_lanes old, batch_lanes new, batch_ilanes mask)
+{
+    return (batch_lanes)(((batch_ilanes)new & mask) | ((batch_ilanes)old & ~mask));
+}
+
+// Same conversions VM does with (int) casts and boolean results
+static inline batch_ilanes batch_int(batch_lanes value)
+{
+    return __builtin_convertvector(value, batch_ilanes);
+}
+
+static inline batch_lanes batch_float(batch_ilanes value)
+{
+    return __builtin_convertvector(value, batch_lanes);
+}
+
+static inline batch_lanes batch_bool(batch_ilanes condition)
+{
+    return batch_float(-condition);
+}
+
+// Lanes with variable of unknown kind drop out of mask
+static batch_lanes batch_load_var(struct batch_context* ctx, uint8_t var, uint32_t* mask)
+{
+    batch_lanes value = {0};
+    for (uint8_t l = 0; l < EXPRESSION_BATCH_LANES; l++) {
+        if (!((*mask >> l) & 1)) continue;
+        const struct mascot_local_variable* variable = &ctx->mascots[l]->local_variables[var];
+        if (variable->kind == mascot_local_variable_int) value[l] = (float)variable->value.i;
+        else if (variable->kind == mascot_local_variable_float) value[l] = variable->value.f;
+        else *mask &= ~(1u << l);
+    }
+    return value;
+}
+
+// Getters and functions work on single mascot, so they are called lane by lane on stack of their own
+static void batch_call(struct batch_context* ctx, batch_function function, const struct expression_stack_effect* effect, uint8_t sp, uint32_t* mask)
+{
+    uint8_t base = sp - effect->pops;
+    for (uint8_t l = 0; l < EXPRESSION_BATCH_LANES; l++) {
+        if (!((*mask >> l) & 1)) continue;
+        struct expression_vm_state state;
+        state.sp = 1;
+        state.ip = 0;
+        state.ref_mascot = ctx->mascots[l];
+        state.error_message = NULL;
+        for (uint8_t i = 0; i < effect->pops; i++) state.stack[state.sp++] = ctx->stack[base + i][l];
+        if (!function(&state)) {
+            *mask &= ~(1u << l);
+            continue;
+        }
+        for (uint8_t i = 0; i < effect->pushes; i++) ctx->stack[base + i][l] = state.stack[1 + i];
+    }
+}
+
+// Splits off lanes that take the branch. Returns true if whole path takes it
+static bool batch_branch(struct batch_context* ctx, struct batch_path* path, uint32_t taken, uint16_t target)
+{
+    taken &= path->mask;
+    if (taken == path->mask) return true;
+    if (taken) {
+        ctx->paths[ctx->paths_count++] = (struct batch_path){target, path->sp, taken};
+        path->mask &= ~taken;
+    }
+    return false;
+}
+
+#define BATCH_WRITE(slot, value) ctx->stack[(slot)] = batch_blend(ctx->stack[(slot)], (value), mask)
+
+#define BATCH_BINARY(expr) \
+{ \
+    batch_lanes a = ctx->stack[path.sp - 2]; \
+    batch_lanes b = ctx->stack[path.sp - 1]; \
+    BATCH_WRITE(path.sp - 2, (expr)); \
+    path.sp--; \
+    break; \
+}
+
+// Operations without vector form, or with undefined cases where lanes must behave exactly as VM does
+#define BATCH_BINARY_SCALAR(expr) \
+{ \
+    batch_lanes r = ctx->stack[path.sp - 2]; \
+    for (uint8_t l = 0; l < EXPRESSION_BATCH_LANES; l++) { \
+        if (!((path.mask >> l) & 1)) continue; \
+        float a = ctx->stack[path.sp - 2][l]; \
+        float b = ctx->stack[path.sp - 1][l]; \
+        r[l] = (expr); \
+    } \
+    ctx->stack[path.sp - 2] = r; \
+    path.sp--; \
+    break; \
+}
+
+#define BATCH_BINARY_K(expr) \
+{ \
+    batch_lanes a = ctx->stack[path.sp - 1]; \
+    batch_lanes b = batch_splat(insn->value); \
+    BATCH_WRITE(path.sp - 1, (expr)); \
+    break; \
+}
+
+#define BATCH_BINARY_VAR(expr) \
+{ \
+    batch_lanes a = ctx->stack[path.sp - 1]; \
+    batch_lanes b = batch_load_var(ctx, insn->operand, &path.mask); \
+    mask = batch_mask_lanes(path.mask); \
+    BATCH_WRITE(path.sp - 1, (expr)); \
+    break; \
+}
+
+#define BATCH_VAR_BINARY_K(expr) \
+{ \
+    batch_lanes a = batch_load_var(ctx, insn->operand, &path.mask); \
+    batch_lanes b = batch_splat(insn->value); \
+    mask = batch_mask_lanes(path.mask); \
+    BATCH_WRITE(path.sp, (expr)); \
+    path.sp++; \
+    break; \
+}
+
+// Executes path until its lanes return or fail
+static void batch_run(struct batch_context* ctx, struct batch_path path)
+{
+    const struct expression_prototype* prototype = ctx->prototype;
+    batch_ilanes mask = batch_mask_lanes(path.mask);
+
+    while (path.mask) {
+        const struct expression_instruction* insn = &prototype->code[path.pc++];
+        switch (insn->opcode) {
+            case OP_RET:
+                for (uint8_t l = 0; l < EXPRESSION_BATCH_LANES; l++) {
+                    if ((path.mask >> l) & 1) ctx->results[l] = ctx->stack[path.sp - 1][l];
+                }
+                ctx->done |= path.mask;
+                return;
+            case OP_ERR:
+            case OP_X_END:
+            case OP_X_BADJUMP:
+                return;
+
+            case OP_LOADL:
+            {
+                batch_lanes value = batch_load_var(ctx, insn->operand, &path.mask);
+                mask = batch_mask_lanes(path.mask);
+                BATCH_WRITE(path.sp, value);
+                path.sp++;
+                break;
+            }
+            case OP_LOADE:
+            case OP_CALL:
+            {
+                bool global = insn->opcode == OP_LOADE;
+                const struct expression_stack_effect* effect = global ? &prototype->global_getters_effects[insn->operand] : &prototype->function_ptrs_effects[insn->operand];
+                batch_call(ctx, global ? prototype->global_getters[insn->operand] : prototype->function_ptrs[insn->operand], effect, path.sp, &path.mask);
+                mask = batch_mask_lanes(path.mask);
+                path.sp = path.sp - effect->pops + effect->pushes;
+                break;
+            }
+
+            case OP_ADD: BATCH_BINARY(a + b)
+            case OP_SUB: BATCH_BINARY(a - b)
+            case OP_MUL: BATCH_BINARY(a * b)
+            case OP_DIV: BATCH_BINARY(a / b)
+            case OP_MOD: BATCH_BINARY_SCALAR(fmodf(a, b))
+            case OP_POW: BATCH_BINARY_SCALAR(powf(a, b))
+
+            case OP_AND: BATCH_BINARY(batch_float(batch_int(a) & batch_int(b)))
+            case OP_OR: BATCH_BINARY(batch_float(batch_int(a) | batch_int(b)))
+            case OP_XOR: BATCH_BINARY(batch_float(batch_int(a) ^ batch_int(b)))
+            case OP_SHL: BATCH_BINARY_SCALAR(((int)a) << ((int)b))
+            case OP_SHR: BATCH_BINARY_SCALAR(((int)a) >> ((int)b))
+            case OP_NOT:
+            case OP_LNOT:
+                BATCH_WRITE(path.sp - 1, batch_bool(batch_int(ctx->stack[path.sp - 1]) == 0));
+                break;
+
+            case OP_LT: BATCH_BINARY(batch_bool(a < b))
+            case OP_LE: BATCH_BINARY(batch_bool(a <= b))
+            case OP_GT: BATCH_BINARY(batch_bool(a > b))
+            case OP_GE: BATCH_BINARY(batch_bool(a >= b))
+            case OP_EQ: BATCH_BINARY(batch_bool(a == b))
+            case OP_NE: BATCH_BINARY(batch_bool(a != b))
+
+            case OP_LAND: BATCH_BINARY(batch_bool((batch_int(a) != 0) & (batch_int(b) != 0)))
+            case OP_LOR: BATCH_BINARY(batch_bool((batch_int(a) != 0) | (batch_int(b) != 0)))
+
+            // Branches do not pop the condition
+            case OP_BQZ:
+            case OP_BNZ:
+            {
+                uint32_t truthy = batch_lanes_mask(batch_int(ctx->stack[path.sp - 1]) != 0);
+                if (batch_branch(ctx, &path, insn->opcode == OP_BNZ ? truthy : ~truthy, insn->target)) path.pc = insn->target;
+                mask = batch_mask_lanes(path.mask);
+                break;
+            }
+            case OP_JMP:
+                path.pc = insn->target;
+                break;
+
+            // Skipping lanes get what OP_LAND / OP_LOR would have produced
+            case OP_X_LAND_SC:
+            case OP_X_LOR_SC:
+            {
+                bool land = insn->opcode == OP_X_LAND_SC;
+                uint32_t truthy = batch_lanes_mask(batch_int(ctx->stack[path.sp - 1]) != 0);
+                uint32_t skipping = (land ? ~truthy : truthy) & path.mask;
+                ctx->stack[path.sp - 1] = batch_blend(ctx->stack[path.sp - 1], batch_splat(land ? 0.0f : 1.0f), batch_mask_lanes(skipping));
+                if (batch_branch(ctx, &path, skipping, insn->target)) path.pc = insn->target;
+                mask = batch_mask_lanes(path.mask);
+                break;
+            }
+
+            case OP_STORE0:
+            case OP_STORE1:
+            case OP_STORE2:
+            case OP_STORE3:
+            {
+                union { batch_lanes lanes; uint8_t bytes[sizeof(batch_lanes)]; } slot = { ctx->stack[path.sp] };
+                for (uint8_t l = 0; l < EXPRESSION_BATCH_LANES; l++) {
+                    if ((path.mask >> l) & 1) slot.bytes[l * sizeof(float) + insn->opcode - OP_STORE0] = insn->operand;
+                }
+                ctx->stack[path.sp] = slot.lanes;
+                break;
+            }
+            case OP_PUSH:
+                path.sp++;
+                break;
+            case OP_X_PUSHF:
+                BATCH_WRITE(path.sp, batch_splat(insn->value));
+                path.sp++;
+                break;
+
+            case OP_X_ADDK: BATCH_BINARY_K(a + b)
+            case OP_X_SUBK: BATCH_BINARY_K(a - b)
+            case OP_X_MULK: BATCH_BINARY_K(a * b)
+            case OP_X_DIVK: BATCH_BINARY_K(a / b)
+            case OP_X_LTK: BATCH_BINARY_K(batch_bool(a < b))
+            case OP_X_LEK: BATCH_BINARY_K(batch_bool(a <= b))
+            case OP_X_GTK: BATCH_BINARY_K(batch_bool(a > b))
+            case OP_X_GEK: BATCH_BINARY_K(batch_bool(a >= b))
+            case OP_X_EQK: BATCH_BINARY_K(batch_bool(a == b))
+            case OP_X_NEK: BATCH_BINARY_K(batch_bool(a != b))
+
+            case OP_X_LT_VAR: BATCH_BINARY_VAR(batch_bool(a < b))
+            case OP_X_LE_VAR: BATCH_BINARY_VAR(batch_bool(a <= b))
+            case OP_X_GT_VAR: BATCH_BINARY_VAR(batch_bool(a > b))
+            case OP_X_GE_VAR: BATCH_BINARY_VAR(batch_bool(a >= b))
+            case OP_X_EQ_VAR: BATCH_BINARY_VAR(batch_bool(a == b))
+            case OP_X_NE_VAR: BATCH_BINARY_VAR(batch_bool(a != b))
+
+            case OP_X_VAR_LTK: BATCH_VAR_BINARY_K(batch_bool(a < b))
+            case OP_X_VAR_LEK: BATCH_VAR_BINARY_K(batch_bool(a <= b))
+            case OP_X_VAR_GTK: BATCH_VAR_BINARY_K(batch_bool(a > b))
+            case OP_X_VAR_GEK: BATCH_VAR_BINARY_K(batch_bool(a >= b))
+            case OP_X_VAR_EQK: BATCH_VAR_BINARY_K(batch_bool(a == b))
+            case OP_X_VAR_NEK: BATCH_VAR_BINARY_K(batch_bool(a != b))
+
+            default:
+                break;
+        }
+    }
+}
+
+uint32_t expression_batch_execute(const struct expression_prototype* prototype, struct mascot* const* mascots, uint8_t count, float* results)
+{
+    if (!prototype || !prototype->code || !mascots || !results) return 0;
+    if (!count || count > EXPRESSION_BATCH_LANES) return 0;
+
+    struct batch_context context;
+    struct batch_context* ctx = &context;
+    ctx->prototype = prototype;
+    ctx->mascots = mascots;
+    ctx->results = results;
+    ctx->done = 0;
+    ctx->paths_count = 0;
+    memset(ctx->stack, 0, (prototype->max_stack + 1) * sizeof(batch_lanes));
+
+    uint32_t all = count == 32 ? UINT32_MAX : (1u << count) - 1;
+    batch_run(ctx, (struct batch_path){0, 1, all});
+    while (ctx->paths_count) {
+        batch_run(ctx, ctx->paths[--ctx->paths_count]);
+    }
+    return ctx->done;
+}
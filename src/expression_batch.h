@@ -0,0 +1,44 @@
+/*
+    expression_batch.h - wl_shimeji's lane-parallel expression evaluator
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef EXPRESSION_BATCH_H
+#define EXPRESSION_BATCH_H
+
+#include "master_header.h"
+#include "expressions.h"
+
+// Mascots evaluated by one pass over program, as many as one vector register of target holds floats.
+// May be overridden at build time
+#ifndef EXPRESSION_BATCH_LANES
+#if defined(__AVX512F__)
+#define EXPRESSION_BATCH_LANES 16
+#elif defined(__AVX__)
+#define EXPRESSION_BATCH_LANES 8
+#else
+#define EXPRESSION_BATCH_LANES 4
+#endif
+#endif
+
+// Runs verified program for count (up to EXPRESSION_BATCH_LANES) mascots at once, lane i executing for mascots[i].
+// Lanes taking different branches are split and continue under their own masks.
+// Returns mask of lanes that reached OP_RET, their results are written to results[i].
+// Failed lanes are left for VM, which reports the error
+uint32_t expression_batch_execute(const struct expression_prototype* prototype, struct mascot* const* mascots, uint8_t count, float* results);
+
+#endif
@@ -0,0 +1,634 @@
+/*
+    expression_jit.c - wl_shimeji's native code compiler for expressions
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "expression_jit.h"
+#include "expression_opcodes.h"
+#include "mascot.h"
+
+// Only x86-64 backend exists, everything else keeps using VM
+#if defined(__x86_64__) && defined(__linux__)
+#define EXPRESSION_JIT_SUPPORTED
+#endif
+
+#ifdef EXPRESSION_JIT_SUPPORTED
+
+// Native code is written through one mapping of memfd and executed through another,
+// so no page is ever writable and executable at once. Functions of many expressions share chunk
+#define EXPRESSION_JIT_CHUNK_SIZE (64 * 1024)
+
+struct expression_jit_chunk {
+    uint8_t* writable;
+    uint8_t* executable;
+    size_t size;
+    size_t used;
+    uint32_t refs; // Functions living in chunk
+};
+
+static pthread_mutex_t jit_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct expression_jit_chunk* jit_current_chunk = NULL; // Chunk new functions are placed to
+static bool jit_unavailable = false; // Executable memory couldn't be mapped, don't try again
+
+static void expression_jit_chunk_release(struct expression_jit_chunk* chunk)
+{
+    munmap(chunk->writable, chunk->size);
+    munmap(chunk->executable, chunk->size);
+    free(chunk);
+}
+
+static struct expression_jit_chunk* expression_jit_chunk_new(size_t size)
+{
+    struct expression_jit_chunk* chunk = calloc(1, sizeof(struct expression_jit_chunk));
+    if (!chunk) return NULL;
+
+    int fd = memfd_create("expression_jit", MFD_CLOEXEC);
+    if (fd < 0) {
+        WARN("Expression JIT is unavailable: memfd_create failed: %s", strerror(errno));
+        free(chunk);
+        return NULL;
+    }
+    if (ftruncate(fd, size) < 0) {
+        WARN("Expression JIT is unavailable: ftruncate failed: %s", strerror(errno));
+        close(fd);
+        free(chunk);
+        return NULL;
+    }
+    chunk->writable = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    chunk->executable = mmap(NULL, size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+    close(fd); // Mappings keep memory alive
+    if (chunk->writable == MAP_FAILED || chunk->executable == MAP_FAILED) {
+        WARN("Expression JIT is unavailable: couldn't map executable memory: %s", strerror(errno));
+        if (chunk->writable != MAP_FAILED) munmap(chunk->writable, size);
+        if (chunk->executable != MAP_FAILED) munmap(chunk->executable, size);
+        free(chunk);
+        return NULL;
+    }
+    chunk->size = size;
+    return chunk;
+}
+
+// Copies position independent code to executable memory
+static bool expression_jit_install(struct expression_jit_code* jit, const uint8_t* code, size_t size)
+{
+    pthread_mutex_lock(&jit_lock);
+    if (jit_unavailable) {
+        pthread_mutex_unlock(&jit_lock);
+        return false;
+    }
+
+    size_t aligned = (size + 15) & ~(size_t)15;
+    if (!jit_current_chunk || jit_current_chunk->used + aligned > jit_current_chunk->size) {
+        size_t chunk_size = EXPRESSION_JIT_CHUNK_SIZE;
+        if (aligned > chunk_size) chunk_size = (aligned + 4095) & ~(size_t)4095;
+        struct expression_jit_chunk* chunk = expression_jit_chunk_new(chunk_size);
+        if (!chunk) {
+            jit_unavailable = true;
+            pthread_mutex_unlock(&jit_lock);
+            return false;
+        }
+        if (jit_current_chunk && !jit_current_chunk->refs) expression_jit_chunk_release(jit_current_chunk);
+        jit_current_chunk = chunk;
+    }
+
+    struct expression_jit_chunk* chunk = jit_current_chunk;
+    memcpy(chunk->writable + chunk->used, code, size);
+    jit->function = (expression_jit_function)(chunk->executable + chunk->used);
+    jit->chunk = chunk;
+    chunk->used += aligned;
+    chunk->refs++;
+    pthread_mutex_unlock(&jit_lock);
+    return true;
+}
+
+// ------------------------------------------------------------------------------------------------
+// x86-64 code generation.
+// Register usage: rbx - VM state, r12 - mascot, r13 - result pointer. Stack depth at every
+// instruction is known at compile time, so stack slots are addressed directly and sp is only
+// written to state before calling getters and functions, which operate on it
+
+#define JIT_STATE_SLOT(n) ((int32_t)(offsetof(struct expression_vm_state, stack) + (n) * sizeof(float)))
+#define JIT_STATE_SP ((int32_t)offsetof(struct expression_vm_state, sp))
+#define JIT_STATE_IP ((int32_t)offsetof(struct expression_vm_state, ip))
+#define JIT_STATE_ERROR ((int32_t)offsetof(struct expression_vm_state, error_message))
+#define JIT_STATE_MASCOT ((int32_t)offsetof(struct expression_vm_state, ref_mascot))
+
+#define JIT_VAR_KIND(n) ((int32_t)(offsetof(struct mascot, local_variables) + (n) * sizeof(struct mascot_local_variable) + offsetof(struct mascot_local_variable, kind)))
+#define JIT_VAR_VALUE(n) ((int32_t)(offsetof(struct mascot, local_variables) + (n) * sizeof(struct mascot_local_variable) + offsetof(struct mascot_local_variable, value)))
+
+#define JIT_ONE_BITS 0x3F800000 // 1.0f
+
+enum jit_fixup_kind {
+    jit_fixup_instruction, // rel32 to start of instruction
+    jit_fixup_fail // rel32 to failure stub
+};
+
+struct jit_fixup {
+    uint32_t at; // Offset of rel32 field
+    uint16_t target;
+    uint8_t kind;
+};
+
+struct jit_fail {
+    uint16_t index; // Instruction that failed
+    uint8_t depth;
+    bool set_sp; // Getters and functions leave sp as they like on failure, VM doesn't touch it either
+    const char* message;
+};
+
+struct jit_context {
+    uint8_t* data;
+    size_t size;
+    size_t used;
+    bool overflow;
+
+    uint32_t* offsets; // Native offset of every instruction
+    struct jit_fixup* fixups;
+    uint32_t fixups_count;
+    struct jit_fail* fails;
+    uint32_t fails_count;
+};
+
+static void jit_emit(struct jit_context* ctx, const uint8_t* bytes, size_t size)
+{
+    if (ctx->used + size > ctx->size) {
+        ctx->overflow = true;
+        return;
+    }
+    memcpy(ctx->data + ctx->used, bytes, size);
+    ctx->used += size;
+}
+
+#define EMIT(ctx, ...) \
+{ \
+    const uint8_t bytes[] = {__VA_ARGS__}; \
+    jit_emit((ctx), bytes, sizeof(bytes)); \
+}
+
+static void jit_emit32(struct jit_context* ctx, uint32_t value)
+{
+    jit_emit(ctx, (const uint8_t*)&value, sizeof(value));
+}
+
+static void jit_emit64(struct jit_context* ctx, uint64_t value)
+{
+    jit_emit(ctx, (const uint8_t*)&value, sizeof(value));
+}
+
+// Emits rel32 field to be patched once all offsets are known
+static void jit_fixup(struct jit_context* ctx, enum jit_fixup_kind kind, uint16_t target)
+{
+    ctx->fixups[ctx->fixups_count++] = (struct jit_fixup){.at = ctx->used, .target = target, .kind = kind};
+    jit_emit32(ctx, 0);
+}
+
+static void jit_jump_fail(struct jit_context* ctx, uint8_t condition, uint16_t index, uint8_t depth, bool set_sp, const char* message)
+{
+    if (condition) EMIT(ctx, 0x0F, condition) // jcc rel32
+    else EMIT(ctx, 0xE9) // jmp rel32
+    ctx->fails[ctx->fails_count] = (struct jit_fail){.index = index, .depth = depth, .set_sp = set_sp, .message = message};
+    jit_fixup(ctx, jit_fixup_fail, ctx->fails_count++);
+}
+
+#define JIT_JZ 0x84
+#define JIT_JNZ 0x85
+
+// movss xmm, [rbx + slot]
+static void jit_load_slot(struct jit_context* ctx, uint8_t xmm, uint8_t slot)
+{
+    EMIT(ctx, 0xF3, 0x0F, 0x10, 0x83 | (xmm << 3));
+    jit_emit32(ctx, JIT_STATE_SLOT(slot));
+}
+
+// movss [rbx + slot], xmm
+static void jit_store_slot(struct jit_context* ctx, uint8_t xmm, uint8_t slot)
+{
+    EMIT(ctx, 0xF3, 0x0F, 0x11, 0x83 | (xmm << 3));
+    jit_emit32(ctx, JIT_STATE_SLOT(slot));
+}
+
+// mov eax, imm32; movd xmm, eax
+static void jit_load_immediate(struct jit_context* ctx, uint8_t xmm, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    EMIT(ctx, 0xB8);
+    jit_emit32(ctx, bits);
+    EMIT(ctx, 0x66, 0x0F, 0x6E, 0xC0 | (xmm << 3));
+}
+
+// Same conversions and failure as VM_LOAD_VAR
+static void jit_load_var(struct jit_context* ctx, uint8_t xmm, uint8_t var, uint16_t index, uint8_t depth)
+{
+    EMIT(ctx, 0x41, 0x8B, 0x84, 0x24); // mov eax, [r12 + kind]
+    jit_emit32(ctx, JIT_VAR_KIND(var));
+    EMIT(ctx, 0x83, 0xF8, mascot_local_variable_int); // cmp eax, int
+    EMIT(ctx, 0x75, 0x0C); // jne float
+    EMIT(ctx, 0xF3, 0x41, 0x0F, 0x2A, 0x84 | (xmm << 3), 0x24); // cvtsi2ss xmm, dword [r12 + value]
+    jit_emit32(ctx, JIT_VAR_VALUE(var));
+    EMIT(ctx, 0xEB, 0x13); // jmp done
+    EMIT(ctx, 0x83, 0xF8, mascot_local_variable_float); // float: cmp eax, float
+    jit_jump_fail(ctx, JIT_JNZ, index, depth, true, "Unknown variable type");
+    EMIT(ctx, 0xF3, 0x41, 0x0F, 0x10, 0x84 | (xmm << 3), 0x24); // movss xmm, [r12 + value]
+    jit_emit32(ctx, JIT_VAR_VALUE(var));
+    // done:
+}
+
+// Turns boolean in al into 0.0 or 1.0 in xmm0
+static void jit_bool_result(struct jit_context* ctx)
+{
+    EMIT(ctx, 0x0F, 0xB6, 0xC0); // movzx eax, al
+    EMIT(ctx, 0x69, 0xC0); // imul eax, eax, 1.0f
+    jit_emit32(ctx, JIT_ONE_BITS);
+    EMIT(ctx, 0x66, 0x0F, 0x6E, 0xC0); // movd xmm0, eax
+}
+
+// Truncates xmm0 to eax and xmm1 to ecx, as (int) casts do
+static void jit_truncate_operands(struct jit_context* ctx)
+{
+    EMIT(ctx, 0xF3, 0x0F, 0x2C, 0xC0); // cvttss2si eax, xmm0
+    EMIT(ctx, 0xF3, 0x0F, 0x2C, 0xC9); // cvttss2si ecx, xmm1
+}
+
+static void jit_call(struct jit_context* ctx, const void* function)
+{
+    EMIT(ctx, 0x48, 0xB8); // mov rax, imm64
+    jit_emit64(ctx, (uint64_t)(uintptr_t)function);
+    EMIT(ctx, 0xFF, 0xD0); // call rax
+}
+
+// Computes xmm0 = xmm0 <op> xmm1 for binary opcode (OP_ADD .. OP_LOR). Comparisons are false for NaN, as in C
+static bool jit_binary(struct jit_context* ctx, uint8_t opcode)
+{
+    switch (opcode) {
+        case OP_ADD: EMIT(ctx, 0xF3, 0x0F, 0x58, 0xC1); return true;
+        case OP_SUB: EMIT(ctx, 0xF3, 0x0F, 0x5C, 0xC1); return true;
+        case OP_MUL: EMIT(ctx, 0xF3, 0x0F, 0x59, 0xC1); return true;
+        case OP_DIV: EMIT(ctx, 0xF3, 0x0F, 0x5E, 0xC1); return true;
+        case OP_MOD: jit_call(ctx, (const void*)fmodf); return true;
+        case OP_POW: jit_call(ctx, (const void*)powf); return true;
+
+        case OP_AND: case OP_OR: case OP_XOR: case OP_SHL: case OP_SHR:
+            jit_truncate_operands(ctx);
+            if (opcode == OP_AND) EMIT(ctx, 0x21, 0xC8) // and eax, ecx
+            else if (opcode == OP_OR) EMIT(ctx, 0x09, 0xC8) // or eax, ecx
+            else if (opcode == OP_XOR) EMIT(ctx, 0x31, 0xC8) // xor eax, ecx
+            else if (opcode == OP_SHL) EMIT(ctx, 0xD3, 0xE0) // shl eax, cl
+            else EMIT(ctx, 0xD3, 0xF8) // sar eax, cl
+            EMIT(ctx, 0xF3, 0x0F, 0x2A, 0xC0); // cvtsi2ss xmm0, eax
+            return true;
+
+        case OP_GT: EMIT(ctx, 0x0F, 0x2E, 0xC1, 0x0F, 0x97, 0xC0); break; // ucomiss xmm0, xmm1; seta al
+        case OP_GE: EMIT(ctx, 0x0F, 0x2E, 0xC1, 0x0F, 0x93, 0xC0); break; // ucomiss xmm0, xmm1; setae al
+        case OP_LT: EMIT(ctx, 0x0F, 0x2E, 0xC8, 0x0F, 0x97, 0xC0); break; // ucomiss xmm1, xmm0; seta al
+        case OP_LE: EMIT(ctx, 0x0F, 0x2E, 0xC8, 0x0F, 0x93, 0xC0); break; // ucomiss xmm1, xmm0; setae al
+        case OP_EQ: EMIT(ctx, 0x0F, 0x2E, 0xC1, 0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1, 0x20, 0xC8); break; // sete al; setnp cl; and al, cl
+        case OP_NE: EMIT(ctx, 0x0F, 0x2E, 0xC1, 0x0F, 0x95, 0xC0, 0x0F, 0x9A, 0xC1, 0x08, 0xC8); break; // setne al; setp cl; or al, cl
+
+        case OP_LAND:
+            jit_truncate_operands(ctx);
+            EMIT(ctx, 0x85, 0xC0, 0x0F, 0x95, 0xC2); // test eax, eax; setne dl
+            EMIT(ctx, 0x85, 0xC9, 0x0F, 0x95, 0xC0); // test ecx, ecx; setne al
+            EMIT(ctx, 0x20, 0xD0); // and al, dl
+            break;
+        case OP_LOR:
+            jit_truncate_operands(ctx);
+            EMIT(ctx, 0x09, 0xC8, 0x0F, 0x95, 0xC0); // or eax, ecx; setne al
+            break;
+
+        default:
+            return false;
+    }
+    jit_bool_result(ctx);
+    return true;
+}
+
+// Truncated top of the stack to eax, then test eax, eax
+static void jit_test_slot(struct jit_context* ctx, uint8_t slot)
+{
+    jit_load_slot(ctx, 0, slot);
+    EMIT(ctx, 0xF3, 0x0F, 0x2C, 0xC0); // cvttss2si eax, xmm0
+    EMIT(ctx, 0x85, 0xC0); // test eax, eax
+}
+
+// Returns stack effect of instruction for depth analysis, false if instruction ends the path
+static bool jit_stack_delta(const struct expression_prototype* prototype, const struct expression_instruction* insn, int16_t* delta)
+{
+    uint8_t opcode = insn->opcode;
+    *delta = 0;
+    switch (opcode) {
+        case OP_ERR: case OP_RET: case OP_X_END: case OP_X_BADJUMP:
+            return false;
+        case OP_LOADL: case OP_PUSH: case OP_X_PUSHF:
+            *delta = 1;
+            return true;
+        case OP_LOADE:
+            *delta = prototype->global_getters_effects[insn->operand].pushes - prototype->global_getters_effects[insn->operand].pops;
+            return true;
+        case OP_CALL:
+            *delta = prototype->function_ptrs_effects[insn->operand].pushes - prototype->function_ptrs_effects[insn->operand].pops;
+            return true;
+    }
+    if (opcode >= OP_X_VAR_LTK && opcode <= OP_X_VAR_NEK) *delta = 1;
+    else if (opcode >= OP_ADD && opcode <= OP_POW) *delta = -1;
+    else if (opcode >= OP_AND && opcode <= OP_SHR && opcode != OP_NOT) *delta = -1;
+    else if (opcode >= OP_LT && opcode <= OP_NE) *delta = -1;
+    else if (opcode == OP_LAND || opcode == OP_LOR) *delta = -1;
+    return true;
+}
+
+// Depth of the stack before every instruction, -1 for unreachable ones.
+// Fails if paths join with different depths, such programs are left to VM
+static bool jit_stack_depths(const struct expression_prototype* prototype, int16_t* depths)
+{
+    uint16_t count = prototype->code_size + 2;
+    uint16_t* worklist = malloc(count * sizeof(uint16_t));
+    if (!worklist) return false;
+    for (uint16_t i = 0; i < count; i++) depths[i] = -1;
+
+    uint16_t pending = 0;
+    depths[0] = 1;
+    worklist[pending++] = 0;
+    while (pending) {
+        uint16_t pc = worklist[--pending];
+        const struct expression_instruction* insn = &prototype->code[pc];
+        int16_t delta = 0;
+        bool falls_through = jit_stack_delta(prototype, insn, &delta);
+        bool branches = insn->opcode == OP_BQZ || insn->opcode == OP_BNZ || insn->opcode == OP_JMP
+            || insn->opcode == OP_X_LAND_SC || insn->opcode == OP_X_LOR_SC;
+        if (insn->opcode == OP_JMP) falls_through = false;
+
+        uint16_t successors[2];
+        uint8_t successors_count = 0;
+        if (falls_through) successors[successors_count++] = pc + 1;
+        if (branches) successors[successors_count++] = insn->target;
+        for (uint8_t i = 0; i < successors_count; i++) {
+            int16_t depth = depths[pc] + delta;
+            if (depths[successors[i]] == depth) continue;
+            if (depths[successors[i]] != -1) {
+                free(worklist);
+                return false;
+            }
+            depths[successors[i]] = depth;
+            worklist[pending++] = successors[i];
+        }
+    }
+    free(worklist);
+    return true;
+}
+
+static bool jit_instruction(struct jit_context* ctx, const struct expression_prototype* prototype, uint16_t index, uint8_t depth)
+{
+    const struct expression_instruction* insn = &prototype->code[index];
+    uint8_t opcode = insn->opcode;
+    uint8_t top = depth - 1;
+
+    switch (opcode) {
+        case OP_ERR:
+            EMIT(ctx, 0x41, 0xC7, 0x45, 0x00); // mov dword [r13], 0
+            jit_emit32(ctx, 0);
+            jit_jump_fail(ctx, 0, index, depth, true, "Program aborted execution using OP_ERR or unbound jump is occured");
+            return true;
+        case OP_RET:
+            jit_load_slot(ctx, 0, top);
+            EMIT(ctx, 0xF3, 0x41, 0x0F, 0x11, 0x45, 0x00); // movss [r13], xmm0
+            EMIT(ctx, 0xB8, 0x01, 0x00, 0x00, 0x00); // mov eax, 1
+            EMIT(ctx, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3); // pop r13; pop r12; pop rbx; ret
+            return true;
+        case OP_X_END:
+            jit_jump_fail(ctx, 0, index, depth, true, "Reached end of bytecode without OP_RET");
+            return true;
+        case OP_X_BADJUMP:
+            jit_jump_fail(ctx, 0, index, depth, true, "Jump beyond bytecode size");
+            return true;
+        case OP_X_NOP:
+        case OP_PUSH: // Depth is tracked statically, slot already holds stored bytes
+            return true;
+
+        case OP_LOADL:
+            jit_load_var(ctx, 0, insn->operand, index, depth);
+            jit_store_slot(ctx, 0, depth);
+            return true;
+        case OP_LOADE:
+        case OP_CALL:
+            EMIT(ctx, 0xC6, 0x83); // mov byte [rbx + sp], depth
+            jit_emit32(ctx, JIT_STATE_SP);
+            EMIT(ctx, depth);
+            EMIT(ctx, 0x48, 0x89, 0xDF); // mov rdi, rbx
+            jit_call(ctx, opcode == OP_LOADE ? prototype->global_getters[insn->operand] : prototype->function_ptrs[insn->operand]);
+            EMIT(ctx, 0x84, 0xC0); // test al, al
+            jit_jump_fail(ctx, JIT_JZ, index, depth, false, NULL);
+            return true;
+        case OP_STORE0: case OP_STORE1: case OP_STORE2: case OP_STORE3:
+            EMIT(ctx, 0xC6, 0x83); // mov byte [rbx + slot + n], imm8
+            jit_emit32(ctx, JIT_STATE_SLOT(depth) + (opcode - OP_STORE0));
+            EMIT(ctx, insn->operand);
+            return true;
+        case OP_X_PUSHF: {
+            uint32_t bits;
+            memcpy(&bits, &insn->value, sizeof(bits));
+            EMIT(ctx, 0xC7, 0x83); // mov dword [rbx + slot], imm32
+            jit_emit32(ctx, JIT_STATE_SLOT(depth));
+            jit_emit32(ctx, bits);
+            return true;
+        }
+
+        case OP_NOT:
+        case OP_LNOT:
+            jit_test_slot(ctx, top);
+            EMIT(ctx, 0x0F, 0x94, 0xC0); // sete al
+            jit_bool_result(ctx);
+            jit_store_slot(ctx, 0, top);
+            return true;
+
+        case OP_BQZ:
+        case OP_BNZ:
+            jit_test_slot(ctx, top);
+            EMIT(ctx, 0x0F, opcode == OP_BQZ ? JIT_JZ : JIT_JNZ);
+            jit_fixup(ctx, jit_fixup_instruction, insn->target);
+            return true;
+        case OP_JMP:
+            EMIT(ctx, 0xE9);
+            jit_fixup(ctx, jit_fixup_instruction, insn->target);
+            return true;
+        case OP_X_LAND_SC:
+        case OP_X_LOR_SC:
+            jit_test_slot(ctx, top);
+            EMIT(ctx, 0x0F, opcode == OP_X_LAND_SC ? JIT_JNZ : JIT_JZ); // Operand has to be evaluated
+            jit_fixup(ctx, jit_fixup_instruction, index + 1);
+            EMIT(ctx, 0xC7, 0x83); // mov dword [rbx + slot], 0.0 / 1.0
+            jit_emit32(ctx, JIT_STATE_SLOT(top));
+            jit_emit32(ctx, opcode == OP_X_LAND_SC ? 0 : JIT_ONE_BITS);
+            EMIT(ctx, 0xE9);
+            jit_fixup(ctx, jit_fixup_instruction, insn->target);
+            return true;
+    }
+
+    if (opcode >= OP_X_ADDK && opcode <= OP_X_NEK) {
+        jit_load_slot(ctx, 0, top);
+        jit_load_immediate(ctx, 1, insn->value);
+        opcode = opcode <= OP_X_DIVK ? OP_ADD + (opcode - OP_X_ADDK) : OP_LT + (opcode - OP_X_LTK);
+        if (!jit_binary(ctx, opcode)) return false;
+        jit_store_slot(ctx, 0, top);
+        return true;
+    }
+    if (opcode >= OP_X_LT_VAR && opcode <= OP_X_NE_VAR) {
+        jit_load_slot(ctx, 0, top);
+        jit_load_var(ctx, 1, insn->operand, index, depth);
+        if (!jit_binary(ctx, OP_LT + (opcode - OP_X_LT_VAR))) return false;
+        jit_store_slot(ctx, 0, top);
+        return true;
+    }
+    if (opcode >= OP_X_VAR_LTK && opcode <= OP_X_VAR_NEK) {
+        jit_load_var(ctx, 0, insn->operand, index, depth);
+        jit_load_immediate(ctx, 1, insn->value);
+        if (!jit_binary(ctx, OP_LT + (opcode - OP_X_VAR_LTK))) return false;
+        jit_store_slot(ctx, 0, depth);
+        return true;
+    }
+
+    jit_load_slot(ctx, 0, depth - 2);
+    jit_load_slot(ctx, 1, top);
+    if (!jit_binary(ctx, opcode)) return false;
+    jit_store_slot(ctx, 0, depth - 2);
+    return true;
+}
+
+static bool jit_generate(struct jit_context* ctx, const struct expression_prototype* prototype, const int16_t* depths)
+{
+    uint16_t count = prototype->code_size + 2;
+
+    EMIT(ctx, 0x53, 0x41, 0x54, 0x41, 0x55); // push rbx; push r12; push r13, keeps stack aligned for calls
+    EMIT(ctx, 0x48, 0x89, 0xFB); // mov rbx, rdi
+    EMIT(ctx, 0x49, 0x89, 0xF5); // mov r13, rsi
+    EMIT(ctx, 0x4C, 0x8B, 0xA7); // mov r12, [rdi + ref_mascot]
+    jit_emit32(ctx, JIT_STATE_MASCOT);
+
+    for (uint16_t i = 0; i < count; i++) {
+        ctx->offsets[i] = ctx->used;
+        if (depths[i] == -1 && i < prototype->code_size) continue;
+        if (!jit_instruction(ctx, prototype, i, depths[i] == -1 ? 1 : depths[i])) return false;
+    }
+
+    // Failure stubs leave state as VM does: ip past failed instruction
+    for (uint32_t i = 0; i < ctx->fails_count; i++) {
+        const struct jit_fail* fail = &ctx->fails[i];
+        uint32_t stub = ctx->used;
+        if (fail->set_sp) {
+            EMIT(ctx, 0xC6, 0x83); // mov byte [rbx + sp], depth
+            jit_emit32(ctx, JIT_STATE_SP);
+            EMIT(ctx, fail->depth);
+        }
+        EMIT(ctx, 0x66, 0xC7, 0x83); // mov word [rbx + ip], index + 1
+        jit_emit32(ctx, JIT_STATE_IP);
+        EMIT(ctx, (fail->index + 1) & 0xFF, (fail->index + 1) >> 8);
+        if (fail->message) {
+            EMIT(ctx, 0x48, 0xB8); // mov rax, imm64
+            jit_emit64(ctx, (uint64_t)(uintptr_t)fail->message);
+            EMIT(ctx, 0x48, 0x89, 0x83); // mov [rbx + error_message], rax
+            jit_emit32(ctx, JIT_STATE_ERROR);
+        }
+        EMIT(ctx, 0x31, 0xC0); // xor eax, eax
+        EMIT(ctx, 0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3); // pop r13; pop r12; pop rbx; ret
+        ctx->offsets[count + i] = stub;
+    }
+    if (ctx->overflow) return false;
+
+    for (uint32_t i = 0; i < ctx->fixups_count; i++) {
+        const struct jit_fixup* fixup = &ctx->fixups[i];
+        uint32_t destination = ctx->offsets[fixup->kind == jit_fixup_fail ? count + fixup->target : fixup->target];
+        int32_t relative = (int32_t)destination - (int32_t)(fixup->at + 4);
+        memcpy(ctx->data + fixup->at, &relative, sizeof(relative));
+    }
+    return true;
+}
+
+struct expression_jit_code* expression_jit_compile(const struct expression_prototype* prototype)
+{
+    if (!prototype || !prototype->code) return NULL;
+
+    uint16_t count = prototype->code_size + 2;
+    struct expression_jit_code* jit = NULL;
+    struct jit_context ctx = {0};
+    int16_t* depths = malloc(count * sizeof(int16_t));
+    // Every instruction needs at most two fixups and one failure stub
+    ctx.size = 64 + count * 160;
+    ctx.data = malloc(ctx.size);
+    ctx.offsets = malloc(count * 2 * sizeof(uint32_t));
+    ctx.fixups = malloc(count * 2 * sizeof(struct jit_fixup));
+    ctx.fails = malloc(count * sizeof(struct jit_fail));
+    if (!depths || !ctx.data || !ctx.offsets || !ctx.fixups || !ctx.fails) goto done;
+
+    if (!jit_stack_depths(prototype, depths)) {
+        DEBUG("Expression %u is not compiled: stack depth isn't static", prototype->id);
+        goto done;
+    }
+    if (!jit_generate(&ctx, prototype, depths)) {
+        WARN("Expression %u couldn't be compiled to native code", prototype->id);
+        goto done;
+    }
+
+    jit = calloc(1, sizeof(struct expression_jit_code));
+    if (!jit) goto done;
+    if (!expression_jit_install(jit, ctx.data, ctx.used)) {
+        free(jit);
+        jit = NULL;
+        goto done;
+    }
+    DEBUG("Expression %u compiled to %zu bytes of native code", prototype->id, ctx.used);
+
+done:
+    free(depths);
+    free(ctx.data);
+    free(ctx.offsets);
+    free(ctx.fixups);
+    free(ctx.fails);
+    return jit;
+}
+
+void expression_jit_free(struct expression_jit_code* jit)
+{
+    if (!jit) return;
+    pthread_mutex_lock(&jit_lock);
+    struct expression_jit_chunk* chunk = jit->chunk;
+    if (!--chunk->refs && chunk != jit_current_chunk) expression_jit_chunk_release(chunk);
+    pthread_mutex_unlock(&jit_lock);
+    free(jit);
+}
+
+#else
+
+struct expression_jit_code* expression_jit_compile(const struct expression_prototype* prototype)
+{
+    UNUSED(prototype);
+    return NULL;
+}
+
+void expression_jit_free(struct expression_jit_code* jit)
+{
+    UNUSED(jit);
+}
+
+#endif
@@ -0,0 +1,42 @@
+/*
+    expression_jit.h - wl_shimeji's native code compiler for expressions
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef EXPRESSION_JIT_H
+#define EXPRESSION_JIT_H
+
+#include "master_header.h"
+#include "expressions.h"
+
+struct expression_jit_chunk;
+
+// Runs program on prepared VM state. On failure returns false with state's ip, sp and error_message
+// set as VM would have left them, so caller can report it the same way
+typedef bool (*expression_jit_function)(struct expression_vm_state* state, float* result);
+
+struct expression_jit_code {
+    expression_jit_function function;
+    struct expression_jit_chunk* chunk; // Executable memory function lives in
+};
+
+// Translates verified and optimized program to native code.
+// Returns NULL if architecture or program isn't supported, VM has to be used then
+struct expression_jit_code* expression_jit_compile(const struct expression_prototype* prototype);
+void expression_jit_free(struct expression_jit_code* code);
+
+#endif
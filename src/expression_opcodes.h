@@ -0,0 +1,112 @@
+/*
+    expression_opcodes.h - wl_shimeji's expression bytecode opcodes and decoded instructions
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef EXPRESSION_OPCODES_H
+#define EXPRESSION_OPCODES_H
+
+#include <stdint.h>
+
+#define OP_ERR 0x00
+#define OP_RET 0x01
+
+#define OP_LOADL  0x10 // Push mascot variable to stack
+#define OP_LOADE  0x11 // Execute global variable getter
+#define OP_STORE0 0x12 // Store float value to stack (0th byte)
+#define OP_STORE1 0x13 // Store float value to stack (1st byte)
+#define OP_STORE2 0x14 // Store float value to stack (2nd byte)
+#define OP_STORE3 0x15 // Store float value to stack (3rd byte)
+
+#define OP_ADD 0x20 // Add two from stack
+#define OP_SUB 0x21 // Subtract two from stack
+#define OP_MUL 0x22 // Multiply two from stack
+#define OP_DIV 0x23 // Divide two from stack
+#define OP_MOD 0x24 // Modulo two from stack
+#define OP_POW 0x25 // Power two from stack
+
+#define OP_AND 0x30 // Bitwise AND two from stack
+#define OP_OR 0x31 // Bitwise OR two from stack
+#define OP_XOR 0x32 // Bitwise XOR two from stack
+#define OP_NOT 0x33 // Bitwise NOT from stack
+#define OP_SHL 0x34 // Bitwise shift left from stack
+#define OP_SHR 0x35 // Bitwise shift right from stack
+
+#define OP_LT 0x40 // Less than
+#define OP_LE 0x41 // Greater than
+#define OP_GT 0x42 // Less or equal
+#define OP_GE 0x43 // Greater or equal
+#define OP_EQ 0x44 // Equal
+#define OP_NE 0x45 // Not equal
+
+#define OP_LAND 0x50 // Logical AND
+#define OP_LOR 0x51 // Logical OR
+#define OP_LNOT 0x52 // Logical NOT
+
+#define OP_BQZ 0x60 // Branch if zero
+#define OP_BNZ 0x61 // Branch if not zero
+#define OP_JMP 0x62 // Jump by offset
+
+#define OP_CALL 0x70 // Call function
+
+#define OP_PUSH 0x80 // Increment stack pointer
+
+// Pseudo opcodes, never present in bytecode. Produced by decoder only
+#define OP_X_NOP 0xF0 // Unknown opcode, ignored
+#define OP_X_END 0xF1 // Execution fell off the end of bytecode
+#define OP_X_BADJUMP 0xF2 // Target of jump that leaves bytecode
+#define OP_X_PUSHF 0xF3 // Push float immediate, produced by optimizer from OP_STORE0-3 + OP_PUSH
+
+// Superinstructions, produced by optimizer. K suffix: right operand is float immediate,
+// VAR: right operand is mascot variable, VAR_..K: variable compared with immediate, pushed
+#define OP_X_ADDK 0xA0
+#define OP_X_SUBK 0xA1
+#define OP_X_MULK 0xA2
+#define OP_X_DIVK 0xA3
+#define OP_X_LTK 0xA4
+#define OP_X_LEK 0xA5
+#define OP_X_GTK 0xA6
+#define OP_X_GEK 0xA7
+#define OP_X_EQK 0xA8
+#define OP_X_NEK 0xA9
+
+#define OP_X_LT_VAR 0xB0
+#define OP_X_LE_VAR 0xB1
+#define OP_X_GT_VAR 0xB2
+#define OP_X_GE_VAR 0xB3
+#define OP_X_EQ_VAR 0xB4
+#define OP_X_NE_VAR 0xB5
+
+#define OP_X_VAR_LTK 0xC0
+#define OP_X_VAR_LEK 0xC1
+#define OP_X_VAR_GTK 0xC2
+#define OP_X_VAR_GEK 0xC3
+#define OP_X_VAR_EQK 0xC4
+#define OP_X_VAR_NEK 0xC5
+
+#define OP_X_LAND_SC 0xD0 // Skips right operand of OP_LAND if left one is false
+#define OP_X_LOR_SC 0xD1 // Skips right operand of OP_LOR if left one is true
+
+// Bytecode instruction decoded at load time, so VM doesn't have to decode it on each execution
+struct expression_instruction {
+    uint8_t opcode;
+    uint8_t operand;
+    uint16_t target; // For branches: index of instruction to continue from if branch is taken
+    float value; // For OP_X_PUSHF: value to push
+};
+
+#endif
@@ -18,437 +18,1205 @@
 */
 
 #include "expressions.h"
+#include "expression_opcodes.h"
+#include "expression_jit.h"
+#include "expression_batch.h"
 #include "mascot.h"
+#include "config.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <time.h>
 
-#define OP_ERR 0x00
-#define OP_RET 0x01
-
-#define OP_LOADL  0x10 // Push mascot variable to stack
-#define OP_LOADE  0x11 // Execute global variable getter
-#define OP_STORE0 0x12 // Store float value to stack (0th byte)
-#define OP_STORE1 0x13 // Store float value to stack (1st byte)
-#define OP_STORE2 0x14 // Store float value to stack (2nd byte)
-#define OP_STORE3 0x15 // Store float value to stack (3rd byte)
-
-#define OP_ADD 0x20 // Add two from stack
-#define OP_SUB 0x21 // Subtract two from stack
-#define OP_MUL 0x22 // Multiply two from stack
-#define OP_DIV 0x23 // Divide two from stack
-#define OP_MOD 0x24 // Modulo two from stack
-#define OP_POW 0x25 // Power two from stack
-
-#define OP_AND 0x30 // Bitwise AND two from stack
-#define OP_OR 0x31 // Bitwise OR two from stack
-#define OP_XOR 0x32 // Bitwise XOR two from stack
-#define OP_NOT 0x33 // Bitwise NOT from stack
-#define OP_SHL 0x34 // Bitwise shift left from stack
-#define OP_SHR 0x35 // Bitwise shift right from stack
-
-#define OP_LT 0x40 // Less than
-#define OP_LE 0x41 // Greater than
-#define OP_GT 0x42 // Less or equal
-#define OP_GE 0x43 // Greater or equal
-#define OP_EQ 0x44 // Equal
-#define OP_NE 0x45 // Not equal
-
-#define OP_LAND 0x50 // Logical AND
-#define OP_LOR 0x51 // Logical OR
-#define OP_LNOT 0x52 // Logical NOT
-
-#define OP_BQZ 0x60 // Branch if zero
-#define OP_BNZ 0x61 // Branch if not zero
-#define OP_JMP 0x62 // Jump by offset
-
-#define OP_CALL 0x70 // Call function
-
-#define OP_PUSH 0x80 // Increment stack pointer
+// Deepest stack pointer verifier accepts. Leaves room for getters and functions,
+// which check for overflow themselves, so they never fail on verified programs
+#define EXPRESSION_STACK_LIMIT 253
+
+// Use labels-as-values dispatch where compiler supports it, switch otherwise
+#if defined(__GNUC__)
+#define EXPRESSION_VM_THREADED
+#endif
 
 typedef bool (*global_getter)(struct expression_vm_state*);
 
-struct expression_prototype* expression_prototype_new()
+// Versions of EXPRESSION_SOURCE_ENVIRONMENT and EXPRESSION_SOURCE_POPULATION, memoized results
+// computed at older versions are stale
+static uint32_t expression_environment_version = 0;
+static uint32_t expression_population_version = 0;
+
+void expression_source_changed(uint8_t source)
 {
-    struct expression_prototype* prototype = calloc(1, sizeof(struct expression_prototype));
-    return prototype;
+    if (source & EXPRESSION_SOURCE_ENVIRONMENT) __atomic_add_fetch(&expression_environment_version, 1, __ATOMIC_RELAXED);
+    if (source & EXPRESSION_SOURCE_POPULATION) __atomic_add_fetch(&expression_population_version, 1, __ATOMIC_RELAXED);
 }
 
-void expression_prototype_free(struct expression_prototype* prototype)
+// Counters are bumped with plain relaxed loads and stores, locked increment on every execution costs more than occasional lost update
+#define EXPRESSION_PROFILE_ADD(field, value) \
+    __atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (value), __ATOMIC_RELAXED)
+
+void expression_profile_get(const struct expression_prototype* prototype, struct expression_profile* profile, uint64_t* nanoseconds)
 {
-    free(prototype);
+    if (!prototype || !profile) return;
+    profile->calls = __atomic_load_n(&prototype->profile.calls, __ATOMIC_RELAXED);
+    profile->errors = __atomic_load_n(&prototype->profile.errors, __ATOMIC_RELAXED);
+    profile->instructions = __atomic_load_n(&prototype->profile.instructions, __ATOMIC_RELAXED);
+    profile->sampled_calls = __atomic_load_n(&prototype->profile.sampled_calls, __ATOMIC_RELAXED);
+    profile->sampled_nanoseconds = __atomic_load_n(&prototype->profile.sampled_nanoseconds, __ATOMIC_RELAXED);
+    if (nanoseconds) {
+        *nanoseconds = 0;
+        if (profile->sampled_calls) {
+            *nanoseconds = (uint64_t)((double)profile->sampled_nanoseconds * profile->calls / profile->sampled_calls);
+        }
+    }
 }
 
-void expression_prototype_load_mascot_vars(struct expression_prototype* prototype, uint8_t* mascot_vars, uint8_t mascot_vars_size)
+void expression_profile_reset(struct expression_prototype* prototype)
 {
-    if (mascot_vars_size > 127) return;
-    if (mascot_vars_size == 0) return;
-    if (!mascot_vars) return;
     if (!prototype) return;
-    memcpy(prototype->mascot_vars, mascot_vars, mascot_vars_size);
-    prototype->mascot_vars_size = mascot_vars_size;
+    __atomic_store_n(&prototype->profile.calls, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&prototype->profile.errors, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&prototype->profile.instructions, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&prototype->profile.sampled_calls, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&prototype->profile.sampled_nanoseconds, 0, __ATOMIC_RELAXED);
 }
 
-void expression_prototype_load_global_getters(struct expression_prototype* prototype, void** function_ptrs, uint8_t function_ptrs_size)
+static bool expression_opcode_known(uint8_t opcode)
 {
-    if (function_ptrs_size > 127) return;
-    if (function_ptrs_size == 0) return;
-    if (!function_ptrs) return;
-    if (!prototype) return;
-    memcpy(prototype->global_getters, function_ptrs, function_ptrs_size*sizeof(void*));
-    prototype->global_getters_size = function_ptrs_size;
+    switch (opcode) {
+        case OP_ERR: case OP_RET:
+        case OP_LOADL: case OP_LOADE: case OP_STORE0: case OP_STORE1: case OP_STORE2: case OP_STORE3:
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD: case OP_POW:
+        case OP_AND: case OP_OR: case OP_XOR: case OP_NOT: case OP_SHL: case OP_SHR:
+        case OP_LT: case OP_LE: case OP_GT: case OP_GE: case OP_EQ: case OP_NE:
+        case OP_LAND: case OP_LOR: case OP_LNOT:
+        case OP_BQZ: case OP_BNZ: case OP_JMP:
+        case OP_CALL:
+        case OP_PUSH:
+            return true;
+        default:
+            return false;
+    }
 }
 
-void expression_prototype_load_function_ptrs(struct expression_prototype* prototype, void** function_ptrs, uint8_t function_ptrs_size)
+// Splits bytecode into instructions and resolves branch offsets into instruction indices.
+// Stream is terminated by OP_X_END and OP_X_BADJUMP, so VM never has to check instruction pointer
+static bool expression_prototype_decode(struct expression_prototype* prototype)
 {
-    if (function_ptrs_size > 127) return;
-    if (function_ptrs_size == 0) return;
-    if (!function_ptrs) return;
-    if (!prototype) return;
-    memcpy(prototype->function_ptrs, function_ptrs, function_ptrs_size*sizeof(void*));
-    prototype->function_ptrs_size = function_ptrs_size;
+    uint16_t count = prototype->bytecode_size / 2;
+    struct expression_instruction* code = calloc(count + 2, sizeof(struct expression_instruction));
+    if (!code) return false;
+
+    for (uint16_t i = 0; i < count; i++) {
+        struct expression_instruction* insn = &code[i];
+        insn->opcode = prototype->bytecode[i * 2];
+        insn->operand = prototype->bytecode[i * 2 + 1];
+
+        if (insn->opcode == OP_BQZ || insn->opcode == OP_BNZ || insn->opcode == OP_JMP) {
+            // Offset is relative to the end of the branch instruction, in bytes
+            uint32_t destination = (i + 1) * 2 + insn->operand;
+            if (destination > prototype->bytecode_size || destination % 2) insn->target = count + 1;
+            else insn->target = destination / 2;
+        } else if (!expression_opcode_known(insn->opcode)) {
+            insn->opcode = OP_X_NOP;
+        }
+    }
+    code[count].opcode = OP_X_END;
+    code[count + 1].opcode = OP_X_BADJUMP;
+
+    free(prototype->code);
+    prototype->code = code;
+    prototype->code_size = count;
+    return true;
+}
+
+// Abstractly interprets decoded program, tracking range of stack pointer along every path.
+// Branches don't pop their condition, so paths may join with different stack depths.
+// Rejects programs that could underflow or overflow the stack, reference missing symbols
+// or leave the bytecode, so VM may execute verified programs without any checks
+static bool expression_prototype_verify(struct expression_prototype* prototype)
+{
+    uint16_t count = prototype->code_size + 2;
+    int16_t* lowest = malloc(count * sizeof(int16_t));
+    int16_t* highest = malloc(count * sizeof(int16_t));
+    uint16_t* worklist = malloc(count * sizeof(uint16_t));
+    bool* queued = calloc(count, sizeof(bool));
+    if (!lowest || !highest || !worklist || !queued) {
+        free(lowest);
+        free(highest);
+        free(worklist);
+        free(queued);
+        return false;
+    }
+    for (uint16_t i = 0; i < count; i++) lowest[i] = highest[i] = -1;
+
+    const char* error = NULL;
+    uint16_t pc = 0;
+    uint16_t pending = 0;
+    int16_t max_depth = 1;
+    lowest[0] = highest[0] = 1;
+    worklist[pending++] = 0;
+    queued[0] = true;
+
+    while (pending) {
+        pc = worklist[--pending];
+        queued[pc] = false;
+        const struct expression_instruction* insn = &prototype->code[pc];
+        int16_t delta = 0;
+        int16_t needed = 1; // Stack pointer required before instruction, stack[0] is never popped
+        bool falls_through = true;
+        bool branches = false;
+        const struct expression_stack_effect* effect = NULL;
+
+        switch (insn->opcode) {
+            case OP_ERR:
+            case OP_RET:
+                falls_through = false;
+                break;
+
+            case OP_LOADL:
+                if (insn->operand >= prototype->mascot_vars_size) error = "Trying to access out of bounds variable";
+                else if (prototype->mascot_vars[insn->operand] >= 128) error = "Variable points towards non existing local variable";
+                delta = 1;
+                break;
+            case OP_LOADE:
+                if (insn->operand >= prototype->global_getters_size) error = "Trying to access out of bounds global variable";
+                else if (!prototype->global_getters[insn->operand]) error = "Global variable not found";
+                else effect = &prototype->global_getters_effects[insn->operand];
+                break;
+            case OP_CALL:
+                if (insn->operand >= prototype->function_ptrs_size) error = "Function index out of bounds";
+                else if (!prototype->function_ptrs[insn->operand]) error = "Function is not found";
+                else effect = &prototype->function_ptrs_effects[insn->operand];
+                break;
+
+            case OP_STORE0: case OP_STORE1: case OP_STORE2: case OP_STORE3:
+                break;
+            case OP_PUSH:
+                delta = 1;
+                break;
+
+            case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD: case OP_POW:
+            case OP_AND: case OP_OR: case OP_XOR: case OP_SHL: case OP_SHR:
+            case OP_LT: case OP_LE: case OP_GT: case OP_GE: case OP_EQ: case OP_NE:
+            case OP_LAND: case OP_LOR:
+                needed = 3;
+                delta = -1;
+                break;
+            case OP_NOT:
+            case OP_LNOT:
+                needed = 2;
+                break;
+
+            case OP_BQZ:
+            case OP_BNZ:
+                needed = 2;
+                branches = true;
+                break;
+            case OP_JMP:
+                branches = true;
+                falls_through = false;
+                break;
+
+            case OP_X_NOP:
+                break;
+            case OP_X_END:
+                error = "Execution may reach end of bytecode without OP_RET";
+                break;
+            case OP_X_BADJUMP:
+                error = "Jump beyond bytecode size";
+                break;
+        }
+
+        if (effect) {
+            needed = effect->pops + 1;
+            delta = effect->pushes - effect->pops;
+        }
+        if (error) break;
+        if (lowest[pc] < needed) {
+            error = "Stack underflow";
+            break;
+        }
+        int16_t next_lowest = lowest[pc] + delta;
+        int16_t next_highest = highest[pc] + delta;
+        if (next_highest > EXPRESSION_STACK_LIMIT) {
+            error = "Stack overflow";
+            break;
+        }
+        if (next_highest > max_depth) max_depth = next_highest;
+
+        uint16_t successors[2];
+        uint8_t successors_count = 0;
+        if (falls_through) successors[successors_count++] = pc + 1;
+        if (branches) successors[successors_count++] = insn->target;
+        for (uint8_t i = 0; i < successors_count; i++) {
+            uint16_t successor = successors[i];
+            bool widened = false;
+            if (lowest[successor] == -1 || next_lowest < lowest[successor]) {
+                lowest[successor] = next_lowest;
+                widened = true;
+            }
+            if (next_highest > highest[successor]) {
+                highest[successor] = next_highest;
+                widened = true;
+            }
+            if (widened && !queued[successor]) {
+                queued[successor] = true;
+                worklist[pending++] = successor;
+            }
+        }
+    }
+
+    free(lowest);
+    free(highest);
+    free(worklist);
+    free(queued);
+
+    if (error) {
+        WARN("Expression bytecode rejected at offset %u: %s", pc * 2, error);
+        return false;
+    }
+    prototype->max_stack = max_depth;
+    return true;
+}
+
+// Same expressions as in VM handlers, so folded constants are bit-identical to computed ones
+static bool expression_fold_binary(uint8_t opcode, float a, float b, float* result)
+{
+    switch (opcode) {
+        case OP_ADD: *result = a + b; return true;
+        case OP_SUB: *result = a - b; return true;
+        case OP_MUL: *result = a * b; return true;
+        case OP_DIV: *result = a / b; return true;
+        case OP_MOD: *result = fmodf(a, b); return true;
+        case OP_POW: *result = powf(a, b); return true;
+        case OP_AND: *result = ((int)a) & ((int)b); return true;
+        case OP_OR: *result = ((int)a) | ((int)b); return true;
+        case OP_XOR: *result = ((int)a) ^ ((int)b); return true;
+        case OP_LT: *result = a < b; return true;
+        case OP_LE: *result = a <= b; return true;
+        case OP_GT: *result = a > b; return true;
+        case OP_GE: *result = a >= b; return true;
+        case OP_EQ: *result = a == b; return true;
+        case OP_NE: *result = a != b; return true;
+        case OP_LAND: *result = ((int)a) && ((int)b); return true;
+        case OP_LOR: *result = ((int)a) || ((int)b); return true;
+        default: return false; // Shifts are left to runtime, their result isn't defined for every operand
+    }
+}
+
+// Index of closest preceding instruction that wasn't optimized out, or -1
+static int32_t expression_previous_live(const struct expression_instruction* code, int32_t index)
+{
+    while (--index >= 0) {
+        if (code[index].opcode != OP_X_NOP) return index;
+    }
+    return -1;
+}
+
+// Whether any instruction in (from, to] is a branch target, so instructions around it can't be merged
+static bool expression_targeted(const bool* targeted, int32_t from, int32_t to)
+{
+    for (int32_t i = from + 1; i <= to; i++) {
+        if (targeted[i]) return true;
+    }
+    return false;
+}
+
+static bool expression_is_branch(uint8_t opcode)
+{
+    return opcode == OP_BQZ || opcode == OP_BNZ || opcode == OP_JMP || opcode == OP_X_LAND_SC || opcode == OP_X_LOR_SC;
+}
+
+// Removes optimized out (and unreachable, if reachable isn't NULL) instructions and remaps branch targets.
+// Removed instructions map to the next kept one, which is where execution would have continued
+static uint16_t expression_compact(struct expression_instruction* code, uint16_t count, const bool* reachable)
+{
+    uint16_t* remap = malloc((count + 2) * sizeof(uint16_t));
+    if (!remap) return count; // Leftover OP_X_NOPs are still valid to execute
+
+    uint16_t kept = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        remap[i] = kept;
+        if ((!reachable || reachable[i]) && code[i].opcode != OP_X_NOP) code[kept++] = code[i];
+    }
+    remap[count] = kept;
+    remap[count + 1] = kept + 1;
+    for (uint16_t i = 0; i < kept; i++) {
+        if (expression_is_branch(code[i].opcode)) code[i].target = remap[code[i].target];
+    }
+    code[kept] = (struct expression_instruction){.opcode = OP_X_END};
+    code[kept + 1] = (struct expression_instruction){.opcode = OP_X_BADJUMP};
+
+    free(remap);
+    return kept;
 }
 
-bool expression_prototype_load_bytecode(struct expression_prototype* prototype, uint8_t* bytecode, uint16_t bytecode_size)
+// Stack effect of instructions that may appear in operand of short-circuited logic.
+// Returns false for anything with side effects or control flow
+static bool expression_pure_effect(const struct expression_prototype* prototype, const struct expression_instruction* insn, uint8_t* pops, uint8_t* pushes)
 {
-    if (!prototype) return false;
-    if (bytecode_size > 1024) return false;
-    if (bytecode_size == 0) return false;
-    if (!bytecode) return false;
+    uint8_t opcode = insn->opcode;
+    *pops = 0;
+    *pushes = 1;
+    if (opcode == OP_X_PUSHF || opcode == OP_LOADL || (opcode >= OP_X_VAR_LTK && opcode <= OP_X_VAR_NEK)) return true;
+    if (opcode == OP_LOADE) {
+        // Getters only read mascot and environment state, functions (OP_CALL) may not
+        *pops = prototype->global_getters_effects[insn->operand].pops;
+        *pushes = prototype->global_getters_effects[insn->operand].pushes;
+        return true;
+    }
+    *pops = 1;
+    if (opcode == OP_NOT || opcode == OP_LNOT) return true;
+    if (opcode >= OP_X_ADDK && opcode <= OP_X_NEK) return true;
+    if (opcode >= OP_X_LT_VAR && opcode <= OP_X_NE_VAR) return true;
+    *pops = 2;
+    if (opcode >= OP_ADD && opcode <= OP_POW) return true;
+    if (opcode >= OP_AND && opcode <= OP_SHR && opcode != OP_NOT) return true;
+    if (opcode >= OP_LT && opcode <= OP_NE) return true;
+    if (opcode == OP_LAND || opcode == OP_LOR) return true;
+    return false;
+}
+
+// Finds start of right operand of binary operation at index, if it is straight-line code without side effects
+static int32_t expression_right_operand(const struct expression_prototype* prototype, const bool* targeted, uint16_t index)
+{
+    const struct expression_instruction* code = prototype->code;
+    int32_t produced = 0;
+    uint8_t pops, pushes;
+    for (int32_t start = index - 1; start >= 0; start--) {
+        if (targeted[start + 1]) return -1;
+        if (!expression_pure_effect(prototype, &code[start], &pops, &pushes)) return -1;
+        produced += pushes - pops;
+        if (produced != 1) continue;
 
-    // Bytecode is encoded as hex string, so we need to convert it to binary
-    for (int i = 0; i < bytecode_size; i += 2)
-    {
-        char hex[3] = {bytecode[i], bytecode[i + 1], 0};
-        prototype->bytecode[i / 2] = strtol(hex, NULL, 16);
+        // Operand must not consume values below itself
+        int32_t depth = 0;
+        for (int32_t i = start; i < index; i++) {
+            expression_pure_effect(prototype, &code[i], &pops, &pushes);
+            if (depth < pops) return -1;
+            depth += pushes - pops;
+        }
+        return targeted[start] ? -1 : start;
     }
+    return -1;
+}
 
-    prototype->bytecode_size = bytecode_size / 2;
+// Superinstructions for verified, optimized program without bare pushes:
+// operations with immediate or variable operand, and short-circuiting of && and || over operands without side effects
+static void expression_prototype_fuse(struct expression_prototype* prototype)
+{
+    struct expression_instruction* code = prototype->code;
+    uint16_t count = prototype->code_size;
+    bool* targeted = calloc(count + 2, sizeof(bool));
+    int32_t* skip_from = malloc(count * sizeof(int32_t));
+    if (!targeted || !skip_from) goto done;
+
+    for (uint16_t i = 0; i < count; i++) {
+        if (expression_is_branch(code[i].opcode)) targeted[code[i].target] = true;
+    }
+
+    for (int32_t i = 0; i < count; i++) {
+        struct expression_instruction* insn = &code[i];
+        int32_t b = expression_previous_live(code, i);
+        if (b < 0 || expression_targeted(targeted, b, i)) continue;
+
+        if (code[b].opcode == OP_X_PUSHF) {
+            if (insn->opcode >= OP_ADD && insn->opcode <= OP_DIV) insn->opcode = OP_X_ADDK + (insn->opcode - OP_ADD);
+            else if (insn->opcode >= OP_LT && insn->opcode <= OP_NE) insn->opcode = OP_X_LTK + (insn->opcode - OP_LT);
+            else continue;
+            insn->value = code[b].value;
+            code[b].opcode = OP_X_NOP;
+
+            // Variable compared with immediate
+            if (insn->opcode < OP_X_LTK) continue;
+            b = expression_previous_live(code, b);
+            if (b < 0 || code[b].opcode != OP_LOADL || expression_targeted(targeted, b, i)) continue;
+            insn->opcode = OP_X_VAR_LTK + (insn->opcode - OP_X_LTK);
+            insn->operand = code[b].operand;
+            code[b].opcode = OP_X_NOP;
+        } else if (code[b].opcode == OP_LOADL && insn->opcode >= OP_LT && insn->opcode <= OP_NE) {
+            insn->opcode = OP_X_LT_VAR + (insn->opcode - OP_LT);
+            insn->operand = code[b].operand;
+            code[b].opcode = OP_X_NOP;
+        }
+    }
+    count = expression_compact(code, count, NULL);
+    prototype->code_size = count;
+
+    // Targets have moved
+    memset(targeted, 0, (count + 2) * sizeof(bool));
+    for (uint16_t i = 0; i < count; i++) {
+        if (expression_is_branch(code[i].opcode)) targeted[code[i].target] = true;
+    }
 
+    // Right operands worth skipping, at least two instructions long
+    uint16_t inserted = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        skip_from[i] = -1;
+        if (code[i].opcode != OP_LAND && code[i].opcode != OP_LOR) continue;
+        int32_t start = expression_right_operand(prototype, targeted, i);
+        if (start < 0 || i - start < 2) continue;
+        skip_from[i] = start;
+        inserted++;
+    }
+    if (!inserted) goto done;
+
+    struct expression_instruction* fused = calloc(count + inserted + 2, sizeof(struct expression_instruction));
+    uint16_t* remap = malloc((count + 2) * sizeof(uint16_t));
+    bool* starts = calloc(count, sizeof(bool));
+    if (!fused || !remap || !starts) {
+        free(fused);
+        free(remap);
+        free(starts);
+        goto done;
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        if (skip_from[i] >= 0) starts[skip_from[i]] = true;
+    }
+
+    uint16_t position = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        if (starts[i]) position++; // Slot for OP_X_LAND_SC / OP_X_LOR_SC
+        remap[i] = position++;
+    }
+    remap[count] = position;
+    remap[count + 1] = position + 1;
+
+    for (uint16_t i = 0; i < count; i++) {
+        struct expression_instruction insn = code[i];
+        if (expression_is_branch(insn.opcode)) insn.target = remap[insn.target];
+        fused[remap[i]] = insn;
+        if (skip_from[i] < 0) continue;
+
+        // Operand can't consume values below itself, so no two operations share its start
+        struct expression_instruction* skip = &fused[remap[skip_from[i]] - 1];
+        skip->opcode = code[i].opcode == OP_LAND ? OP_X_LAND_SC : OP_X_LOR_SC;
+        skip->target = remap[i + 1];
+    }
+    fused[position] = (struct expression_instruction){.opcode = OP_X_END};
+    fused[position + 1] = (struct expression_instruction){.opcode = OP_X_BADJUMP};
+
+    free(prototype->code);
+    prototype->code = fused;
+    prototype->code_size = position;
+    free(remap);
+    free(starts);
+
+done:
+    free(targeted);
+    free(skip_from);
+}
+
+// Peephole pass over verified program:
+// 1. Fuses byte-wise immediate loads (OP_STORE0-3 + OP_PUSH) into OP_X_PUSHF
+// 2. Folds operations and branches on constants, when every push in the program is a complete immediate,
+//    so no instruction could observe stale stack slots left behind by removed computations
+// 3. Removes unreachable code and optimized out instructions
+// 4. Replaces common sequences with superinstructions
+static void expression_prototype_optimize(struct expression_prototype* prototype)
+{
+    struct expression_instruction* code = prototype->code;
+    uint16_t count = prototype->code_size;
+    bool* targeted = calloc(count + 2, sizeof(bool));
+    bool* reachable = calloc(count + 2, sizeof(bool));
+    uint16_t* worklist = malloc((count + 2) * sizeof(uint16_t));
+    if (!targeted || !reachable || !worklist) goto done;
+
+    // Variables are resolved once, so VM indexes mascot's variables directly
+    for (uint16_t i = 0; i < count; i++) {
+        if (code[i].opcode == OP_LOADL) code[i].operand = prototype->mascot_vars[code[i].operand];
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        if (code[i].opcode == OP_BQZ || code[i].opcode == OP_BNZ || code[i].opcode == OP_JMP) targeted[code[i].target] = true;
+    }
+
+    bool pure = true;
+    for (uint16_t i = 0; i < count; i++) {
+        if (code[i].opcode == OP_STORE0 && i + 4 < count
+            && code[i + 1].opcode == OP_STORE1 && code[i + 2].opcode == OP_STORE2
+            && code[i + 3].opcode == OP_STORE3 && code[i + 4].opcode == OP_PUSH
+            && !expression_targeted(targeted, i, i + 4)) {
+            uint8_t bytes[4] = {code[i].operand, code[i + 1].operand, code[i + 2].operand, code[i + 3].operand};
+            code[i].opcode = OP_X_PUSHF;
+            memcpy(&code[i].value, bytes, sizeof(float));
+            for (uint16_t j = i + 1; j <= i + 4; j++) code[j].opcode = OP_X_NOP;
+            i += 4;
+            continue;
+        }
+        if (code[i].opcode >= OP_STORE0 && code[i].opcode <= OP_STORE3) pure = false;
+        if (code[i].opcode == OP_PUSH) pure = false;
+    }
+
+    for (int32_t i = 0; pure && i < count; i++) {
+        struct expression_instruction* insn = &code[i];
+        int32_t b = expression_previous_live(code, i);
+        if (b < 0 || code[b].opcode != OP_X_PUSHF || expression_targeted(targeted, b, i)) continue;
+
+        float result = 0.0;
+        if (insn->opcode == OP_NOT || insn->opcode == OP_LNOT) {
+            code[b].opcode = OP_X_NOP;
+            insn->value = !((int)code[b].value);
+            insn->opcode = OP_X_PUSHF;
+        } else if (insn->opcode == OP_BQZ || insn->opcode == OP_BNZ) {
+            // Condition stays on the stack either way
+            bool taken = (int)code[b].value ? insn->opcode == OP_BNZ : insn->opcode == OP_BQZ;
+            insn->opcode = taken ? OP_JMP : OP_X_NOP;
+        } else {
+            int32_t a = expression_previous_live(code, b);
+            if (a < 0 || code[a].opcode != OP_X_PUSHF || expression_targeted(targeted, a, b)) continue;
+            if (!expression_fold_binary(insn->opcode, code[a].value, code[b].value, &result)) continue;
+            code[a].opcode = OP_X_NOP;
+            code[b].opcode = OP_X_NOP;
+            insn->value = result;
+            insn->opcode = OP_X_PUSHF;
+        }
+    }
+
+    // Reachability after folding, code behind OP_RET, OP_ERR and taken jumps is dropped
+    uint16_t pending = 0;
+    worklist[pending++] = 0;
+    reachable[0] = true;
+    while (pending) {
+        uint16_t pc = worklist[--pending];
+        uint8_t opcode = code[pc].opcode;
+        uint16_t successors[2];
+        uint8_t successors_count = 0;
+        if (opcode != OP_RET && opcode != OP_ERR && opcode != OP_JMP && pc < count) successors[successors_count++] = pc + 1;
+        if (opcode == OP_BQZ || opcode == OP_BNZ || opcode == OP_JMP) successors[successors_count++] = code[pc].target;
+        for (uint8_t i = 0; i < successors_count; i++) {
+            if (reachable[successors[i]]) continue;
+            reachable[successors[i]] = true;
+            worklist[pending++] = successors[i];
+        }
+    }
+
+    uint16_t kept = expression_compact(code, count, reachable);
+    DEBUG("Expression optimized from %u to %u instructions", count, kept);
+    prototype->code_size = kept;
+
+    // Superinstructions drop pushes as well, so they need the same guarantee as folding
+    if (pure) expression_prototype_fuse(prototype);
+
+done:
+    free(targeted);
+    free(reachable);
+    free(worklist);
+}
+
+static bool expression_read_var(struct expression_prototype* prototype, uint8_t var)
+{
+    for (uint8_t i = 0; i < prototype->read_vars_count; i++) {
+        if (prototype->read_vars[i] == var) return true;
+    }
+    if (prototype->read_vars_count == EXPRESSION_CACHE_VARS) return false;
+    prototype->read_vars[prototype->read_vars_count++] = var;
+    return true;
+}
+
+// Read set of optimized program: variables it loads and sources symbols it calls depend on.
+// Programs reading volatile sources or too many variables are always executed
+static void expression_prototype_collect_reads(struct expression_prototype* prototype)
+{
+    bool fits = true;
+    prototype->reads = EXPRESSION_SOURCE_NONE;
+    prototype->read_vars_count = 0;
+
+    for (uint16_t i = 0; i < prototype->code_size; i++) {
+        const struct expression_instruction* insn = &prototype->code[i];
+        if (insn->opcode == OP_LOADL
+            || (insn->opcode >= OP_X_LT_VAR && insn->opcode <= OP_X_NE_VAR)
+            || (insn->opcode >= OP_X_VAR_LTK && insn->opcode <= OP_X_VAR_NEK)) {
+            fits &= expression_read_var(prototype, insn->operand);
+        } else if (insn->opcode == OP_LOADE) {
+            prototype->reads |= prototype->global_getters_effects[insn->operand].reads;
+        } else if (insn->opcode == OP_CALL) {
+            prototype->reads |= prototype->function_ptrs_effects[insn->operand].reads;
+        }
+    }
+    if (prototype->reads & EXPRESSION_SOURCE_POSITION) {
+        fits &= expression_read_var(prototype, MASCOT_LOCAL_VARIABLE_X_ID);
+        fits &= expression_read_var(prototype, MASCOT_LOCAL_VARIABLE_Y_ID);
+    }
+    prototype->memoizable = fits && !(prototype->reads & EXPRESSION_SOURCE_VOLATILE);
+}
+
+// Memoized result is valid if program reads nothing that changed since it was stored
+static bool expression_cache_valid(const struct expression_prototype* prototype, const struct mascot* mascot, const struct expression_cache_entry* entry, uint32_t environment_version, uint32_t population_version)
+{
+    if (entry->program != prototype) return false;
+    if (prototype->reads & EXPRESSION_SOURCE_ENVIRONMENT) {
+        if (entry->environment != mascot->environment || entry->environment_version != environment_version) return false;
+    }
+    if ((prototype->reads & EXPRESSION_SOURCE_POPULATION) && entry->population_version != population_version) return false;
+    for (uint8_t i = 0; i < prototype->read_vars_count; i++) {
+        if (memcmp(&entry->vars[i], &mascot->local_variables[prototype->read_vars[i]].value, sizeof(uint32_t))) return false;
+    }
     return true;
 }
 
+// Records inputs of mascot, result is filled in once program is executed
+static void expression_cache_snapshot(const struct expression_prototype* prototype, const struct mascot* mascot, struct expression_cache_entry* entry, uint32_t environment_version, uint32_t population_version)
+{
+    entry->program = prototype;
+    entry->environment = mascot->environment;
+    entry->environment_version = environment_version;
+    entry->population_version = population_version;
+    for (uint8_t i = 0; i < prototype->read_vars_count; i++) {
+        memcpy(&entry->vars[i], &mascot->local_variables[prototype->read_vars[i]].value, sizeof(uint32_t));
+    }
+}
+
+static void expression_cache_store(const struct expression_prototype* prototype, const struct mascot* mascot, struct expression_cache_entry* entry, uint32_t environment_version, uint32_t population_version, float result)
+{
+    expression_cache_snapshot(prototype, mascot, entry, environment_version, population_version);
+    entry->result = result;
+}
+
+// Arena memory is handed out from chunks of this size, larger programs get chunk of their own
+#define EXPRESSION_ARENA_CHUNK_SIZE 16384
+
+struct expression_arena_chunk {
+    struct expression_arena_chunk* next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+};
+
+struct expression_arena {
+    struct expression_arena_chunk* chunks;
+    struct expression_prototype** programs; // Open addressing by hash, NULL slots are empty
+    uint32_t programs_capacity; // Power of two
+    uint32_t programs_count;
+};
+
+struct expression_arena* expression_arena_new()
+{
+    return calloc(1, sizeof(struct expression_arena));
+}
+
+void expression_arena_free(struct expression_arena* arena)
+{
+    if (!arena) return;
+    for (uint32_t i = 0; i < arena->programs_capacity; i++) {
+        if (arena->programs[i]) expression_jit_free(arena->programs[i]->jit);
+    }
+    free(arena->programs);
+    while (arena->chunks) {
+        struct expression_arena_chunk* next = arena->chunks->next;
+        free(arena->chunks);
+        arena->chunks = next;
+    }
+    free(arena);
+}
+
+static void* expression_arena_alloc(struct expression_arena* arena, size_t size)
+{
+    size = (size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+    struct expression_arena_chunk* chunk = arena->chunks;
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t chunk_size = size > EXPRESSION_ARENA_CHUNK_SIZE ? size : EXPRESSION_ARENA_CHUNK_SIZE;
+        chunk = malloc(sizeof(struct expression_arena_chunk) + chunk_size);
+        if (!chunk) return NULL;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+    void* memory = (uint8_t*)chunk->data + chunk->used;
+    chunk->used += size;
+    return memory;
+}
+
+// Copies table into arena. Empty tables are never indexed, verifier rejects references past their size
+static void* expression_arena_copy(struct expression_arena* arena, const void* data, size_t size, bool* ok)
+{
+    if (!size) return NULL;
+    void* copy = expression_arena_alloc(arena, size);
+    if (!copy) {
+        *ok = false;
+        return NULL;
+    }
+    memcpy(copy, data, size);
+    return copy;
+}
+
+#define EXPRESSION_HASH(hash, data, size) \
+{ \
+    const uint8_t* bytes = (const uint8_t*)(data); \
+    for (size_t i = 0; i < (size); i++) hash = (hash ^ bytes[i]) * 16777619u; \
+    hash = (hash ^ 0xFF) * 16777619u; \
+}
+
+// FNV-1a of everything program's behavior depends on, tables are terminated so their boundaries matter
+static uint32_t expression_source_hash(const struct expression_source* source)
+{
+    uint32_t hash = 2166136261u;
+    EXPRESSION_HASH(hash, source->bytecode, source->bytecode_size);
+    EXPRESSION_HASH(hash, source->mascot_vars, source->mascot_vars_size);
+    EXPRESSION_HASH(hash, source->global_getters, source->global_getters_size * sizeof(void*));
+    EXPRESSION_HASH(hash, source->global_getters_effects, source->global_getters_size * sizeof(struct expression_stack_effect));
+    EXPRESSION_HASH(hash, source->function_ptrs, source->function_ptrs_size * sizeof(void*));
+    EXPRESSION_HASH(hash, source->function_ptrs_effects, source->function_ptrs_size * sizeof(struct expression_stack_effect));
+    return hash;
+}
+
+static bool expression_source_equal(const struct expression_prototype* prototype, const struct expression_source* source)
+{
+    if (prototype->bytecode_size != source->bytecode_size) return false;
+    if (prototype->mascot_vars_size != source->mascot_vars_size) return false;
+    if (prototype->global_getters_size != source->global_getters_size) return false;
+    if (prototype->function_ptrs_size != source->function_ptrs_size) return false;
+    if (memcmp(prototype->bytecode, source->bytecode, source->bytecode_size)) return false;
+    if (source->mascot_vars_size && memcmp(prototype->mascot_vars, source->mascot_vars, source->mascot_vars_size)) return false;
+    if (source->global_getters_size) {
+        if (memcmp(prototype->global_getters, source->global_getters, source->global_getters_size * sizeof(void*))) return false;
+        if (memcmp(prototype->global_getters_effects, source->global_getters_effects, source->global_getters_size * sizeof(struct expression_stack_effect))) return false;
+    }
+    if (source->function_ptrs_size) {
+        if (memcmp(prototype->function_ptrs, source->function_ptrs, source->function_ptrs_size * sizeof(void*))) return false;
+        if (memcmp(prototype->function_ptrs_effects, source->function_ptrs_effects, source->function_ptrs_size * sizeof(struct expression_stack_effect))) return false;
+    }
+    return true;
+}
+
+static struct expression_prototype* expression_arena_find(const struct expression_arena* arena, uint32_t hash, const struct expression_source* source)
+{
+    if (!arena->programs_capacity) return NULL;
+    uint32_t mask = arena->programs_capacity - 1;
+    for (uint32_t i = hash & mask; arena->programs[i]; i = (i + 1) & mask) {
+        if (arena->programs[i]->hash == hash && expression_source_equal(arena->programs[i], source)) return arena->programs[i];
+    }
+    return NULL;
+}
+
+// Keeps table at most half full, so probing always finds an empty slot
+static bool expression_arena_reserve(struct expression_arena* arena)
+{
+    if ((arena->programs_count + 1) * 2 <= arena->programs_capacity) return true;
+
+    uint32_t capacity = arena->programs_capacity ? arena->programs_capacity * 2 : 64;
+    struct expression_prototype** programs = calloc(capacity, sizeof(struct expression_prototype*));
+    if (!programs) return false;
+    for (uint32_t i = 0; i < arena->programs_capacity; i++) {
+        struct expression_prototype* program = arena->programs[i];
+        if (!program) continue;
+        uint32_t j = program->hash & (capacity - 1);
+        while (programs[j]) j = (j + 1) & (capacity - 1);
+        programs[j] = program;
+    }
+    free(arena->programs);
+    arena->programs = programs;
+    arena->programs_capacity = capacity;
+    return true;
+}
+
+struct expression_prototype* expression_arena_load(struct expression_arena* arena, const struct expression_source* source)
+{
+    if (!arena || !source) return NULL;
+    if (!source->bytecode || !source->bytecode_size) return NULL;
+    // Instructions are two bytes, trailing half of one would be read past the end
+    if (source->bytecode_size % 2) return NULL;
+
+    uint32_t hash = expression_source_hash(source);
+    struct expression_prototype* existing = expression_arena_find(arena, hash, source);
+    if (existing) return existing;
+
+    // Program is decoded and optimized outside of arena first, so rejected programs leave nothing behind
+    struct expression_prototype scratch = {
+        .hash = hash,
+        .bytecode = source->bytecode, .bytecode_size = source->bytecode_size,
+        .mascot_vars = source->mascot_vars, .mascot_vars_size = source->mascot_vars_size,
+        .global_getters = source->global_getters, .global_getters_effects = source->global_getters_effects,
+        .global_getters_size = source->global_getters_size,
+        .function_ptrs = source->function_ptrs, .function_ptrs_effects = source->function_ptrs_effects,
+        .function_ptrs_size = source->function_ptrs_size,
+    };
+    if (!expression_prototype_decode(&scratch)) return NULL;
+    if (!expression_prototype_verify(&scratch)) {
+        free(scratch.code);
+        return NULL;
+    }
+    expression_prototype_optimize(&scratch);
+    expression_prototype_collect_reads(&scratch);
+
+    bool ok = expression_arena_reserve(arena);
+    struct expression_prototype* prototype = ok ? expression_arena_alloc(arena, sizeof(struct expression_prototype)) : NULL;
+    if (prototype) {
+        *prototype = scratch;
+        prototype->id = arena->programs_count;
+        prototype->bytecode = expression_arena_copy(arena, source->bytecode, source->bytecode_size, &ok);
+        prototype->mascot_vars = expression_arena_copy(arena, source->mascot_vars, source->mascot_vars_size, &ok);
+        prototype->global_getters = expression_arena_copy(arena, source->global_getters, source->global_getters_size * sizeof(void*), &ok);
+        prototype->global_getters_effects = expression_arena_copy(arena, source->global_getters_effects, source->global_getters_size * sizeof(struct expression_stack_effect), &ok);
+        prototype->function_ptrs = expression_arena_copy(arena, source->function_ptrs, source->function_ptrs_size * sizeof(void*), &ok);
+        prototype->function_ptrs_effects = expression_arena_copy(arena, source->function_ptrs_effects, source->function_ptrs_size * sizeof(struct expression_stack_effect), &ok);
+        // Decoded program is terminated by OP_X_END and OP_X_BADJUMP
+        prototype->code = expression_arena_copy(arena, scratch.code, (scratch.code_size + 2) * sizeof(struct expression_instruction), &ok);
+    }
+    free(scratch.code);
+    if (!prototype || !ok) {
+        WARN("Failed to allocate memory for expression");
+        return NULL;
+    }
+
+    uint32_t mask = arena->programs_capacity - 1;
+    uint32_t slot = hash & mask;
+    while (arena->programs[slot]) slot = (slot + 1) & mask;
+    arena->programs[slot] = prototype;
+    arena->programs_count++;
+
+    if (config_get_expression_jit()) prototype->jit = expression_jit_compile(prototype);
+    return prototype;
+}
+
 #define FAIL(message) \
 { \
     state.error_message = message ; \
     goto vmfail; \
 }\
 
+#ifdef EXPRESSION_VM_THREADED
+#define VM_CASE(op) label_##op:
+#define VM_DEFAULT label_default:
+#define VM_NEXT() \
+{ \
+    executed++; \
+    insn = &code[pc++]; \
+    goto *dispatch_table[insn->opcode]; \
+}
+#else
+#define VM_CASE(op) case op:
+#define VM_DEFAULT default:
+#define VM_NEXT() continue
+#endif
+
+// Handlers don't check stack bounds and symbol indices, verifier guarantees them for every loaded program
+#define VM_BINARY_OP(expr) \
+{ \
+    float a = state.stack[state.sp - 2]; \
+    float b = state.stack[state.sp - 1]; \
+    state.stack[state.sp - 2] = (expr); \
+    state.sp--; \
+    VM_NEXT(); \
+}
 
-enum expression_execution_result expression_vm_execute(struct expression_prototype* prototype, struct mascot* mascot, float* execution_result)
+#define VM_LOAD_VAR(destination, index) \
+{ \
+    struct mascot_local_variable* var = &mascot->local_variables[(index)]; \
+    if (var->kind == mascot_local_variable_int) { \
+        destination = (float)var->value.i; \
+    } else if (var->kind == mascot_local_variable_float) { \
+        destination = var->value.f; \
+    } else { \
+        FAIL("Unknown variable type"); \
+    } \
+}
+
+// Top of the stack with immediate
+#define VM_BINARY_K(expr) \
+{ \
+    float a = state.stack[state.sp - 1]; \
+    float b = insn->value; \
+    state.stack[state.sp - 1] = (expr); \
+    VM_NEXT(); \
+}
+
+// Top of the stack with variable
+#define VM_BINARY_VAR(expr) \
+{ \
+    float a = state.stack[state.sp - 1]; \
+    float b = 0.0; \
+    VM_LOAD_VAR(b, insn->operand); \
+    state.stack[state.sp - 1] = (expr); \
+    VM_NEXT(); \
+}
+
+// Variable with immediate, result is pushed
+#define VM_VAR_BINARY_K(expr) \
+{ \
+    float a = 0.0; \
+    VM_LOAD_VAR(a, insn->operand); \
+    float b = insn->value; \
+    state.stack[state.sp++] = (expr); \
+    VM_NEXT(); \
+}
+
+#define VM_STORE_BYTE(n) \
+{ \
+    *((uint8_t*)(&state.stack[state.sp])+(n)) = insn->operand; \
+    VM_NEXT(); \
+}
+
+void expression_vm_prefetch(struct expression_prototype* prototype, struct mascot* const* mascots, uint32_t count)
 {
-    if (!prototype) return EXPRESSION_EXECUTION_ERROR;
-    if (!mascot) return EXPRESSION_EXECUTION_ERROR;
+    if (!prototype || !prototype->code || !mascots) return;
+    if (!prototype->memoizable) return;
+
+    uint32_t environment_version = __atomic_load_n(&expression_environment_version, __ATOMIC_RELAXED);
+    uint32_t population_version = __atomic_load_n(&expression_population_version, __ATOMIC_RELAXED);
+    struct mascot* lanes[EXPRESSION_BATCH_LANES];
+    float results[EXPRESSION_BATCH_LANES];
+    uint8_t lanes_count = 0;
+
+    // Lanes stay locked from validation until result is stored, so it is keyed on the inputs it was computed from.
+    // Only try-locks are taken while holding others, mascot that is busy is skipped and evaluated on its own tick
+    for (uint32_t i = 0; i < count || lanes_count; i++) {
+        if (i < count) {
+            struct mascot* mascot = mascots[i];
+            if (pthread_mutex_trylock(&mascot->tick_lock)) continue;
+            if (expression_cache_valid(prototype, mascot, &mascot->expression_cache[prototype->id % EXPRESSION_CACHE_SIZE], environment_version, population_version)) {
+                pthread_mutex_unlock(&mascot->tick_lock);
+                continue;
+            }
+            lanes[lanes_count++] = mascot;
+            if (lanes_count < EXPRESSION_BATCH_LANES) continue;
+        }
+        uint32_t done = expression_batch_execute(prototype, lanes, lanes_count, results);
+        for (uint8_t l = 0; l < lanes_count; l++) {
+            struct mascot* mascot = lanes[l];
+            if ((done >> l) & 1) {
+                expression_cache_store(prototype, mascot, &mascot->expression_cache[prototype->id % EXPRESSION_CACHE_SIZE], environment_version, population_version, results[l]);
+            }
+            pthread_mutex_unlock(&mascot->tick_lock);
+        }
+        lanes_count = 0;
+    }
+}
+
+// Executes program, counting instructions interpreted to *instructions
+static enum expression_execution_result expression_vm_run(struct expression_prototype* prototype, struct mascot* mascot, float* execution_result, uint32_t* instructions)
+{
+    uint32_t executed = 0;
+
+    // Inputs are snapshotted before execution, so changes made meanwhile invalidate stored result
+    struct expression_cache_entry* entry = NULL;
+    uint32_t environment_version = 0, population_version = 0;
+    if (prototype->memoizable) {
+        entry = &mascot->expression_cache[prototype->id % EXPRESSION_CACHE_SIZE];
+        environment_version = __atomic_load_n(&expression_environment_version, __ATOMIC_RELAXED);
+        population_version = __atomic_load_n(&expression_population_version, __ATOMIC_RELAXED);
+        if (expression_cache_valid(prototype, mascot, entry, environment_version, population_version)) {
+            *execution_result = entry->result;
+            return EXPRESSION_EXECUTION_OK;
+        }
+    }
 
     DEBUG("EXECUTING EXPRESSIONS VM: bytecode size = %d, vars_size = %d, globals_size = %d", prototype->bytecode_size, prototype->mascot_vars_size, prototype->global_getters_size);
     DEBUG(",   functions_size = %d, id = %d", prototype->function_ptrs_size, prototype->id);
 
-    // Prepare the VM
-    struct expression_vm_state state = {};
-    state.stack[0] = 0.0;
+    // Prepare the VM. Only slots the program may reach have to be cleared
+    struct expression_vm_state state;
+    memset(state.stack, 0, (prototype->max_stack + 1) * sizeof(float));
     state.sp = 1;
     state.ip = 0;
     state.ref_mascot = mascot;
-#ifdef DEBUG
-    struct timespec start, end;
-    uint16_t opcode_count = 0;
-    clock_gettime(CLOCK_MONOTONIC, &start);
-#endif
-    uint8_t opcode = OP_ERR;
-    float freg0 = 0.0, freg1 = 0.0;
-    uint8_t immoperand = 0;
-    uint8_t offsetr = 0;
-    uint8_t indexr = 0;
-    global_getter ptrr = NULL;
+    state.error_message = NULL;
+    const struct expression_instruction* code = prototype->code;
+    const struct expression_instruction* insn = code;
+    uint16_t pc = 0;
+    global_getter getter = NULL;
+
+    if (prototype->jit) {
+        if (prototype->jit->function(&state, execution_result)) {
+            if (entry) expression_cache_store(prototype, mascot, entry, environment_version, population_version, *execution_result);
+            return EXPRESSION_EXECUTION_OK;
+        }
+        // Native code leaves state as VM would, so failure is traced the same way
+        pc = state.ip;
+        insn = &code[pc - 1];
+        goto vmfail;
+    }
+
+#ifdef EXPRESSION_VM_THREADED
+    static const void* const dispatch_table[256] = {
+        [OP_ERR] = &&label_OP_ERR, [OP_RET] = &&label_OP_RET,
+        [OP_LOADL] = &&label_OP_LOADL, [OP_LOADE] = &&label_OP_LOADE,
+        [OP_STORE0] = &&label_OP_STORE0, [OP_STORE1] = &&label_OP_STORE1,
+        [OP_STORE2] = &&label_OP_STORE2, [OP_STORE3] = &&label_OP_STORE3,
+        [OP_ADD] = &&label_OP_ADD, [OP_SUB] = &&label_OP_SUB, [OP_MUL] = &&label_OP_MUL,
+        [OP_DIV] = &&label_OP_DIV, [OP_MOD] = &&label_OP_MOD, [OP_POW] = &&label_OP_POW,
+        [OP_AND] = &&label_OP_AND, [OP_OR] = &&label_OP_OR, [OP_XOR] = &&label_OP_XOR,
+        [OP_NOT] = &&label_OP_NOT, [OP_SHL] = &&label_OP_SHL, [OP_SHR] = &&label_OP_SHR,
+        [OP_LT] = &&label_OP_LT, [OP_LE] = &&label_OP_LE, [OP_GT] = &&label_OP_GT,
+        [OP_GE] = &&label_OP_GE, [OP_EQ] = &&label_OP_EQ, [OP_NE] = &&label_OP_NE,
+        [OP_LAND] = &&label_OP_LAND, [OP_LOR] = &&label_OP_LOR, [OP_LNOT] = &&label_OP_LNOT,
+        [OP_BQZ] = &&label_OP_BQZ, [OP_BNZ] = &&label_OP_BNZ, [OP_JMP] = &&label_OP_JMP,
+        [OP_CALL] = &&label_OP_CALL,
+        [OP_PUSH] = &&label_OP_PUSH,
+        [OP_X_NOP] = &&label_default, [OP_X_END] = &&label_OP_X_END, [OP_X_BADJUMP] = &&label_OP_X_BADJUMP,
+        [OP_X_PUSHF] = &&label_OP_X_PUSHF,
+        [OP_X_ADDK] = &&label_OP_X_ADDK, [OP_X_SUBK] = &&label_OP_X_SUBK,
+        [OP_X_MULK] = &&label_OP_X_MULK, [OP_X_DIVK] = &&label_OP_X_DIVK,
+        [OP_X_LTK] = &&label_OP_X_LTK, [OP_X_LEK] = &&label_OP_X_LEK, [OP_X_GTK] = &&label_OP_X_GTK,
+        [OP_X_GEK] = &&label_OP_X_GEK, [OP_X_EQK] = &&label_OP_X_EQK, [OP_X_NEK] = &&label_OP_X_NEK,
+        [OP_X_LT_VAR] = &&label_OP_X_LT_VAR, [OP_X_LE_VAR] = &&label_OP_X_LE_VAR, [OP_X_GT_VAR] = &&label_OP_X_GT_VAR,
+        [OP_X_GE_VAR] = &&label_OP_X_GE_VAR, [OP_X_EQ_VAR] = &&label_OP_X_EQ_VAR, [OP_X_NE_VAR] = &&label_OP_X_NE_VAR,
+        [OP_X_VAR_LTK] = &&label_OP_X_VAR_LTK, [OP_X_VAR_LEK] = &&label_OP_X_VAR_LEK, [OP_X_VAR_GTK] = &&label_OP_X_VAR_GTK,
+        [OP_X_VAR_GEK] = &&label_OP_X_VAR_GEK, [OP_X_VAR_EQK] = &&label_OP_X_VAR_EQK, [OP_X_VAR_NEK] = &&label_OP_X_VAR_NEK,
+        [OP_X_LAND_SC] = &&label_OP_X_LAND_SC, [OP_X_LOR_SC] = &&label_OP_X_LOR_SC,
+    };
+
+    // Execute the VM
+    VM_NEXT();
+#else
     // Execute the VM
-    while (state.ip < prototype->bytecode_size)
-    {
-#ifdef DEBUG
-        ++opcode_count;
+    for (;;) {
+        executed++;
+        insn = &code[pc++];
+        switch (insn->opcode) {
 #endif
-        opcode = prototype->bytecode[state.ip++];
-        immoperand = prototype->bytecode[state.ip++];
-        freg0 = 0.0;
-        freg1 = 0.0;
-        offsetr = 0;
-        indexr = 0;
-        ptrr = NULL;
-        switch (opcode) {
-            case OP_ERR:
+            VM_CASE(OP_ERR)
                 *execution_result = 0.0;
                 FAIL("Program aborted execution using OP_ERR or unbound jump is occured");
-            case OP_RET:
-                if (state.sp < 1) FAIL("Stack underflow");
+            VM_CASE(OP_RET)
+            {
                 *execution_result = state.stack[state.sp - 1];
-#ifdef DEBUG
-                clock_gettime(CLOCK_MONOTONIC, &end);
-                long seconds = end.tv_sec - start.tv_sec;
-                long ns = end.tv_nsec - start.tv_nsec;
-                if (start.tv_nsec > end.tv_nsec) { // clock underflow
-                    --seconds;
-                    ns += 1000000000;
-                }
-                DEBUG("OP_RET: Executed %u instructions in %ld.%09ld seconds, execution result: %f", opcode_count, seconds, ns, *execution_result);
-#endif
+                *instructions = executed;
+                DEBUG("OP_RET: Executed %u instructions, execution result: %f", executed, *execution_result);
+                if (entry) expression_cache_store(prototype, mascot, entry, environment_version, population_version, *execution_result);
                 return EXPRESSION_EXECUTION_OK;
+            }
 
-            case OP_LOADL:
-                if (state.sp >= 255) FAIL("Stack overflow");
-                indexr = immoperand;
-                if (indexr > prototype->mascot_vars_size) FAIL("Trying to access out of bounds variable");
-                indexr = prototype->mascot_vars[indexr];
-                if (indexr > mascot->prototype->local_variables_count) FAIL("Variable points towards non existing local variable");
-                struct mascot_local_variable* var = &mascot->local_variables[indexr];
-
-                if (var->kind == mascot_local_variable_int) {
-                    state.stack[state.sp] = (float)var->value.i;
-                } else if (var->kind == mascot_local_variable_float) {
-                    state.stack[state.sp] = var->value.f;
-                } else {
-                    FAIL("Unknown variable type");
-                }
+            VM_CASE(OP_LOADL)
+                VM_LOAD_VAR(state.stack[state.sp], insn->operand);
                 state.sp++;
-                break;
-            case OP_LOADE:
-                if (state.sp >= 255) FAIL("Stack overflow");
-                indexr = immoperand;
-                if (indexr > prototype->global_getters_size) FAIL("Trying to access out of bounds global variable");
-                ptrr = prototype->global_getters[indexr];
-                if (!ptrr) FAIL("Global variable not found");
-                if (!ptrr(&state)) goto vmfail;
-                break;
-
-            case OP_ADD:
-                if (state.sp < 3) FAIL("Stack underflow");
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = freg0 + freg1;
-                state.sp--;
-                break;
-            case OP_SUB:
-                if (state.sp < 3) FAIL("Stack underflow");
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = freg0 - freg1;
-                state.sp--;
+                VM_NEXT();
+            VM_CASE(OP_LOADE)
+                getter = prototype->global_getters[insn->operand];
+                if (!getter(&state)) goto vmfail;
+                VM_NEXT();
 
-                break;
-            case OP_MUL:
-                if (state.sp < 3) FAIL("Stack underflow");
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = freg0 * freg1;
-                state.sp--;
-                break;
-            case OP_DIV:
-                if (state.sp < 3) FAIL("Stack underflow");
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = freg0 / freg1;
-                state.sp--;
-                break;
-            case OP_MOD:
-                if (state.sp < 3) FAIL("Stack underflow");
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = fmodf(freg0, freg1);
-                state.sp--;
-                break;
-            case OP_POW:
-                if (state.sp < 3) FAIL("Stack underflow");
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = powf(freg0, freg1);
-                state.sp--;
-                break;
+            VM_CASE(OP_ADD) VM_BINARY_OP(a + b)
+            VM_CASE(OP_SUB) VM_BINARY_OP(a - b)
+            VM_CASE(OP_MUL) VM_BINARY_OP(a * b)
+            VM_CASE(OP_DIV) VM_BINARY_OP(a / b)
+            VM_CASE(OP_MOD) VM_BINARY_OP(fmodf(a, b))
+            VM_CASE(OP_POW) VM_BINARY_OP(powf(a, b))
 
-            case OP_AND:
-                if (state.sp < 3) FAIL("Stack underflow");
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = ((int)freg0) & ((int)freg1);
-                state.sp--;
-                break;
-            case OP_OR:
-                if (state.sp < 3) FAIL("Stack underflow");
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = ((int)freg0) | ((int)freg1);
-                state.sp--;
-                break;
-            case OP_XOR:
-                if (state.sp < 3) FAIL("Stack underflow");
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = ((int)freg0) ^ ((int)freg1);
-                state.sp--;
-                break;
-            case OP_NOT:
-                if (state.sp < 2) FAIL("Stack underflow");
-                freg0 = state.stack[state.sp - 1];
-                state.stack[state.sp - 1] = !((int)freg0);
-                break;
-            case OP_SHL:
-                if (state.sp < 3)
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = ((int)freg0) << ((int)freg1);
-                state.sp--;
-                break;
-            case OP_SHR:
-                if (state.sp < 3) FAIL("Stack underflow");
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = ((int)freg0) >> ((int)freg1);
-                state.sp--;
-                break;
+            VM_CASE(OP_AND) VM_BINARY_OP(((int)a) & ((int)b))
+            VM_CASE(OP_OR) VM_BINARY_OP(((int)a) | ((int)b))
+            VM_CASE(OP_XOR) VM_BINARY_OP(((int)a) ^ ((int)b))
+            VM_CASE(OP_NOT)
+                state.stack[state.sp - 1] = !((int)state.stack[state.sp - 1]);
+                VM_NEXT();
+            VM_CASE(OP_SHL) VM_BINARY_OP(((int)a) << ((int)b))
+            VM_CASE(OP_SHR) VM_BINARY_OP(((int)a) >> ((int)b))
 
-            case OP_LT:
-                if (state.sp < 3) FAIL("Stack underflow");
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = freg0 < freg1;
-                state.sp--;
-                break;
-            case OP_LE:
-                if (state.sp < 3) FAIL("Stack underflow")
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = freg0 <= freg1;
-                state.sp--;
-                break;
-            case OP_GT:
-                if (state.sp < 3) FAIL("Stack underflow")
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = freg0 > freg1;
-                state.sp--;
-                break;
-            case OP_GE:
-                if (state.sp < 3) FAIL("Stack underflow")
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = freg0 >= freg1;
-                state.sp--;
-                break;
-            case OP_EQ:
-                if (state.sp < 3) FAIL("Stack underflow")
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = freg0 == freg1;
-                state.sp--;
-                break;
-            case OP_NE:
-                if (state.sp < 3) FAIL("Stack underflow")
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = freg0 != freg1;
-                state.sp--;
-                break;
+            VM_CASE(OP_LT) VM_BINARY_OP(a < b)
+            VM_CASE(OP_LE) VM_BINARY_OP(a <= b)
+            VM_CASE(OP_GT) VM_BINARY_OP(a > b)
+            VM_CASE(OP_GE) VM_BINARY_OP(a >= b)
+            VM_CASE(OP_EQ) VM_BINARY_OP(a == b)
+            VM_CASE(OP_NE) VM_BINARY_OP(a != b)
 
-            case OP_LAND:
-                if (state.sp < 3) FAIL("Stack underflow")
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = ((int)freg0) && ((int)freg1);
-                state.sp--;
-                break;
-            case OP_LOR:
-                if (state.sp < 3) FAIL("Stack underflow")
-                freg0 = state.stack[state.sp - 2];
-                freg1 = state.stack[state.sp - 1];
-                state.stack[state.sp - 2] = ((int)freg0) || ((int)freg1);
-                state.sp--;
-                break;
-            case OP_LNOT:
-                if (state.sp < 2) FAIL("Stack underflow")
-                freg0 = state.stack[state.sp - 1];
-                state.stack[state.sp - 1] = !((int)freg0);
-                break;
+            VM_CASE(OP_LAND) VM_BINARY_OP(((int)a) && ((int)b))
+            VM_CASE(OP_LOR) VM_BINARY_OP(((int)a) || ((int)b))
+            VM_CASE(OP_LNOT)
+                state.stack[state.sp - 1] = !((int)state.stack[state.sp - 1]);
+                VM_NEXT();
 
-            case OP_BQZ:
-                if (state.sp < 2) FAIL("Stack underflow")
-                freg0 = state.stack[state.sp - 1];
-                if (!(int)freg0) {
-                    offsetr = immoperand;
-                    if (state.ip + offsetr > prototype->bytecode_size) FAIL("Jump beyond bytecode size");
-                    state.ip += offsetr;
-                    break;
-                }
-                break;
-            case OP_BNZ:
-                if (state.sp < 2) FAIL("Stack underflow")
-                freg0 = state.stack[state.sp - 1];
-                if ((int)freg0) {
-                    offsetr = immoperand;
-                    if (state.ip + offsetr > prototype->bytecode_size) FAIL("Jump beyond bytecode size");
-                    state.ip += offsetr;
-                    break;
-                }
-                break;
-            case OP_JMP:
-                offsetr = immoperand;
-                if (state.ip + offsetr > prototype->bytecode_size) FAIL("Jump beyond bytecode size");
-                state.ip += offsetr;
-                break;
+            // Branches do not pop the condition
+            VM_CASE(OP_BQZ)
+                if (!(int)state.stack[state.sp - 1]) pc = insn->target;
+                VM_NEXT();
+            VM_CASE(OP_BNZ)
+                if ((int)state.stack[state.sp - 1]) pc = insn->target;
+                VM_NEXT();
+            VM_CASE(OP_JMP)
+                pc = insn->target;
+                VM_NEXT();
 
-            case OP_CALL:
-                if (state.sp < 1) FAIL("Stack underflow")
-                indexr = immoperand;
-                if (indexr > prototype->function_ptrs_size) FAIL("Function index out of bounds");
-                if (prototype->function_ptrs[indexr] == NULL) FAIL("Function is not found");
-                ptrr = prototype->function_ptrs[indexr];
-                if (!ptrr(&state)) goto vmfail;
-                break;
+            VM_CASE(OP_CALL)
+                getter = prototype->function_ptrs[insn->operand];
+                if (!getter(&state)) goto vmfail;
+                VM_NEXT();
 
-            case OP_STORE0:
-                if (state.sp >= 255) FAIL("Stack overflow");
-                *(uint8_t*)(&state.stack[state.sp]) = immoperand;
-                break;
-            case OP_STORE1:
-                if (state.sp >= 255) FAIL("Stack overflow")
-                *((uint8_t*)(&state.stack[state.sp])+1) = immoperand;
-                break;
-            case OP_STORE2:
-                if (state.sp >= 255) FAIL("Stack overflow")
-                *((uint8_t*)(&state.stack[state.sp])+2) = immoperand;
-                break;
-            case OP_STORE3:
-                if (state.sp >= 255) FAIL("Stack overflow")
-                *((uint8_t*)(&state.stack[state.sp])+3) = immoperand;
-                break;
+            VM_CASE(OP_STORE0) VM_STORE_BYTE(0)
+            VM_CASE(OP_STORE1) VM_STORE_BYTE(1)
+            VM_CASE(OP_STORE2) VM_STORE_BYTE(2)
+            VM_CASE(OP_STORE3) VM_STORE_BYTE(3)
 
-            case OP_PUSH:
-                if (state.sp >= 255) FAIL("Stack overflow")
+            VM_CASE(OP_PUSH)
                 state.sp++;
-                break;
+                VM_NEXT();
+            VM_CASE(OP_X_PUSHF)
+                state.stack[state.sp++] = insn->value;
+                VM_NEXT();
+
+            VM_CASE(OP_X_ADDK) VM_BINARY_K(a + b)
+            VM_CASE(OP_X_SUBK) VM_BINARY_K(a - b)
+            VM_CASE(OP_X_MULK) VM_BINARY_K(a * b)
+            VM_CASE(OP_X_DIVK) VM_BINARY_K(a / b)
+            VM_CASE(OP_X_LTK) VM_BINARY_K(a < b)
+            VM_CASE(OP_X_LEK) VM_BINARY_K(a <= b)
+            VM_CASE(OP_X_GTK) VM_BINARY_K(a > b)
+            VM_CASE(OP_X_GEK) VM_BINARY_K(a >= b)
+            VM_CASE(OP_X_EQK) VM_BINARY_K(a == b)
+            VM_CASE(OP_X_NEK) VM_BINARY_K(a != b)
 
+            VM_CASE(OP_X_LT_VAR) VM_BINARY_VAR(a < b)
+            VM_CASE(OP_X_LE_VAR) VM_BINARY_VAR(a <= b)
+            VM_CASE(OP_X_GT_VAR) VM_BINARY_VAR(a > b)
+            VM_CASE(OP_X_GE_VAR) VM_BINARY_VAR(a >= b)
+            VM_CASE(OP_X_EQ_VAR) VM_BINARY_VAR(a == b)
+            VM_CASE(OP_X_NE_VAR) VM_BINARY_VAR(a != b)
+
+            VM_CASE(OP_X_VAR_LTK) VM_VAR_BINARY_K(a < b)
+            VM_CASE(OP_X_VAR_LEK) VM_VAR_BINARY_K(a <= b)
+            VM_CASE(OP_X_VAR_GTK) VM_VAR_BINARY_K(a > b)
+            VM_CASE(OP_X_VAR_GEK) VM_VAR_BINARY_K(a >= b)
+            VM_CASE(OP_X_VAR_EQK) VM_VAR_BINARY_K(a == b)
+            VM_CASE(OP_X_VAR_NEK) VM_VAR_BINARY_K(a != b)
+
+            // Result of skipped operation is what OP_LAND / OP_LOR would have produced
+            VM_CASE(OP_X_LAND_SC)
+                if (!(int)state.stack[state.sp - 1]) {
+                    state.stack[state.sp - 1] = 0;
+                    pc = insn->target;
+                }
+                VM_NEXT();
+            VM_CASE(OP_X_LOR_SC)
+                if ((int)state.stack[state.sp - 1]) {
+                    state.stack[state.sp - 1] = 1;
+                    pc = insn->target;
+                }
+                VM_NEXT();
+
+            // Unreachable in verified programs
+            VM_CASE(OP_X_END)
+                FAIL("Reached end of bytecode without OP_RET");
+            VM_CASE(OP_X_BADJUMP)
+                FAIL("Jump beyond bytecode size");
+
+            VM_DEFAULT
+                VM_NEXT();
+#ifndef EXPRESSION_VM_THREADED
         }
     }
+#endif
 
     uint32_t mascot_id = 0;
     const char* mascot_name = NULL;
 vmfail:
+    *instructions = executed;
 
     if (mascot) {
         mascot_id = mascot->id;
         mascot_name = mascot->prototype->name;
     }
+    state.ip = pc;
 
     TRACE("<Mascot:%s:%u> VM Execution failed for program with id %i", mascot_name, mascot_id, prototype->id);
-    TRACE("-> instruction pointer: %u", state.ip);
+    TRACE("-> instruction index: %u", state.ip);
     TRACE("-> stack pointer: %u", state.sp);
     TRACE("-> stack:");
     for (int i = 0; i < state.sp; i++) {
         TRACE("    -> %u: %f", i, state.stack[i]);
     }
     TRACE("-> bytecode length: %u", prototype->bytecode_size);
-    TRACE("-> opcode: %hhx", opcode);
-    TRACE("-> immoperand: %hhx", immoperand);
-    TRACE("-> offset register: %u", offsetr);
-    TRACE("-> index register: %u", indexr);
-    TRACE("-> operand0: %f", freg0);
-    TRACE("-> operand1: %f", freg1);
-    TRACE("-> function pointer register: %p", ptrr);
+    TRACE("-> opcode: %hhx", insn->opcode);
+    TRACE("-> immoperand: %hhx", insn->operand);
+    TRACE("-> function pointer register: %p", getter);
     if (state.error_message) {
         TRACE("-> stop reason: %s", state.error_message);
     }
@@ -456,3 +1224,32 @@ vmfail:
 
     return EXPRESSION_EXECUTION_ERROR;
 }
+
+enum expression_execution_result expression_vm_execute(struct expression_prototype* prototype, struct mascot* mascot, float* execution_result)
+{
+    if (!prototype) return EXPRESSION_EXECUTION_ERROR;
+    if (!mascot) return EXPRESSION_EXECUTION_ERROR;
+    if (!prototype->code) return EXPRESSION_EXECUTION_ERROR;
+
+    uint64_t calls = __atomic_load_n(&prototype->profile.calls, __ATOMIC_RELAXED) + 1;
+    __atomic_store_n(&prototype->profile.calls, calls, __ATOMIC_RELAXED);
+
+    // Reading the clock costs about as much as running typical program, so only every n-th execution is timed
+    bool sampled = !(calls % EXPRESSION_PROFILE_SAMPLE_PERIOD);
+    struct timespec start, end;
+    if (sampled) clock_gettime(CLOCK_MONOTONIC, &start);
+
+    uint32_t instructions = 0;
+    enum expression_execution_result status = expression_vm_run(prototype, mascot, execution_result, &instructions);
+
+    if (sampled) {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        int64_t ns = (int64_t)(end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec);
+        EXPRESSION_PROFILE_ADD(prototype->profile.sampled_calls, 1);
+        EXPRESSION_PROFILE_ADD(prototype->profile.sampled_nanoseconds, ns > 0 ? (uint64_t)ns : 0);
+    }
+    if (instructions) EXPRESSION_PROFILE_ADD(prototype->profile.instructions, instructions);
+    if (status != EXPRESSION_EXECUTION_OK) EXPRESSION_PROFILE_ADD(prototype->profile.errors, 1);
+
+    return status;
+}
@@ -21,20 +21,98 @@
 #define EXPRESSION_VM_H
 
 #include "master_header.h"
+
+struct expression_prototype;
+
+// State results of global getters and functions depend on
+#define EXPRESSION_SOURCE_NONE 0x00
+#define EXPRESSION_SOURCE_POSITION 0x01 // Mascot's X and Y variables
+#define EXPRESSION_SOURCE_ENVIRONMENT 0x02 // Geometry of outputs and work areas, active IE
+#define EXPRESSION_SOURCE_POPULATION 0x04 // Number of mascots
+#define EXPRESSION_SOURCE_VOLATILE 0x08 // Cursor, other mascots, randomness. Never memoized
+
+#define EXPRESSION_CACHE_SIZE 64 // Memoized results kept per mascot
+#define EXPRESSION_CACHE_VARS 6 // Most mascot variables memoized program may read
+
+#define EXPRESSION_PROFILE_SAMPLE_PERIOD 64 // Every n-th execution of program is timed
+
+// Result of program for given mascot, valid as long as inputs it was computed from are unchanged.
+// Defined before mascot.h is included, as struct mascot embeds these
+struct expression_cache_entry {
+    const struct expression_prototype* program; // NULL if entry is empty
+    const void* environment;
+    uint32_t environment_version;
+    uint32_t population_version;
+    uint32_t vars[EXPRESSION_CACHE_VARS]; // Raw values of variables program read
+    float result;
+};
+
 #include "mascot.h"
 
+struct expression_instruction;
+struct expression_jit_code;
+
+// Stack effect of global getter or function, used by bytecode verifier
+struct expression_stack_effect {
+    uint8_t pops; // Values consumed from top of the stack
+    uint8_t pushes; // Values pushed in their place
+    uint8_t reads; // EXPRESSION_SOURCE_* result depends on
+};
+
+// Execution counters of program, always collected.
+// Updated without atomic read-modify-write, so concurrent executions may rarely lose an increment
+struct expression_profile {
+    uint64_t calls;
+    uint64_t errors;
+    uint64_t instructions; // Instructions interpreted by VM. Native and memoized executions interpret none
+    uint64_t sampled_calls; // Executions timed, one per EXPRESSION_PROFILE_SAMPLE_PERIOD calls
+    uint64_t sampled_nanoseconds;
+};
+
+// Program is stored in arena of mascot prototype it belongs to, with bytecode and symbol tables sized to fit
 struct expression_prototype {
-    uint16_t id;
-    uint8_t bytecode[512];
+    uint16_t id; // Index of program in its arena
+    uint32_t hash; // Hash of bytecode and symbol tables, identical programs are stored once
+    const uint8_t* bytecode;
     uint16_t bytecode_size;
-    uint8_t mascot_vars[128];
+    struct expression_instruction* code; // Pre-decoded bytecode, executed by VM
+    uint16_t code_size;
+    uint8_t max_stack; // Deepest stack pointer verified program may reach
+    struct expression_jit_code* jit; // Native code of program, NULL if JIT is disabled or couldn't compile it
+    const uint8_t* mascot_vars;
     uint8_t mascot_vars_size;
-    void* global_getters[128];
+    void* const* global_getters;
+    const struct expression_stack_effect* global_getters_effects;
     uint8_t global_getters_size;
-    void* function_ptrs[128];
+    void* const* function_ptrs;
+    const struct expression_stack_effect* function_ptrs_effects;
+    uint8_t function_ptrs_size;
+
+    // Read set of optimized program, so results can be memoized until something program reads changes
+    bool memoizable;
+    uint8_t reads; // EXPRESSION_SOURCE_* of symbols program calls
+    uint8_t read_vars[EXPRESSION_CACHE_VARS]; // Mascot variables program loads
+    uint8_t read_vars_count;
+
+    struct expression_profile profile;
+};
+
+// Program as read from configuration, before it is loaded into arena
+struct expression_source {
+    const uint8_t* bytecode;
+    uint16_t bytecode_size;
+    const uint8_t* mascot_vars;
+    uint8_t mascot_vars_size;
+    void* const* global_getters;
+    const struct expression_stack_effect* global_getters_effects;
+    uint8_t global_getters_size;
+    void* const* function_ptrs;
+    const struct expression_stack_effect* function_ptrs_effects;
     uint8_t function_ptrs_size;
 };
 
+struct expression_arena;
+
 struct expression_vm_state {
     float stack[255];
     uint8_t sp;
@@ -48,13 +126,25 @@ enum expression_execution_result {
     EXPRESSION_EXECUTION_ERROR
 };
 
-struct expression_prototype* expression_prototype_new();
-void expression_prototype_free(struct expression_prototype* prototype);
-bool expression_prototype_load_bytecode(struct expression_prototype* prototype, uint8_t* bytecode, uint16_t bytecode_size);
-void expression_prototype_load_mascot_vars(struct expression_prototype* prototype, uint8_t* mascot_vars, uint8_t mascot_vars_size);
-void expression_prototype_load_global_getters(struct expression_prototype* prototype, void** global_getters, uint8_t global_getters_size);
-void expression_prototype_load_function_ptrs(struct expression_prototype* prototype, void** function_ptrs, uint8_t function_ptrs_size);
+struct expression_arena* expression_arena_new();
+// Frees every program loaded into arena
+void expression_arena_free(struct expression_arena* arena);
+// Decodes and verifies program, and copies it into arena. If identical program was loaded before, returns that one instead.
+// Returns NULL if program fails verification
+struct expression_prototype* expression_arena_load(struct expression_arena* arena, const struct expression_source* source);
+
+// Invalidates memoized results of programs reading any of EXPRESSION_SOURCE_* in source
+void expression_source_changed(uint8_t source);
+
+// Copies counters of program to profile, estimating total time spent from timed executions
+void expression_profile_get(const struct expression_prototype* prototype, struct expression_profile* profile, uint64_t* nanoseconds);
+void expression_profile_reset(struct expression_prototype* prototype);
 
 enum expression_execution_result expression_vm_execute(struct expression_prototype* prototype, struct mascot* mascot, float* result);
 
+// Evaluates memoizable program for many mascots at once, vector lane per mascot, and memoizes results.
+// expression_vm_execute then returns them unless inputs of mascot changed in between.
+// Mascots locked by another thread are skipped, their programs run on their own ticks
+void expression_vm_prefetch(struct expression_prototype* prototype, struct mascot* const* mascots, uint32_t count);
+
 #endif
@@ -30,6 +30,10 @@
 #include "physics.h"
 #include "plugins.h"
 
+// Symbols are defined as { name, function, { pops, pushes, reads } }, where pops and pushes
+// describe stack effect of the function and are checked by bytecode verifier, and reads is
+// EXPRESSION_SOURCE_* mask of state its result depends on, used to memoize expressions
+
 bool mascot_noop(struct expression_vm_state* state);
 
 // Math functions from js
@@ -40,7 +44,7 @@ bool math_e(struct expression_vm_state* state)
     state->stack[state->sp++] = 2.718281828459045;
     return true;
 }
-#define GLOBAL_SYM_MATH_E { "math.e", math_e }
+#define GLOBAL_SYM_MATH_E { "math.e", math_e, { 0, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_ln10(struct expression_vm_state* state)
 {
@@ -48,7 +52,7 @@ bool math_ln10(struct expression_vm_state* state)
     state->stack[state->sp++] = 2.302585092994046;
     return true;
 }
-#define GLOBAL_SYM_MATH_LN10 { "math.ln10", math_ln10 }
+#define GLOBAL_SYM_MATH_LN10 { "math.ln10", math_ln10, { 0, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_ln2(struct expression_vm_state* state)
 {
@@ -56,7 +60,7 @@ bool math_ln2(struct expression_vm_state* state)
     state->stack[state->sp++] = 0.6931471805599453;
     return true;
 }
-#define GLOBAL_SYM_MATH_LN2 { "math.ln2", math_ln2 }
+#define GLOBAL_SYM_MATH_LN2 { "math.ln2", math_ln2, { 0, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_log2e(struct expression_vm_state* state)
 {
@@ -64,7 +68,7 @@ bool math_log2e(struct expression_vm_state* state)
     state->stack[state->sp++] = 1.4426950408889634;
     return true;
 }
-#define GLOBAL_SYM_MATH_LOG2E { "math.log2e", math_log2e }
+#define GLOBAL_SYM_MATH_LOG2E { "math.log2e", math_log2e, { 0, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_log10e(struct expression_vm_state* state)
 {
@@ -72,7 +76,7 @@ bool math_log10e(struct expression_vm_state* state)
     state->stack[state->sp++] = 0.4342944819032518;
     return true;
 }
-#define GLOBAL_SYM_MATH_LOG10E { "math.log10e", math_log10e }
+#define GLOBAL_SYM_MATH_LOG10E { "math.log10e", math_log10e, { 0, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_pi(struct expression_vm_state* state)
 {
@@ -80,7 +84,7 @@ bool math_pi(struct expression_vm_state* state)
     state->stack[state->sp++] = 3.141592653589793;
     return true;
 }
-#define GLOBAL_SYM_MATH_PI { "math.pi", math_pi }
+#define GLOBAL_SYM_MATH_PI { "math.pi", math_pi, { 0, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_sqrt1_2(struct expression_vm_state* state)
 {
@@ -88,7 +92,7 @@ bool math_sqrt1_2(struct expression_vm_state* state)
     state->stack[state->sp++] = 0.7071067811865476;
     return true;
 }
-#define GLOBAL_SYM_MATH_SQRT1_2 { "math.sqrt1_2", math_sqrt1_2 }
+#define GLOBAL_SYM_MATH_SQRT1_2 { "math.sqrt1_2", math_sqrt1_2, { 0, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_sqrt2(struct expression_vm_state* state)
 {
@@ -96,7 +100,7 @@ bool math_sqrt2(struct expression_vm_state* state)
     state->stack[state->sp++] = 1.4142135623730951;
     return true;
 }
-#define GLOBAL_SYM_MATH_SQRT2 { "math.sqrt2", math_sqrt2 }
+#define GLOBAL_SYM_MATH_SQRT2 { "math.sqrt2", math_sqrt2, { 0, 1, EXPRESSION_SOURCE_NONE } }
 
 // Functions
 
@@ -106,7 +110,7 @@ bool math_abs(struct expression_vm_state* state)
     state->stack[state->sp - 1] = fabs(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_ABS { "math.abs", math_abs }
+#define FUNC_MATH_ABS { "math.abs", math_abs, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_acos(struct expression_vm_state* state)
 {
@@ -114,7 +118,7 @@ bool math_acos(struct expression_vm_state* state)
     state->stack[state->sp - 1] = acos(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_ACOS { "math.acos", math_acos }
+#define FUNC_MATH_ACOS { "math.acos", math_acos, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_acosh(struct expression_vm_state* state)
 {
@@ -122,7 +126,7 @@ bool math_acosh(struct expression_vm_state* state)
     state->stack[state->sp - 1] = acosh(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_ACOSH { "math.acosh", math_acosh }
+#define FUNC_MATH_ACOSH { "math.acosh", math_acosh, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_asin(struct expression_vm_state* state)
 {
@@ -130,7 +134,7 @@ bool math_asin(struct expression_vm_state* state)
     state->stack[state->sp - 1] = asin(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_ASIN { "math.asin", math_asin }
+#define FUNC_MATH_ASIN { "math.asin", math_asin, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_asinh(struct expression_vm_state* state)
 {
@@ -138,7 +142,7 @@ bool math_asinh(struct expression_vm_state* state)
     state->stack[state->sp - 1] = asinh(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_ASINH { "math.asinh", math_asinh }
+#define FUNC_MATH_ASINH { "math.asinh", math_asinh, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_atan(struct expression_vm_state* state)
 {
@@ -146,7 +150,7 @@ bool math_atan(struct expression_vm_state* state)
     state->stack[state->sp - 1] = atan(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_ATAN { "math.atan", math_atan }
+#define FUNC_MATH_ATAN { "math.atan", math_atan, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_atanh(struct expression_vm_state* state)
 {
@@ -154,7 +158,7 @@ bool math_atanh(struct expression_vm_state* state)
     state->stack[state->sp - 1] = atanh(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_ATANH { "math.atanh", math_atanh }
+#define FUNC_MATH_ATANH { "math.atanh", math_atanh, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_cbrt(struct expression_vm_state* state)
 {
@@ -162,7 +166,7 @@ bool math_cbrt(struct expression_vm_state* state)
     state->stack[state->sp - 1] = cbrt(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_CBRT { "math.cbrt", math_cbrt }
+#define FUNC_MATH_CBRT { "math.cbrt", math_cbrt, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_ceil(struct expression_vm_state* state)
 {
@@ -170,7 +174,7 @@ bool math_ceil(struct expression_vm_state* state)
     state->stack[state->sp - 1] = ceil(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_CEIL { "math.ceil", math_ceil }
+#define FUNC_MATH_CEIL { "math.ceil", math_ceil, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_clz32(struct expression_vm_state* state)
 {
@@ -178,7 +182,7 @@ bool math_clz32(struct expression_vm_state* state)
     state->stack[state->sp - 1] = __builtin_clz((int)state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_CLZ32 { "math.clz32", math_clz32 }
+#define FUNC_MATH_CLZ32 { "math.clz32", math_clz32, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_cos(struct expression_vm_state* state)
 {
@@ -186,7 +190,7 @@ bool math_cos(struct expression_vm_state* state)
     state->stack[state->sp - 1] = cos(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_COS { "math.cos", math_cos }
+#define FUNC_MATH_COS { "math.cos", math_cos, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_cosh(struct expression_vm_state* state)
 {
@@ -194,7 +198,7 @@ bool math_cosh(struct expression_vm_state* state)
     state->stack[state->sp - 1] = cosh(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_COSH { "math.cosh", math_cosh }
+#define FUNC_MATH_COSH { "math.cosh", math_cosh, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_exp(struct expression_vm_state* state)
 {
@@ -202,7 +206,7 @@ bool math_exp(struct expression_vm_state* state)
     state->stack[state->sp - 1] = exp(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_EXP { "math.exp", math_exp }
+#define FUNC_MATH_EXP { "math.exp", math_exp, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_expm1(struct expression_vm_state* state)
 {
@@ -210,7 +214,7 @@ bool math_expm1(struct expression_vm_state* state)
     state->stack[state->sp - 1] = expm1(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_EXPM1 { "math.expm1", math_expm1 }
+#define FUNC_MATH_EXPM1 { "math.expm1", math_expm1, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_floor(struct expression_vm_state* state)
 {
@@ -218,7 +222,7 @@ bool math_floor(struct expression_vm_state* state)
     state->stack[state->sp - 1] = floor(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_FLOOR { "math.floor", math_floor }
+#define FUNC_MATH_FLOOR { "math.floor", math_floor, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_fround(struct expression_vm_state* state)
 {
@@ -227,7 +231,7 @@ bool math_fround(struct expression_vm_state* state)
     state->stack[state->sp - 1] = f;
     return true;
 }
-#define FUNC_MATH_FROUND { "math.fround", math_fround }
+#define FUNC_MATH_FROUND { "math.fround", math_fround, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_log(struct expression_vm_state* state)
 {
@@ -235,7 +239,7 @@ bool math_log(struct expression_vm_state* state)
     state->stack[state->sp - 1] = log(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_LOG { "math.log", math_log }
+#define FUNC_MATH_LOG { "math.log", math_log, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_log1p(struct expression_vm_state* state)
 {
@@ -243,7 +247,7 @@ bool math_log1p(struct expression_vm_state* state)
     state->stack[state->sp - 1] = log1p(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_LOG1P { "math.log1p", math_log1p }
+#define FUNC_MATH_LOG1P { "math.log1p", math_log1p, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_log2(struct expression_vm_state* state)
 {
@@ -251,7 +255,7 @@ bool math_log2(struct expression_vm_state* state)
     state->stack[state->sp - 1] = log2(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_LOG2 { "math.log2", math_log2 }
+#define FUNC_MATH_LOG2 { "math.log2", math_log2, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_log10(struct expression_vm_state* state)
 {
@@ -259,7 +263,7 @@ bool math_log10(struct expression_vm_state* state)
     state->stack[state->sp - 1] = log10(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_LOG10 { "math.log10", math_log10 }
+#define FUNC_MATH_LOG10 { "math.log10", math_log10, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_max(struct expression_vm_state* state)
 {
@@ -270,7 +274,7 @@ bool math_max(struct expression_vm_state* state)
     state->sp--;
     return true;
 }
-#define FUNC_MATH_MAX { "math.max", math_max }
+#define FUNC_MATH_MAX { "math.max", math_max, { 2, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_min(struct expression_vm_state* state)
 {
@@ -281,7 +285,7 @@ bool math_min(struct expression_vm_state* state)
     state->sp--;
     return true;
 }
-#define FUNC_MATH_MIN { "math.min", math_min }
+#define FUNC_MATH_MIN { "math.min", math_min, { 2, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_pow(struct expression_vm_state* state)
 {
@@ -292,7 +296,7 @@ bool math_pow(struct expression_vm_state* state)
     state->sp--;
     return true;
 }
-#define FUNC_MATH_POW { "math.pow", math_pow }
+#define FUNC_MATH_POW { "math.pow", math_pow, { 2, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_random(struct expression_vm_state* state)
 {
@@ -301,7 +305,7 @@ bool math_random(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define FUNC_MATH_RANDOM { "math.random", math_random }
+#define FUNC_MATH_RANDOM { "math.random", math_random, { 0, 1, EXPRESSION_SOURCE_VOLATILE } }
 
 bool math_round(struct expression_vm_state* state)
 {
@@ -309,7 +313,7 @@ bool math_round(struct expression_vm_state* state)
     state->stack[state->sp - 1] = round(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_ROUND { "math.round", math_round }
+#define FUNC_MATH_ROUND { "math.round", math_round, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_sign(struct expression_vm_state* state)
 {
@@ -318,7 +322,7 @@ bool math_sign(struct expression_vm_state* state)
     state->stack[state->sp - 1] = f > 0 ? 1 : f < 0 ? -1 : 0;
     return true;
 }
-#define FUNC_MATH_SIGN { "math.sign", math_sign }
+#define FUNC_MATH_SIGN { "math.sign", math_sign, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_sin(struct expression_vm_state* state)
 {
@@ -326,7 +330,7 @@ bool math_sin(struct expression_vm_state* state)
     state->stack[state->sp - 1] = sin(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_SIN { "math.sin", math_sin }
+#define FUNC_MATH_SIN { "math.sin", math_sin, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_sinh(struct expression_vm_state* state)
 {
@@ -334,7 +338,7 @@ bool math_sinh(struct expression_vm_state* state)
     state->stack[state->sp - 1] = sinh(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_SINH { "math.sinh", math_sinh }
+#define FUNC_MATH_SINH { "math.sinh", math_sinh, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_sqrt(struct expression_vm_state* state)
 {
@@ -342,7 +346,7 @@ bool math_sqrt(struct expression_vm_state* state)
     state->stack[state->sp - 1] = sqrt(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_SQRT { "math.sqrt", math_sqrt }
+#define FUNC_MATH_SQRT { "math.sqrt", math_sqrt, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_tan(struct expression_vm_state* state)
 {
@@ -350,7 +354,7 @@ bool math_tan(struct expression_vm_state* state)
     state->stack[state->sp - 1] = tan(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_TAN { "math.tan", math_tan }
+#define FUNC_MATH_TAN { "math.tan", math_tan, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_tanh(struct expression_vm_state* state)
 {
@@ -358,7 +362,7 @@ bool math_tanh(struct expression_vm_state* state)
     state->stack[state->sp - 1] = tanh(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_TANH { "math.tanh", math_tanh }
+#define FUNC_MATH_TANH { "math.tanh", math_tanh, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 bool math_trunc(struct expression_vm_state* state)
 {
@@ -366,7 +370,7 @@ bool math_trunc(struct expression_vm_state* state)
     state->stack[state->sp - 1] = trunc(state->stack[state->sp - 1]);
     return true;
 }
-#define FUNC_MATH_TRUNC { "math.trunc", math_trunc }
+#define FUNC_MATH_TRUNC { "math.trunc", math_trunc, { 1, 1, EXPRESSION_SOURCE_NONE } }
 
 // Our global syms
 
@@ -378,7 +382,7 @@ bool mascot_anchor(struct expression_vm_state* state)
     state->sp += 2;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ANCHOR { "mascot.anchor", mascot_anchor }
+#define GLOBAL_SYM_MASCOT_ANCHOR { "mascot.anchor", mascot_anchor, { 0, 2, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_anchor_x(struct expression_vm_state* state)
 {
@@ -386,7 +390,7 @@ bool mascot_anchor_x(struct expression_vm_state* state)
     state->stack[state->sp++] = state->ref_mascot->X->value.i;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ANCHOR_X { "mascot.anchor.x", mascot_anchor_x }
+#define GLOBAL_SYM_MASCOT_ANCHOR_X { "mascot.anchor.x", mascot_anchor_x, { 0, 1, EXPRESSION_SOURCE_POSITION } }
 
 bool mascot_anchor_y(struct expression_vm_state* state)
 {
@@ -394,7 +398,7 @@ bool mascot_anchor_y(struct expression_vm_state* state)
     state->stack[state->sp++] = environment_workarea_height(state->ref_mascot->environment) - state->ref_mascot->Y->value.i;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ANCHOR_Y { "mascot.anchor.y", mascot_anchor_y }
+#define GLOBAL_SYM_MASCOT_ANCHOR_Y { "mascot.anchor.y", mascot_anchor_y, { 0, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 // Environment syms
 bool mascot_environment_cursor_x(struct expression_vm_state* state)
@@ -404,7 +408,7 @@ bool mascot_environment_cursor_x(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_CURSOR_X { "mascot.environment.cursor.x", mascot_environment_cursor_x }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_CURSOR_X { "mascot.environment.cursor.x", mascot_environment_cursor_x, { 0, 1, EXPRESSION_SOURCE_VOLATILE } }
 
 bool mascot_environment_cursor_y(struct expression_vm_state* state)
 {
@@ -413,7 +417,7 @@ bool mascot_environment_cursor_y(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_CURSOR_Y { "mascot.environment.cursor.y", mascot_environment_cursor_y }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_CURSOR_Y { "mascot.environment.cursor.y", mascot_environment_cursor_y, { 0, 1, EXPRESSION_SOURCE_VOLATILE } }
 
 bool mascot_environment_cursor_dx(struct expression_vm_state* state)
 {
@@ -422,7 +426,7 @@ bool mascot_environment_cursor_dx(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_CURSOR_DX { "mascot.environment.cursor.dx", mascot_environment_cursor_dx }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_CURSOR_DX { "mascot.environment.cursor.dx", mascot_environment_cursor_dx, { 0, 1, EXPRESSION_SOURCE_VOLATILE } }
 
 bool mascot_environment_cursor_dy(struct expression_vm_state* state)
 {
@@ -431,7 +435,7 @@ bool mascot_environment_cursor_dy(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_CURSOR_DY { "mascot.environment.cursor.dy", mascot_environment_cursor_dy }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_CURSOR_DY { "mascot.environment.cursor.dy", mascot_environment_cursor_dy, { 0, 1, EXPRESSION_SOURCE_VOLATILE } }
 
 bool mascot_environment_screen_width(struct expression_vm_state* state)
 {
@@ -441,7 +445,7 @@ bool mascot_environment_screen_width(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_SCREEN_WIDTH { "mascot.environment.screen.width", mascot_environment_screen_width }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_SCREEN_WIDTH { "mascot.environment.screen.width", mascot_environment_screen_width, { 0, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_screen_height(struct expression_vm_state* state)
 {
@@ -452,7 +456,7 @@ bool mascot_environment_screen_height(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_SCREEN_HEIGHT { "mascot.environment.screen.height", mascot_environment_screen_height }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_SCREEN_HEIGHT { "mascot.environment.screen.height", mascot_environment_screen_height, { 0, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_work_area_width(struct expression_vm_state* state)
 {
@@ -462,7 +466,7 @@ bool mascot_environment_work_area_width(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_WORK_AREA_WIDTH { "mascot.environment.workarea.width", mascot_environment_work_area_width }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_WORK_AREA_WIDTH { "mascot.environment.workarea.width", mascot_environment_work_area_width, { 0, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_work_area_height(struct expression_vm_state* state)
 {
@@ -472,7 +476,7 @@ bool mascot_environment_work_area_height(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_WORK_AREA_HEIGHT { "mascot.environment.workarea.height", mascot_environment_work_area_height }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_WORK_AREA_HEIGHT { "mascot.environment.workarea.height", mascot_environment_work_area_height, { 0, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_work_area_left(struct expression_vm_state* state)
 {
@@ -482,7 +486,7 @@ bool mascot_environment_work_area_left(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_WORK_AREA_LEFT { "mascot.environment.workarea.left", mascot_environment_work_area_left }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_WORK_AREA_LEFT { "mascot.environment.workarea.left", mascot_environment_work_area_left, { 0, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_work_area_top(struct expression_vm_state* state)
 {
@@ -493,7 +497,7 @@ bool mascot_environment_work_area_top(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_WORK_AREA_TOP { "mascot.environment.workarea.top", mascot_environment_work_area_top }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_WORK_AREA_TOP { "mascot.environment.workarea.top", mascot_environment_work_area_top, { 0, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_work_area_right(struct expression_vm_state* state)
 {
@@ -503,7 +507,7 @@ bool mascot_environment_work_area_right(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_WORK_AREA_RIGHT { "mascot.environment.workarea.right", mascot_environment_work_area_right }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_WORK_AREA_RIGHT { "mascot.environment.workarea.right", mascot_environment_work_area_right, { 0, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_work_area_bottom(struct expression_vm_state* state)
 {
@@ -513,7 +517,7 @@ bool mascot_environment_work_area_bottom(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_WORK_AREA_BOTTOM { "mascot.environment.workarea.bottom", mascot_environment_work_area_bottom }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_WORK_AREA_BOTTOM { "mascot.environment.workarea.bottom", mascot_environment_work_area_bottom, { 0, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_floor_ison(struct expression_vm_state* state)
 {
@@ -523,7 +527,7 @@ bool mascot_environment_floor_ison(struct expression_vm_state* state)
     state->sp--;
     return true;
 }
-#define FUNC_MASCOT_ENVIRONMENT_FLOOR_ISON { "mascot.environment.floor.ison", mascot_environment_floor_ison }
+#define FUNC_MASCOT_ENVIRONMENT_FLOOR_ISON { "mascot.environment.floor.ison", mascot_environment_floor_ison, { 2, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_ceiling_ison(struct expression_vm_state* state)
 {
@@ -533,7 +537,7 @@ bool mascot_environment_ceiling_ison(struct expression_vm_state* state)
     state->sp--;
     return true;
 }
-#define FUNC_MASCOT_ENVIRONMENT_CEILING_ISON { "mascot.environment.ceiling.ison", mascot_environment_ceiling_ison }
+#define FUNC_MASCOT_ENVIRONMENT_CEILING_ISON { "mascot.environment.ceiling.ison", mascot_environment_ceiling_ison, { 2, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_wall_ison(struct expression_vm_state* state)
 {
@@ -543,7 +547,7 @@ bool mascot_environment_wall_ison(struct expression_vm_state* state)
     state->sp--;
     return true;
 }
-#define FUNC_MASCOT_ENVIRONMENT_WALL_ISON { "mascot.environment.wall.ison", mascot_environment_wall_ison }
+#define FUNC_MASCOT_ENVIRONMENT_WALL_ISON { "mascot.environment.wall.ison", mascot_environment_wall_ison, { 2, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_left_ison(struct expression_vm_state* state)
 {
@@ -563,7 +567,7 @@ bool mascot_environment_left_ison(struct expression_vm_state* state)
     state->sp--;
     return true;
 }
-#define FUNC_MASCOT_ENVIRONMENT_LEFT_ISON { "mascot.environment.left.ison", mascot_environment_left_ison }
+#define FUNC_MASCOT_ENVIRONMENT_LEFT_ISON { "mascot.environment.left.ison", mascot_environment_left_ison, { 2, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_right_ison(struct expression_vm_state* state)
 {
@@ -582,7 +586,7 @@ bool mascot_environment_right_ison(struct expression_vm_state* state)
     state->sp--;
     return true;
 }
-#define FUNC_MASCOT_ENVIRONMENT_RIGHT_ISON { "mascot.environment.right.ison", mascot_environment_right_ison }
+#define FUNC_MASCOT_ENVIRONMENT_RIGHT_ISON { "mascot.environment.right.ison", mascot_environment_right_ison, { 2, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_work_area_left_border_ison(struct expression_vm_state* state)
 {
@@ -597,7 +601,7 @@ bool mascot_environment_work_area_left_border_ison(struct expression_vm_state* s
     state->sp--;
     return true;
 }
-#define FUNC_MASCOT_ENVIRONMENT_WORK_AREA_LEFT_BORDER_ISON { "mascot.environment.workarea.leftborder.ison", mascot_environment_work_area_left_border_ison }
+#define FUNC_MASCOT_ENVIRONMENT_WORK_AREA_LEFT_BORDER_ISON { "mascot.environment.workarea.leftborder.ison", mascot_environment_work_area_left_border_ison, { 2, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_work_area_right_border_ison(struct expression_vm_state* state)
 {
@@ -612,7 +616,7 @@ bool mascot_environment_work_area_right_border_ison(struct expression_vm_state*
     state->sp--;
     return true;
 }
-#define FUNC_MASCOT_ENVIRONMENT_WORK_AREA_RIGHT_BORDER_ISON { "mascot.environment.workarea.rightborder.ison", mascot_environment_work_area_right_border_ison }
+#define FUNC_MASCOT_ENVIRONMENT_WORK_AREA_RIGHT_BORDER_ISON { "mascot.environment.workarea.rightborder.ison", mascot_environment_work_area_right_border_ison, { 2, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_work_area_top_border_ison(struct expression_vm_state* state)
 {
@@ -627,7 +631,7 @@ bool mascot_environment_work_area_top_border_ison(struct expression_vm_state* st
     state->sp--;
     return true;
 }
-#define FUNC_MASCOT_ENVIRONMENT_WORK_AREA_CEILING_BORDER_ISON { "mascot.environment.workarea.topborder.ison", mascot_environment_work_area_top_border_ison }
+#define FUNC_MASCOT_ENVIRONMENT_WORK_AREA_CEILING_BORDER_ISON { "mascot.environment.workarea.topborder.ison", mascot_environment_work_area_top_border_ison, { 2, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_work_area_bottom_border_ison(struct expression_vm_state* state)
 {
@@ -642,7 +646,7 @@ bool mascot_environment_work_area_bottom_border_ison(struct expression_vm_state*
     state->sp--;
     return true;
 }
-#define FUNC_MASCOT_ENVIRONMENT_WORK_AREA_FLOOR_BORDER_ISON { "mascot.environment.workarea.bottomborder.ison", mascot_environment_work_area_bottom_border_ison }
+#define FUNC_MASCOT_ENVIRONMENT_WORK_AREA_FLOOR_BORDER_ISON { "mascot.environment.workarea.bottomborder.ison", mascot_environment_work_area_bottom_border_ison, { 2, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_active_ie_right(struct expression_vm_state* state)
 {
@@ -657,7 +661,7 @@ bool mascot_environment_active_ie_right(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_ACTIVE_IE_RIGHT { "mascot.environment.activeie.right", mascot_environment_active_ie_right }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_ACTIVE_IE_RIGHT { "mascot.environment.activeie.right", mascot_environment_active_ie_right, { 0, 1, EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_active_ie_left(struct expression_vm_state* state)
 {
@@ -672,7 +676,7 @@ bool mascot_environment_active_ie_left(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_ACTIVE_IE_LEFT { "mascot.environment.activeie.left", mascot_environment_active_ie_left }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_ACTIVE_IE_LEFT { "mascot.environment.activeie.left", mascot_environment_active_ie_left, { 0, 1, EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_active_ie_top(struct expression_vm_state* state)
 {
@@ -688,7 +692,7 @@ bool mascot_environment_active_ie_top(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_ACTIVE_IE_TOP { "mascot.environment.activeie.top", mascot_environment_active_ie_top }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_ACTIVE_IE_TOP { "mascot.environment.activeie.top", mascot_environment_active_ie_top, { 0, 1, EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_active_ie_bottom(struct expression_vm_state* state)
 {
@@ -703,7 +707,7 @@ bool mascot_environment_active_ie_bottom(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_ACTIVE_IE_BOTTOM { "mascot.environment.activeie.bottom", mascot_environment_active_ie_bottom }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_ACTIVE_IE_BOTTOM { "mascot.environment.activeie.bottom", mascot_environment_active_ie_bottom, { 0, 1, EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_active_ie_width(struct expression_vm_state* state)
 {
@@ -718,7 +722,7 @@ bool mascot_environment_active_ie_width(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_ACTIVE_IE_WIDTH { "mascot.environment.activeie.width", mascot_environment_active_ie_width }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_ACTIVE_IE_WIDTH { "mascot.environment.activeie.width", mascot_environment_active_ie_width, { 0, 1, EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_active_ie_height(struct expression_vm_state* state)
 {
@@ -734,7 +738,7 @@ bool mascot_environment_active_ie_height(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_ACTIVE_IE_HEIGHT { "mascot.environment.activeie.height", mascot_environment_active_ie_height }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_ACTIVE_IE_HEIGHT { "mascot.environment.activeie.height", mascot_environment_active_ie_height, { 0, 1, EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_active_ie_visible(struct expression_vm_state* state)
 {
@@ -749,7 +753,7 @@ bool mascot_environment_active_ie_visible(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_ENVIRONMENT_ACTIVE_IE_VISIBLE { "mascot.environment.activeie.visible", mascot_environment_active_ie_visible }
+#define GLOBAL_SYM_MASCOT_ENVIRONMENT_ACTIVE_IE_VISIBLE { "mascot.environment.activeie.visible", mascot_environment_active_ie_visible, { 0, 1, EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_active_ie_top_border_ison(struct expression_vm_state* state)
 {
@@ -768,7 +772,7 @@ bool mascot_environment_active_ie_top_border_ison(struct expression_vm_state* st
     state->sp--;
     return true;
 }
-#define FUNC_MASCOT_ENVIRONMENT_ACTIVE_IE_TOP_BORDER_ISON { "mascot.environment.activeie.topborder.ison", mascot_environment_active_ie_top_border_ison }
+#define FUNC_MASCOT_ENVIRONMENT_ACTIVE_IE_TOP_BORDER_ISON { "mascot.environment.activeie.topborder.ison", mascot_environment_active_ie_top_border_ison, { 2, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_active_ie_bottom_border_ison(struct expression_vm_state* state)
 {
@@ -788,7 +792,7 @@ bool mascot_environment_active_ie_bottom_border_ison(struct expression_vm_state*
 
     return true;
 }
-#define FUNC_MASCOT_ENVIRONMENT_ACTIVE_IE_BOTTOM_BORDER_ISON { "mascot.environment.activeie.bottomborder.ison", mascot_environment_active_ie_bottom_border_ison }
+#define FUNC_MASCOT_ENVIRONMENT_ACTIVE_IE_BOTTOM_BORDER_ISON { "mascot.environment.activeie.bottomborder.ison", mascot_environment_active_ie_bottom_border_ison, { 2, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_active_ie_left_border_ison(struct expression_vm_state* state)
 {
@@ -808,7 +812,7 @@ bool mascot_environment_active_ie_left_border_ison(struct expression_vm_state* s
     state->sp--;
     return true;
 }
-#define FUNC_MASCOT_ENVIRONMENT_ACTIVE_IE_LEFT_BORDER_ISON { "mascot.environment.activeie.leftborder.ison", mascot_environment_active_ie_left_border_ison }
+#define FUNC_MASCOT_ENVIRONMENT_ACTIVE_IE_LEFT_BORDER_ISON { "mascot.environment.activeie.leftborder.ison", mascot_environment_active_ie_left_border_ison, { 2, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_active_ie_right_border_ison(struct expression_vm_state* state)
 {
@@ -829,7 +833,7 @@ bool mascot_environment_active_ie_right_border_ison(struct expression_vm_state*
 
     return true;
 }
-#define FUNC_MASCOT_ENVIRONMENT_ACTIVE_IE_RIGHT_BORDER_ISON { "mascot.environment.activeie.rightborder.ison", mascot_environment_active_ie_right_border_ison }
+#define FUNC_MASCOT_ENVIRONMENT_ACTIVE_IE_RIGHT_BORDER_ISON { "mascot.environment.activeie.rightborder.ison", mascot_environment_active_ie_right_border_ison, { 2, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_environment_active_ie_border_ison(struct expression_vm_state* state)
 {
@@ -848,7 +852,7 @@ bool mascot_environment_active_ie_border_ison(struct expression_vm_state* state)
     state->sp--;
     return true;
 }
-#define FUNC_MASCOT_ENVIRONMENT_ACTIVE_IE_BORDER_ISON { "mascot.environment.activeie.border.ison", mascot_environment_active_ie_border_ison }
+#define FUNC_MASCOT_ENVIRONMENT_ACTIVE_IE_BORDER_ISON { "mascot.environment.activeie.border.ison", mascot_environment_active_ie_border_ison, { 2, 1, EXPRESSION_SOURCE_POSITION | EXPRESSION_SOURCE_ENVIRONMENT } }
 
 bool mascot_count(struct expression_vm_state* state)
 {
@@ -857,7 +861,7 @@ bool mascot_count(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_COUNT { "mascot.count", mascot_count }
+#define GLOBAL_SYM_MASCOT_COUNT { "mascot.count", mascot_count, { 0, 1, EXPRESSION_SOURCE_POPULATION } }
 
 bool mascot_count_total(struct expression_vm_state* state)
 {
@@ -866,7 +870,7 @@ bool mascot_count_total(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_COUNT_TOTAL { "mascot.totalCount", mascot_count_total }
+#define GLOBAL_SYM_MASCOT_COUNT_TOTAL { "mascot.totalCount", mascot_count_total, { 0, 1, EXPRESSION_SOURCE_POPULATION } }
 
 bool mascot_noop(struct expression_vm_state* state)
 {
@@ -875,7 +879,7 @@ bool mascot_noop(struct expression_vm_state* state)
     state->sp++;
     return true;
 }
-#define GLOBAL_SYM_MASCOT_NOOP { "fallback", mascot_noop }
+#define GLOBAL_SYM_MASCOT_NOOP { "fallback", mascot_noop, { 0, 1, EXPRESSION_SOURCE_NONE } }
 
 bool target_anchor(struct expression_vm_state* state)
 {
@@ -899,7 +903,7 @@ bool target_anchor(struct expression_vm_state* state)
     }
     return true;
 }
-#define GLOBAL_SYM_TARGET_ANCHOR { "target.anchor", target_anchor }
+#define GLOBAL_SYM_TARGET_ANCHOR { "target.anchor", target_anchor, { 0, 2, EXPRESSION_SOURCE_VOLATILE } }
 
 bool target_anchor_x(struct expression_vm_state* state)
 {
@@ -917,7 +921,7 @@ bool target_anchor_x(struct expression_vm_state* state)
     }
     return true;
 }
-#define GLOBAL_SYM_TARGET_ANCHOR_X { "target.anchor.x", target_anchor_x }
+#define GLOBAL_SYM_TARGET_ANCHOR_X { "target.anchor.x", target_anchor_x, { 0, 1, EXPRESSION_SOURCE_VOLATILE } }
 
 bool target_anchor_y(struct expression_vm_state* state)
 {
@@ -933,7 +937,7 @@ bool target_anchor_y(struct expression_vm_state* state)
     }
     return true;
 }
-#define GLOBAL_SYM_TARGET_ANCHOR_Y { "target.anchor.y", target_anchor_y }
+#define GLOBAL_SYM_TARGET_ANCHOR_Y { "target.anchor.y", target_anchor_y, { 0, 1, EXPRESSION_SOURCE_VOLATILE } }
 
 
 #endif
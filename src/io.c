@@ -711,16 +711,15 @@ int32_t io_buildtreeat(int32_t dirfd, const char *path) {
     char buf[PATH_MAX] = {0};
     strncpy(buf, path, PATH_MAX - 1);
 
-    char *dir = buf;
-    char *next = strchr(dir, '/');
+    // Every prefix of the path is created, leading slash of absolute path is not a directory of its own
+    char *next = strchr(buf + 1, '/');
     while (next) {
         *next = '\0';
-        if (mkdirat(dirfd, dir, 0755) == -1 && errno != EEXIST) {
+        if (mkdirat(dirfd, buf, 0755) == -1 && errno != EEXIST) {
             return IO_UNKNOWN_ERROR;
         }
         *next = '/';
-        dir = next + 1;
-        next = strchr(dir, '/');
+        next = strchr(next + 1, '/');
     }
     return 0;
 }
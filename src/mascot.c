@@ -55,9 +55,12 @@ mascot_prototype_behavior_by_name(const struct mascot_prototype *prototype,
     ERROR("MascotPrototypeBehaviorByName: prototype is NULL");
   if (!name)
     return NULL;
+  // Names that were never interned can't belong to any loaded behavior
+  atom_t atom = atom_lookup(name);
+  if (atom == ATOM_NONE)
+    return NULL;
   for (uint16_t i = 0; i < prototype->behavior_count; i++) {
-    if (strcmp(prototype->behavior_definitions[i]->name, name) == 0 &&
-        strlen(prototype->behavior_definitions[i]->name) == strlen(name)) {
+    if (prototype->behavior_definitions[i]->name_atom == atom) {
       return prototype->behavior_definitions[i];
     }
   }
@@ -65,8 +68,8 @@ mascot_prototype_behavior_by_name(const struct mascot_prototype *prototype,
 }
 
 struct mascot *mascot_get_target_by_affordance(struct mascot *mascot,
-                                               const char *affordance) {
-  if (!affordance)
+                                               atom_t affordance) {
+  if (affordance == ATOM_NONE)
     return NULL;
   if (!config_get_per_mascot_interactions())
     return NULL;
@@ -82,12 +85,8 @@ struct mascot *mascot_get_target_by_affordance(struct mascot *mascot,
   for (uint32_t i = 0; i < mascot->affordance_manager->slot_count; i++) {
     if (mascot->affordance_manager->slot_state[i] &&
         mascot->affordance_manager->slots[i]) {
-      if (!mascot->affordance_manager->slots[i]->current_affordance)
-        continue;
-      if (strcmp(mascot->affordance_manager->slots[i]->current_affordance,
-                 affordance) == 0 &&
-          strlen(mascot->affordance_manager->slots[i]->current_affordance) ==
-              strlen(affordance)) {
+      if (mascot->affordance_manager->slots[i]->current_affordance ==
+          affordance) {
         struct mascot *candidate_ = mascot->affordance_manager->slots[i];
         if (mascot->environment != candidate_->environment &&
             !config_get_unified_outputs())
@@ -101,14 +100,14 @@ struct mascot *mascot_get_target_by_affordance(struct mascot *mascot,
     }
   }
   INFO("<Mascot:%s:%u> Target by affordance %s: %s:%u, score %f",
-       mascot->prototype->name, mascot->id, affordance,
+       mascot->prototype->name, mascot->id, atom_name(affordance),
        candidate ? candidate->prototype->name : "(nil)",
        candidate ? candidate->id : 0, score);
   pthread_mutex_unlock(&mascot->affordance_manager->mutex);
   return candidate;
 }
 
-void mascot_announce_affordance(struct mascot *mascot, const char *affordance) {
+void mascot_announce_affordance(struct mascot *mascot, atom_t affordance) {
   if (!mascot)
     return;
   if (!mascot->affordance_manager)
@@ -116,8 +115,8 @@ void mascot_announce_affordance(struct mascot *mascot, const char *affordance) {
   pthread_mutex_lock(&mascot->affordance_manager->mutex);
   mascot->current_affordance = affordance;
   DEBUG("<Mascot:%s:%u> Announcing affordance: %s", mascot->prototype->name,
-        mascot->id, affordance ? affordance : "(nil)");
-  if (affordance) {
+        mascot->id, affordance ? atom_name(affordance) : "(nil)");
+  if (affordance != ATOM_NONE) {
     if (mascot->affordance_manager->occupied_slots_count ==
         mascot->affordance_manager->slot_count) {
       pthread_mutex_unlock(&mascot->affordance_manager->mutex);
@@ -129,7 +128,7 @@ void mascot_announce_affordance(struct mascot *mascot, const char *affordance) {
         mascot->affordance_manager->slot_state[i] = true;
         mascot->affordance_manager->occupied_slots_count++;
         INFO("<Mascot:%s:%u> Affordance %s announced, slot %u",
-             mascot->prototype->name, mascot->id, affordance, i);
+             mascot->prototype->name, mascot->id, atom_name(affordance), i);
         break;
       }
     }
@@ -139,8 +138,8 @@ void mascot_announce_affordance(struct mascot *mascot, const char *affordance) {
         mascot->affordance_manager->slots[i] = NULL;
         mascot->affordance_manager->slot_state[i] = false;
         mascot->affordance_manager->occupied_slots_count--;
-        INFO("<Mascot:%s:%u> Affordance %s unannounced, slot %u",
-             mascot->prototype->name, mascot->id, affordance, i);
+        INFO("<Mascot:%s:%u> Affordance unannounced, slot %u",
+             mascot->prototype->name, mascot->id, i);
         break;
       }
     }
@@ -194,7 +193,7 @@ bool mascot_interact(struct mascot *mascot, struct mascot *target,
   }
 
   pthread_mutex_lock(&target->tick_lock);
-  mascot_announce_affordance(target, NULL);
+  mascot_announce_affordance(target, ATOM_NONE);
   target->X->value = mascot->X->value;
   target->Y->value = mascot->Y->value;
 
@@ -233,7 +232,12 @@ void mascot_attach_pose(struct mascot *mascot, const struct mascot_pose *pose,
     environment_subsurface_unmap(mascot->subsurface);
     return;
   }
-  environment_subsurface_attach(mascot->subsurface, pose);
+  // Sprites that couldn't be materialized are not shown rather than attached
+  // without buffers
+  if (mascot_atlas_use(mascot->prototype->atlas))
+    environment_subsurface_attach(mascot->subsurface, pose);
+  else
+    environment_subsurface_unmap(mascot->subsurface);
   DEBUG("<Mascot:%s:%u> Attaching pose %d, with velocity = (%d,%d), anchor = "
         "(%d,%d)",
         mascot->prototype->name, mascot->id,
@@ -257,7 +261,10 @@ void mascot_reattach_pose(struct mascot *mascot) {
       mascot->current_animation->frames[mascot->frame_index - 1];
   if (!pose)
     return;
-  environment_subsurface_attach(mascot->subsurface, pose);
+  if (mascot_atlas_use(mascot->prototype->atlas))
+    environment_subsurface_attach(mascot->subsurface, pose);
+  else
+    environment_subsurface_unmap(mascot->subsurface);
 }
 
 struct action_funcs {
@@ -857,6 +864,169 @@ enum mascot_tick_result mascot_tick(struct mascot *mascot, uint32_t tick,
   return action_result;
 }
 
+struct mascot_prefetch_request {
+  struct expression_prototype *program;
+  struct mascot *mascot;
+  uint32_t group;
+};
+
+// Requests of one program, lanes[start..start+count) are its mascots
+struct mascot_prefetch_group {
+  struct expression_prototype *program; // NULL if slot is empty
+  uint32_t start, count;
+};
+
+struct mascot_prefetch_scratch {
+  struct mascot_prefetch_request *requests;
+  struct mascot **lanes;
+  uint32_t requests_capacity;
+  struct mascot_prefetch_group *groups; // Open addressing by program pointer
+  uint32_t groups_capacity;             // Power of two
+};
+
+struct mascot_prefetch_scratch *mascot_prefetch_scratch_new() {
+  struct mascot_prefetch_scratch *scratch =
+      calloc(1, sizeof(struct mascot_prefetch_scratch));
+  if (!scratch)
+    ERROR("Could not create prefetch buffers: Allocation failed");
+  return scratch;
+}
+
+void mascot_prefetch_scratch_free(struct mascot_prefetch_scratch *scratch) {
+  if (!scratch)
+    return;
+  free(scratch->requests);
+  free(scratch->lanes);
+  free(scratch->groups);
+  free(scratch);
+}
+
+// Buffers only grow, so steady state ticks don't allocate
+static bool mascot_prefetch_reserve(struct mascot_prefetch_scratch *scratch,
+                                    uint32_t count) {
+  if (count <= scratch->requests_capacity)
+    return true;
+  uint32_t capacity = scratch->requests_capacity * 2;
+  if (capacity < count)
+    capacity = count;
+
+  struct mascot_prefetch_request *requests = realloc(
+      scratch->requests, capacity * sizeof(struct mascot_prefetch_request));
+  if (!requests)
+    return false;
+  scratch->requests = requests;
+  struct mascot **lanes =
+      realloc(scratch->lanes, capacity * sizeof(struct mascot *));
+  if (!lanes)
+    return false;
+  scratch->lanes = lanes;
+  scratch->requests_capacity = capacity;
+  return true;
+}
+
+static void mascot_prefetch_add(struct mascot_prefetch_scratch *scratch,
+                                uint32_t *count,
+                                const struct mascot_expression *expression,
+                                struct mascot *mascot, bool recheck) {
+  if (!expression || !expression->body || !expression->body->memoizable)
+    return;
+  if (recheck && expression->evaluate_once)
+    return;
+  scratch->requests[(*count)++] =
+      (struct mascot_prefetch_request){expression->body, mascot, 0};
+}
+
+// Groups requests by program into lanes, keeping order of mascots within
+// group. Returns false if table couldn't be allocated
+static bool mascot_prefetch_group(struct mascot_prefetch_scratch *scratch,
+                                  uint32_t requests_count) {
+  uint32_t capacity = scratch->groups_capacity ? scratch->groups_capacity : 16;
+  while (capacity < requests_count * 2)
+    capacity *= 2;
+  if (capacity != scratch->groups_capacity) {
+    struct mascot_prefetch_group *groups =
+        realloc(scratch->groups, capacity * sizeof(struct mascot_prefetch_group));
+    if (!groups)
+      return false;
+    scratch->groups = groups;
+    scratch->groups_capacity = capacity;
+  }
+  memset(scratch->groups, 0, capacity * sizeof(struct mascot_prefetch_group));
+
+  for (uint32_t i = 0; i < requests_count; i++) {
+    struct mascot_prefetch_request *request = &scratch->requests[i];
+    uint32_t slot =
+        (uint32_t)(((uintptr_t)request->program >> 4) * 2654435761u) &
+        (capacity - 1);
+    while (scratch->groups[slot].program &&
+           scratch->groups[slot].program != request->program)
+      slot = (slot + 1) & (capacity - 1);
+    scratch->groups[slot].program = request->program;
+    scratch->groups[slot].count++;
+    request->group = slot;
+  }
+
+  uint32_t start = 0;
+  for (uint32_t slot = 0; slot < capacity; slot++) {
+    scratch->groups[slot].start = start;
+    start += scratch->groups[slot].count;
+    scratch->groups[slot].count = 0;
+  }
+  for (uint32_t i = 0; i < requests_count; i++) {
+    struct mascot_prefetch_group *group =
+        &scratch->groups[scratch->requests[i].group];
+    scratch->lanes[group->start + group->count++] = scratch->requests[i].mascot;
+  }
+  return true;
+}
+
+// Conditions current actions recheck every tick are evaluated for all mascots
+// sharing them at once, before mascots are ticked. Mascot uses memoized result
+// only if its inputs are unchanged by the time its action checks condition
+void mascot_prefetch_conditions(struct mascot_prefetch_scratch *scratch,
+                                struct mascot **mascots, uint32_t count) {
+  if (!scratch || count < 2)
+    return;
+
+  // Mascots are locked one at a time, actions may change right after, which
+  // only costs an unused prefetch
+  uint32_t requests_count = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    struct mascot *mascot = mascots[i];
+    pthread_mutex_lock(&mascot->tick_lock);
+    const struct mascot_action *action = mascot->current_action.action;
+    if (!action ||
+        !mascot_prefetch_reserve(scratch, requests_count + 2 + action->length)) {
+      pthread_mutex_unlock(&mascot->tick_lock);
+      continue;
+    }
+    mascot_prefetch_add(scratch, &requests_count,
+                        mascot->current_action.condition, mascot, true);
+    mascot_prefetch_add(scratch, &requests_count, action->condition, mascot,
+                        true);
+    for (uint16_t j = 0; j < action->length; j++) {
+      if (action->content[j].kind != mascot_action_content_type_animation ||
+          !action->content[j].value.animation)
+        continue;
+      mascot_prefetch_add(scratch, &requests_count,
+                          action->content[j].value.animation->condition, mascot,
+                          false);
+    }
+    pthread_mutex_unlock(&mascot->tick_lock);
+  }
+
+  if (requests_count < 2 || !mascot_prefetch_group(scratch, requests_count))
+    return;
+
+  for (uint32_t slot = 0; slot < scratch->groups_capacity; slot++) {
+    const struct mascot_prefetch_group *group = &scratch->groups[slot];
+    // Single mascot gains nothing from evaluating ahead of time
+    if (group->count > 1)
+      expression_vm_prefetch(group->program, &scratch->lanes[group->start],
+                             group->count);
+  }
+}
+
 // Try to start dragging the mascot
 bool mascot_drag_started(struct mascot *mascot,
                          environment_pointer_t *pointer) {
@@ -928,16 +1098,8 @@ struct mascot *mascot_new(const struct mascot_prototype *prototype,
 
   // Look up the starting behavior
   if (starting_behavior) {
-    const struct mascot_behavior *starting_behavior_ptr = NULL;
-    for (uint16_t i = 0; i < prototype->behavior_count; i++) {
-      if (!strcmp(prototype->behavior_definitions[i]->name,
-                  starting_behavior) &&
-          strlen(prototype->behavior_definitions[i]->name) ==
-              strlen(starting_behavior)) {
-        starting_behavior_ptr = prototype->behavior_definitions[i];
-        break;
-      }
-    }
+    const struct mascot_behavior *starting_behavior_ptr =
+        mascot_prototype_behavior_by_name(prototype, starting_behavior);
     if (starting_behavior_ptr) {
       mascot_set_behavior(mascot, starting_behavior_ptr);
     } else {
@@ -956,6 +1118,7 @@ struct mascot *mascot_new(const struct mascot_prototype *prototype,
   environment_subsurface_set_position(mascot->subsurface, posx,
                                       environment_screen_height(env) - posy);
   mascot_total_count++;
+  expression_source_changed(EXPRESSION_SOURCE_POPULATION);
 
   pthread_mutex_init(&mascot->tick_lock, &init_attrs);
   INFO("<Mascot:%s:%u> Created new mascot of type \"%s\" at (%d,%d)",
@@ -987,6 +1150,7 @@ void mascot_unlink(struct mascot *mascot) {
   protocol_server_mascot_destroyed(mascot);
 
   if (mascot->prototype) {
+    mascot_atlas_unpin(mascot->prototype->atlas);
     mascot_prototype_unlink((struct mascot_prototype *)mascot->prototype);
   }
 
@@ -994,7 +1158,7 @@ void mascot_unlink(struct mascot *mascot) {
     environment_destroy_subsurface(mascot->subsurface);
   }
 
-  mascot_announce_affordance(mascot, NULL);
+  mascot_announce_affordance(mascot, ATOM_NONE);
 
   mascot_detach_affordance_manager(mascot);
 
@@ -1004,6 +1168,7 @@ void mascot_unlink(struct mascot *mascot) {
   pthread_mutex_destroy(&mascot->tick_lock);
 
   mascot_total_count--;
+  expression_source_changed(EXPRESSION_SOURCE_POPULATION);
 
   free(mascot);
 }
@@ -1015,11 +1180,16 @@ static void mascot_init_(struct mascot *mascot,
     return;
 
   if (mascot->prototype) {
+    mascot_atlas_unpin(mascot->prototype->atlas);
     mascot_prototype_unlink((struct mascot_prototype *)mascot->prototype);
   }
 
   mascot->prototype = prototype;
   mascot_prototype_link(mascot->prototype);
+  mascot_atlas_pin(mascot->prototype->atlas);
+
+  // Results memoized for expressions of previous prototype
+  memset(mascot->expression_cache, 0, sizeof(mascot->expression_cache));
 
   if (!save_vars) {
     for (uint16_t i = 0; i < prototype->local_variables_count; i++) {
@@ -1077,7 +1247,7 @@ static void mascot_init_(struct mascot *mascot,
   mascot->next_frame_tick = 0;
   mascot->dragged = false;
   mascot->state = mascot_state_none;
-  mascot->current_affordance = NULL;
+  mascot->current_affordance = ATOM_NONE;
   memset(mascot->action_stack, 0, sizeof(const struct mascot_action *) * 128);
   mascot->as_p = 0;
   memset(mascot->behavior_pool, 0,
@@ -21,6 +21,7 @@
 #define MASCOT_H
 
 #include "master_header.h"
+#include "atom.h"
 #include "wayland_includes.h"
 #include <stdint.h>
 #include <pthread.h>
@@ -259,7 +260,8 @@ struct mascot_animation {
 
 struct mascot_expression {
     bool evaluate_once:1;
-    struct expression_prototype* body;
+    uint16_t id; // Index of program in programs.json
+    struct expression_prototype* body; // Shared by all identical programs of prototype
 };
 
 struct mascot_expression_value {
@@ -309,6 +311,7 @@ struct mascot_action_content {
 // Action is a sequence of animations or other actions
 struct mascot_action {
     char* name; // Name of the action
+    atom_t name_atom; // Interned name of the action
     bool loop; // Loop the action?
     enum mascot_action_type type; // Type of the action
     enum mascot_action_embedded_property embedded_type; // Embedded property of the action
@@ -321,6 +324,7 @@ struct mascot_action {
     const char* select_behavior; // Select behavior of the action
     const char* born_behavior; // Born behavior of the action
     const char* affordance; // Affordance of the action
+    atom_t affordance_atom; // Interned affordance of the action
     const char* transform_target; // prototype to transform to
     const char* born_mascot; // Mascot to be born
     const char* behavior; // Behavior to be set
@@ -359,6 +363,7 @@ struct mascot_behavior_reference {
 
 struct mascot_behavior {
     const char* name; // Name of the behavior
+    atom_t name_atom; // Interned name of the behavior
 
     bool hidden;
     const struct mascot_action* action;
@@ -399,6 +404,7 @@ struct mascot_prototype {
     uint16_t reference_count;
 
     mascot_prototype_store* prototype_store;
+    struct expression_arena* expression_arena; // Storage of expression bodies, shared by identical programs
 };
 
 enum mascot_state {
@@ -445,7 +451,7 @@ struct mascot {
 
     enum mascot_state state;
 
-    const char* current_affordance; // Current affordance of the mascot
+    atom_t current_affordance; // Current affordance of the mascot, ATOM_NONE if none
     struct mascot* target_mascot; // Target mascot of the current action
     struct mascot_affordance_manager* affordance_manager; // Affordance manager of the mascot
 
@@ -485,6 +491,9 @@ struct mascot {
 
     struct mascot_local_variable local_variables[128];
 
+    // Memoized results of expressions, indexed by expression id
+    struct expression_cache_entry expression_cache[EXPRESSION_CACHE_SIZE];
+
     // Tick syncronization
     pthread_mutex_t tick_lock;
     uint16_t refcounter;
@@ -507,6 +516,12 @@ void mascot_link(struct mascot* mascot);
 
 // Standard tick routine
 enum mascot_tick_result mascot_tick(struct mascot* mascot, uint32_t tick, struct mascot_tick_return* tick_return);
+// Evaluates conditions shared by mascots about to be ticked in batches, ahead of their ticks.
+// Scratch holds buffers reused between calls, kept by the caller
+struct mascot_prefetch_scratch;
+struct mascot_prefetch_scratch* mascot_prefetch_scratch_new();
+void mascot_prefetch_scratch_free(struct mascot_prefetch_scratch* scratch);
+void mascot_prefetch_conditions(struct mascot_prefetch_scratch* scratch, struct mascot** mascots, uint32_t count);
 
 // Behavior management
 void mascot_set_behavior(struct mascot* mascot, const struct mascot_behavior* behavior);
@@ -524,8 +539,8 @@ bool mascot_environment_changed(struct mascot* mascot, environment_t* env);
 // Affordance management, used for interaction between mascots
 void mascot_attach_affordance_manager(struct mascot* mascot, struct mascot_affordance_manager* manager);
 void mascot_detach_affordance_manager(struct mascot* mascot);
-void mascot_announce_affordance(struct mascot* mascot, const char* affordance);
-struct mascot* mascot_get_target_by_affordance(struct mascot* mascot, const char* affordance);
+void mascot_announce_affordance(struct mascot* mascot, atom_t affordance);
+struct mascot* mascot_get_target_by_affordance(struct mascot* mascot, atom_t affordance);
 
 // Interact with target mascot
 bool mascot_interact(struct mascot* mascot, struct mascot* target, const char* affordance, const char* my_behavior, const char* your_behavior);
@@ -24,103 +24,886 @@
 #include <sys/stat.h>
 
 #include "mascot_atlas.h"
+#include "mascot_atlas_cache.h"
+#include "pixel_ops.h"
+#include "config.h"
 #include <errno.h>
+#include <inttypes.h>
 #include <io.h>
+#include <math.h>
+#include <pthread.h>
+#include <time.h>
 
 #define QOI_IMPLEMENTATION
 #include "third_party/qoi/qoi.h"
 
 void _find_ireg(const uint8_t* buffer, uint32_t width, uint32_t height, uint32_t* out_x, uint32_t* out_y, uint32_t* out_width, uint32_t* out_height) {
+    size_t stride = (size_t)width * 4;
     uint32_t minX = UINT32_MAX;
     uint32_t minY = UINT32_MAX;
     uint32_t maxX = 0;
     uint32_t maxY = 0;
 
+    // First non-transparent row from the top, it also gives initial horizontal extent
     for (uint32_t y = 0; y < height; ++y) {
-        for (uint32_t x = 0; x < width; ++x) {
-            // Calculate the index for the alpha component of the current pixel
-            uint32_t alphaIndex = (y * width + x) * 4 + 3; // 4 components per pixel, alpha is the 4th
-            uint8_t alpha = buffer[alphaIndex];
-
-            if (alpha > 0) { // Pixel is not fully transparent
-                if (x < minX) minX = x;
-                if (x > maxX) maxX = x;
-                if (y < minY) minY = y;
-                if (y > maxY) maxY = y;
-            }
+        uint32_t first = pixel_ops_find_opaque(buffer + y * stride, 0, width);
+        if (first != UINT32_MAX) {
+            minY = y;
+            minX = first;
+            maxX = pixel_ops_rfind_opaque(buffer + y * stride, first, width);
+            break;
         }
     }
 
-    // Calculate the output values
-    if (minX <= maxX && minY <= maxY) { // Ensure we found at least one non-transparent pixel
-        *out_x = minX;
-        *out_y = minY;
-        *out_width = maxX - minX + 1;
-        *out_height = maxY - minY + 1;
-    } else { // No non-transparent pixels found, return an empty region
+    if (minY == UINT32_MAX) { // No non-transparent pixels found, return an empty region
         *out_x = 0;
         *out_y = 0;
         *out_width = 0;
         *out_height = 0;
+        return;
+    }
+
+    // Last non-transparent row from the bottom
+    maxY = minY;
+    for (uint32_t y = height - 1; y > minY; --y) {
+        uint32_t first = pixel_ops_find_opaque(buffer + y * stride, 0, width);
+        if (first != UINT32_MAX) {
+            maxY = y;
+            if (first < minX) minX = first;
+            uint32_t last = pixel_ops_rfind_opaque(buffer + y * stride, first, width);
+            if (last > maxX) maxX = last;
+            break;
+        }
+    }
+
+    // Rows in between can only widen the region, so only columns outside of it are scanned.
+    // Once region spans the whole width nothing can change anymore
+    for (uint32_t y = minY + 1; y < maxY && (minX > 0 || maxX < width - 1); ++y) {
+        const uint8_t* row = buffer + y * stride;
+        if (minX > 0) {
+            uint32_t first = pixel_ops_find_opaque(row, 0, minX);
+            if (first != UINT32_MAX) minX = first;
+        }
+        if (maxX < width - 1) {
+            uint32_t last = pixel_ops_rfind_opaque(row, maxX + 1, width);
+            if (last != UINT32_MAX) maxX = last;
+        }
+    }
+
+    *out_x = minX;
+    *out_y = minY;
+    *out_width = maxX - minX + 1;
+    *out_height = maxY - minY + 1;
+}
+
+// Converts RGBA pixels to premultiplied ARGB8888, writes direct image to out and mirrored one to mirror_out (if not NULL)
+void _convert_pixels(const uint8_t* buffer, uint8_t* out, uint8_t* mirror_out, uint32_t width, uint32_t height) {
+    size_t stride = (size_t)width * 4;
+    for (uint32_t y = 0; y < height; y++) {
+        pixel_ops_convert_row(buffer + y * stride, out + y * stride, mirror_out ? mirror_out + y * stride : NULL, width);
+    }
+}
+
+// Read-only mapping of an uploaded pool, kept while any share placed in it is alive
+struct mascot_sprite_pool {
+    uint8_t* pixels;
+    size_t size;
+    uint32_t refcount;
+};
+
+struct mascot_atlas_decoded_sprite;
+
+// Sprites with identical decoded content are uploaded once and shared by every atlas that contains them.
+// Re-skinned packs often ship byte-identical images, so memory scales with the number of unique sprites.
+// Hash only narrows the candidates down, pixels are compared before a share is reused.
+struct mascot_sprite_share {
+    uint64_t hash;
+    uint32_t width, height;
+    uint32_t scale; // Pre-scaled sprites are only shared with sprites of the same scale
+    uint32_t trim_x, trim_y, trim_w, trim_h; // Trimmed rectangle of the uploaded image
+    environment_buffer_t* buffers[2]; // Left and right (mirrored) buffers, NULL until uploaded
+    bool mirrored_copy; // Right buffer exists, otherwise left one is flipped by the compositor
+    uint64_t bytes; // Size of uploaded pixel data
+    struct mascot_sprite_pool* pool; // Pool left image was uploaded into
+    const uint8_t* pixels; // Trimmed left image in the pool
+    size_t stride;
+    const struct mascot_atlas_decoded_sprite* pending; // Sprite that created the share, until it is uploaded
+    uint32_t refcount;
+    struct mascot_sprite_share* next;
+};
+
+#define MASCOT_SPRITE_SHARE_BUCKETS 1024
+
+static struct mascot_sprite_share* sprite_shares[MASCOT_SPRITE_SHARE_BUCKETS] = {0};
+static pthread_mutex_t sprite_shares_mutex = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t sprite_shares_bytes = 0; // Pixel data of all shares, compared against ATLAS_MEMORY_BUDGET
+
+// Every live atlas, for eviction. Protected by sprite_shares_mutex
+static struct mascot_atlas* atlases = NULL;
+// Advanced on materialization and unpinning, uses only copy it so attaching poses never writes shared state
+static uint64_t atlas_use_clock = 0;
+
+static uint64_t _sprite_hash(const uint8_t* pixels, uint32_t width, uint32_t height)
+{
+    size_t len = (size_t)width * (size_t)height * 4;
+    return mascot_atlas_cache_hash(pixels, len, 0xcbf29ce484222325ull ^ (((uint64_t)width << 32) | height));
+}
+
+// Must be called with sprite_shares_mutex held
+static void _sprite_share_release(struct mascot_sprite_share* share)
+{
+    if (!share) return;
+    if (--share->refcount) return;
+
+    struct mascot_sprite_share** link = &sprite_shares[share->hash % MASCOT_SPRITE_SHARE_BUCKETS];
+    while (*link && *link != share) link = &(*link)->next;
+    if (*link) *link = share->next;
+    sprite_shares_bytes -= share->bytes;
+
+    environment_buffer_destroy(share->buffers[0]);
+    environment_buffer_destroy(share->buffers[1]);
+    if (share->pool && !--share->pool->refcount) {
+        munmap(share->pool->pixels, share->pool->size);
+        free(share->pool);
+    }
+    free(share);
+}
+
+// Per-sprite state of atlas build
+struct mascot_atlas_decoded_sprite {
+    qoi_desc desc;
+    uint8_t* rgba; // Decoded straight RGBA pixels
+    uint8_t* scaled; // Converted direct and mirrored pixels of pre-scaled sprite, until they are cached
+    const uint8_t* converted; // Converted direct and mirrored pixels in the cache (or scaled), if there are any
+    uint64_t file_hash; // Hash of the QOI file, used as cache key
+    uint64_t hash; // Hash of rgba, used for sharing
+    uint32_t ireg_x, ireg_y, ireg_w, ireg_h; // In frame coordinates
+    uint32_t pixel_width, pixel_height; // Size of uploaded image, differs from frame size if sprite is pre-scaled
+    uint32_t pixel_ireg_x, pixel_ireg_y, pixel_ireg_w, pixel_ireg_h; // Input region in uploaded image
+    uint32_t trim_x, trim_y, trim_w, trim_h; // Part of the uploaded image that is uploaded, transparent borders are cut off
+    uint32_t sheet; // Sheet the sprite is placed in
+    uint32_t sheet_x, sheet_y; // Position within the sheet
+    bool upload; // Sprite was not shared, and has to be converted into the pool
+    uint8_t* mask; // Left image mask followed by mirrored one, to be built on conversion. NULL if already built
+};
+
+// Row of trimmed left image in converted pixels. Straight pixels are converted into row_buf
+static const uint8_t* _sprite_trimmed_row(const struct mascot_atlas_decoded_sprite* sprite, uint32_t y, uint8_t* row_buf)
+{
+    size_t offset = ((size_t)(sprite->trim_y + y) * sprite->pixel_width + sprite->trim_x) * 4;
+    if (sprite->converted) return sprite->converted + offset;
+    pixel_ops_convert_row(sprite->rgba + offset, row_buf, NULL, sprite->trim_w);
+    return row_buf;
+}
+
+// Mirrored image is derived from the left one, so comparing left images is enough.
+// row_bufs holds two rows of the widest sprite
+static bool _sprite_share_matches(const struct mascot_sprite_share* share, const struct mascot_atlas_decoded_sprite* sprite, uint8_t* row_bufs)
+{
+    if (share->trim_x != sprite->trim_x || share->trim_y != sprite->trim_y || share->trim_w != sprite->trim_w || share->trim_h != sprite->trim_h) return false;
+    if (!share->pending && !share->pixels) return false;
+
+    size_t row_len = (size_t)sprite->trim_w * 4;
+    for (uint32_t y = 0; y < sprite->trim_h; y++) {
+        const uint8_t* shared_row = share->pending ? _sprite_trimmed_row(share->pending, y, row_bufs + row_len) : share->pixels + y * share->stride;
+        if (memcmp(_sprite_trimmed_row(sprite, y, row_bufs), shared_row, row_len)) return false;
     }
+    return true;
+}
+
+// Must be called with sprite_shares_mutex held, after sprite is trimmed. Sets *created if share was not registered before
+static struct mascot_sprite_share* _sprite_share_acquire(const struct mascot_atlas_decoded_sprite* sprite, uint32_t scale, bool mirrored_copy, uint8_t* row_bufs, bool* created)
+{
+    struct mascot_sprite_share** bucket = &sprite_shares[sprite->hash % MASCOT_SPRITE_SHARE_BUCKETS];
+    for (struct mascot_sprite_share* share = *bucket; share; share = share->next) {
+        if (share->hash != sprite->hash || share->width != sprite->desc.width || share->height != sprite->desc.height) continue;
+        if (share->scale != scale || share->mirrored_copy != mirrored_copy) continue;
+        if (!_sprite_share_matches(share, sprite, row_bufs)) continue;
+        share->refcount++;
+        *created = false;
+        return share;
+    }
+
+    struct mascot_sprite_share* share = calloc(1, sizeof(struct mascot_sprite_share));
+    if (!share) ERROR("Could not create sprite share: Allocation failed");
+    share->hash = sprite->hash;
+    share->width = sprite->desc.width;
+    share->height = sprite->desc.height;
+    share->scale = scale;
+    share->trim_x = sprite->trim_x;
+    share->trim_y = sprite->trim_y;
+    share->trim_w = sprite->trim_w;
+    share->trim_h = sprite->trim_h;
+    share->mirrored_copy = mirrored_copy;
+    share->pending = sprite;
+    share->refcount = 1;
+    share->next = *bucket;
+    *bucket = share;
+    *created = true;
+    return share;
+}
+
+// Sprites are packed into few large sheets, each a single wl_buffer. Sprites are cropped out of it by viewport.
+// If sprites are mirrored by copies, every sheet is followed by its horizontally mirrored copy.
+// Without viewporter every sprite gets sheet of its own size
+struct mascot_atlas_sheet {
+    uint64_t offset; // Offset in the pool
+    uint32_t width, height;
+    environment_buffer_t* buffers[2];
+};
+
+// Kept within texture size limits of any sane compositor
+#define MASCOT_ATLAS_SHEET_MAX 4096
+// Transparent gap between packed sprites, so filtering of scaled sprites doesn't pick up their neighbours
+#define MASCOT_ATLAS_SHEET_GUTTER 1
+// Failed materialization decodes every sprite again, so it isn't repeated on every attach
+#define MASCOT_ATLAS_MATERIALIZE_BACKOFF 5000000000ull
+
+static int _pack_order(const void* a, const void* b, void* data)
+{
+    const struct mascot_atlas_decoded_sprite* sprites = data;
+    const struct mascot_atlas_decoded_sprite* sa = &sprites[*(const uint16_t*)a];
+    const struct mascot_atlas_decoded_sprite* sb = &sprites[*(const uint16_t*)b];
+    if (sa->trim_h != sb->trim_h) return sa->trim_h < sb->trim_h ? 1 : -1;
+    if (sa->trim_w != sb->trim_w) return sa->trim_w < sb->trim_w ? 1 : -1;
+    return *(const uint16_t*)a - *(const uint16_t*)b;
+}
+
+static uint32_t _sheet_add(struct mascot_atlas_sheet** sheets, uint32_t* sheet_count, uint32_t width)
+{
+    struct mascot_atlas_sheet* new_sheets = realloc(*sheets, (*sheet_count + 1) * sizeof(struct mascot_atlas_sheet));
+    if (!new_sheets) ERROR("Could not create atlas: Allocation failed for sheets");
+    *sheets = new_sheets;
+    (*sheets)[*sheet_count] = (struct mascot_atlas_sheet) {.width = width};
+    return (*sheet_count)++;
 }
 
-bool _write_buffers(environment_buffer_factory_t* factory, uint64_t* buffer_factory_pos, const uint8_t* buffer, size_t buffer_len, uint32_t width, uint32_t height) {
+// Places every uploaded sprite into a sheet and lays sheets out in the pool. Returns pool size.
+// Packing is shelf based (next fit, decreasing height): sprites are sorted by height and put in rows,
+// which is close to optimal for frames of an animation pack, as they are mostly of similar sizes
+static uint64_t _layout_sheets(struct mascot_atlas_decoded_sprite* sprites, uint16_t count, bool packed, bool mirrored_copies, struct mascot_atlas_sheet** out_sheets, uint32_t* out_sheet_count)
+{
+    struct mascot_atlas_sheet* sheets = NULL;
+    uint32_t sheet_count = 0;
+
+    if (!packed) {
+        for (uint16_t i = 0; i < count; i++) {
+            if (!sprites[i].upload) continue;
+            sprites[i].sheet = _sheet_add(&sheets, &sheet_count, sprites[i].trim_w);
+            sprites[i].sheet_x = 0;
+            sprites[i].sheet_y = 0;
+            sheets[sprites[i].sheet].height = sprites[i].trim_h;
+        }
+    } else {
+        uint16_t* order = calloc(count, sizeof(uint16_t));
+        if (!order) ERROR("Could not create atlas: Allocation failed for packing order");
+
+        uint16_t order_count = 0;
+        uint64_t area = 0;
+        uint32_t max_width = 0;
+        for (uint16_t i = 0; i < count; i++) {
+            if (!sprites[i].upload) continue;
+            order[order_count++] = i;
+            area += (uint64_t)(sprites[i].trim_w + MASCOT_ATLAS_SHEET_GUTTER) * (sprites[i].trim_h + MASCOT_ATLAS_SHEET_GUTTER);
+            if (sprites[i].trim_w > max_width) max_width = sprites[i].trim_w;
+        }
+        qsort_r(order, order_count, sizeof(uint16_t), _pack_order, sprites);
 
-    if (buffer_len > QOI_PIXELS_MAX) return false;
+        // Roughly square sheets, oversized sprites get sheets as wide as they are
+        uint32_t sheet_width = 64;
+        while (sheet_width < MASCOT_ATLAS_SHEET_MAX && (sheet_width < max_width || (uint64_t)sheet_width * sheet_width < area)) sheet_width *= 2;
+        if (sheet_width < max_width) sheet_width = max_width;
 
-    uint8_t* buffers = calloc(2, buffer_len);
+        uint32_t x = 0, y = 0, shelf_height = 0;
+        uint32_t current = UINT32_MAX;
+        for (uint16_t i = 0; i < order_count; i++) {
+            struct mascot_atlas_decoded_sprite* sprite = &sprites[order[i]];
+            if (current != UINT32_MAX && x + sprite->trim_w > sheet_width) {
+                y += shelf_height + MASCOT_ATLAS_SHEET_GUTTER;
+                x = 0;
+                shelf_height = 0;
+            }
+            if (current == UINT32_MAX || (y && y + sprite->trim_h > MASCOT_ATLAS_SHEET_MAX)) {
+                current = _sheet_add(&sheets, &sheet_count, sheet_width);
+                x = y = shelf_height = 0;
+            }
+
+            sprite->sheet = current;
+            sprite->sheet_x = x;
+            sprite->sheet_y = y;
+            x += sprite->trim_w + MASCOT_ATLAS_SHEET_GUTTER;
+            if (sprite->trim_h > shelf_height) shelf_height = sprite->trim_h;
+            sheets[current].height = y + shelf_height;
+        }
+        free(order);
+    }
+
+    uint64_t pos = 0;
+    for (uint32_t i = 0; i < sheet_count; i++) {
+        sheets[i].offset = pos;
+        pos += (uint64_t)sheets[i].width * sheets[i].height * 4 * (mirrored_copies ? 2 : 1);
+    }
+
+    *out_sheets = sheets;
+    *out_sheet_count = sheet_count;
+    return pos;
+}
+
+struct mascot_atlas_job {
+    const char* dirname;
+    char** names;
+    struct mascot_atlas_decoded_sprite* sprites;
+    uint8_t* pool; // Mapped pool, destination of conversion
+    const struct mascot_atlas_sheet* sheets;
+    struct mascot_atlas_cache* cache;
+    const struct mascot_atlas_cache_entry* cache_entries;
+    bool mirrored_copies; // Pool holds mirrored copy after every sheet
+    uint32_t scale; // In MASCOT_ATLAS_SCALE_UNIT units
+    bool (*work)(struct mascot_atlas_job* job, uint16_t index);
+    uint16_t count;
+    uint32_t next; // Next sprite to be picked up, atomic
+    bool failed;
+};
+
+static bool _hash_sprite_file(struct mascot_atlas_job* job, uint16_t index)
+{
+    char fullpath[256] = {0};
+    size_t printed = snprintf(fullpath, 256, "%s/%s", job->dirname, job->names[index]);
+    UNUSED(printed);
 
-    if (!buffers) {
-        WARN("Failed to write buffers to memfd: Allocation failed for buffer with size %d", buffer_len*2);
+    if (!mascot_atlas_cache_hash_file(fullpath, &job->sprites[index].file_hash)) {
+        WARN("Could not create atlas from dir \"%s\": Failed to read file \"%s\"", job->dirname, job->names[index]);
         return false;
     }
+    return true;
+}
 
-    // Convert RGBA to ARGB and fill the direct and mirrored buffers
-    for (uint32_t y = 0; y < height; y++) {
-        for (uint32_t x = 0; x < width; x++) {
-            size_t rgbaIndex = (y * width + x) * 4;
-            size_t argbIndex = rgbaIndex; // Direct mapping for ARGB buffer
-            size_t mirrorIndex = (y * width + (width - 1 - x)) * 4; // Mirrored mapping
-            
-            // Premultiply aplha
-            *(buffers+argbIndex+0) = (buffer[rgbaIndex + 2] * buffer[rgbaIndex+3] + 127) / 255; // Premultiplied B
-            *(buffers+argbIndex+1) = (buffer[rgbaIndex + 1] * buffer[rgbaIndex+3] + 127) / 255; // Premultiplied G
-            *(buffers+argbIndex+2) = (buffer[rgbaIndex + 0] * buffer[rgbaIndex+3] + 127) / 255; // Premultiplied R
-            *(buffers+argbIndex+3) =  buffer[rgbaIndex + 3]; // Just alpha
-
-            *(buffers+buffer_len+mirrorIndex+0) = (buffer[rgbaIndex + 2] * buffer[rgbaIndex+3] + 127) / 255; // Premultiplied B
-            *(buffers+buffer_len+mirrorIndex+1) = (buffer[rgbaIndex + 1] * buffer[rgbaIndex+3] + 127) / 255; // Premultiplied G
-            *(buffers+buffer_len+mirrorIndex+2) = (buffer[rgbaIndex + 0] * buffer[rgbaIndex+3] + 127) / 255; // Premultiplied R
-            *(buffers+buffer_len+mirrorIndex+3) =  buffer[rgbaIndex + 3]; // Just alpha
-
-
-            // *(buffers+argbIndex) = buffer[rgbaIndex + 3] ? buffer[rgbaIndex + 2] : 0; // B
-            // *(buffers+argbIndex+1) = buffer[rgbaIndex + 3] ? buffer[rgbaIndex + 1] : 0; // G
-            // *(buffers+argbIndex+2) = buffer[rgbaIndex + 3] ? buffer[rgbaIndex + 0] : 0; // R
-            // *(buffers+argbIndex+3) = buffer[rgbaIndex + 3]; // A
-
-            // Fill mirrored ARGB buffer
-            // *(buffers+buffer_len+mirrorIndex) = buffer[rgbaIndex + 3] ? buffer[rgbaIndex + 2] : 0; // B
-            // *(buffers+buffer_len+mirrorIndex+1) = buffer[rgbaIndex + 3] ? buffer[rgbaIndex + 1] : 0; // G
-            // *(buffers+buffer_len+mirrorIndex+2) = buffer[rgbaIndex + 3] ? buffer[rgbaIndex + 0] : 0; // R
-            // *(buffers+buffer_len+mirrorIndex+3) = buffer[rgbaIndex + 3]; // A
+static bool _decode_sprite(struct mascot_atlas_job* job, uint16_t index)
+{
+    struct mascot_atlas_decoded_sprite* sprite = &job->sprites[index];
+    char fullpath[256] = {0};
+    size_t printed = snprintf(fullpath, 256, "%s/%s", job->dirname, job->names[index]);
+    UNUSED(printed);
+
+    sprite->rgba = qoi_read(fullpath, &sprite->desc, 4);
+    if (!sprite->rgba) {
+        WARN("Could not create atlas from dir \"%s\": Failed to read QOI file \"%s\"", job->dirname, job->names[index]);
+        return false;
+    }
+
+    _find_ireg(sprite->rgba, sprite->desc.width, sprite->desc.height, &sprite->ireg_x, &sprite->ireg_y, &sprite->ireg_w, &sprite->ireg_h);
+    sprite->hash = _sprite_hash(sprite->rgba, sprite->desc.width, sprite->desc.height);
+
+    sprite->pixel_width = sprite->desc.width;
+    sprite->pixel_height = sprite->desc.height;
+    sprite->pixel_ireg_x = sprite->ireg_x;
+    sprite->pixel_ireg_y = sprite->ireg_y;
+    sprite->pixel_ireg_w = sprite->ireg_w;
+    sprite->pixel_ireg_h = sprite->ireg_h;
+    if (job->scale == MASCOT_ATLAS_SCALE_UNIT) return true;
+
+    // Filtering needs premultiplied pixels, otherwise colors of transparent pixels bleed into edges
+    sprite->pixel_width = mascot_atlas_cache_scaled_size(sprite->desc.width, job->scale);
+    sprite->pixel_height = mascot_atlas_cache_scaled_size(sprite->desc.height, job->scale);
+
+    size_t frame_len = (size_t)sprite->desc.width * sprite->desc.height * 4;
+    size_t scaled_len = (size_t)sprite->pixel_width * sprite->pixel_height * 4;
+    uint8_t* premultiplied = malloc(frame_len);
+    sprite->scaled = malloc(scaled_len * 2);
+    if (!premultiplied || !sprite->scaled) ERROR("Could not create atlas from dir \"%s\": Allocation failed for pre-scaled sprite", job->dirname);
+
+    _convert_pixels(sprite->rgba, premultiplied, NULL, sprite->desc.width, sprite->desc.height);
+    free(sprite->rgba);
+    sprite->rgba = NULL;
+    bool resampled = pixel_ops_resample(premultiplied, sprite->desc.width, sprite->desc.height, sprite->scaled, sprite->pixel_width, sprite->pixel_height);
+    free(premultiplied);
+    if (!resampled) ERROR("Could not create atlas from dir \"%s\": Allocation failed for resampling", job->dirname);
+
+    size_t stride = (size_t)sprite->pixel_width * 4;
+    for (uint32_t y = 0; y < sprite->pixel_height; y++) {
+        const uint8_t* row = sprite->scaled + y * stride;
+        uint8_t* mirror_row = sprite->scaled + scaled_len + y * stride;
+        for (uint32_t x = 0; x < sprite->pixel_width; x++) memcpy(mirror_row + (sprite->pixel_width - 1 - x) * 4, row + x * 4, 4);
+    }
+
+    // Alpha is the last byte in both RGBA and ARGB8888
+    _find_ireg(sprite->scaled, sprite->pixel_width, sprite->pixel_height, &sprite->pixel_ireg_x, &sprite->pixel_ireg_y, &sprite->pixel_ireg_w, &sprite->pixel_ireg_h);
+    sprite->converted = sprite->scaled;
+    return true;
+}
+
+// Converts every decoded sprite into newly created cache, so the pool can be filled from it like on a cache hit
+static bool _cache_sprite(struct mascot_atlas_job* job, uint16_t index)
+{
+    struct mascot_atlas_decoded_sprite* sprite = &job->sprites[index];
+    uint8_t* out = mascot_atlas_cache_pixels(job->cache, &job->cache_entries[index]);
+    if (sprite->scaled) {
+        memcpy(out, sprite->scaled, (size_t)sprite->pixel_width*(size_t)sprite->pixel_height*(size_t)4*2);
+        free(sprite->scaled);
+        sprite->scaled = NULL;
+    } else {
+        _convert_pixels(sprite->rgba, out, out + (size_t)sprite->desc.width*(size_t)sprite->desc.height*(size_t)4, sprite->desc.width, sprite->desc.height);
+    }
+    sprite->converted = out;
+    free(sprite->rgba);
+    sprite->rgba = NULL;
+    return true;
+}
+
+// Uses alpha of direct image, which is the last byte of both straight RGBA and converted pixels.
+// Pre-scaled images are sampled at centers of frame pixels
+static void _build_mask(struct mascot_atlas_decoded_sprite* sprite, const uint8_t* pixels)
+{
+    size_t stride = (sprite->ireg_w + 7) / 8;
+    uint8_t* mirror = sprite->mask + stride * sprite->ireg_h;
+    for (uint32_t y = 0; y < sprite->ireg_h; y++) {
+        uint32_t py = sprite->ireg_y + y;
+        if (sprite->pixel_height != sprite->desc.height) {
+            py = (uint32_t)(((float)py + 0.5f) * sprite->pixel_height / sprite->desc.height);
+            if (py >= sprite->pixel_height) py = sprite->pixel_height - 1;
+        }
+        const uint8_t* row = pixels + (size_t)py * sprite->pixel_width * 4;
+        for (uint32_t x = 0; x < sprite->ireg_w; x++) {
+            uint32_t px = sprite->ireg_x + x;
+            if (sprite->pixel_width != sprite->desc.width) {
+                px = (uint32_t)(((float)px + 0.5f) * sprite->pixel_width / sprite->desc.width);
+                if (px >= sprite->pixel_width) px = sprite->pixel_width - 1;
+            }
+            if (!row[(size_t)px * 4 + 3]) continue;
+            uint32_t mx = sprite->ireg_w - 1 - x;
+            sprite->mask[y * stride + x / 8] |= 1 << (x & 7);
+            mirror[y * stride + mx / 8] |= 1 << (mx & 7);
         }
     }
+}
+
+static bool _convert_sprite(struct mascot_atlas_job* job, uint16_t index)
+{
+    struct mascot_atlas_decoded_sprite* sprite = &job->sprites[index];
+    if (sprite->mask) _build_mask(sprite, sprite->converted ? sprite->converted : sprite->rgba);
+    if (sprite->upload) {
+        const struct mascot_atlas_sheet* sheet = &job->sheets[sprite->sheet];
+        size_t stride = (size_t)sprite->pixel_width * 4;
+        size_t sprite_len = stride * sprite->pixel_height;
+        size_t trim_len = (size_t)sprite->trim_w * 4;
+        size_t sheet_stride = (size_t)sheet->width * 4;
+        uint8_t* out = job->pool + sheet->offset + sprite->sheet_y * sheet_stride + (size_t)sprite->sheet_x * 4;
+        uint8_t* mirror_out = NULL;
+        if (job->mirrored_copies) {
+            // Mirrored sheet is mirror of the whole sheet, so sprite lands on the opposite side
+            mirror_out = job->pool + sheet->offset + sheet_stride * sheet->height + sprite->sheet_y * sheet_stride + (size_t)(sheet->width - sprite->sheet_x - sprite->trim_w) * 4;
+        }
 
-    // Write the buffers to the factory
-    environment_buffer_factory_write(factory, buffers, buffer_len * 2);
-    *buffer_factory_pos += buffer_len * 2;
-    free(buffers);
+        // Only trimmed rectangle is copied, in mirrored image it is on the opposite side of the frame
+        size_t src_x = (size_t)sprite->trim_x * 4;
+        size_t src_mirror_x = (size_t)(sprite->pixel_width - sprite->trim_x - sprite->trim_w) * 4;
+        for (uint32_t y = 0; y < sprite->trim_h; y++) {
+            size_t src_row = (size_t)(sprite->trim_y + y) * stride;
+            if (sprite->converted) {
+                // Cache always holds both images
+                memcpy(out + y * sheet_stride, sprite->converted + src_row + src_x, trim_len);
+                if (mirror_out) memcpy(mirror_out + y * sheet_stride, sprite->converted + sprite_len + src_row + src_mirror_x, trim_len);
+            } else {
+                pixel_ops_convert_row(sprite->rgba + src_row + src_x, out + y * sheet_stride, mirror_out ? mirror_out + y * sheet_stride : NULL, sprite->trim_w);
+            }
+        }
+    }
+    free(sprite->rgba);
+    sprite->rgba = NULL;
+    free(sprite->scaled);
+    sprite->scaled = NULL;
+    sprite->converted = NULL;
     return true;
 }
 
+// Workers pick sprites one by one, so output order only depends on sprite index
+static void* _atlas_worker(void* data)
+{
+    struct mascot_atlas_job* job = data;
+
+    while (!__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+        uint32_t index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (index >= job->count) break;
+
+        if (!job->work(job, index)) {
+            __atomic_store_n(&job->failed, true, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+// Runs job->work for every sprite using up to one thread per online CPU
+static bool _run_atlas_job(struct mascot_atlas_job* job)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint16_t thread_count = cpus > 0 ? (cpus > 64 ? 64 : (uint16_t)cpus) : 1;
+    if (thread_count > job->count) thread_count = job->count;
+
+    job->next = 0;
+    job->failed = false;
+
+    pthread_t threads[64];
+    uint16_t started = 0;
+    for (; started + 1 < thread_count; started++) {
+        if (pthread_create(&threads[started], NULL, _atlas_worker, job)) break;
+    }
+
+    // Calling thread works too, so job proceeds even if no threads could be started
+    _atlas_worker(job);
+
+    for (uint16_t i = 0; i < started; i++) pthread_join(threads[i], NULL);
+
+    return !job->failed;
+}
+
+// Compositor shows sprites at 1/MASCOT_SCALE physical pixels per frame pixel regardless of output scale,
+// so pre-scaled sprites are produced at that scale and are valid for every output
+static uint32_t _atlas_target_scale()
+{
+    if (!config_get_prescale_sprites() && environment_supports_viewport_crop()) return MASCOT_ATLAS_SCALE_UNIT;
+    long scale = lroundf(MASCOT_ATLAS_SCALE_UNIT / config_get_mascot_scale());
+    return scale > 0 ? (uint32_t)scale : MASCOT_ATLAS_SCALE_UNIT;
+}
+
+// Decodes (or loads from cache) and uploads every sprite of the atlas. Sprite entries are updated in place,
+// so pointers to them stay valid across eviction and re-materialization
+static bool _atlas_materialize(struct mascot_atlas* atlas)
+{
+    const char* dirname = atlas->dirname;
+    char** namelist = atlas->name_order;
+    uint16_t sprite_count = atlas->sprite_count;
+
+    struct mascot_atlas_decoded_sprite* decoded = calloc(sprite_count, sizeof(struct mascot_atlas_decoded_sprite));
+    if (!decoded) {
+        ERROR("Could not create atlas from dir \"%s\": Allocation failed for decoded sprites", dirname);
+    }
+
+    struct mascot_atlas_job job = {
+        .dirname = dirname,
+        .names = namelist,
+        .sprites = decoded,
+        .work = _hash_sprite_file,
+        .count = sprite_count,
+        .scale = _atlas_target_scale()
+    };
+    if (!_run_atlas_job(&job)) {
+        goto fail_free_decoded;
+    }
+
+    // If no file changed since last load, everything needed is already in the cache and nothing is decoded
+    job.cache = mascot_atlas_cache_open(dirname, job.scale);
+    for (uint16_t i = 0; job.cache && i < sprite_count; i++) {
+        const struct mascot_atlas_cache_entry* entry = mascot_atlas_cache_find(job.cache, namelist[i], decoded[i].file_hash, i);
+        if (!entry) {
+            mascot_atlas_cache_close(job.cache);
+            job.cache = NULL;
+            break;
+        }
+        decoded[i].desc.width = entry->width;
+        decoded[i].desc.height = entry->height;
+        decoded[i].hash = entry->content_hash;
+        decoded[i].ireg_x = entry->ireg_x;
+        decoded[i].ireg_y = entry->ireg_y;
+        decoded[i].ireg_w = entry->ireg_w;
+        decoded[i].ireg_h = entry->ireg_h;
+        decoded[i].pixel_width = entry->pixel_width;
+        decoded[i].pixel_height = entry->pixel_height;
+        decoded[i].pixel_ireg_x = entry->pixel_ireg_x;
+        decoded[i].pixel_ireg_y = entry->pixel_ireg_y;
+        decoded[i].pixel_ireg_w = entry->pixel_ireg_w;
+        decoded[i].pixel_ireg_h = entry->pixel_ireg_h;
+        decoded[i].converted = mascot_atlas_cache_pixels(job.cache, entry);
+    }
+
+    if (job.cache) {
+        DEBUG("Atlas \"%s\": Loaded all sprites from cache", dirname);
+    } else {
+        for (uint16_t i = 0; i < sprite_count; i++) decoded[i].converted = NULL;
+
+        job.work = _decode_sprite;
+        if (!_run_atlas_job(&job)) {
+            goto fail_free_decoded;
+        }
+
+        struct mascot_atlas_cache_entry* entries = calloc(sprite_count, sizeof(struct mascot_atlas_cache_entry));
+        if (!entries) ERROR("Could not create atlas from dir \"%s\": Allocation failed for cache entries", dirname);
+        for (uint16_t i = 0; i < sprite_count; i++) {
+            entries[i] = (struct mascot_atlas_cache_entry) {
+                .file_hash = decoded[i].file_hash,
+                .content_hash = decoded[i].hash,
+                .width = decoded[i].desc.width,
+                .height = decoded[i].desc.height,
+                .ireg_x = decoded[i].ireg_x,
+                .ireg_y = decoded[i].ireg_y,
+                .ireg_w = decoded[i].ireg_w,
+                .ireg_h = decoded[i].ireg_h,
+                .pixel_width = decoded[i].pixel_width,
+                .pixel_height = decoded[i].pixel_height,
+                .pixel_ireg_x = decoded[i].pixel_ireg_x,
+                .pixel_ireg_y = decoded[i].pixel_ireg_y,
+                .pixel_ireg_w = decoded[i].pixel_ireg_w,
+                .pixel_ireg_h = decoded[i].pixel_ireg_h
+            };
+        }
+
+        // Without a writable cache directory pixels are converted straight into the pool as before
+        job.cache = mascot_atlas_cache_create(dirname, job.scale, entries, namelist, sprite_count);
+        if (job.cache) {
+            job.cache_entries = entries;
+            job.work = _cache_sprite;
+            _run_atlas_job(&job);
+            job.cache_entries = NULL;
+            if (!mascot_atlas_cache_commit(job.cache)) WARN("Atlas \"%s\": Failed to write sprite cache", dirname);
+        }
+        free(entries);
+    }
+
+    environment_buffer_factory_t* buffer_factory = environment_buffer_factory_new();
+    uint64_t buffer_factory_pos = 0;
+    uint16_t unique_count = 0;
+
+    // Right images are direct ones flipped by buffer transform, unless compositor can't do it or user opted out.
+    // Then both images are uploaded
+    job.mirrored_copies = !config_get_mirror_by_transform() || !environment_supports_buffer_transform();
+
+    uint32_t max_width = 1;
+    for (uint16_t i = 0; i < sprite_count; i++) {
+        if (decoded[i].pixel_width > max_width) max_width = decoded[i].pixel_width;
+    }
+    uint8_t* row_bufs = malloc((size_t)max_width * 4 * 2);
+    if (!row_bufs) ERROR("Could not create atlas from dir \"%s\": Allocation failed for sprite comparison", dirname);
+
+    // Held until every share created here has its buffers, so other atlases never see half-uploaded shares
+    pthread_mutex_lock(&sprite_shares_mutex);
+
+    // Every sprite that isn't shared yet goes into the pool
+    for (uint16_t sprite_i = 0; sprite_i < sprite_count; sprite_i ++) {
+        struct mascot_atlas_decoded_sprite* sprite = &decoded[sprite_i];
+
+        // Input region is the bounding box of non-transparent pixels, nothing outside of it has to be uploaded.
+        // Fully transparent sprites keep a single pixel, as empty buffers are not allowed
+        sprite->trim_x = sprite->pixel_ireg_x;
+        sprite->trim_y = sprite->pixel_ireg_y;
+        sprite->trim_w = sprite->pixel_ireg_w ? sprite->pixel_ireg_w : 1;
+        sprite->trim_h = sprite->pixel_ireg_h ? sprite->pixel_ireg_h : 1;
+        atlas->shares[sprite_i] = _sprite_share_acquire(sprite, job.scale, job.mirrored_copies, row_bufs, &sprite->upload);
+        if (!sprite->upload) {
+            DEBUG("Atlas \"%s\": Sprite \"%s\" is shared with already loaded sprite", dirname, namelist[sprite_i]);
+        } else {
+            unique_count++;
+        }
+    }
+    free(row_bufs);
+
+    struct mascot_atlas_sheet* sheets = NULL;
+    uint32_t sheet_count = 0;
+    bool packed = environment_supports_viewport_crop();
+    buffer_factory_pos = _layout_sheets(decoded, sprite_count, packed, job.mirrored_copies, &sheets, &sheet_count);
+    job.sheets = sheets;
+
+    // Trim offsets are in frame coordinates, for pre-scaled sprites they are rounded to the nearest frame pixel
+    float scale = (float)job.scale / MASCOT_ATLAS_SCALE_UNIT;
+    for (uint16_t sprite_i = 0; sprite_i < sprite_count; sprite_i ++) {
+        struct mascot_atlas_decoded_sprite* sprite = &decoded[sprite_i];
+        atlas->sprites[(sprite_i*2)] = (struct mascot_sprite) {
+            .width = sprite->desc.width,
+            .height = sprite->desc.height,
+            .trim_x = lroundf(sprite->trim_x / scale),
+            .trim_y = lroundf(sprite->trim_y / scale),
+            .scale = scale,
+            .ireg = {
+                .x = sprite->ireg_x,
+                .y = sprite->ireg_y,
+                .w = sprite->ireg_w,
+                .h = sprite->ireg_h
+            }
+        };
+
+        atlas->sprites[(sprite_i*2)+1] = (struct mascot_sprite) {
+            .width = sprite->desc.width,
+            .height = sprite->desc.height,
+            .trim_x = lroundf((sprite->pixel_width - sprite->trim_x - sprite->trim_w) / scale),
+            .trim_y = lroundf(sprite->trim_y / scale),
+            .scale = scale,
+            .mirrored = !job.mirrored_copies,
+            .ireg = {
+                .x = sprite->desc.width - sprite->ireg_x - sprite->ireg_w,
+                .y = sprite->ireg_y,
+                .w = sprite->ireg_w,
+                .h = sprite->ireg_h
+            }
+        };
+    }
+
+    // Pixels are converted straight into the shared memory, without intermediate buffers and copies
+    if (unique_count) {
+        job.pool = environment_buffer_factory_map(buffer_factory, buffer_factory_pos);
+        if (!job.pool) {
+            WARN("Could not create atlas from dir \"%s\": Failed to map sprite pool", dirname);
+            for (uint16_t i = 0; i < sprite_count; i++) {
+                _sprite_share_release(atlas->shares[i]);
+                atlas->shares[i] = NULL;
+            }
+            pthread_mutex_unlock(&sprite_shares_mutex);
+            environment_buffer_factory_destroy(buffer_factory);
+            free(sheets);
+            goto fail_free_decoded;
+        }
+    }
+
+    // Masks only depend on frame contents, so they are built once and survive eviction and rescaling
+    bool build_masks = !atlas->masks;
+    if (build_masks) {
+        size_t masks_len = 0;
+        for (uint16_t i = 0; i < sprite_count; i++) masks_len += (size_t)(decoded[i].ireg_w + 7) / 8 * decoded[i].ireg_h * 2;
+        atlas->masks = calloc(masks_len ? masks_len : 1, 1);
+        if (!atlas->masks) ERROR("Could not create atlas from dir \"%s\": Allocation failed for sprite masks", dirname);
+    }
+    size_t mask_pos = 0;
+    for (uint16_t sprite_i = 0; sprite_i < sprite_count; sprite_i ++) {
+        size_t mask_len = (size_t)(decoded[sprite_i].ireg_w + 7) / 8 * decoded[sprite_i].ireg_h;
+        if (build_masks) decoded[sprite_i].mask = atlas->masks + mask_pos;
+        atlas->sprites[(sprite_i*2)].mask = atlas->masks + mask_pos;
+        atlas->sprites[(sprite_i*2)+1].mask = atlas->masks + mask_pos + mask_len;
+        mask_pos += mask_len * 2;
+    }
+
+    job.work = _convert_sprite;
+    _run_atlas_job(&job);
+    mascot_atlas_cache_close(job.cache);
+
+    // Pool stays mapped read-only while its sprites are shared, later atlases compare their pixels against it
+    struct mascot_sprite_pool* pool = NULL;
+    if (unique_count) {
+        pool = calloc(1, sizeof(struct mascot_sprite_pool));
+        if (!pool) ERROR("Could not create atlas from dir \"%s\": Allocation failed for sprite pool", dirname);
+        pool->pixels = environment_buffer_factory_detach_mapping(buffer_factory, &pool->size);
+    }
+
+    // Pool of zero size is a protocol error, and there is nothing to upload if every sprite is shared
+    if (unique_count) environment_buffer_factory_done(buffer_factory);
+
+    for (uint32_t i = 0; i < sheet_count; i++) {
+        uint64_t sheet_len = (uint64_t)sheets[i].width * sheets[i].height * 4;
+        for (uint8_t right = 0; right < (job.mirrored_copies ? 2 : 1); right++) {
+            sheets[i].buffers[right] = environment_buffer_factory_create_buffer(buffer_factory, sheets[i].width, sheets[i].height, sheets[i].width*4, sheets[i].offset + right*sheet_len);
+        }
+    }
+    if (packed) DEBUG("Atlas \"%s\": Packed %u sprites into %u sheets", dirname, unique_count, sheet_count);
+
+    for (uint16_t sprite_i = 0; sprite_i < sprite_count; sprite_i ++) {
+        struct mascot_sprite_share* share = atlas->shares[sprite_i];
+        struct mascot_atlas_decoded_sprite* placed = &decoded[sprite_i];
+        if (placed->upload) {
+            struct mascot_atlas_sheet* sheet = &sheets[placed->sheet];
+            for (uint8_t right = 0; right < (job.mirrored_copies ? 2 : 1); right++) {
+                struct mascot_sprite* sprite = &atlas->sprites[(sprite_i*2)+right];
+                uint32_t x = right ? sheet->width - placed->sheet_x - placed->trim_w : placed->sheet_x;
+                sprite->offset = sheet->offset + (right ? (uint64_t)sheet->width * sheet->height * 4 : 0) + ((uint64_t)placed->sheet_y * sheet->width + x) * 4;
+                share->buffers[right] = packed ? environment_buffer_new_view(sheet->buffers[right], x, placed->sheet_y, placed->trim_w, placed->trim_h) : sheet->buffers[right];
+                // Region is in buffer pixels, mirrored for right image just like the trimmed rectangle
+                uint32_t ireg_x = right ? placed->trim_x + placed->trim_w - placed->pixel_ireg_x - placed->pixel_ireg_w : placed->pixel_ireg_x - placed->trim_x;
+                environment_buffer_add_to_input_region(share->buffers[right], ireg_x, placed->pixel_ireg_y - placed->trim_y, placed->pixel_ireg_w, placed->pixel_ireg_h);
+            }
+            share->bytes = (uint64_t)placed->trim_w * placed->trim_h * 4 * (job.mirrored_copies ? 2 : 1);
+            sprite_shares_bytes += share->bytes;
+            share->pool = pool;
+            pool->refcount++;
+            share->stride = (size_t)sheet->width * 4;
+            share->pixels = pool->pixels + sheet->offset + placed->sheet_y * share->stride + (size_t)placed->sheet_x * 4;
+            share->pending = NULL;
+            DEBUG("Atlas \"%s\": Created sprite \"%s\"", dirname, namelist[sprite_i]);
+        }
+        atlas->sprites[(sprite_i*2)].buffer = share->buffers[0];
+        atlas->sprites[(sprite_i*2)+1].buffer = share->mirrored_copy ? share->buffers[1] : share->buffers[0];
+    }
+
+    // Sheets are kept alive by views of them
+    for (uint32_t i = 0; packed && i < sheet_count; i++) {
+        environment_buffer_destroy(sheets[i].buffers[0]);
+        environment_buffer_destroy(sheets[i].buffers[1]);
+    }
+    free(sheets);
+
+    atlas->scale = job.scale;
+    atlas->last_used = __atomic_add_fetch(&atlas_use_clock, 1, __ATOMIC_RELAXED);
+    // Sprites are complete before other threads see the atlas resident
+    __atomic_store_n(&atlas->resident, true, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&sprite_shares_mutex);
+
+    environment_buffer_factory_destroy(buffer_factory);
+
+    DEBUG("Atlas \"%s\": %u of %u sprites uploaded, rest are shared", dirname, unique_count, sprite_count);
+
+    free(decoded);
+    return true;
+
+fail_free_decoded:
+    mascot_atlas_cache_close(job.cache);
+    for (uint16_t i = 0; i < sprite_count; i++) {
+        free(decoded[i].rgba);
+        free(decoded[i].scaled);
+    }
+    free(decoded);
+    return false;
+}
+
+// Atoms are sequential, scramble them so neighbouring ones don't cluster
+static inline uint32_t _name_bucket(atom_t atom)
+{
+    return atom * 2654435761u;
+}
+
+// Must be called with sprite_shares_mutex held. Buffers go away with the last share reference,
+// sprite metadata is kept for hit testing and anchoring
+static void _atlas_evict(struct mascot_atlas* atlas)
+{
+    for (uint16_t i = 0; i < atlas->sprite_count; i++) {
+        _sprite_share_release(atlas->shares[i]);
+        atlas->shares[i] = NULL;
+        atlas->sprites[i*2].buffer = NULL;
+        atlas->sprites[(i*2)+1].buffer = NULL;
+    }
+    __atomic_store_n(&atlas->resident, false, __ATOMIC_RELAXED);
+}
+
+// Evicts least recently used atlases without live mascots until resident pixel data fits the budget
+static void _enforce_budget()
+{
+    uint64_t budget = (uint64_t)config_get_atlas_memory_budget() * 1024 * 1024;
+    if (!budget) return;
+
+    pthread_mutex_lock(&sprite_shares_mutex);
+    while (sprite_shares_bytes > budget) {
+        struct mascot_atlas* victim = NULL;
+        for (struct mascot_atlas* atlas = atlases; atlas; atlas = atlas->next) {
+            if (!atlas->resident || __atomic_load_n(&atlas->pins, __ATOMIC_RELAXED)) continue;
+            if (!victim || __atomic_load_n(&atlas->last_used, __ATOMIC_RELAXED) < __atomic_load_n(&victim->last_used, __ATOMIC_RELAXED)) victim = atlas;
+        }
+        if (!victim) break;
+
+        // Atlas being materialized right now is going to be used anyway, budget is enforced again after that
+        if (pthread_mutex_trylock(&victim->residency_lock)) break;
+        // Pins are taken under residency_lock only, so victim may have been pinned since it was picked
+        if (__atomic_load_n(&victim->pins, __ATOMIC_RELAXED)) {
+            pthread_mutex_unlock(&victim->residency_lock);
+            continue;
+        }
+        DEBUG("Atlas \"%s\": Evicted, %" PRIu64 " bytes of sprites resident", victim->dirname, sprite_shares_bytes);
+        _atlas_evict(victim);
+        pthread_mutex_unlock(&victim->residency_lock);
+    }
+    pthread_mutex_unlock(&sprite_shares_mutex);
+}
+
 struct mascot_atlas* mascot_atlas_new(const char* dirname)
 {
 
     if (!strlen(dirname)) return NULL;
 
-    qoi_desc* qois = NULL;
     uint16_t sprite_count = 0;
     struct mascot_atlas* atlas = NULL;
     char** file_paths = NULL;
@@ -151,44 +934,27 @@ struct mascot_atlas* mascot_atlas_new(const char* dirname)
         return NULL;
     }
 
-    qois = calloc(sprite_count, sizeof(qoi_desc));
     char ** namelist = calloc(sprite_count, sizeof(char*));
-    void ** pixels = calloc(sprite_count, sizeof(void*));
 
-    if (!qois) {
-        ERROR("Could not create atlas from dir \"%s\": Allocation failed for png_ctxs", dirname);
-    }
     if (!namelist) {
         ERROR("Could not create atlas from dir \"%s\":Allocation failed for namelists", dirname);
     }
-    if (!pixels) {
-        ERROR("Could not create atlas from dir \"%s\": Allocation failed for filelists", dirname);
-    }
 
     uint16_t local_ecount = 0;
     for (uint32_t i = 0; i < file_count; i++) {
         if (strnlen(file_paths[i], 128) < 5) continue;
         if (!strcasecmp(file_paths[i] + strnlen(file_paths[i], 128) - 4, ".qoi")) {
-            if (local_ecount > sprite_count) break;
-            else local_ecount ++;
-            char fullpath[256] = {0};
-            size_t printed = snprintf(fullpath, 256, "%s/%s", dirname, file_paths[i]);
-            UNUSED(printed);
-            pixels[i] = qoi_read(fullpath, &qois[local_ecount-1], 4);
-            if (!pixels[i])
-            {
-                WARN("Could not create atlas from dir \"%s\": Failed to read QOI file \"%s\"", dirname, file_paths[i]);
-                goto fail_free_qoi_ctxs;
-            }
-            namelist[local_ecount-1] = strdup(file_paths[i]);
-            if (!namelist[local_ecount-1]) {
+            if (local_ecount >= sprite_count) break;
+            namelist[local_ecount] = strdup(file_paths[i]);
+            if (!namelist[local_ecount]) {
                 ERROR("Could not create atlas from dir \"%s\": Allocation failed for namelist", dirname);
             }
+            local_ecount ++;
         }
     }
 
-    environment_buffer_factory_t* buffer_factory = environment_buffer_factory_new();
-    uint64_t buffer_factory_pos = 0;
+    for (uint32_t i = 0; i < file_count; i++) free(file_paths[i]);
+    free(file_paths);
 
     atlas = calloc(1, sizeof(struct mascot_atlas));
     if (!atlas) ERROR("Could not create atlas from dir \"%s\": Allocation failed for atlas struct", dirname);
@@ -196,90 +962,140 @@ struct mascot_atlas* mascot_atlas_new(const char* dirname)
     atlas->sprites = calloc(2*sprite_count, sizeof(struct mascot_sprite));
     if (!atlas->sprites) ERROR("Could not create atlas from dir \"%s\": Allocation failed for atlas sprites array", dirname);
 
-    for (uint16_t sprite_i = 0; sprite_i < sprite_count; sprite_i ++) {
-        uint64_t buffer_factory_offset = buffer_factory_pos;
-        uint32_t input_x, input_y, input_width, input_height;
+    atlas->shares = calloc(sprite_count, sizeof(struct mascot_sprite_share*));
+    if (!atlas->shares) ERROR("Could not create atlas from dir \"%s\": Allocation failed for atlas sprite shares", dirname);
 
-        _find_ireg(pixels[sprite_i], qois[sprite_i].width, qois[sprite_i].height, &input_x, &input_y, &input_width, &input_height);
+    atlas->dirname = strdup(dirname);
+    if (!atlas->dirname) ERROR("Could not create atlas from dir \"%s\": Allocation failed for atlas path", dirname);
 
-        atlas->sprites[(sprite_i*2)] = (struct mascot_sprite) {
-            .width = qois[sprite_i].width,
-            .height = qois[sprite_i].height,
-            .offset = buffer_factory_offset,
-            .ireg = {
-                .x = input_x,
-                .y = input_y,
-                .w = input_width,
-                .h = input_height
-            }
-        };
+    atlas->name_order = namelist;
+    atlas->sprite_count = sprite_count;
+    pthread_mutex_init(&atlas->residency_lock, NULL);
 
-        atlas->sprites[(sprite_i*2)+1] = (struct mascot_sprite) {
-            .width = qois[sprite_i].width,
-            .height = qois[sprite_i].height,
-            .offset = buffer_factory_offset + (uint64_t)qois[sprite_i].width*(uint64_t)qois[sprite_i].height*(uint64_t)4,
-            .ireg = {
-                .x = qois[sprite_i].width - input_x - input_width,
-                .y = input_y,
-                .w = input_width,
-                .h = input_height
-            }
-        };
-        if (!_write_buffers(buffer_factory, &buffer_factory_pos, pixels[sprite_i], (size_t)qois[sprite_i].width*(size_t)qois[sprite_i].height*(size_t)4, qois[sprite_i].width, qois[sprite_i].height)) {
-            environment_buffer_factory_destroy(buffer_factory);
-            return NULL;
-        }
-    }
+    atlas->name_atoms = calloc(sprite_count, sizeof(atom_t));
+    if (!atlas->name_atoms) ERROR("Could not create atlas from dir \"%s\": Allocation failed for atlas name atoms", dirname);
+    for (uint16_t i = 0; i < sprite_count; i++) atlas->name_atoms[i] = atom_intern(namelist[i]);
 
-    environment_buffer_factory_done(buffer_factory);
+    // Keep load factor below 1/2
+    atlas->name_bucket_count = 16;
+    while (atlas->name_bucket_count < (uint32_t)sprite_count * 2) atlas->name_bucket_count *= 2;
+    atlas->name_buckets = malloc(atlas->name_bucket_count * sizeof(uint16_t));
+    if (!atlas->name_buckets) ERROR("Could not create atlas from dir \"%s\": Allocation failed for atlas name index", dirname);
+    memset(atlas->name_buckets, 0xff, atlas->name_bucket_count * sizeof(uint16_t));
 
-    for (uint16_t mascot_sprite = 0; mascot_sprite < sprite_count*(uint16_t)2; mascot_sprite ++) {
-        atlas->sprites[mascot_sprite].buffer = environment_buffer_factory_create_buffer(buffer_factory, atlas->sprites[mascot_sprite].width, atlas->sprites[mascot_sprite].height, atlas->sprites[mascot_sprite].width*4, atlas->sprites[mascot_sprite].offset);
-        environment_buffer_add_to_input_region(atlas->sprites[mascot_sprite].buffer, atlas->sprites[mascot_sprite].ireg.x, atlas->sprites[mascot_sprite].ireg.y, atlas->sprites[mascot_sprite].ireg.w, atlas->sprites[mascot_sprite].ireg.h);
-        if (mascot_sprite%2 == 0) DEBUG("Atlas \"%s\": Created sprite \"%s\"", dirname, namelist[mascot_sprite/2]);
-        else DEBUG("Atlas \"%s\": Created sprite \"%s\" (Right)", dirname, namelist[mascot_sprite/2]);
+    uint32_t name_mask = atlas->name_bucket_count - 1;
+    for (uint16_t i = 0; i < sprite_count; i++) {
+        uint32_t b = _name_bucket(atlas->name_atoms[i]) & name_mask;
+        while (atlas->name_buckets[b] != UINT16_MAX && atlas->name_atoms[atlas->name_buckets[b]] != atlas->name_atoms[i]) b = (b + 1) & name_mask;
+        // First sprite with given name wins, same as with linear lookup
+        if (atlas->name_buckets[b] == UINT16_MAX) atlas->name_buckets[b] = i;
     }
 
-    environment_buffer_factory_destroy(buffer_factory);
+    // Sprites are materialized right away, so broken files are reported on load and not when mascot shows them
+    if (!_atlas_materialize(atlas)) {
+        mascot_atlas_destroy(atlas);
+        return NULL;
+    }
 
-    atlas->name_order = namelist;
-    atlas->sprite_count = sprite_count;
+    pthread_mutex_lock(&sprite_shares_mutex);
+    atlas->next = atlases;
+    atlases = atlas;
+    pthread_mutex_unlock(&sprite_shares_mutex);
 
-    for (uint16_t i = 0; i < sprite_count; i++) free(pixels[i]);
-    for (uint32_t i = 0; i < file_count; i++) free(file_paths[i]);
-    free(file_paths);
-    free(qois);
-    free(pixels);
+    _enforce_budget();
 
     DEBUG("Sucessfully created atlas for directory \"%s\", located at %p", dirname, atlas);
 
     return atlas;
-
-fail_free_qoi_ctxs:
-    free(atlas);
-    for (uint16_t i = 0; i < sprite_count; i++) free(pixels[i]);
-    for (uint16_t i = 0; i < sprite_count; i++) free(namelist[i]);
-    for (uint32_t i = 0; i < file_count; i++) free(file_paths[i]);
-    free(qois);
-    free(namelist);
-    free(file_paths);
-    return NULL;
 }
 
 void mascot_atlas_destroy(struct mascot_atlas* atlas)
 {
     if (!atlas) return;
 
-    for (uint16_t i = 0; i < atlas->sprite_count*(uint16_t)2; i++) {
-        if (i % 2 == 0) free(atlas->name_order[i/2]);
-        environment_buffer_destroy(atlas->sprites[i].buffer);
+    // Buffers are owned by shares, they are destroyed when last atlas referencing them goes away
+    pthread_mutex_lock(&sprite_shares_mutex);
+    struct mascot_atlas** link = &atlases;
+    while (*link && *link != atlas) link = &(*link)->next;
+    if (*link) *link = atlas->next;
+
+    for (uint16_t i = 0; i < atlas->sprite_count; i++) {
+        free(atlas->name_order[i]);
+        _sprite_share_release(atlas->shares[i]);
     }
+    pthread_mutex_unlock(&sprite_shares_mutex);
 
+    pthread_mutex_destroy(&atlas->residency_lock);
+    free(atlas->dirname);
+    free(atlas->shares);
     free(atlas->name_order);
+    free(atlas->name_atoms);
+    free(atlas->name_buckets);
+    free(atlas->masks);
     free(atlas->sprites);
     free(atlas);
 }
 
+// Sprites are rewritten in place, so that only happens while no mascot can be reading them: here, before
+// the first mascot gets the atlas, or on materialization, which every user waits for in mascot_atlas_use
+void mascot_atlas_pin(const struct mascot_atlas* atlas)
+{
+    if (!atlas) return;
+    struct mascot_atlas* a = (struct mascot_atlas*)atlas;
+
+    pthread_mutex_lock(&a->residency_lock);
+    if (!a->pins && a->resident && a->scale != _atlas_target_scale()) {
+        // Surfaces still showing old buffers keep their contents until next attach
+        DEBUG("Atlas \"%s\": Scale changed, dropping sprites", a->dirname);
+        pthread_mutex_lock(&sprite_shares_mutex);
+        _atlas_evict(a);
+        pthread_mutex_unlock(&sprite_shares_mutex);
+    }
+    __atomic_fetch_add(&a->pins, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&a->residency_lock);
+}
+
+void mascot_atlas_unpin(const struct mascot_atlas* atlas)
+{
+    if (!atlas) return;
+    struct mascot_atlas* a = (struct mascot_atlas*)atlas;
+    if (__atomic_sub_fetch(&a->pins, 1, __ATOMIC_RELAXED)) return;
+    // Eviction order among unpinned atlases is the order their last mascots went away
+    __atomic_store_n(&a->last_used, __atomic_add_fetch(&atlas_use_clock, 1, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+}
+
+bool mascot_atlas_use(const struct mascot_atlas* atlas)
+{
+    if (!atlas) return false;
+    struct mascot_atlas* a = (struct mascot_atlas*)atlas;
+
+    // Pinned atlases are neither evicted nor rescaled, so once resident this is all every attach costs
+    if (__atomic_load_n(&a->resident, __ATOMIC_ACQUIRE)) {
+        __atomic_store_n(&a->last_used, __atomic_load_n(&atlas_use_clock, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+        return true;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t now_ns = (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+    if (now_ns < __atomic_load_n(&a->materialize_retry_at, __ATOMIC_RELAXED)) return false;
+
+    pthread_mutex_lock(&a->residency_lock);
+    bool materialized = false;
+    bool resident = a->resident;
+    if (!resident && now_ns >= a->materialize_retry_at) {
+        DEBUG("Atlas \"%s\": Materializing evicted sprites", a->dirname);
+        resident = materialized = _atlas_materialize(a);
+        if (!resident) {
+            WARN("Atlas \"%s\": Failed to materialize sprites, retrying in %llu seconds", a->dirname, MASCOT_ATLAS_MATERIALIZE_BACKOFF / 1000000000ull);
+            __atomic_store_n(&a->materialize_retry_at, now_ns + MASCOT_ATLAS_MATERIALIZE_BACKOFF, __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&a->residency_lock);
+
+    if (materialized) _enforce_budget();
+    return resident;
+}
 
 struct mascot_sprite* mascot_atlas_get(const struct mascot_atlas* atlas, uint16_t index, bool right)
 {
@@ -293,9 +1109,13 @@ uint16_t mascot_atlas_get_name_index(const struct mascot_atlas* atlas, const cha
 {
     if (!atlas) return UINT16_MAX;
 
-    for (uint16_t i = 0; i < atlas->sprite_count; i++) {
-        if (strcmp(atlas->name_order[i], name) == 0) {
-            return i;
+    atom_t atom = atom_lookup(name);
+    if (atom == ATOM_NONE) return UINT16_MAX;
+
+    uint32_t mask = atlas->name_bucket_count - 1;
+    for (uint32_t i = _name_bucket(atom) & mask; atlas->name_buckets[i] != UINT16_MAX; i = (i + 1) & mask) {
+        if (atlas->name_atoms[atlas->name_buckets[i]] == atom) {
+            return atlas->name_buckets[i];
         }
     }
 
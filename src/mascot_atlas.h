@@ -21,34 +21,77 @@
 #define MASCOT_ATLAS
 
 #include <stdint.h>
+#include <pthread.h>
 
 struct mascot_sprite;
 struct mascot_atlas;
+struct mascot_sprite_share;
 
 #include "master_header.h"
+#include "atom.h"
 #include "environment.h"
 
 #define MASCOT_ENOSPRITE 1
 
+// Denominator of atlas scales, same as of wp_fractional_scale_v1 preferred scale
+#define MASCOT_ATLAS_SCALE_UNIT 120
+
 struct mascot_sprite {
     environment_buffer_t* buffer;
     uint64_t offset;
-    uint32_t height, width;
+    uint32_t height, width; // Size of the frame, buffer is trimmed to its non-transparent part
+    int32_t trim_x, trim_y; // Position of buffer contents within the frame
     struct {
         uint32_t x, y;
         uint32_t w, h;
-    } ireg;
+    } ireg; // In frame coordinates, already mirrored for right images
+    bool mirrored; // Buffer holds unmirrored image, surface has to flip it
+    float scale; // Buffer pixels per frame pixel, other than 1 only for pre-scaled sprites
+    const uint8_t* mask; // 1-bit alpha of ireg rectangle in frame pixels, rows padded to whole bytes. NULL if not built
 };
 
+// Whether frame pixel (x, y) of sprite is opaque. Falls back to ireg rectangle for sprites without mask
+static inline bool mascot_sprite_hit(const struct mascot_sprite* sprite, int32_t x, int32_t y)
+{
+    uint32_t mx = (uint32_t)(x - (int32_t)sprite->ireg.x);
+    uint32_t my = (uint32_t)(y - (int32_t)sprite->ireg.y);
+    if (mx >= sprite->ireg.w || my >= sprite->ireg.h) return false;
+    if (!sprite->mask) return true;
+    return sprite->mask[my * ((sprite->ireg.w + 7) / 8) + mx / 8] & (1 << (mx & 7));
+}
+
 struct mascot_atlas {
-    struct mascot_sprite* sprites; // Array has following layout: buffers[x] -> left image; buffers[x+1] -> right image
+    struct mascot_sprite* sprites; // Array has following layout: buffers[x] -> left image; buffers[x+1] -> right image (may share buffer of left one)
     uint16_t sprite_count;
     char ** name_order;
+    atom_t* name_atoms; // Interned name_order, compared instead of names on lookup
+    uint16_t* name_buckets; // Open addressing table of sprite indices keyed by name atom, UINT16_MAX marks empty bucket
+    uint32_t name_bucket_count; // Always power of two
+    struct mascot_sprite_share** shares; // Refcounted buffers, shared between atlases with identical sprites
+    uint8_t* masks; // Storage of sprite masks. Built on first materialization and kept through eviction
+
+    // Residency: pixel data of atlases without live mascots may be evicted to fit ATLAS_MEMORY_BUDGET,
+    // and is materialized again on next use
+    char* dirname;
+    bool resident;
+    uint32_t scale; // Scale resident sprites were produced at, in MASCOT_ATLAS_SCALE_UNIT units
+    uint32_t pins; // Live mascots using this atlas, pinned atlases are never evicted
+    uint64_t last_used;
+    uint64_t materialize_retry_at; // CLOCK_MONOTONIC nanoseconds, failed materialization isn't retried before that
+    pthread_mutex_t residency_lock;
+    struct mascot_atlas* next;
 };
 
 struct mascot_atlas* mascot_atlas_new(const char* dirname);
 void mascot_atlas_destroy(struct mascot_atlas* atlas);
 
+// Pinning the first mascot also drops sprites of outdated scale, pinned atlases keep theirs until all mascots are gone
+void mascot_atlas_pin(const struct mascot_atlas* atlas);
+void mascot_atlas_unpin(const struct mascot_atlas* atlas);
+// Makes sure sprite buffers are present before showing them, returns false if they couldn't be materialized.
+// After a failure, materialization is retried only once MASCOT_ATLAS_MATERIALIZE_BACKOFF passed
+bool mascot_atlas_use(const struct mascot_atlas* atlas);
+
 struct mascot_sprite* mascot_atlas_get(const struct mascot_atlas* atlas, uint16_t index, bool right);
 uint16_t mascot_atlas_get_name_index(const struct mascot_atlas* atlas, const char* name);
 
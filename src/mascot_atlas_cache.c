@@ -0,0 +1,395 @@
+/*
+    mascot_atlas_cache.c - wl_shimeji's on-disk cache of converted atlas sprites
+
+    Copyright (C) 2025  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "mascot_atlas_cache.h"
+#include "mascot_atlas.h"
+#include <io.h>
+
+#define MASCOT_ATLAS_CACHE_MAGIC "WLSATLAS"
+// Bump whenever layout of the file or output of pixel conversion changes
+#define MASCOT_ATLAS_CACHE_VERSION 2
+#define MASCOT_ATLAS_CACHE_ALIGN 64
+// Caches are touched whenever they are opened, ones of removed packs and unused scales expire
+#define MASCOT_ATLAS_CACHE_MAX_AGE (30 * 24 * 60 * 60)
+// Temporary files of loads that never committed, e.g. after a crash
+#define MASCOT_ATLAS_CACHE_TMP_MAX_AGE (24 * 60 * 60)
+
+struct mascot_atlas_cache_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t scale;
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t names_offset;
+    uint64_t data_offset;
+    uint64_t size;
+};
+
+struct mascot_atlas_cache {
+    uint8_t* mapping;
+    size_t size;
+    const struct mascot_atlas_cache_header* header;
+    struct mascot_atlas_cache_entry* entries;
+    const char* names;
+    uint8_t* data;
+    char* tmp_path; // Set for created caches until they are committed
+    char* path;
+};
+
+uint64_t mascot_atlas_cache_hash(const uint8_t* data, size_t len, uint64_t seed)
+{
+    uint64_t hash = seed;
+
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 29;
+    }
+    for (; i < len; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ull;
+    }
+
+    // Final avalanche (murmur3 fmix64)
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+bool mascot_atlas_cache_hash_file(const char* path, uint64_t* out)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) || st.st_size < 0) {
+        close(fd);
+        return false;
+    }
+
+    uint64_t seed = 0xcbf29ce484222325ull ^ (uint64_t)st.st_size;
+    if (!st.st_size) {
+        close(fd);
+        *out = mascot_atlas_cache_hash(NULL, 0, seed);
+        return true;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    *out = mascot_atlas_cache_hash(data, st.st_size, seed);
+    munmap(data, st.st_size);
+    return true;
+}
+
+uint32_t mascot_atlas_cache_scaled_size(uint32_t size, uint32_t scale)
+{
+    if (scale == MASCOT_ATLAS_SCALE_UNIT) return size;
+    long scaled = lroundf(size * ((float)scale / MASCOT_ATLAS_SCALE_UNIT));
+    return scaled > 0 ? (uint32_t)scaled : 1;
+}
+
+static size_t _cache_directory(char* pathbuf, size_t pathbuf_len)
+{
+    const char* cache_home = secure_getenv("XDG_CACHE_HOME");
+    if (cache_home && cache_home[0] == '/') {
+        return snprintf(pathbuf, pathbuf_len, "%s/wl_shimeji/atlases/", cache_home);
+    }
+
+    const char* home = secure_getenv("HOME");
+    if (!home) return 0;
+    return snprintf(pathbuf, pathbuf_len, "%s/.cache/wl_shimeji/atlases/", home);
+}
+
+// Cache file name is derived from canonical atlas path and scale
+static bool _cache_path(const char* dirname, uint32_t scale, char* pathbuf, size_t pathbuf_len)
+{
+    char dir[PATH_MAX];
+    size_t dir_len = _cache_directory(dir, sizeof(dir));
+    if (!dir_len || dir_len >= sizeof(dir)) return false;
+
+    char canonical[PATH_MAX];
+    const char* key = realpath(dirname, canonical) ? canonical : dirname;
+    uint64_t hash = mascot_atlas_cache_hash((const uint8_t*)key, strlen(key), 0xcbf29ce484222325ull ^ scale);
+
+    size_t printed = snprintf(pathbuf, pathbuf_len, "%s%016" PRIx64 ".atlas", dir, hash);
+    return printed < pathbuf_len;
+}
+
+static size_t _align(size_t value)
+{
+    return (value + MASCOT_ATLAS_CACHE_ALIGN - 1) & ~(size_t)(MASCOT_ATLAS_CACHE_ALIGN - 1);
+}
+
+static size_t _entry_pixels_len(const struct mascot_atlas_cache_entry* entry)
+{
+    return (size_t)entry->pixel_width * (size_t)entry->pixel_height * 4 * 2;
+}
+
+// Region must lie within size. Empty regions are still trimmed to their first pixel, so it has to exist
+static bool _region_fits(uint32_t x, uint32_t y, uint32_t w, uint32_t h, uint32_t width, uint32_t height)
+{
+    return (uint64_t)x + (w ? w : 1) <= width && (uint64_t)y + (h ? h : 1) <= height;
+}
+
+// Everything the atlas derives from an entry is checked, so a damaged entry can't point outside of its pixels
+static bool _entry_valid(const struct mascot_atlas_cache_entry* entry, uint32_t scale, uint64_t data_len)
+{
+    if (!entry->width || !entry->height) return false;
+    if (entry->pixel_width != mascot_atlas_cache_scaled_size(entry->width, scale)) return false;
+    if (entry->pixel_height != mascot_atlas_cache_scaled_size(entry->height, scale)) return false;
+    if (!_region_fits(entry->ireg_x, entry->ireg_y, entry->ireg_w, entry->ireg_h, entry->width, entry->height)) return false;
+    if (!_region_fits(entry->pixel_ireg_x, entry->pixel_ireg_y, entry->pixel_ireg_w, entry->pixel_ireg_h, entry->pixel_width, entry->pixel_height)) return false;
+    return entry->offset <= data_len && _entry_pixels_len(entry) <= data_len - entry->offset;
+}
+
+// Caches of removed packs and unused scales are never opened again, so they are expired by age
+static void _remove_expired(const char* dir)
+{
+    int dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) return;
+    DIR* d = fdopendir(dirfd);
+    if (!d) {
+        close(dirfd);
+        return;
+    }
+
+    time_t now = time(NULL);
+    struct dirent* dent;
+    while ((dent = readdir(d))) {
+        const char* ext = strstr(dent->d_name, ".atlas");
+        if (!ext) continue;
+        time_t max_age = ext[6] ? MASCOT_ATLAS_CACHE_TMP_MAX_AGE : MASCOT_ATLAS_CACHE_MAX_AGE;
+
+        struct stat st;
+        if (fstatat(dirfd, dent->d_name, &st, AT_SYMLINK_NOFOLLOW) || !S_ISREG(st.st_mode)) continue;
+        if (now - st.st_mtime < max_age) continue;
+        if (!unlinkat(dirfd, dent->d_name, 0)) DEBUG("Atlas cache \"%s%s\": Removed expired cache", dir, dent->d_name);
+    }
+    closedir(d);
+}
+
+struct mascot_atlas_cache* mascot_atlas_cache_open(const char* dirname, uint32_t scale)
+{
+    char path[PATH_MAX];
+    if (!_cache_path(dirname, scale, path, sizeof(path))) return NULL;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) DEBUG("Atlas cache \"%s\": Failed to open: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(struct mascot_atlas_cache_header)) {
+        close(fd);
+        return NULL;
+    }
+
+    // Modification time marks the cache as used, so it doesn't expire
+    futimens(fd, NULL);
+
+    uint8_t* mapping = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return NULL;
+
+    const struct mascot_atlas_cache_header* header = (const struct mascot_atlas_cache_header*)mapping;
+    size_t size = st.st_size;
+
+    // Anything not matching exactly is treated as stale, it will be replaced on this load
+    bool valid = !memcmp(header->magic, MASCOT_ATLAS_CACHE_MAGIC, 8)
+        && header->version == MASCOT_ATLAS_CACHE_VERSION
+        && header->scale == scale
+        && header->size == size
+        && header->names_offset >= sizeof(struct mascot_atlas_cache_header) + (uint64_t)header->count * sizeof(struct mascot_atlas_cache_entry)
+        && header->names_offset <= header->data_offset
+        && header->data_offset <= size;
+
+    struct mascot_atlas_cache_entry* entries = (struct mascot_atlas_cache_entry*)(mapping + sizeof(struct mascot_atlas_cache_header));
+    for (uint32_t i = 0; valid && i < header->count; i++) {
+        valid = (uint64_t)entries[i].name_offset + entries[i].name_length <= header->data_offset - header->names_offset
+            && _entry_valid(&entries[i], scale, size - header->data_offset);
+    }
+
+    if (!valid) {
+        DEBUG("Atlas cache \"%s\": Removing stale or damaged cache", path);
+        munmap(mapping, size);
+        unlink(path);
+        return NULL;
+    }
+
+    struct mascot_atlas_cache* cache = calloc(1, sizeof(struct mascot_atlas_cache));
+    if (!cache) ERROR("Could not open atlas cache: Allocation failed");
+
+    cache->mapping = mapping;
+    cache->size = size;
+    cache->header = header;
+    cache->entries = entries;
+    cache->names = (const char*)mapping + header->names_offset;
+    cache->data = mapping + header->data_offset;
+    return cache;
+}
+
+struct mascot_atlas_cache* mascot_atlas_cache_create(const char* dirname, uint32_t scale, struct mascot_atlas_cache_entry* entries, char** names, uint16_t count)
+{
+    char path[PATH_MAX];
+    if (!_cache_path(dirname, scale, path, sizeof(path))) return NULL;
+
+    if (io_buildtree(path)) {
+        DEBUG("Atlas cache \"%s\": Failed to create cache directory", path);
+        return NULL;
+    }
+
+    size_t names_offset = sizeof(struct mascot_atlas_cache_header) + (size_t)count * sizeof(struct mascot_atlas_cache_entry);
+    size_t names_len = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        entries[i].name_offset = names_len;
+        entries[i].name_length = strlen(names[i]);
+        names_len += entries[i].name_length;
+    }
+
+    size_t data_offset = _align(names_offset + names_len);
+    size_t data_len = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        entries[i].offset = data_len;
+        data_len = _align(data_len + _entry_pixels_len(&entries[i]));
+    }
+    size_t size = data_offset + data_len;
+
+    char tmp_path[PATH_MAX];
+    size_t printed = snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+    if (printed >= sizeof(tmp_path)) return NULL;
+
+    int fd = mkostemp(tmp_path, O_CLOEXEC);
+    if (fd < 0) {
+        DEBUG("Atlas cache \"%s\": Failed to create temporary file: %s", path, strerror(errno));
+        return NULL;
+    }
+
+    uint8_t* mapping = MAP_FAILED;
+    if (!ftruncate(fd, size)) {
+        mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        DEBUG("Atlas cache \"%s\": Failed to allocate %zu bytes: %s", path, size, strerror(errno));
+        unlink(tmp_path);
+        return NULL;
+    }
+
+    struct mascot_atlas_cache_header* header = (struct mascot_atlas_cache_header*)mapping;
+    memcpy(header->magic, MASCOT_ATLAS_CACHE_MAGIC, 8);
+    header->version = MASCOT_ATLAS_CACHE_VERSION;
+    header->scale = scale;
+    header->count = count;
+    header->names_offset = names_offset;
+    header->data_offset = data_offset;
+    header->size = size;
+
+    memcpy(mapping + sizeof(struct mascot_atlas_cache_header), entries, (size_t)count * sizeof(struct mascot_atlas_cache_entry));
+    for (uint16_t i = 0; i < count; i++) {
+        memcpy(mapping + names_offset + entries[i].name_offset, names[i], entries[i].name_length);
+    }
+
+    struct mascot_atlas_cache* cache = calloc(1, sizeof(struct mascot_atlas_cache));
+    if (!cache) ERROR("Could not create atlas cache: Allocation failed");
+
+    cache->mapping = mapping;
+    cache->size = size;
+    cache->header = header;
+    cache->entries = (struct mascot_atlas_cache_entry*)(mapping + sizeof(struct mascot_atlas_cache_header));
+    cache->names = (const char*)mapping + names_offset;
+    cache->data = mapping + data_offset;
+    cache->tmp_path = strdup(tmp_path);
+    cache->path = strdup(path);
+    if (!cache->tmp_path || !cache->path) ERROR("Could not create atlas cache: Allocation failed");
+    return cache;
+}
+
+const struct mascot_atlas_cache_entry* mascot_atlas_cache_find(const struct mascot_atlas_cache* cache, const char* name, uint64_t file_hash, uint16_t index)
+{
+    if (!cache) return NULL;
+
+    size_t name_len = strlen(name);
+    uint32_t count = cache->header->count;
+
+    // Directory walk order rarely changes between loads, so the entry is usually found at the same index
+    for (uint32_t i = 0; i < count; i++) {
+        const struct mascot_atlas_cache_entry* entry = &cache->entries[(index + i) % count];
+        if (entry->name_length != name_len) continue;
+        if (memcmp(cache->names + entry->name_offset, name, name_len)) continue;
+        return entry->file_hash == file_hash ? entry : NULL;
+    }
+    return NULL;
+}
+
+uint8_t* mascot_atlas_cache_pixels(const struct mascot_atlas_cache* cache, const struct mascot_atlas_cache_entry* entry)
+{
+    return cache->data + entry->offset;
+}
+
+bool mascot_atlas_cache_commit(struct mascot_atlas_cache* cache)
+{
+    if (!cache || !cache->tmp_path) return false;
+
+    // Data has to reach the disk before the file becomes visible under its final name,
+    // otherwise a crash could leave a valid looking cache with missing pixels
+    bool ok = !msync(cache->mapping, cache->size, MS_SYNC) && !rename(cache->tmp_path, cache->path);
+    if (!ok) {
+        DEBUG("Atlas cache \"%s\": Failed to commit: %s", cache->path, strerror(errno));
+        unlink(cache->tmp_path);
+    }
+
+    free(cache->tmp_path);
+    cache->tmp_path = NULL;
+
+    char dir[PATH_MAX];
+    size_t dir_len = _cache_directory(dir, sizeof(dir));
+    if (dir_len && dir_len < sizeof(dir)) _remove_expired(dir);
+    return ok;
+}
+
+void mascot_atlas_cache_close(struct mascot_atlas_cache* cache)
+{
+    if (!cache) return;
+
+    munmap(cache->mapping, cache->size);
+    if (cache->tmp_path) unlink(cache->tmp_path);
+    free(cache->tmp_path);
+    free(cache->path);
+    free(cache);
+}
@@ -0,0 +1,69 @@
+/*
+    mascot_atlas_cache.h - wl_shimeji's on-disk cache of converted atlas sprites
+
+    Copyright (C) 2025  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef MASCOT_ATLAS_CACHE_H
+#define MASCOT_ATLAS_CACHE_H
+
+#include "master_header.h"
+
+// Every atlas directory gets one cache file in $XDG_CACHE_HOME/wl_shimeji/atlases.
+// It holds premultiplied direct and mirrored pixels of every sprite together with its input region,
+// so unchanged sprites are copied straight into the pool instead of being decoded and converted again.
+struct mascot_atlas_cache;
+
+struct mascot_atlas_cache_entry {
+    uint64_t file_hash; // Hash of the source QOI file
+    uint64_t content_hash; // Hash of decoded pixels, used for sprite sharing
+    uint64_t offset; // Offset of converted pixels (direct image followed by mirrored one) in cache data
+    uint32_t width, height;
+    uint32_t ireg_x, ireg_y, ireg_w, ireg_h;
+    uint32_t pixel_width, pixel_height; // Size of converted pixels, differs from frame size in caches of other scales
+    uint32_t pixel_ireg_x, pixel_ireg_y, pixel_ireg_w, pixel_ireg_h; // Input region in converted pixels
+    uint32_t name_offset, name_length;
+};
+
+// Hash used both for source files and decoded pixels
+uint64_t mascot_atlas_cache_hash(const uint8_t* data, size_t len, uint64_t seed);
+
+// Hashes file at path, returns false if it can't be read
+bool mascot_atlas_cache_hash_file(const char* path, uint64_t* out);
+
+// Frame dimension after pre-scaling to scale (in MASCOT_ATLAS_SCALE_UNIT units), never zero
+uint32_t mascot_atlas_cache_scaled_size(uint32_t size, uint32_t scale);
+
+// Maps existing cache for atlas directory, returns NULL if there is no valid cache. Damaged caches are removed.
+// Scale is in MASCOT_ATLAS_SCALE_UNIT units, every scale has cache of its own
+struct mascot_atlas_cache* mascot_atlas_cache_open(const char* dirname, uint32_t scale);
+
+// Creates new cache with given entries. Offsets of entries are assigned here, pixels are to be written
+// to mascot_atlas_cache_pixels() and published with mascot_atlas_cache_commit()
+struct mascot_atlas_cache* mascot_atlas_cache_create(const char* dirname, uint32_t scale, struct mascot_atlas_cache_entry* entries, char** names, uint16_t count);
+
+// Returns entry for sprite name with matching file hash, or NULL. Index is only a hint where to look first
+const struct mascot_atlas_cache_entry* mascot_atlas_cache_find(const struct mascot_atlas_cache* cache, const char* name, uint64_t file_hash, uint16_t index);
+
+uint8_t* mascot_atlas_cache_pixels(const struct mascot_atlas_cache* cache, const struct mascot_atlas_cache_entry* entry);
+
+// Makes created cache visible to later loads. Caches unused for MASCOT_ATLAS_CACHE_MAX_AGE are removed on the way
+bool mascot_atlas_cache_commit(struct mascot_atlas_cache* cache);
+
+// Unmaps cache. Created but not committed cache is discarded
+void mascot_atlas_cache_close(struct mascot_atlas_cache* cache);
+
+#endif
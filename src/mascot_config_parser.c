@@ -34,6 +34,7 @@
 #include <strings.h>
 #include "global_symbols.h"
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <io.h>
 #include "protocol/server.h"
 
@@ -67,6 +68,7 @@ void mascot_prototype_link(const struct mascot_prototype* prototype)
         return;
     }
     ((struct mascot_prototype*)prototype)->reference_count++;
+    expression_source_changed(EXPRESSION_SOURCE_POPULATION);
 }
 
 void mascot_prototype_unlink(const struct mascot_prototype* prototype)
@@ -77,6 +79,7 @@ void mascot_prototype_unlink(const struct mascot_prototype* prototype)
     struct mascot_prototype* p = (struct mascot_prototype*)prototype;
 
     if (p->reference_count) p->reference_count--;
+    expression_source_changed(EXPRESSION_SOURCE_POPULATION);
     if (!p->reference_count) {
         close(p->path_fd);
         if (p->icon_fd != -1) close(p->icon_fd);
@@ -147,9 +150,10 @@ void mascot_prototype_unlink(const struct mascot_prototype* prototype)
         }
 
         for (uint16_t i = 0; i < expressions_count; i++) {
-            free((struct mascot_expression_definition*)p->expression_definitions[i]);
+            free((struct mascot_expression*)p->expression_definitions[i]);
         }
         free(p->expression_definitions);
+        expression_arena_free(p->expression_arena);
         mascot_atlas_destroy((struct mascot_atlas*)p->atlas);
 
         protocol_server_prototype_withdraw(p);
@@ -319,6 +323,7 @@ struct mascot_prototype* mascot_prototype_store_get_index(mascot_prototype_store
 
 struct config_program_loader_result {
     struct mascot_expression** expressions;
+    struct expression_arena* arena;
     size_t count;
     bool ok;
 };
@@ -358,6 +363,7 @@ struct string_int_int {
 struct string_ptr_pair {
     const char* string;
     void* value;
+    struct expression_stack_effect effect;
 };
 
 struct string_int_int locals[] = {
@@ -482,7 +488,7 @@ struct string_ptr_pair globals_n_funcs[] = {
 
 uint8_t GLOBAL_SYMS_COUNT = sizeof(globals_n_funcs) / sizeof(struct string_ptr_pair);
 
-struct mascot_expression* parse_program(struct json_object_s* program)
+struct mascot_expression* parse_program(struct json_object_s* program, struct expression_arena* arena)
 {
     struct expression_prototype* prototype = NULL;
     struct mascot_expression* expression = NULL;
@@ -492,15 +498,17 @@ struct mascot_expression* parse_program(struct json_object_s* program)
     bool    mascot_vars_found = false;
 
     void*   global_getters[128] = {0};
+    struct expression_stack_effect global_effects[128] = {0};
     uint8_t globals_count = 0;
     bool    globals_found = false;
 
     void* function_getters[128] = {0};
+    struct expression_stack_effect function_effects[128] = {0};
     uint8_t functions_count = 0;
     bool    functions_found = false;
 
-    char bytecode[1024] = {0};
-    uint16_t bytecode_size = 0;
+    const char* instructions_hex = NULL;
+    size_t instructions_hex_size = 0;
     bool insructions_found = false;
 
     bool evaluate_once = true;
@@ -513,13 +521,13 @@ struct mascot_expression* parse_program(struct json_object_s* program)
                 return NULL;
             }
             struct json_string_s* instructions = (struct json_string_s*)element->value->payload;
-            if (instructions->string_size > 1024) {
+            if (instructions->string_size > UINT16_MAX * 2) {
                 WARN("Instructions string too long");
                 return NULL;
             }
             insructions_found = true;
-            memcpy(bytecode, instructions->string, instructions->string_size);
-            bytecode_size = instructions->string_size;
+            instructions_hex = instructions->string;
+            instructions_hex_size = instructions->string_size;
         }
         if (!strncmp(element->name->string, "symtab_l", element->name->string_size) && strlen("symtab_l") == element->name->string_size) {
             if (element->value->type != json_type_array) {
@@ -570,10 +578,12 @@ struct mascot_expression* parse_program(struct json_object_s* program)
                 for (int i = 0; i < GLOBAL_SYMS_COUNT+1; i++) {
                     if (i == GLOBAL_SYMS_COUNT) {
                         WARN("Unknown global variable %s", var->string);
+                        global_effects[globals_count] = (struct expression_stack_effect){0, 1, EXPRESSION_SOURCE_NONE};
                         global_getters[globals_count++] = mascot_noop;
                         break;
                     }
                     if (!strncasecmp(var->string, globals_n_funcs[i].string, var->string_size) && strlen(globals_n_funcs[i].string) == var->string_size) {
+                        global_effects[globals_count] = globals_n_funcs[i].effect;
                         global_getters[globals_count++] = globals_n_funcs[i].value;
                         break;
                     }
@@ -602,10 +612,12 @@ struct mascot_expression* parse_program(struct json_object_s* program)
                 for (int i = 0; i < GLOBAL_SYMS_COUNT+1; i++) {
                     if (i == GLOBAL_SYMS_COUNT) {
                         WARN("Unknown function %s", var->string);
+                        function_effects[functions_count] = (struct expression_stack_effect){0, 1, EXPRESSION_SOURCE_NONE};
                         function_getters[functions_count++] = mascot_noop;
                         break;
                     }
                     if (!strncasecmp(var->string, globals_n_funcs[i].string, var->string_size)) {
+                        function_effects[functions_count] = globals_n_funcs[i].effect;
                         function_getters[functions_count++] = globals_n_funcs[i].value;
                         break;
                     }
@@ -645,25 +657,38 @@ struct mascot_expression* parse_program(struct json_object_s* program)
         return NULL;
     }
 
-    prototype = expression_prototype_new();
-    if (!prototype) {
-        WARN("Failed to create prototype");
+    // Every instruction is an opcode and an operand byte, two hex digits each
+    if (instructions_hex_size % 4 != 0) {
+        WARN("Instructions string length must be a multiple of 4");
         return NULL;
     }
-
-    // Check if instructions len is a multiple of 2
-    if (bytecode_size % 2 != 0) {
-        WARN("Instructions string length must be a multiple of 2");
+    if (instructions_hex_size / 2 > UINT16_MAX) {
+        WARN("Instructions are longer than %u bytes", UINT16_MAX);
         return NULL;
     }
 
-    // Load into prototype
-    expression_prototype_load_mascot_vars(prototype, mascot_vars, mascot_vars_count);
-    expression_prototype_load_global_getters(prototype, global_getters, globals_count);
-    expression_prototype_load_function_ptrs(prototype, function_getters, functions_count);
+    // Bytecode is encoded as hex string, so we need to convert it to binary
+    uint16_t bytecode_size = instructions_hex_size / 2;
+    uint8_t* bytecode = malloc(bytecode_size ? bytecode_size : 1);
+    if (!bytecode) {
+        WARN("Failed to allocate memory for bytecode");
+        return NULL;
+    }
+    for (uint16_t i = 0; i < bytecode_size; i++) {
+        char hex[3] = {instructions_hex[i * 2], instructions_hex[i * 2 + 1], 0};
+        bytecode[i] = strtol(hex, NULL, 16);
+    }
 
-    // load bytecode
-    if (!expression_prototype_load_bytecode(prototype, (uint8_t*)bytecode, bytecode_size)) {
+    // Identical programs share one body
+    struct expression_source source = {
+        .bytecode = bytecode, .bytecode_size = bytecode_size,
+        .mascot_vars = mascot_vars, .mascot_vars_size = mascot_vars_count,
+        .global_getters = global_getters, .global_getters_effects = global_effects, .global_getters_size = globals_count,
+        .function_ptrs = function_getters, .function_ptrs_effects = function_effects, .function_ptrs_size = functions_count,
+    };
+    prototype = expression_arena_load(arena, &source);
+    free(bytecode);
+    if (!prototype) {
         WARN("Failed to load bytecode");
         return NULL;
     }
@@ -700,6 +725,14 @@ struct config_program_loader_result load_programs(struct json_object_s* programs
         return result;
     }
 
+    result.arena = expression_arena_new();
+    if (!result.arena) {
+        WARN("Failed to allocate expression arena");
+        free(result.expressions);
+        result.expressions = NULL;
+        return result;
+    }
+
     struct json_array_s* programs_array = (struct json_array_s*)programs->value->payload;
     struct json_array_element_s* program = programs_array->start;
     int i = 0;
@@ -713,14 +746,14 @@ struct config_program_loader_result load_programs(struct json_object_s* programs
             return result;
         }
 
-        struct mascot_expression* expression = parse_program((struct json_object_s*)program->value->payload);
+        struct mascot_expression* expression = parse_program((struct json_object_s*)program->value->payload, result.arena);
         if (!expression) {
             program = program->next;
             WARN("Failed to parse program num %d", i++);
             continue;
         }
         result.expressions[result.count++] = expression;
-        expression->body->id = i;
+        expression->id = i;
 
         program = program->next;
         i++;
@@ -774,8 +807,9 @@ struct config_actionref_parse_result parse_action_reference(struct mascot_protot
 
             // Now we need to find the action in the action_definitions
             struct json_string_s* action_name = (struct json_string_s*)celement->value->payload;
-            for (size_t i = 0; i < *count; i++) {
-                if (!strncmp(action_definitions[i]->name, action_name->string, action_name->string_size) && strlen(action_definitions[i]->name) == action_name->string_size) {
+            atom_t action_atom = atom_lookup_n(action_name->string, action_name->string_size);
+            for (size_t i = 0; i < *count && action_atom != ATOM_NONE; i++) {
+                if (action_definitions[i]->name_atom == action_atom) {
                     actionref_obj->action = action_definitions[i];
                     action_name_set = true;
                     break;
@@ -820,7 +854,7 @@ struct config_actionref_parse_result parse_action_reference(struct mascot_protot
                 for (int i = 0; i < MASCOT_LOCAL_VARIABLE_COUNT; i++) {
                     if (!strncasecmp(clocal_var->name->string, locals[i].string, clocal_var->name->string_size)) {
                         for (uint16_t j = 0; j < prototype->expressions_count; j++) {
-                            if (prototype->expression_definitions[j]->body->id == atoi(local_var_value->number)) {
+                            if (prototype->expression_definitions[j]->id == atoi(local_var_value->number)) {
                                 actionref_obj->overwritten_locals[i]->used = true;
                                 actionref_obj->overwritten_locals[i]->expr.expression_prototype = (struct mascot_expression*)prototype->expression_definitions[j];
                                 actionref_obj->overwritten_locals[i]->expr.kind = locals[i].kind;
@@ -849,7 +883,7 @@ struct config_actionref_parse_result parse_action_reference(struct mascot_protot
             struct json_number_s* condition = (struct json_number_s*)celement->value->payload;
             // Find the condition in the prototype expression definitions
             for (uint16_t i = 0; i < prototype->expressions_count; i++) {
-                if (prototype->expression_definitions[i]->body->id == atoi(condition->number)) {
+                if (prototype->expression_definitions[i]->id == atoi(condition->number)) {
                     actionref_obj->condition = (struct mascot_expression*)prototype->expression_definitions[i];
                     break;
                 }
@@ -872,7 +906,7 @@ struct config_actionref_parse_result parse_action_reference(struct mascot_protot
             struct json_number_s* condition = (struct json_number_s*)celement->value->payload;
             // Find the condition in the prototype expression definitions
             for (uint16_t i = 0; i < prototype->expressions_count; i++) {
-                if (prototype->expression_definitions[i]->body->id == atoi(condition->number)) {
+                if (prototype->expression_definitions[i]->id == atoi(condition->number)) {
                     actionref_obj->duration_limit = (struct mascot_expression*)prototype->expression_definitions[i];
                     break;
                 }
@@ -1318,7 +1352,7 @@ struct mascot_animation* parse_animation(struct mascot_prototype* prototype, str
             struct json_number_s* condition = (struct json_number_s*)celement->value->payload;
             // Find the condition in the prototype expression definitions
             for (uint16_t i = 0; i < prototype->expressions_count; i++) {
-                if (prototype->expression_definitions[i]->body->id == atoi(condition->number)) {
+                if (prototype->expression_definitions[i]->id == atoi(condition->number)) {
                     animation_obj->condition = (struct mascot_expression*)prototype->expression_definitions[i];
                     break;
                 }
@@ -1392,6 +1426,7 @@ struct config_action_parse_result action_parse(struct mascot_prototype* prototyp
                 goto action_generator_fail;
             }
             action_obj->name = strndup(((struct json_string_s*)celement->value->payload)->string, ((struct json_string_s*)celement->value->payload)->string_size);
+            action_obj->name_atom = atom_intern(action_obj->name);
             name_set = true;
         }
         if (!strncmp("type", celement->name->string, celement->name->string_size) && strlen("type") == celement->name->string_size) {
@@ -1512,7 +1547,7 @@ struct config_action_parse_result action_parse(struct mascot_prototype* prototyp
                 continue;
             }
             for (uint16_t i = 0; i < prototype->expressions_count; i++) {
-                if (prototype->expression_definitions[i]->body->id == condition_name) {
+                if (prototype->expression_definitions[i]->id == condition_name) {
                     action_obj->condition = prototype->expression_definitions[i];
                     break;
                 }
@@ -1557,7 +1592,7 @@ struct config_action_parse_result action_parse(struct mascot_prototype* prototyp
                 for (int i = 0; i < MASCOT_LOCAL_VARIABLE_COUNT; i++) {
                     if (!strncasecmp(curr_local_var->name->string, locals[i].string, strlen(locals[i].string))) {
                         for (uint16_t j = 0; j < prototype->expressions_count; j++) {
-                            if (prototype->expression_definitions[j]->body->id == atoi(local_var_value->number)) {
+                            if (prototype->expression_definitions[j]->id == atoi(local_var_value->number)) {
                                 action_obj->variables[i]->used = true;
                                 action_obj->variables[i]->expr.expression_prototype = (struct mascot_expression*)prototype->expression_definitions[j];
                                 action_obj->variables[i]->expr.kind = locals[i].kind;
@@ -1622,6 +1657,7 @@ struct config_action_parse_result action_parse(struct mascot_prototype* prototyp
             }
             struct json_string_s* affordance = (struct json_string_s*)celement->value->payload;
             action_obj->affordance = strndup(affordance->string, affordance->string_size);
+            action_obj->affordance_atom = atom_intern(action_obj->affordance);
         }
         // Get transform_target
         if (!strncmp("transform_target", celement->name->string, celement->name->string_size) && strlen("transform_target") == celement->name->string_size) {
@@ -1887,8 +1923,9 @@ struct config_behaviorref_parse_result parse_behaviorref(struct mascot_prototype
                 name_set = true;
             } else {
                 struct json_string_s* name = (struct json_string_s*)celement->value->payload;
-                for (size_t i = 0; i < *bcount; i++) {
-                    if (!strncmp(name->string, behaviors_definitions[i]->name, name->string_size)) {
+                atom_t name_atom = atom_lookup_n(name->string, name->string_size);
+                for (size_t i = 0; i < *bcount && name_atom != ATOM_NONE; i++) {
+                    if (behaviors_definitions[i]->name_atom == name_atom) {
                         result.behavior.behavior = behaviors_definitions[i];
                         name_set = true;
                     }
@@ -1931,8 +1968,9 @@ bool resolve_temporal_behavior_reference(struct mascot_prototype* prototype, str
         struct mascot_temporal_behavior_reference ref = *(struct mascot_temporal_behavior_reference*)(void*)&behavior->next_behavior_list[i];
         bool replaced = false;
         DEBUG("Resolving behavior ref %s", ref.name);
-        for (size_t j = 0; j < bcount; j++) {
-            if (!strncmp(ref.name, behaviors_definitions[j]->name, strlen(behaviors_definitions[j]->name)) && strlen(ref.name) == strlen(behaviors_definitions[j]->name)) {
+        atom_t ref_atom = atom_lookup(ref.name);
+        for (size_t j = 0; j < bcount && ref_atom != ATOM_NONE; j++) {
+            if (behaviors_definitions[j]->name_atom == ref_atom) {
                 behavior->next_behavior_list[i] = (struct mascot_behavior_reference){.behavior = behaviors_definitions[j], .frequency = ref.frequency, .condition = behavior->is_condition ? behavior->condition : NULL};
                 replaced = true;
                 break;
@@ -2026,7 +2064,7 @@ struct config_behavior_parse_result parse_behavior(struct mascot_prototype* prot
             }
             // Find expression by id
             for (size_t i = 0; i < prototype->expressions_count; i++) {
-                if (prototype->expression_definitions[i]->body->id == atoi(((struct json_number_s*)celement->value->payload)->number)) {
+                if (prototype->expression_definitions[i]->id == atoi(((struct json_number_s*)celement->value->payload)->number)) {
                     behavior_obj->condition = prototype->expression_definitions[i];
                     break;
                 }
@@ -2085,21 +2123,13 @@ struct config_behavior_parse_result parse_behavior(struct mascot_prototype* prot
         goto behavior_parser_failed;
     }
     if (!behavior_obj->is_condition) {
-        if (!action_name) {
-            // Find action by behavior name
-            for (size_t i = 0; i < prototype->actions_count; i++) {
-                if (!strcmp(prototype->action_definitions[i]->name, behavior_name->string) && strlen(prototype->action_definitions[i]->name) == behavior_name->string_size) {
-                    behavior_obj->action = prototype->action_definitions[i];
-                    break;
-                }
-            }
-        } else {
-            // Find action by action name
-            for (size_t i = 0; i < prototype->actions_count; i++) {
-                if (!strcmp(prototype->action_definitions[i]->name, action_name->string) && strlen(prototype->action_definitions[i]->name) == action_name->string_size) {
-                    behavior_obj->action = prototype->action_definitions[i];
-                    break;
-                }
+        // Find action by action name, or by behavior name if action is not specified
+        struct json_string_s* lookup_name = action_name ? action_name : behavior_name;
+        atom_t action_atom = atom_lookup_n(lookup_name->string, lookup_name->string_size);
+        for (size_t i = 0; i < prototype->actions_count && action_atom != ATOM_NONE; i++) {
+            if (prototype->action_definitions[i]->name_atom == action_atom) {
+                behavior_obj->action = prototype->action_definitions[i];
+                break;
             }
         }
         if (!behavior_obj->action) {
@@ -2114,6 +2144,7 @@ struct config_behavior_parse_result parse_behavior(struct mascot_prototype* prot
         WARN("Failed to allocate memory for behavior name");
         goto behavior_parser_failed;
     }
+    behavior_obj->name_atom = atom_intern(behavior_obj->name);
 
     result.status = MASCOT_BEHAVIOR_PARSE_OK;
     result.behavior = behavior_obj;
@@ -2225,6 +2256,41 @@ struct config_behavior_loader_result load_behaviors(struct mascot_prototype* pro
 
 }
 
+// Maps whole JSON file read-only and parses it in place.
+// json.h copies everything it needs into the returned DOM, so the mapping is dropped right after parsing,
+// and no intermediate heap copy of the file is ever made. Returns NULL and leaves errno set on failure.
+static struct json_value_s* config_parse_json_file(const char* path, struct json_parse_result_s* result)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return NULL;
+    }
+
+    if (!S_ISREG(st.st_mode) || st.st_size == 0) {
+        close(fd);
+        errno = EINVAL;
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+
+    madvise(data, size, MADV_SEQUENTIAL);
+    struct json_value_s* value = json_parse_ex(data, size, json_parse_flags_default, NULL, NULL, result);
+    munmap(data, size);
+
+    if (!value) errno = EINVAL;
+    return value;
+}
+
 enum mascot_prototype_load_result mascot_prototype_load(struct mascot_prototype * prototype, const char* prototypes_root, const char *path_)
 {
     static int64_t minver = -1;
@@ -2277,33 +2343,19 @@ enum mascot_prototype_load_result mascot_prototype_load(struct mascot_prototype
 
     char filename_buf[PATH_MAX+15] = {0};
     snprintf(filename_buf, PATH_MAX+15, "%s/manifest.json", path);
-    FILE* manifest = fopen(filename_buf, "r");
-    if (!manifest) {
+    struct json_value_s* manifest_data = config_parse_json_file(filename_buf, NULL);
+    if (!manifest_data) {
         if (errno == ENOENT) {
             WARN("Failed to load prototype from %s: manifest.json not found", path);
             return PROTOTYPE_LOAD_MANIFEST_NOT_FOUND;
         }
+        WARN("Cannot load prototype from %s: Invalid JSON or out of memory", filename_buf);
         return PROTOTYPE_LOAD_MANIFEST_INVALID;
     }
-    fseek(manifest, 0, SEEK_END);
-    size_t size = ftell(manifest);
-
-    char* buffer = (char*)malloc(size + 1);
-    if (!buffer) {
-        ERROR("Cannot load prototype from %s: Out of memory", filename_buf);
-    }
-
-    fseek(manifest, 0, SEEK_SET);
-    int readed = fread(buffer, 1, size, manifest);
-    UNUSED(readed);
-
-    struct json_value_s* manifest_data = json_parse(buffer, size);
-    if (!manifest_data) {
-        ERROR("Cannot load prototype from %s: Invalid JSON or out of memory", filename_buf);
-    }
 
     if (manifest_data->type != json_type_object) {
         WARN("Cannot load prototype from %s: Invalid JSON: Root expected to be an object", filename_buf);
+        free(manifest_data);
         return PROTOTYPE_LOAD_MANIFEST_INVALID;
     }
 
@@ -2320,53 +2372,54 @@ enum mascot_prototype_load_result mascot_prototype_load(struct mascot_prototype
         if (!strcmp(element->name->string, "name")) {
             if (element->value->type != json_type_string) {
                 WARN("Cannot load prototype from %s: Invalid JSON: name expected to be a string", filename_buf);
-                return PROTOTYPE_LOAD_MANIFEST_INVALID;
+                goto manifest_invalid;
             }
             prototype->name = strdup(((struct json_string_s*)(element->value->payload))->string);
         } else if (!strcmp(element->name->string, "version")) {
             if (element->value->type != json_type_string) {
                 WARN("Cannot load prototype from %s: Invalid JSON: version expected to be a string", filename_buf);
-                return PROTOTYPE_LOAD_MANIFEST_INVALID;
+                goto manifest_invalid;
             }
             version = version_to_i64(((struct json_string_s*)(element->value->payload))->string);
             if (version < 0) {
                 WARN("Cannot load prototype from %s: Invalid JSON: Mascot config version is invalid", filename_buf);
-                return PROTOTYPE_LOAD_MANIFEST_INVALID;
+                goto manifest_invalid;
             }
             strncpy(version_str, ((struct json_string_s*)(element->value->payload))->string, 127);
         } else if (!strcmp(element->name->string, "display_name")) {
             if (element->value->type != json_type_string) {
                 WARN("Cannot load prototype from %s: Invalid JSON: display_name expected to be a string", filename_buf);
-                return PROTOTYPE_LOAD_MANIFEST_INVALID;
+                goto manifest_invalid;
             }
             prototype->display_name = strdup(((struct json_string_s*)(element->value->payload))->string);
         } else if (!strcmp(element->name->string, "programs")) {
             if (element->value->type != json_type_string) {
                 WARN("Cannot load prototype from %s: Invalid JSON: programs expected to be a string", filename_buf);
-                return PROTOTYPE_LOAD_MANIFEST_INVALID;
+                goto manifest_invalid;
             }
             snprintf(programs_path, PATH_MAX+2, "%s/%s", path, ((struct json_string_s*)(element->value->payload))->string);
         } else if (!strcmp(element->name->string, "assets")) {
             if (element->value->type != json_type_string) {
                 WARN("Cannot load prototype from %s: Invalid JSON: assets expected to be a string", filename_buf);
-                return PROTOTYPE_LOAD_MANIFEST_INVALID;
+                goto manifest_invalid;
             }
             snprintf(assets_path, PATH_MAX+2, "%s/%s", path, ((struct json_string_s*)(element->value->payload))->string);
         } else if (!strcmp(element->name->string, "actions")) {
             if (element->value->type != json_type_string) {
                 WARN("Cannot load prototype from %s: Invalid JSON: actions expected to be a string", filename_buf);
-                return PROTOTYPE_LOAD_MANIFEST_INVALID;
+                goto manifest_invalid;
             }
             snprintf(actions_path, PATH_MAX+2, "%s/%s", path, ((struct json_string_s*)(element->value->payload))->string);
         } else if (!strcmp(element->name->string, "behaviors")) {
             if (element->value->type != json_type_string) {
                 WARN("Cannot load prototype from %s: Invalid JSON: behaviors expected to be a string", filename_buf);
-                return PROTOTYPE_LOAD_MANIFEST_INVALID;
+                goto manifest_invalid;
             }
             snprintf(behaviors_path, PATH_MAX+2, "%s/%s", path, ((struct json_string_s*)(element->value->payload))->string);
         }
         element = element->next;
     }
+    free(manifest_data);
 
     if (version < minver) {
         WARN("Cannot load prototype from %s: Mascot config version is too old! Minimum supported version is %s but got %s", filename_buf, WL_SHIMEJI_MASCOT_MIN_VER, version_str);
@@ -2405,22 +2458,12 @@ enum mascot_prototype_load_result mascot_prototype_load(struct mascot_prototype
     }
 
     // Open and load programs.json
-    FILE* programs = fopen(programs_path, "r");
-    if (!programs) {
-        WARN("Cannot load prototype from %s: Failed to open %s", filename_buf, programs_path);
-        return PROTOTYPE_LOAD_PROGRAMS_NOT_FOUND;
-    }
-
-    fseek(programs, 0, SEEK_END);
-    size = ftell(programs);
-    fseek(programs, 0, SEEK_SET);
-
-    char* progbuf = (char*)calloc(1, size + 1);
-    readed = fread(progbuf, 1, size, programs);
-    UNUSED(readed);
-    struct json_value_s* programs_data = json_parse(progbuf, size);
-
+    struct json_value_s* programs_data = config_parse_json_file(programs_path, NULL);
     if (!programs_data) {
+        if (errno == ENOENT) {
+            WARN("Cannot load prototype from %s: Failed to open %s", filename_buf, programs_path);
+            return PROTOTYPE_LOAD_PROGRAMS_NOT_FOUND;
+        }
         WARN("Cannot load prototype from %s: Failed to parse programs.json", filename_buf);
         return PROTOTYPE_LOAD_PROGRAMS_INVALID;
     }
@@ -2434,33 +2477,25 @@ enum mascot_prototype_load_result mascot_prototype_load(struct mascot_prototype
     struct config_program_loader_result program_loader_result = load_programs(programs_root);
     if (!program_loader_result.ok) {
         WARN("Cannot load prototype from %s: Failed to load programs", filename_buf);
+        for (size_t i = 0; i < program_loader_result.count; i++) free(program_loader_result.expressions[i]);
+        free(program_loader_result.expressions);
+        expression_arena_free(program_loader_result.arena);
         return PROTOTYPE_LOAD_PROGRAMS_INVALID;
     }
 
     DEBUG("Prototype %s: loaded %d programs", prototype->name, program_loader_result.count);
     prototype->expression_definitions = (const struct mascot_expression**)program_loader_result.expressions;
     prototype->expressions_count = program_loader_result.count;
+    prototype->expression_arena = program_loader_result.arena;
 
     free(programs_data);
-    fclose(programs);
-    free(progbuf);
-
-    FILE* actions = fopen(actions_path, "r");
-    if (!actions) {
-        WARN("Cannot load prototype from %s: Failed to open %s", filename_buf, actions_path);
-        return PROTOTYPE_LOAD_ACTIONS_NOT_FOUND;
-    }
-
-    fseek(actions, 0, SEEK_END);
-    size = ftell(actions);
-    fseek(actions, 0, SEEK_SET);
-
-    char* actbuf = (char*)calloc(1, size + 1);
-    readed = fread(actbuf, 1, size, actions);
-    UNUSED(readed);
-    struct json_value_s* actions_data = json_parse(actbuf, size);
 
+    struct json_value_s* actions_data = config_parse_json_file(actions_path, NULL);
     if (!actions_data) {
+        if (errno == ENOENT) {
+            WARN("Cannot load prototype from %s: Failed to open %s", filename_buf, actions_path);
+            return PROTOTYPE_LOAD_ACTIONS_NOT_FOUND;
+        }
         WARN("Cannot load prototype from %s: Failed to parse actions.json", filename_buf);
         return PROTOTYPE_LOAD_ACTIONS_INVALID;
     }
@@ -2482,27 +2517,14 @@ enum mascot_prototype_load_result mascot_prototype_load(struct mascot_prototype
     prototype->actions_count = actions_loader_result.count;
 
     free(actions_data);
-    fclose(actions);
-    free(actbuf);
 
-    FILE* behaviors = fopen(behaviors_path, "r");
-    if (!behaviors) {
-        WARN("Cannot load prototype from %s: Failed to open %s", filename_buf, behaviors_path);
-        return PROTOTYPE_LOAD_BEHAVIORS_NOT_FOUND;
-    }
-
-    fseek(behaviors, 0, SEEK_END);
-    size = ftell(behaviors);
-    fseek(behaviors, 0, SEEK_SET);
-
-    char* behbuf = (char*)calloc(1, size + 1);
-    readed = fread(behbuf, 1, size, behaviors);
-    UNUSED(readed);
-    // struct json_value_s* behaviors_data = json_parse(behbuf, size);
     struct json_parse_result_s result;
-    struct json_value_s* behaviors_data = json_parse_ex(behbuf, size, 0, NULL, NULL, &result);
-
+    struct json_value_s* behaviors_data = config_parse_json_file(behaviors_path, &result);
     if (!behaviors_data) {
+        if (errno == ENOENT) {
+            WARN("Cannot load prototype from %s: Failed to open %s", filename_buf, behaviors_path);
+            return PROTOTYPE_LOAD_BEHAVIORS_NOT_FOUND;
+        }
         WARN("Cannot load prototype from %s: Failed to parse behaviors.json", filename_buf);
         return PROTOTYPE_LOAD_BEHAVIORS_INVALID;
     }
@@ -2548,8 +2570,6 @@ enum mascot_prototype_load_result mascot_prototype_load(struct mascot_prototype
     }
 
     free(behaviors_data);
-    fclose(behaviors);
-    free(behbuf);
 
     prototype->local_variables_count = 128;
     prototype->path = strdup(path_);
@@ -2558,12 +2578,16 @@ enum mascot_prototype_load_result mascot_prototype_load(struct mascot_prototype
     prototype->version = version;
 
     return PROTOTYPE_LOAD_SUCCESS;
+
+manifest_invalid:
+    free(manifest_data);
+    return PROTOTYPE_LOAD_MANIFEST_INVALID;
 }
 
 void mascot_attach_affordance_manager(struct mascot* mascot, struct mascot_affordance_manager* manager) {
     if (!mascot) ERROR("Cannot attach affordance manager to NULL mascot");
     if (!manager && mascot->affordance_manager) {
-        mascot_announce_affordance(mascot, NULL);
+        mascot_announce_affordance(mascot, ATOM_NONE);
     }
     mascot->affordance_manager = manager;
     DEBUG("Attached affordance manager to mascot %s", mascot->prototype->name);
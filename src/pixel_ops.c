@@ -0,0 +1,437 @@
+/*
+    pixel_ops.c - wl_shimeji's sprite pixel conversion kernels
+
+    Copyright (C) 2025  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "pixel_ops.h"
+
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXEL_OPS_X86 1
+#endif
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PIXEL_OPS_NEON 1
+#endif
+
+// (c * a + 127) / 255 == (t + (t >> 8)) >> 8 where t = c * a + 128, for every c, a in [0, 255].
+// SIMD kernels use the shift form, scalar one keeps the division it was always using.
+static inline void pixel_ops_convert_scalar_pixels(const uint8_t* src, uint8_t* dst, uint8_t* mirror, uint32_t from, uint32_t width)
+{
+    for (uint32_t x = from; x < width; x++) {
+        const uint8_t* in = src + x * 4;
+        uint8_t out[4] = {
+            (in[2] * in[3] + 127) / 255, // Premultiplied B
+            (in[1] * in[3] + 127) / 255, // Premultiplied G
+            (in[0] * in[3] + 127) / 255, // Premultiplied R
+            in[3]                        // Just alpha
+        };
+        memcpy(dst + x * 4, out, 4);
+        if (mirror) memcpy(mirror + (width - 1 - x) * 4, out, 4);
+    }
+}
+
+static void pixel_ops_convert_row_scalar(const uint8_t* src, uint8_t* dst, uint8_t* mirror, uint32_t width)
+{
+    pixel_ops_convert_scalar_pixels(src, dst, mirror, 0, width);
+}
+
+static uint32_t pixel_ops_find_opaque_scalar(const uint8_t* row, uint32_t from, uint32_t to)
+{
+    for (uint32_t x = from; x < to; x++) {
+        if (row[x * 4 + 3]) return x;
+    }
+    return UINT32_MAX;
+}
+
+static uint32_t pixel_ops_rfind_opaque_scalar(const uint8_t* row, uint32_t from, uint32_t to)
+{
+    for (uint32_t x = to; x > from; x--) {
+        if (row[(x - 1) * 4 + 3]) return x - 1;
+    }
+    return UINT32_MAX;
+}
+
+#ifdef PIXEL_OPS_X86
+
+__attribute__((target("sse2")))
+static void pixel_ops_convert_row_sse2(const uint8_t* src, uint8_t* dst, uint8_t* mirror, uint32_t width)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i rgb_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+    const __m128i alpha_one = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    const __m128i bias = _mm_set1_epi16(128);
+
+    uint32_t x = 0;
+    for (; x + 4 <= width; x += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i*)(src + x * 4));
+        __m128i halves[2] = { _mm_unpacklo_epi8(px, zero), _mm_unpackhi_epi8(px, zero) };
+
+        for (int i = 0; i < 2; i++) {
+            __m128i c = halves[i];
+            // Multiply color channels by alpha, alpha itself by 255 so it passes through unchanged
+            __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm_or_si128(_mm_and_si128(a, rgb_mask), alpha_one);
+            __m128i t = _mm_add_epi16(_mm_mullo_epi16(c, a), bias);
+            t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+            // RGBA -> BGRA
+            halves[i] = _mm_shufflehi_epi16(_mm_shufflelo_epi16(t, _MM_SHUFFLE(3, 0, 1, 2)), _MM_SHUFFLE(3, 0, 1, 2));
+        }
+
+        __m128i out = _mm_packus_epi16(halves[0], halves[1]);
+        _mm_storeu_si128((__m128i*)(dst + x * 4), out);
+        if (mirror) _mm_storeu_si128((__m128i*)(mirror + (width - x - 4) * 4), _mm_shuffle_epi32(out, _MM_SHUFFLE(0, 1, 2, 3)));
+    }
+
+    pixel_ops_convert_scalar_pixels(src, dst, mirror, x, width);
+}
+
+__attribute__((target("avx2")))
+static void pixel_ops_convert_row_avx2(const uint8_t* src, uint8_t* dst, uint8_t* mirror, uint32_t width)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    // Per 128-bit lane: broadcast alpha word of each pixel into RGB words, zero alpha word
+    const __m256i alpha_shuffle = _mm256_setr_epi8(
+        6, 7, 6, 7, 6, 7, -1, -1, 14, 15, 14, 15, 14, 15, -1, -1,
+        6, 7, 6, 7, 6, 7, -1, -1, 14, 15, 14, 15, 14, 15, -1, -1
+    );
+    const __m256i alpha_one = _mm256_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255);
+    const __m256i bias = _mm256_set1_epi16(128);
+    const __m256i swizzle = _mm256_setr_epi8(
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+    );
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256i px = _mm256_loadu_si256((const __m256i*)(src + x * 4));
+        __m256i lo = _mm256_unpacklo_epi8(px, zero);
+        __m256i hi = _mm256_unpackhi_epi8(px, zero);
+
+        __m256i alo = _mm256_or_si256(_mm256_shuffle_epi8(lo, alpha_shuffle), alpha_one);
+        __m256i ahi = _mm256_or_si256(_mm256_shuffle_epi8(hi, alpha_shuffle), alpha_one);
+
+        __m256i tlo = _mm256_add_epi16(_mm256_mullo_epi16(lo, alo), bias);
+        __m256i thi = _mm256_add_epi16(_mm256_mullo_epi16(hi, ahi), bias);
+        tlo = _mm256_srli_epi16(_mm256_add_epi16(tlo, _mm256_srli_epi16(tlo, 8)), 8);
+        thi = _mm256_srli_epi16(_mm256_add_epi16(thi, _mm256_srli_epi16(thi, 8)), 8);
+
+        // Unpack and pack both work per lane, so pixel order is preserved
+        __m256i out = _mm256_shuffle_epi8(_mm256_packus_epi16(tlo, thi), swizzle);
+        _mm256_storeu_si256((__m256i*)(dst + x * 4), out);
+        if (mirror) _mm256_storeu_si256((__m256i*)(mirror + (width - x - 8) * 4), _mm256_permutevar8x32_epi32(out, reverse));
+    }
+
+    // Remaining pixels are the first ones of the mirrored row, so mirror pointer stays as is
+    pixel_ops_convert_row_sse2(src + x * 4, dst + x * 4, mirror, width - x);
+}
+
+// Alpha scans compare whole vectors of pixels against zero alpha and only look at single pixels in a block with a hit
+
+__attribute__((target("sse2")))
+static uint32_t pixel_ops_find_opaque_sse2(const uint8_t* row, uint32_t from, uint32_t to)
+{
+    const __m128i alpha_mask = _mm_set1_epi32((int32_t)0xFF000000);
+    uint32_t x = from;
+    for (; x + 4 <= to; x += 4) {
+        __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(row + x * 4)), alpha_mask);
+        uint32_t transparent = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, _mm_setzero_si128())));
+        if (transparent != 0xF) return x + __builtin_ctz(~transparent);
+    }
+    return pixel_ops_find_opaque_scalar(row, x, to);
+}
+
+__attribute__((target("sse2")))
+static uint32_t pixel_ops_rfind_opaque_sse2(const uint8_t* row, uint32_t from, uint32_t to)
+{
+    const __m128i alpha_mask = _mm_set1_epi32((int32_t)0xFF000000);
+    uint32_t x = to;
+    for (; x >= from + 4; x -= 4) {
+        __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(row + (x - 4) * 4)), alpha_mask);
+        uint32_t opaque = ~_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, _mm_setzero_si128()))) & 0xF;
+        if (opaque) return x - 4 + (31 - __builtin_clz(opaque));
+    }
+    return pixel_ops_rfind_opaque_scalar(row, from, x);
+}
+
+__attribute__((target("avx2")))
+static uint32_t pixel_ops_find_opaque_avx2(const uint8_t* row, uint32_t from, uint32_t to)
+{
+    const __m256i alpha_mask = _mm256_set1_epi32((int32_t)0xFF000000);
+    uint32_t x = from;
+    for (; x + 8 <= to; x += 8) {
+        __m256i a = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(row + x * 4)), alpha_mask);
+        uint32_t transparent = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a, _mm256_setzero_si256())));
+        if (transparent != 0xFF) return x + __builtin_ctz(~transparent);
+    }
+    return pixel_ops_find_opaque_sse2(row, x, to);
+}
+
+__attribute__((target("avx2")))
+static uint32_t pixel_ops_rfind_opaque_avx2(const uint8_t* row, uint32_t from, uint32_t to)
+{
+    const __m256i alpha_mask = _mm256_set1_epi32((int32_t)0xFF000000);
+    uint32_t x = to;
+    for (; x >= from + 8; x -= 8) {
+        __m256i a = _mm256_and_si256(_mm256_loadu_si256((const __m256i*)(row + (x - 8) * 4)), alpha_mask);
+        uint32_t opaque = ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(a, _mm256_setzero_si256()))) & 0xFF;
+        if (opaque) return x - 8 + (31 - __builtin_clz(opaque));
+    }
+    return pixel_ops_rfind_opaque_sse2(row, from, x);
+}
+
+#endif
+
+#ifdef PIXEL_OPS_NEON
+
+static void pixel_ops_convert_row_neon(const uint8_t* src, uint8_t* dst, uint8_t* mirror, uint32_t width)
+{
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        uint8x8x4_t px = vld4_u8(src + x * 4);
+        uint8x8x4_t out;
+        for (int c = 0; c < 3; c++) {
+            uint16x8_t t = vaddq_u16(vmull_u8(px.val[c], px.val[3]), vdupq_n_u16(128));
+            // Channel c goes to position 2 - c: RGBA -> BGRA
+            out.val[2 - c] = vshrn_n_u16(vaddq_u16(t, vshrq_n_u16(t, 8)), 8);
+        }
+        out.val[3] = px.val[3];
+        vst4_u8(dst + x * 4, out);
+
+        if (mirror) {
+            for (int c = 0; c < 4; c++) out.val[c] = vrev64_u8(out.val[c]);
+            vst4_u8(mirror + (width - x - 8) * 4, out);
+        }
+    }
+
+    pixel_ops_convert_scalar_pixels(src, dst, mirror, x, width);
+}
+
+static uint32_t pixel_ops_find_opaque_neon(const uint8_t* row, uint32_t from, uint32_t to)
+{
+    const uint32x4_t alpha_mask = vdupq_n_u32(0xFF000000);
+    uint32_t x = from;
+    for (; x + 4 <= to; x += 4) {
+        uint64x2_t a = vreinterpretq_u64_u32(vandq_u32(vld1q_u32((const uint32_t*)(const void*)(row + x * 4)), alpha_mask));
+        if (vgetq_lane_u64(a, 0) | vgetq_lane_u64(a, 1)) break;
+    }
+    return pixel_ops_find_opaque_scalar(row, x, to);
+}
+
+static uint32_t pixel_ops_rfind_opaque_neon(const uint8_t* row, uint32_t from, uint32_t to)
+{
+    const uint32x4_t alpha_mask = vdupq_n_u32(0xFF000000);
+    uint32_t x = to;
+    for (; x >= from + 4; x -= 4) {
+        uint64x2_t a = vreinterpretq_u64_u32(vandq_u32(vld1q_u32((const uint32_t*)(const void*)(row + (x - 4) * 4)), alpha_mask));
+        if (vgetq_lane_u64(a, 0) | vgetq_lane_u64(a, 1)) break;
+    }
+    return pixel_ops_rfind_opaque_scalar(row, from, x);
+}
+
+#endif
+
+static void (*pixel_ops_kernel)(const uint8_t*, uint8_t*, uint8_t*, uint32_t) = NULL;
+static uint32_t (*pixel_ops_find_kernel)(const uint8_t*, uint32_t, uint32_t) = NULL;
+static uint32_t (*pixel_ops_rfind_kernel)(const uint8_t*, uint32_t, uint32_t) = NULL;
+static const char* pixel_ops_kernel_name = NULL;
+static pthread_once_t pixel_ops_once = PTHREAD_ONCE_INIT;
+
+static void pixel_ops_select_kernel()
+{
+    pixel_ops_kernel = pixel_ops_convert_row_scalar;
+    pixel_ops_find_kernel = pixel_ops_find_opaque_scalar;
+    pixel_ops_rfind_kernel = pixel_ops_rfind_opaque_scalar;
+    pixel_ops_kernel_name = "scalar";
+
+#ifdef PIXEL_OPS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        pixel_ops_kernel = pixel_ops_convert_row_avx2;
+        pixel_ops_find_kernel = pixel_ops_find_opaque_avx2;
+        pixel_ops_rfind_kernel = pixel_ops_rfind_opaque_avx2;
+        pixel_ops_kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        pixel_ops_kernel = pixel_ops_convert_row_sse2;
+        pixel_ops_find_kernel = pixel_ops_find_opaque_sse2;
+        pixel_ops_rfind_kernel = pixel_ops_rfind_opaque_sse2;
+        pixel_ops_kernel_name = "sse2";
+    }
+#endif
+
+#ifdef PIXEL_OPS_NEON
+    pixel_ops_kernel = pixel_ops_convert_row_neon;
+    pixel_ops_find_kernel = pixel_ops_find_opaque_neon;
+    pixel_ops_rfind_kernel = pixel_ops_rfind_opaque_neon;
+    pixel_ops_kernel_name = "neon";
+#endif
+
+    // Kernels can be forced to the portable path, e.g. to compare output
+    const char* force = getenv("WL_SHIMEJI_SCALAR_PIXEL_OPS");
+    if (force && *force && *force != '0') {
+        pixel_ops_kernel = pixel_ops_convert_row_scalar;
+        pixel_ops_find_kernel = pixel_ops_find_opaque_scalar;
+        pixel_ops_rfind_kernel = pixel_ops_rfind_opaque_scalar;
+        pixel_ops_kernel_name = "scalar";
+    }
+
+    DEBUG("Using %s pixel conversion kernel", pixel_ops_kernel_name);
+}
+
+void pixel_ops_convert_row(const uint8_t* src, uint8_t* dst, uint8_t* mirror, uint32_t width)
+{
+    pthread_once(&pixel_ops_once, pixel_ops_select_kernel);
+    pixel_ops_kernel(src, dst, mirror, width);
+}
+
+uint32_t pixel_ops_find_opaque(const uint8_t* row, uint32_t from, uint32_t to)
+{
+    pthread_once(&pixel_ops_once, pixel_ops_select_kernel);
+    return pixel_ops_find_kernel(row, from, to);
+}
+
+uint32_t pixel_ops_rfind_opaque(const uint8_t* row, uint32_t from, uint32_t to)
+{
+    pthread_once(&pixel_ops_once, pixel_ops_select_kernel);
+    return pixel_ops_rfind_kernel(row, from, to);
+}
+
+// Taps of one output pixel along one axis
+struct pixel_ops_contribution {
+    uint32_t first;
+    uint32_t count;
+    float* weights;
+};
+
+static struct pixel_ops_contribution* pixel_ops_contributions(uint32_t src_len, uint32_t dst_len, float** storage)
+{
+    float ratio = (float)src_len / (float)dst_len;
+    float support = ratio > 1.0f ? ratio : 1.0f;
+    uint32_t max_taps = (uint32_t)ceilf(support) * 2 + 1;
+
+    struct pixel_ops_contribution* contributions = calloc(dst_len, sizeof(struct pixel_ops_contribution));
+    *storage = calloc((size_t)dst_len * max_taps, sizeof(float));
+    if (!contributions || !*storage) {
+        free(contributions);
+        free(*storage);
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < dst_len; i++) {
+        // Pixel centers of both images are aligned, so edges map onto edges
+        float center = ((float)i + 0.5f) * ratio - 0.5f;
+        int64_t first = (int64_t)ceilf(center - support);
+        int64_t last = (int64_t)floorf(center + support);
+        if (first < 0) first = 0;
+        if (last > (int64_t)src_len - 1) last = (int64_t)src_len - 1;
+
+        struct pixel_ops_contribution* contribution = &contributions[i];
+        contribution->weights = *storage + (size_t)i * max_taps;
+        contribution->first = (uint32_t)first;
+
+        // Taps falling outside of the image are dropped and the rest renormalized
+        float total = 0.0f;
+        for (int64_t j = first; j <= last && contribution->count < max_taps; j++) {
+            float weight = 1.0f - fabsf((float)j - center) / support;
+            if (weight <= 0.0f) weight = 0.0f;
+            contribution->weights[contribution->count++] = weight;
+            total += weight;
+        }
+        if (total <= 0.0f) {
+            // Can only happen with degenerate sizes, fall back to nearest pixel
+            contribution->first = (uint32_t)(center < 0.0f ? 0 : (center > src_len - 1 ? src_len - 1 : (uint32_t)lroundf(center)));
+            contribution->count = 1;
+            contribution->weights[0] = 1.0f;
+            continue;
+        }
+        for (uint32_t j = 0; j < contribution->count; j++) contribution->weights[j] /= total;
+    }
+
+    return contributions;
+}
+
+bool pixel_ops_resample(const uint8_t* src, uint32_t src_width, uint32_t src_height, uint8_t* dst, uint32_t dst_width, uint32_t dst_height)
+{
+    if (!src_width || !src_height || !dst_width || !dst_height) return false;
+
+    float* horizontal_storage = NULL;
+    float* vertical_storage = NULL;
+    struct pixel_ops_contribution* horizontal = pixel_ops_contributions(src_width, dst_width, &horizontal_storage);
+    struct pixel_ops_contribution* vertical = pixel_ops_contributions(src_height, dst_height, &vertical_storage);
+    // Horizontally resampled rows, kept in float so the second pass doesn't round twice
+    float* rows = calloc((size_t)src_height * dst_width * 4, sizeof(float));
+
+    if (!horizontal || !vertical || !rows) {
+        free(horizontal);
+        free(horizontal_storage);
+        free(vertical);
+        free(vertical_storage);
+        free(rows);
+        return false;
+    }
+
+    for (uint32_t y = 0; y < src_height; y++) {
+        const uint8_t* in = src + (size_t)y * src_width * 4;
+        float* out = rows + (size_t)y * dst_width * 4;
+        for (uint32_t x = 0; x < dst_width; x++) {
+            const struct pixel_ops_contribution* contribution = &horizontal[x];
+            float acc[4] = {0};
+            for (uint32_t t = 0; t < contribution->count; t++) {
+                const uint8_t* pixel = in + (size_t)(contribution->first + t) * 4;
+                float weight = contribution->weights[t];
+                for (uint8_t c = 0; c < 4; c++) acc[c] += pixel[c] * weight;
+            }
+            memcpy(out + (size_t)x * 4, acc, sizeof(acc));
+        }
+    }
+
+    // Weights are normalized and non-negative, so premultiplied channels never exceed alpha after rounding
+    for (uint32_t y = 0; y < dst_height; y++) {
+        const struct pixel_ops_contribution* contribution = &vertical[y];
+        uint8_t* out = dst + (size_t)y * dst_width * 4;
+        for (uint32_t x = 0; x < dst_width; x++) {
+            float acc[4] = {0};
+            for (uint32_t t = 0; t < contribution->count; t++) {
+                const float* pixel = rows + ((size_t)(contribution->first + t) * dst_width + x) * 4;
+                float weight = contribution->weights[t];
+                for (uint8_t c = 0; c < 4; c++) acc[c] += pixel[c] * weight;
+            }
+            for (uint8_t c = 0; c < 4; c++) {
+                float value = acc[c] + 0.5f;
+                out[(size_t)x * 4 + c] = value >= 255.0f ? 255 : (value <= 0.0f ? 0 : (uint8_t)value);
+            }
+        }
+    }
+
+    free(horizontal);
+    free(horizontal_storage);
+    free(vertical);
+    free(vertical_storage);
+    free(rows);
+    return true;
+}
+
+const char* pixel_ops_backend_name()
+{
+    pthread_once(&pixel_ops_once, pixel_ops_select_kernel);
+    return pixel_ops_kernel_name;
+}
@@ -0,0 +1,43 @@
+/*
+    pixel_ops.h - wl_shimeji's sprite pixel conversion kernels
+
+    Copyright (C) 2025  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef PIXEL_OPS_H
+#define PIXEL_OPS_H
+
+#include "master_header.h"
+
+// Converts one row of straight RGBA pixels to premultiplied ARGB8888 (BGRA in memory).
+// Result is written to dst as is, and with horizontally reversed pixel order to mirror (if not NULL).
+// Channels are premultiplied as (c * a + 127) / 255, every implementation produces identical output.
+void pixel_ops_convert_row(const uint8_t* src, uint8_t* dst, uint8_t* mirror, uint32_t width);
+
+// Returns index of first/last pixel in [from, to) of RGBA row with non-zero alpha, or UINT32_MAX if there is none
+uint32_t pixel_ops_find_opaque(const uint8_t* row, uint32_t from, uint32_t to);
+uint32_t pixel_ops_rfind_opaque(const uint8_t* row, uint32_t from, uint32_t to);
+
+// Resamples premultiplied 4-channel image to dst_width x dst_height using separable triangle filter.
+// Filter widens when downscaling, so every source pixel contributes (area averaging rather than point sampling).
+// Resampling commutes with mirroring, so mirrored image may be produced by mirroring the result.
+// Returns false if temporary storage can't be allocated
+bool pixel_ops_resample(const uint8_t* src, uint32_t src_width, uint32_t src_height, uint8_t* dst, uint32_t dst_width, uint32_t dst_height);
+
+// Name of the kernel selected for this CPU
+const char* pixel_ops_backend_name();
+
+#endif
@@ -293,7 +293,7 @@ ipc_packet_t* protocol_builder_mascot_info(struct mascot* mascot)
         ENSURE_MARSHALLER(ipc_packet_write_string(packet, ""));
     }
 
-    ENSURE_MARSHALLER(ipc_packet_write_string(packet, mascot->current_affordance));
+    ENSURE_MARSHALLER(ipc_packet_write_string(packet, atom_name(mascot->current_affordance)));
 
     ENSURE_MARSHALLER(ipc_packet_write_uint8(packet, mascot->as_p));
     for (int i = 0; i < mascot->as_p; i++) {
@@ -314,7 +314,7 @@ ipc_packet_t* protocol_builder_mascot_info(struct mascot* mascot)
         ENSURE_MARSHALLER(ipc_packet_write_uint8(packet, mascot->local_variables[i].used));
         if (mascot->local_variables[i].expr.expression_prototype) {
             ENSURE_MARSHALLER(ipc_packet_write_uint8(packet, mascot->local_variables[i].expr.expression_prototype->evaluate_once));
-            ENSURE_MARSHALLER(ipc_packet_write_uint16(packet, mascot->local_variables[i].expr.expression_prototype->body->id));
+            ENSURE_MARSHALLER(ipc_packet_write_uint16(packet, mascot->local_variables[i].expr.expression_prototype->id));
         } else {
             ENSURE_MARSHALLER(ipc_packet_write_uint8(packet, 0));
             ENSURE_MARSHALLER(ipc_packet_write_uint16(packet, 0));
@@ -471,6 +471,30 @@ ipc_packet_t* protocol_builder_config_key(const char* key, const char* value)
     return packet;
 }
 
+ipc_packet_t* protocol_builder_expression_profile(struct mascot_prototype* prototype, const struct mascot_expression* expression, const char* site_kind, const char* site_name)
+{
+    ipc_packet_t* packet = ipc_allocate_packet(560);
+
+    ipc_packet_set_type(packet, 0x5A);
+
+    struct expression_profile profile = {0};
+    uint64_t nanoseconds = 0;
+    if (prototype && expression) {
+        ipc_packet_set_object(packet, (prototype->id & 0x00FFFFFF) | (PROTOCOL_OBJECT_PROTOTYPE << 24));
+        expression_profile_get(expression->body, &profile, &nanoseconds);
+    }
+
+    ENSURE_MARSHALLER(ipc_packet_write_uint16(packet, expression ? expression->id : 0));
+    ENSURE_MARSHALLER(ipc_packet_write_string(packet, site_kind));
+    ENSURE_MARSHALLER(ipc_packet_write_string(packet, site_name));
+    ENSURE_MARSHALLER(ipc_packet_write_uint64(packet, profile.calls));
+    ENSURE_MARSHALLER(ipc_packet_write_uint64(packet, profile.instructions));
+    ENSURE_MARSHALLER(ipc_packet_write_uint64(packet, nanoseconds));
+    ENSURE_MARSHALLER(ipc_packet_write_uint64(packet, profile.errors));
+
+    return packet;
+}
+
 ipc_packet_t* protocol_builder_prototype_withdrawn(struct mascot_prototype* prototype)
 {
     ipc_packet_t* packet = ipc_allocate_packet(0);
@@ -1150,6 +1174,97 @@ bool protocol_handler_list_config_keys(struct protocol_client* client, ipc_packe
     return false;
 }
 
+// Sends profile of expression once per site referencing it. Identical expressions share body and counters, so they are sent once,
+// under id of the first definition with that body, letting client merge their sites.
+// Sites are numbered, stamps[i] holds last site body of expression i was sent for
+static void protocol_send_expression_profile(struct protocol_client* client, struct mascot_prototype* prototype, const struct mascot_expression* expression, uint32_t* stamps, uint32_t site, const char* site_kind, const char* site_name)
+{
+    if (!expression || !expression->body) return;
+
+    for (uint16_t i = 0; i < prototype->expressions_count; i++) {
+        if (prototype->expression_definitions[i]->body != expression->body) continue;
+        if (stamps[i] == site) return;
+        stamps[i] = site;
+        if (expression->body->profile.calls) {
+            ipc_packet_t* profile = protocol_builder_expression_profile(prototype, prototype->expression_definitions[i], site_kind, site_name);
+            ipc_connector_send(client->connector, profile);
+        }
+        return;
+    }
+}
+
+static void protocol_send_variables_profile(struct protocol_client* client, struct mascot_prototype* prototype, struct mascot_local_variable** variables, uint32_t* stamps, uint32_t site, const char* site_kind, const char* site_name)
+{
+    if (!variables) return;
+    for (uint16_t i = 0; i < 128; i++) {
+        if (!variables[i] || !variables[i]->used) continue;
+        protocol_send_expression_profile(client, prototype, variables[i]->expr.expression_prototype, stamps, site, site_kind, site_name);
+    }
+}
+
+bool protocol_handler_get_expression_profile(struct protocol_client* client, ipc_packet_t* packet)
+{
+    uint8_t reset = 0;
+    ENSURE_MARSHALLER(ipc_packet_read_uint8(packet, &reset));
+
+    struct protocol_server_state* state = protocol_get_server_state();
+
+    pthread_mutex_lock(&state->prototypes_mutex);
+    for (int32_t i = 0; i < mascot_prototype_store_count(state->prototypes); i++) {
+        struct mascot_prototype* prototype = mascot_prototype_store_get_index(state->prototypes, i);
+        if (!prototype || !prototype->expressions_count) continue;
+
+        uint32_t* stamps = calloc(prototype->expressions_count, sizeof(uint32_t));
+        if (!stamps) continue;
+
+        // Expressions are attributed to actions and behaviors evaluating them, conditions of behavior lists to behavior owning the list
+        uint32_t site = 0;
+        for (uint16_t j = 0; j < prototype->actions_count; j++) {
+            const struct mascot_action* action = prototype->action_definitions[j];
+            if (!action) continue;
+            site++;
+            protocol_send_expression_profile(client, prototype, action->condition, stamps, site, "action", action->name);
+            protocol_send_variables_profile(client, prototype, action->variables, stamps, site, "action", action->name);
+            for (uint16_t k = 0; k < action->length; k++) {
+                const struct mascot_action_content* content = &action->content[k];
+                if (content->kind == mascot_action_content_type_animation && content->value.animation) {
+                    protocol_send_expression_profile(client, prototype, content->value.animation->condition, stamps, site, "action", action->name);
+                } else if (content->kind == mascot_action_content_type_action_reference && content->value.action_reference) {
+                    const struct mascot_action_reference* reference = content->value.action_reference;
+                    protocol_send_expression_profile(client, prototype, reference->condition, stamps, site, "action", action->name);
+                    protocol_send_expression_profile(client, prototype, reference->duration_limit, stamps, site, "action", action->name);
+                    protocol_send_variables_profile(client, prototype, reference->overwritten_locals, stamps, site, "action", action->name);
+                }
+            }
+        }
+        for (uint16_t j = 0; j < prototype->behavior_count; j++) {
+            const struct mascot_behavior* behavior = prototype->behavior_definitions[j];
+            if (!behavior) continue;
+            site++;
+            protocol_send_expression_profile(client, prototype, behavior->condition, stamps, site, "behavior", behavior->name);
+            for (uint16_t k = 0; k < behavior->next_behaviors_count; k++) {
+                protocol_send_expression_profile(client, prototype, behavior->next_behavior_list[k].condition, stamps, site, "behavior", behavior->name);
+            }
+        }
+        site++;
+        for (uint16_t j = 0; j < prototype->root_behavior_list_count; j++) {
+            protocol_send_expression_profile(client, prototype, prototype->root_behavior_list[j].condition, stamps, site, "root", NULL);
+        }
+        free(stamps);
+
+        if (reset) {
+            for (uint16_t j = 0; j < prototype->expressions_count; j++) {
+                expression_profile_reset(prototype->expression_definitions[j]->body);
+            }
+        }
+    }
+    pthread_mutex_unlock(&state->prototypes_mutex);
+
+    ipc_packet_t* end = protocol_builder_expression_profile(NULL, NULL, NULL, NULL);
+    ipc_connector_send(client->connector, end);
+    return true;
+}
+
 bool protocol_handler_import(struct protocol_client* client, ipc_packet_t* packet)
 {
     int32_t fd;
@@ -33,6 +33,7 @@ bool protocol_handler_apply_behavior(struct protocol_client* client, ipc_packet_
 bool protocol_handler_set_config_key(struct protocol_client* client, ipc_packet_t* packet);
 bool protocol_handler_get_config_key(struct protocol_client* client, ipc_packet_t* packet);
 bool protocol_handler_list_config_keys(struct protocol_client* client, ipc_packet_t* packet);
+bool protocol_handler_get_expression_profile(struct protocol_client* client, ipc_packet_t* packet);
 bool protocol_handler_import(struct protocol_client* client, ipc_packet_t* packet);
 bool protocol_handler_export(struct protocol_client* client, ipc_packet_t* packet);
 bool protocol_handler_stop(struct protocol_client* client, ipc_packet_t* packet);
@@ -70,6 +71,7 @@ ipc_packet_t* protocol_builder_export_failed(protocol_export_t* export, uint32_t
 ipc_packet_t* protocol_builder_export_finished(protocol_export_t* export);
 ipc_packet_t* protocol_builder_click_event_expired(protocol_click_event_t* event);
 ipc_packet_t* protocol_builder_config_key(const char* key, const char* value);
+ipc_packet_t* protocol_builder_expression_profile(struct mascot_prototype* prototype, const struct mascot_expression* expression, const char* site_kind, const char* site_name);
 ipc_packet_t* protocol_builder_prototype_withdrawn(struct mascot_prototype* prototype);
 ipc_packet_t* protocol_builder_shm_pool_imported(protocol_shm_pool_t* pool);
 ipc_packet_t* protocol_builder_shm_pool_failed(protocol_shm_pool_t* pool);
@@ -24,7 +24,7 @@ import random
 import logging
 
 from ipc_protocol import Packet,\
-ServerHello, ClientHello, Notice, StartSession, EnvironmentAnnouncement, EnvironmentChanged, EnvironmentMascot, EnvironmentWithdrawn, StartPrototype, PrototypeName, PrototypeDisplayName, PrototypePath, PrototypeFD, PrototypeAddAction, PrototypeAddBehavior, PrototypeIcon, PrototypeAuthor, PrototypeVersion, CommitPrototypes, MascotMigrated, MascotDisposed, MascotInfo, MascotClicked, SelectionDone, SelectionCancelled, ImportFailed, ImportStarted, ImportFinished, ImportProgress, ExportFailed, ExportFinished, ConfigKey, ClickEventExpired, PrototypeWithdraw, ReloadPrototype, Spawn, MascotGetInfo, MascotInfo, ApplyBehavior, Stop, GetConfigKey, ListConfigKeys, SetConfigKey, ConfigKey, Disconnect,\
+ServerHello, ClientHello, Notice, StartSession, EnvironmentAnnouncement, EnvironmentChanged, EnvironmentMascot, EnvironmentWithdrawn, StartPrototype, PrototypeName, PrototypeDisplayName, PrototypePath, PrototypeFD, PrototypeAddAction, PrototypeAddBehavior, PrototypeIcon, PrototypeAuthor, PrototypeVersion, CommitPrototypes, MascotMigrated, MascotDisposed, MascotInfo, MascotClicked, SelectionDone, SelectionCancelled, ImportFailed, ImportStarted, ImportFinished, ImportProgress, ExportFailed, ExportFinished, ConfigKey, ClickEventExpired, PrototypeWithdraw, ReloadPrototype, Spawn, MascotGetInfo, MascotInfo, ApplyBehavior, Stop, GetConfigKey, ListConfigKeys, SetConfigKey, ConfigKey, GetExpressionProfile, ExpressionProfile, Disconnect,\
 Prototype, Environment, Mascot, Selection, Import, Export, PluginRestoreWindows,\
 objects, prototypes, environments, mascots, active_selection, imports, exports
 
@@ -65,6 +65,7 @@ class Client:
         0x28: ExportFailed,
         0x29: ExportFinished,
         0x54: ConfigKey,
+        0x5A: ExpressionProfile,
         0x55: ClickEventExpired,
         0x57: PrototypeWithdraw
     }
@@ -593,6 +594,39 @@ def prototypes_handler(arguments: argparse.Namespace, client: Client, parser):
             packet = ReloadPrototype("")
             client.queue_packet(packet)
 
+        case "profile":
+            # Expressions shared by several sites are reported once per site, counters are shared
+            expressions: dict[tuple[int, int], dict[str, Any]] = {}
+
+            def received_profile(client: Client, packet: ExpressionProfile):
+                if len(packet.site_kind) == 0:
+                    ranked = sorted(expressions.values(), key=lambda e: e["nanoseconds"], reverse=True)
+                    total = sum(e["nanoseconds"] for e in ranked) or 1
+                    print(f"{'Time, ms':>10} {'Share':>6} {'Calls':>10} {'Instructions':>12} {'Errors':>7}  Expression")
+                    for e in ranked[:arguments.count]:
+                        print(f"{e['nanoseconds'] / 1e6:>10.3f} {e['nanoseconds'] * 100 / total:>5.1f}% {e['calls']:>10} {e['instructions']:>12} {e['errors']:>7}  {e['prototype']}#{e['id']} ({', '.join(e['sites'])})")
+                    exit(0)
+
+                prototype = prototypes.get(packet.object_id)
+                key = (packet.object_id, packet.expression_id)
+                if key not in expressions:
+                    expressions[key] = {
+                        "prototype": prototype.name if prototype else str(packet.object_id & 0x00FFFFFF),
+                        "id": packet.expression_id,
+                        "calls": packet.calls,
+                        "instructions": packet.instructions,
+                        "nanoseconds": packet.nanoseconds,
+                        "errors": packet.errors,
+                        "sites": []
+                    }
+                expressions[key]["sites"].append(f"{packet.site_kind} {packet.site_name}".strip())
+
+            client.register_callback(ExpressionProfile, received_profile)
+            client.queue_packet(GetExpressionProfile(arguments.reset))
+            starttime = time.time()
+            client.dispatch_events(until=lambda: time.time() - starttime > 5)
+            print("Timeout.")
+
         case "export":
             is_dir = os.path.isdir(arguments.output[0])
             if not is_dir and len(arguments.name) != len(arguments.output):
@@ -1077,7 +1111,12 @@ def config_handler(arguments: argparse.Namespace, client: Client, parser):
         "ON_TOOL_BUTTON2": "On Tool Button 2",
         "ON_TOOL_BUTTON3": "On Tool Button 3",
         "OPACITY": "Opacity",
-        "MASCOT_SCALE": "Scaling"
+        "MASCOT_SCALE": "Scaling",
+        "MIRROR_BY_TRANSFORM": "Mirror By Transform",
+        "ATLAS_MEMORY_BUDGET": "Atlas Memory Budget",
+        "PRESCALE_SPRITES": "Prescale Sprites",
+        "PRECISE_INPUT_REGIONS": "Precise Input Regions",
+        "EXPRESSION_JIT": "Expression JIT"
     }
     starttime = time.time()
     wait_until_null_null = False
@@ -1154,6 +1193,11 @@ def local_config_handler(arguments: argparse.Namespace, parser):
         "ON_TOOL_BUTTON3": "on_tool_button3_value",
         "OPACITY": "mascot_opacity",
         "MASCOT_SCALE": "mascot_scale",
+        "MIRROR_BY_TRANSFORM": "mirror_by_transform",
+        "ATLAS_MEMORY_BUDGET": "atlas_memory_budget",
+        "PRESCALE_SPRITES": "prescale_sprites",
+        "PRECISE_INPUT_REGIONS": "precise_input_regions",
+        "EXPRESSION_JIT": "expression_jit",
         "PROTOTYPES_LOCATION": "prototypes_location",
         "PLUGINS_LOCATION": "plugins_location",
         "SOCKET_LOCATION": "socket_location",
@@ -1285,6 +1329,10 @@ if __name__ == "__main__":
 
     prototype_reload_all = prototype_subparsers.add_parser("reload-all", help="Reload all prototypes")
 
+    prototype_profile = prototype_subparsers.add_parser("profile", help="Show expressions that took most time to evaluate")
+    prototype_profile.add_argument("-n", "--count", type=int, default=20, help="Number of expressions to show")
+    prototype_profile.add_argument("-r", "--reset", action="store_true", help="Reset counters after reading them")
+
     prototype_exporter = prototype_subparsers.add_parser("export", help="Export a prototype")
     prototype_exporter.add_argument("-i", "--name", action="append", help="Name of the prototype to export. Can be specified multiple times.")
     prototype_exporter.add_argument("-o", "--output", action="append", help="Output file path. Should match inputs count or be a directory")
@@ -717,6 +717,34 @@ class ConfigKey(Packet):
         value_len = self.read_values("b")[0]
         self.value = self.read_values(f"{value_len}s")[0].decode()
 
+class GetExpressionProfile(Packet):
+    type: int = 0x59
+    reset: bool
+
+    def __init__(self, reset: bool = False):
+        Packet.__init__(self, self.type, 0, 0, b'')
+        self.reset = reset
+
+    def serialize(self) -> bytes:
+        return struct.pack("B", int(self.reset))
+
+class ExpressionProfile(Packet):
+    expression_id: int
+    site_kind: str
+    site_name: str
+    calls: int
+    instructions: int
+    nanoseconds: int
+    errors: int
+
+    def deserialize(self):
+        self.expression_id = self.read_values("H")[0]
+        site_kind_len = self.read_values("B")[0]
+        self.site_kind = self.read_values(f"{site_kind_len}s")[0].decode()
+        site_name_len = self.read_values("B")[0]
+        self.site_name = self.read_values(f"{site_name_len}s")[0].decode()
+        self.calls, self.instructions, self.nanoseconds, self.errors = self.read_values("QQQQ")
+
 class ClickEventExpired(Packet): ...
 
 class Stop(Packet):
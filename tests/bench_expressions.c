@@ -0,0 +1,124 @@
+/*
+    bench_expressions.c - Measures interpreters of expression programs
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: bench_expressions [corpus] [rounds]
+// Runs every corpus program on a set of mascots with byte-decoding reference interpreter,
+// pre-decoded VM and native code, and reports average time of one execution for each.
+// Memoization is disabled, so every execution actually runs the program
+
+#include <errno.h>
+#include <time.h>
+
+#include "expression_corpus.h"
+#include "expression_reference.h"
+#include "expression_jit.h"
+
+#define BENCH_MASCOTS 64
+
+enum bench_executor {
+    BENCH_REFERENCE,
+    BENCH_VM,
+    BENCH_JIT,
+    BENCH_EXECUTORS
+};
+
+static const char* const bench_executor_names[BENCH_EXECUTORS] = {"byte-decoding", "pre-decoded", "native"};
+
+static volatile float bench_sink;
+
+static uint64_t bench_now()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+static uint64_t bench_run(enum bench_executor executor, struct expression_prototype* prototype, struct mascot* mascots, uint32_t rounds)
+{
+    float sum = 0.0, result = 0.0;
+    uint64_t start = bench_now();
+    for (uint32_t round = 0; round < rounds; round++) {
+        for (uint32_t k = 0; k < BENCH_MASCOTS; k++) {
+            if (executor == BENCH_REFERENCE) expression_reference_execute(prototype, &mascots[k], &result);
+            else expression_vm_execute(prototype, &mascots[k], &result);
+            sum += result;
+        }
+    }
+    uint64_t elapsed = bench_now() - start;
+    bench_sink = sum;
+    return elapsed;
+}
+
+int main(int argc, char** argv)
+{
+    const char* path = argc > 1 ? argv[1] : EXPRESSION_CORPUS_PATH;
+    uint32_t rounds = argc > 2 ? strtoul(argv[2], NULL, 0) : 200;
+
+    FILE* corpus = fopen(path, "r");
+    if (!corpus) ERROR("Couldn't open corpus %s: %s", path, strerror(errno));
+
+    static struct mascot_prototype mascot_prototype;
+    static struct mascot mascots[BENCH_MASCOTS];
+    expression_corpus_mascots(&mascot_prototype, mascots, BENCH_MASCOTS);
+
+    uint64_t nanoseconds[BENCH_EXECUTORS] = {0};
+    uint64_t executions[BENCH_EXECUTORS] = {0};
+    uint32_t programs = 0;
+
+    struct expression_corpus_program program = {0};
+    while (expression_corpus_read(corpus, &program)) {
+        struct expression_arena* arena = expression_arena_new();
+        struct expression_arena* jit_arena = expression_arena_new();
+        support_expression_jit = 0;
+        struct expression_prototype* prototype = expression_arena_load(arena, &program.source);
+        support_expression_jit = 1;
+        struct expression_prototype* jit_prototype = expression_arena_load(jit_arena, &program.source);
+        support_expression_jit = 0;
+        if (!prototype || !jit_prototype) ERROR("Corpus program %s was rejected", program.text);
+        prototype->memoizable = false;
+        jit_prototype->memoizable = false;
+
+        // Both interpreters run the very same prototype, only the way they execute it differs
+        nanoseconds[BENCH_REFERENCE] += bench_run(BENCH_REFERENCE, prototype, mascots, rounds);
+        nanoseconds[BENCH_VM] += bench_run(BENCH_VM, prototype, mascots, rounds);
+        executions[BENCH_REFERENCE] += rounds * BENCH_MASCOTS;
+        executions[BENCH_VM] += rounds * BENCH_MASCOTS;
+        if (jit_prototype->jit) {
+            nanoseconds[BENCH_JIT] += bench_run(BENCH_JIT, jit_prototype, mascots, rounds);
+            executions[BENCH_JIT] += rounds * BENCH_MASCOTS;
+        }
+
+        expression_arena_free(arena);
+        expression_arena_free(jit_arena);
+        programs++;
+    }
+    fclose(corpus);
+
+    printf("%u programs x %u mascots x %u rounds\n", programs, BENCH_MASCOTS, rounds);
+    double baseline = executions[BENCH_REFERENCE] ? (double)nanoseconds[BENCH_REFERENCE] / executions[BENCH_REFERENCE] : 0.0;
+    for (int executor = 0; executor < BENCH_EXECUTORS; executor++) {
+        if (!executions[executor]) {
+            printf("%-14s not supported\n", bench_executor_names[executor]);
+            continue;
+        }
+        double average = (double)nanoseconds[executor] / executions[executor];
+        printf("%-14s %8.2f ns/execution, %5.2fx\n", bench_executor_names[executor], average, baseline / average);
+    }
+    return 0;
+}
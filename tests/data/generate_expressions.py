@@ -0,0 +1,73 @@
+#!/usr/bin/env python3
+
+# Generates corpus of expression programs with shimejictl's compiler.
+# Each line is: expression bytecode local_vars global_vars functions, where empty lists are "-".
+# Usage: generate_expressions.py [seed] [count] > expressions.txt
+
+import contextlib
+import io
+import os
+import random
+import sys
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "src", "shimejictl"))
+
+from compiler import Compiler
+
+# Symbols tests bind stubs to, see tests/expression_corpus.c
+LEAVES = [
+    "1", "0", "2", "0.5", "100", "3.25", "-7", "true", "false",
+    "Math.PI", "Math.random()",
+    "mascot.anchor.x", "mascot.anchor.y", "mascot.count",
+    "mascot.environment.screen.width", "mascot.environment.workarea.right",
+    "footX", "gap", "bornCount", "modX",
+]
+
+BINARY_OPERATORS = ["+", "-", "*", "/", "%", "<", "<=", ">", ">=", "==", "!=", "&&", "||", "&", "|", "^"]
+
+
+def generate(depth):
+    r = random.random()
+    if depth <= 0 or r < 0.25:
+        return random.choice(LEAVES)
+    if r < 0.65:
+        return "(" + generate(depth - 1) + " " + random.choice(BINARY_OPERATORS) + " " + generate(depth - 1) + ")"
+    if r < 0.75:
+        return "!(" + generate(depth - 1) + ")"
+    if r < 0.85:
+        return "(" + generate(depth - 1) + " ? " + generate(depth - 1) + " : " + generate(depth - 1) + ")"
+    if r < 0.9:
+        return "Math.floor(" + generate(depth - 1) + ")"
+    if r < 0.95:
+        return "Math.max(" + generate(depth - 1) + ", " + generate(depth - 1) + ")"
+    return "mascot.environment.floor.ison(mascot.anchor)"
+
+
+def main():
+    random.seed(int(sys.argv[1]) if len(sys.argv) > 1 else 1)
+    count = int(sys.argv[2]) if len(sys.argv) > 2 else 600
+
+    produced = 0
+    while produced < count:
+        expression = generate(random.randint(1, 5))
+        output = io.StringIO()
+        with contextlib.redirect_stdout(output):
+            try:
+                program = Compiler.emit(Compiler.compile(expression, [], [], []))
+            except Exception:
+                continue
+        # Compiler reports problems on stdout, bytecode of such programs isn't what config would contain
+        if "WARNING" in output.getvalue() or len(program["instructions"]) > 1024:
+            continue
+        print(
+            expression.replace(" ", ""),
+            program["instructions"],
+            ",".join(program["local_vars"]) or "-",
+            ",".join(program["global_vars"]) or "-",
+            ",".join(program["functions"]) or "-",
+        )
+        produced += 1
+
+
+if __name__ == "__main__":
+    main()
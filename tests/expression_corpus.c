@@ -0,0 +1,227 @@
+/*
+    expression_corpus.c - Programs compiled by shimejictl, for tests and benchmarks
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "expression_corpus.h"
+
+// Stubs depend on the mascot only, so every executor must produce the same result for it
+static float corpus_mascot_seed(const struct expression_vm_state* state)
+{
+    return (float)(state->ref_mascot->id % 17);
+}
+
+static bool corpus_pi(struct expression_vm_state* state)
+{
+    state->stack[state->sp++] = 3.14159265358979f;
+    return true;
+}
+
+static bool corpus_anchor_x(struct expression_vm_state* state)
+{
+    state->stack[state->sp++] = 40.0f * corpus_mascot_seed(state) + 0.5f;
+    return true;
+}
+
+static bool corpus_anchor_y(struct expression_vm_state* state)
+{
+    state->stack[state->sp++] = 1080.0f - 64.0f * corpus_mascot_seed(state);
+    return true;
+}
+
+static bool corpus_anchor(struct expression_vm_state* state)
+{
+    state->stack[state->sp] = 40.0f * corpus_mascot_seed(state) + 0.5f;
+    state->stack[state->sp + 1] = 1080.0f - 64.0f * corpus_mascot_seed(state);
+    state->sp += 2;
+    return true;
+}
+
+static bool corpus_count(struct expression_vm_state* state)
+{
+    state->stack[state->sp++] = 1.0f + corpus_mascot_seed(state) / 4.0f;
+    return true;
+}
+
+static bool corpus_screen_width(struct expression_vm_state* state)
+{
+    state->stack[state->sp++] = 1920.0f;
+    return true;
+}
+
+static bool corpus_workarea_right(struct expression_vm_state* state)
+{
+    state->stack[state->sp++] = 1880.0f - corpus_mascot_seed(state);
+    return true;
+}
+
+// Not random at all, results have to be reproducible
+static bool corpus_random(struct expression_vm_state* state)
+{
+    state->stack[state->sp++] = corpus_mascot_seed(state) / 17.0f;
+    return true;
+}
+
+static bool corpus_ison(struct expression_vm_state* state)
+{
+    state->stack[state->sp - 2] = state->stack[state->sp - 1] > 900.0f;
+    state->sp--;
+    return true;
+}
+
+static bool corpus_max(struct expression_vm_state* state)
+{
+    state->stack[state->sp - 2] = fmaxf(state->stack[state->sp - 2], state->stack[state->sp - 1]);
+    state->sp--;
+    return true;
+}
+
+static bool corpus_floor(struct expression_vm_state* state)
+{
+    state->stack[state->sp - 1] = floorf(state->stack[state->sp - 1]);
+    return true;
+}
+
+struct corpus_symbol {
+    const char* name;
+    void* callable;
+    struct expression_stack_effect effect;
+};
+
+static const struct corpus_symbol corpus_symbols[] = {
+    {"math.pi", corpus_pi, {0, 1, EXPRESSION_SOURCE_NONE}},
+    {"math.random", corpus_random, {0, 1, EXPRESSION_SOURCE_VOLATILE}},
+    {"math.max", corpus_max, {2, 1, EXPRESSION_SOURCE_NONE}},
+    {"math.floor", corpus_floor, {1, 1, EXPRESSION_SOURCE_NONE}},
+    {"mascot.anchor", corpus_anchor, {0, 2, EXPRESSION_SOURCE_POSITION}},
+    {"mascot.anchor.x", corpus_anchor_x, {0, 1, EXPRESSION_SOURCE_POSITION}},
+    {"mascot.anchor.y", corpus_anchor_y, {0, 1, EXPRESSION_SOURCE_POSITION}},
+    {"mascot.count", corpus_count, {0, 1, EXPRESSION_SOURCE_POPULATION}},
+    {"mascot.environment.screen.width", corpus_screen_width, {0, 1, EXPRESSION_SOURCE_ENVIRONMENT}},
+    {"mascot.environment.workarea.right", corpus_workarea_right, {0, 1, EXPRESSION_SOURCE_ENVIRONMENT}},
+    {"mascot.environment.floor.ison", corpus_ison, {2, 1, EXPRESSION_SOURCE_ENVIRONMENT}},
+};
+
+// Mascot variables corpus uses and local variable each of them is bound to
+static const char* const corpus_variables[] = {"mascot.footX", "mascot.gap", "mascot.bornCount", "modx"};
+
+#define CORPUS_VARIABLES (sizeof(corpus_variables) / sizeof(*corpus_variables))
+
+static uint8_t corpus_bind(const char* line, char* list, void** callables, struct expression_stack_effect* effects, uint8_t* variables)
+{
+    if (!strcmp(list, "-")) return 0;
+
+    uint8_t count = 0;
+    char* saveptr = NULL;
+    for (char* name = strtok_r(list, ",", &saveptr); name; name = strtok_r(NULL, ",", &saveptr)) {
+        if (count == EXPRESSION_CORPUS_SYMBOLS) ERROR("Too many symbols in corpus line: %s", line);
+        bool found = false;
+        if (variables) {
+            for (uint8_t i = 0; i < CORPUS_VARIABLES && !found; i++) {
+                if (strcmp(corpus_variables[i], name)) continue;
+                variables[count] = i;
+                found = true;
+            }
+        } else {
+            for (uint8_t i = 0; i < sizeof(corpus_symbols) / sizeof(*corpus_symbols) && !found; i++) {
+                if (strcmp(corpus_symbols[i].name, name)) continue;
+                callables[count] = corpus_symbols[i].callable;
+                effects[count] = corpus_symbols[i].effect;
+                found = true;
+            }
+        }
+        if (!found) ERROR("Corpus uses symbol %s no stub is bound to", name);
+        count++;
+    }
+    return count;
+}
+
+bool expression_corpus_read(FILE* corpus, struct expression_corpus_program* program)
+{
+    expression_corpus_program_free(program);
+
+    char* line = NULL;
+    size_t capacity = 0;
+    ssize_t length = 0;
+    do {
+        length = getline(&line, &capacity, corpus);
+        if (length < 0) {
+            free(line);
+            return false;
+        }
+        while (length && (line[length - 1] == '\n' || line[length - 1] == '\r')) line[--length] = 0;
+    } while (!length);
+
+    char* fields[5] = {0};
+    char* saveptr = NULL;
+    char* field = strtok_r(line, " ", &saveptr);
+    for (int i = 0; i < 5 && field; i++, field = strtok_r(NULL, " ", &saveptr)) fields[i] = field;
+    if (!fields[4]) ERROR("Malformed corpus line: %s", line);
+
+    size_t hex_length = strlen(fields[1]);
+    if (!hex_length || hex_length % 4 || hex_length / 2 > UINT16_MAX) ERROR("Malformed bytecode of %s", fields[0]);
+
+    program->text = strdup(fields[0]);
+    program->bytecode = malloc(hex_length / 2);
+    for (size_t i = 0; i < hex_length / 2; i++) {
+        char hex[3] = {fields[1][i * 2], fields[1][i * 2 + 1], 0};
+        program->bytecode[i] = strtol(hex, NULL, 16);
+    }
+
+    struct expression_source* source = &program->source;
+    *source = (struct expression_source) {
+        .bytecode = program->bytecode,
+        .bytecode_size = hex_length / 2,
+        .mascot_vars = program->mascot_vars,
+        .mascot_vars_size = corpus_bind(program->text, fields[2], NULL, NULL, program->mascot_vars),
+        .global_getters = program->global_getters,
+        .global_getters_effects = program->global_getters_effects,
+        .global_getters_size = corpus_bind(program->text, fields[3], program->global_getters, program->global_getters_effects, NULL),
+        .function_ptrs = program->function_ptrs,
+        .function_ptrs_effects = program->function_ptrs_effects,
+        .function_ptrs_size = corpus_bind(program->text, fields[4], program->function_ptrs, program->function_ptrs_effects, NULL),
+    };
+
+    free(line);
+    return true;
+}
+
+void expression_corpus_program_free(struct expression_corpus_program* program)
+{
+    free(program->text);
+    free(program->bytecode);
+    program->text = NULL;
+    program->bytecode = NULL;
+}
+
+void expression_corpus_mascots(struct mascot_prototype* prototype, struct mascot* mascots, uint32_t count)
+{
+    prototype->name = "corpus";
+    prototype->local_variables_count = CORPUS_VARIABLES;
+    for (uint32_t k = 0; k < count; k++) {
+        struct mascot* mascot = &mascots[k];
+        mascot->id = k;
+        mascot->prototype = prototype;
+        for (uint8_t v = 0; v < CORPUS_VARIABLES; v++) {
+            mascot->local_variables[v].kind = v & 1 ? mascot_local_variable_float : mascot_local_variable_int;
+        }
+        mascot->local_variables[0].value.i = (int32_t)(k % 50) - 10;
+        mascot->local_variables[1].value.f = k % 3 ? k * 0.75f : -0.0f;
+        mascot->local_variables[2].value.i = k & 1;
+        mascot->local_variables[3].value.f = (float)(k % 9) - 4.5f;
+    }
+}
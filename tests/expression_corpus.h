@@ -0,0 +1,51 @@
+/*
+    expression_corpus.h - Programs compiled by shimejictl, for tests and benchmarks
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TESTS_EXPRESSION_CORPUS_H
+#define TESTS_EXPRESSION_CORPUS_H
+
+#include "support.h"
+#include "mascot.h"
+#include "expressions.h"
+
+#define EXPRESSION_CORPUS_PATH "tests/data/expressions.txt" // Relative to repository root, where make runs tests
+#define EXPRESSION_CORPUS_SYMBOLS 64
+
+// One line of corpus (see tests/data/generate_expressions.py) with symbols bound to stubs
+struct expression_corpus_program {
+    char* text; // Expression program was compiled from
+    uint8_t* bytecode;
+    uint8_t mascot_vars[EXPRESSION_CORPUS_SYMBOLS];
+    void* global_getters[EXPRESSION_CORPUS_SYMBOLS];
+    struct expression_stack_effect global_getters_effects[EXPRESSION_CORPUS_SYMBOLS];
+    void* function_ptrs[EXPRESSION_CORPUS_SYMBOLS];
+    struct expression_stack_effect function_ptrs_effects[EXPRESSION_CORPUS_SYMBOLS];
+    struct expression_source source; // Points to the fields above
+};
+
+// Reads next program, returns false at end of corpus. Malformed lines and unknown symbols abort,
+// so corpus and stubs can't silently drift apart. Program has to be zeroed before first call,
+// it is valid until the next one
+bool expression_corpus_read(FILE* corpus, struct expression_corpus_program* program);
+void expression_corpus_program_free(struct expression_corpus_program* program);
+
+// Sets up mascots, so variables and stub symbols give different results for each of them
+void expression_corpus_mascots(struct mascot_prototype* prototype, struct mascot* mascots, uint32_t count);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+    expression_reference.c - Byte-decoding interpreter of expression bytecode
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "expression_reference.h"
+#include "expression_opcodes.h"
+
+typedef bool (*reference_callable)(struct expression_vm_state*);
+
+#define FAIL(message) \
+{ \
+    state.error_message = message ; \
+    return EXPRESSION_EXECUTION_ERROR; \
+}\
+
+#define BINARY_OP(expr) \
+{ \
+    if (state.sp < 3) FAIL("Stack underflow"); \
+    freg0 = state.stack[state.sp - 2]; \
+    freg1 = state.stack[state.sp - 1]; \
+    state.stack[state.sp - 2] = (expr); \
+    state.sp--; \
+    break; \
+}
+
+#define STORE_BYTE(n) \
+{ \
+    if (state.sp >= 255) FAIL("Stack overflow"); \
+    *((uint8_t*)(&state.stack[state.sp])+(n)) = immoperand; \
+    break; \
+}
+
+#define BRANCH(condition) \
+{ \
+    if (state.sp < 2) FAIL("Stack underflow"); \
+    freg0 = state.stack[state.sp - 1]; \
+    if (condition) { \
+        offsetr = immoperand; \
+        if (state.ip + offsetr > prototype->bytecode_size || offsetr % 2) FAIL("Jump beyond bytecode size"); \
+        state.ip += offsetr; \
+    } \
+    break; \
+}
+
+enum expression_execution_result expression_reference_execute(const struct expression_prototype* prototype, struct mascot* mascot, float* execution_result)
+{
+    if (!prototype || !prototype->bytecode || !mascot) return EXPRESSION_EXECUTION_ERROR;
+
+    struct expression_vm_state state = {};
+    state.sp = 1;
+    state.ip = 0;
+    state.ref_mascot = mascot;
+
+    // Registers are reset on every step, as the interpreter always did
+    uint8_t opcode = OP_ERR;
+    float freg0 = 0.0, freg1 = 0.0;
+    uint8_t immoperand = 0;
+    uint8_t offsetr = 0;
+    uint8_t indexr = 0;
+    reference_callable ptrr = NULL;
+    while (state.ip + 1 < prototype->bytecode_size) {
+        opcode = prototype->bytecode[state.ip++];
+        immoperand = prototype->bytecode[state.ip++];
+        freg0 = 0.0;
+        freg1 = 0.0;
+        offsetr = 0;
+        indexr = 0;
+        ptrr = NULL;
+        switch (opcode) {
+            case OP_ERR:
+                *execution_result = 0.0;
+                FAIL("Program aborted execution using OP_ERR or unbound jump is occured");
+            case OP_RET:
+                if (state.sp < 1) FAIL("Stack underflow");
+                *execution_result = state.stack[state.sp - 1];
+                return EXPRESSION_EXECUTION_OK;
+
+            case OP_LOADL: {
+                if (state.sp >= 255) FAIL("Stack overflow");
+                indexr = immoperand;
+                if (indexr >= prototype->mascot_vars_size) FAIL("Trying to access out of bounds variable");
+                indexr = prototype->mascot_vars[indexr];
+                if (indexr >= mascot->prototype->local_variables_count) FAIL("Variable points towards non existing local variable");
+                struct mascot_local_variable* var = &mascot->local_variables[indexr];
+                if (var->kind == mascot_local_variable_int) {
+                    state.stack[state.sp] = (float)var->value.i;
+                } else if (var->kind == mascot_local_variable_float) {
+                    state.stack[state.sp] = var->value.f;
+                } else {
+                    FAIL("Unknown variable type");
+                }
+                state.sp++;
+                break;
+            }
+            case OP_LOADE:
+                if (state.sp >= 255) FAIL("Stack overflow");
+                indexr = immoperand;
+                if (indexr >= prototype->global_getters_size) FAIL("Trying to access out of bounds global variable");
+                ptrr = prototype->global_getters[indexr];
+                if (!ptrr) FAIL("Global variable not found");
+                if (!ptrr(&state)) return EXPRESSION_EXECUTION_ERROR;
+                break;
+
+            case OP_ADD: BINARY_OP(freg0 + freg1)
+            case OP_SUB: BINARY_OP(freg0 - freg1)
+            case OP_MUL: BINARY_OP(freg0 * freg1)
+            case OP_DIV: BINARY_OP(freg0 / freg1)
+            case OP_MOD: BINARY_OP(fmodf(freg0, freg1))
+            case OP_POW: BINARY_OP(powf(freg0, freg1))
+
+            case OP_AND: BINARY_OP(((int)freg0) & ((int)freg1))
+            case OP_OR: BINARY_OP(((int)freg0) | ((int)freg1))
+            case OP_XOR: BINARY_OP(((int)freg0) ^ ((int)freg1))
+            case OP_NOT:
+                if (state.sp < 2) FAIL("Stack underflow");
+                freg0 = state.stack[state.sp - 1];
+                state.stack[state.sp - 1] = !((int)freg0);
+                break;
+            case OP_SHL: BINARY_OP(((int)freg0) << ((int)freg1))
+            case OP_SHR: BINARY_OP(((int)freg0) >> ((int)freg1))
+
+            case OP_LT: BINARY_OP(freg0 < freg1)
+            case OP_LE: BINARY_OP(freg0 <= freg1)
+            case OP_GT: BINARY_OP(freg0 > freg1)
+            case OP_GE: BINARY_OP(freg0 >= freg1)
+            case OP_EQ: BINARY_OP(freg0 == freg1)
+            case OP_NE: BINARY_OP(freg0 != freg1)
+
+            case OP_LAND: BINARY_OP(((int)freg0) && ((int)freg1))
+            case OP_LOR: BINARY_OP(((int)freg0) || ((int)freg1))
+            case OP_LNOT:
+                if (state.sp < 2) FAIL("Stack underflow");
+                freg0 = state.stack[state.sp - 1];
+                state.stack[state.sp - 1] = !((int)freg0);
+                break;
+
+            case OP_BQZ: BRANCH(!(int)freg0)
+            case OP_BNZ: BRANCH((int)freg0)
+            case OP_JMP:
+                offsetr = immoperand;
+                if (state.ip + offsetr > prototype->bytecode_size || offsetr % 2) FAIL("Jump beyond bytecode size");
+                state.ip += offsetr;
+                break;
+
+            case OP_CALL:
+                if (state.sp < 1) FAIL("Stack underflow");
+                indexr = immoperand;
+                if (indexr >= prototype->function_ptrs_size) FAIL("Function index out of bounds");
+                ptrr = prototype->function_ptrs[indexr];
+                if (!ptrr) FAIL("Function is not found");
+                if (!ptrr(&state)) return EXPRESSION_EXECUTION_ERROR;
+                break;
+
+            case OP_STORE0: STORE_BYTE(0)
+            case OP_STORE1: STORE_BYTE(1)
+            case OP_STORE2: STORE_BYTE(2)
+            case OP_STORE3: STORE_BYTE(3)
+
+            case OP_PUSH:
+                if (state.sp >= 255) FAIL("Stack overflow");
+                state.sp++;
+                break;
+        }
+    }
+
+    FAIL("Reached end of bytecode without OP_RET");
+}
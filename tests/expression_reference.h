@@ -0,0 +1,30 @@
+/*
+    expression_reference.h - Byte-decoding interpreter of expression bytecode
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TESTS_EXPRESSION_REFERENCE_H
+#define TESTS_EXPRESSION_REFERENCE_H
+
+#include "expressions.h"
+
+// Interprets raw bytecode of program the way VM did before programs were pre-decoded:
+// operands are decoded and every bound is checked on each step, optimizer rewrites are not used.
+// Serves as baseline for benchmarks and as unoptimized semantics for tests
+enum expression_execution_result expression_reference_execute(const struct expression_prototype* prototype, struct mascot* mascot, float* execution_result);
+
+#endif
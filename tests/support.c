@@ -0,0 +1,85 @@
+/*
+    support.c - wl_shimeji's shared helpers of unit tests
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdarg.h>
+
+#include "support.h"
+
+int32_t support_expression_jit = 0;
+uint32_t support_failures = 0;
+
+int32_t config_get_expression_jit()
+{
+    return support_expression_jit;
+}
+
+PRINT_FORMAT void __error(const char* file, int line, const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "[ERROR][%s:%d]: ", file, line);
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+    abort();
+}
+
+PRINT_FORMAT void __warn(const char* file, int line, const char* fmt, ...)
+{
+    if (!getenv("TEST_VERBOSE")) return;
+    va_list args;
+    va_start(args, fmt);
+    fprintf(stderr, "[WARN][%s:%d]: ", file, line);
+    vfprintf(stderr, fmt, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+PRINT_FORMAT void __info(const char* file, int line, const char* fmt, ...)
+{
+    UNUSED(file);
+    UNUSED(line);
+    UNUSED(fmt);
+}
+
+PRINT_FORMAT void __debug(const char* file, int line, const char* fmt, ...)
+{
+    UNUSED(file);
+    UNUSED(line);
+    UNUSED(fmt);
+}
+
+PRINT_FORMAT void __clog(const char* color, const char* logtype, const char* file, int line, const char* fmt, ...)
+{
+    UNUSED(color);
+    UNUSED(logtype);
+    UNUSED(file);
+    UNUSED(line);
+    UNUSED(fmt);
+}
+
+int support_finish(const char* name)
+{
+    if (support_failures) {
+        fprintf(stderr, "%s: %u failures\n", name, support_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
@@ -0,0 +1,53 @@
+/*
+    support.h - wl_shimeji's shared helpers of unit tests
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef TESTS_SUPPORT_H
+#define TESTS_SUPPORT_H
+
+#include "master_header.h"
+
+// Tests link only the modules under test. Logging and config they use are stubbed here:
+// ERROR aborts as in the daemon, WARN is printed if TEST_VERBOSE is set, everything else is dropped
+
+// Value returned by config_get_expression_jit()
+extern int32_t support_expression_jit;
+
+// Failed expectations so far, test exits with failure if there are any
+extern uint32_t support_failures;
+
+// Only first few failures are printed, the rest are counted
+#define EXPECT(cond, fmt, ...) \
+do { \
+    if (!(cond) && support_failures++ < 16) fprintf(stderr, "%s:%d: " fmt "\n", __FILE__, __LINE__, ##__VA_ARGS__); \
+} while (0)
+
+// xorshift32, so failures reproduce from the seed alone on every platform
+static inline uint32_t support_random(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+// Prints summary and returns exit status of the test
+int support_finish(const char* name);
+
+#endif
@@ -0,0 +1,104 @@
+/*
+    test_expression_corpus.c - Compares optimized execution of compiled programs with their raw bytecode
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: test_expression_corpus [corpus]
+// Every program shimejictl compiled must be accepted. Its unfolded bytecode, interpreted by reference
+// interpreter, is the expected result; folded and fused program executed by VM, native code and
+// batch executor must fail on the same mascots and return bit-identical results otherwise
+
+#include <errno.h>
+
+#include "expression_corpus.h"
+#include "expression_reference.h"
+#include "expression_jit.h"
+#include "expression_batch.h"
+
+#define TEST_MASCOTS 37
+
+static bool same_result(enum expression_execution_result expected_status, float expected, enum expression_execution_result status, float result)
+{
+    if (expected_status != status) return false;
+    return status != EXPRESSION_EXECUTION_OK || !memcmp(&expected, &result, sizeof(float));
+}
+
+int main(int argc, char** argv)
+{
+    const char* path = argc > 1 ? argv[1] : EXPRESSION_CORPUS_PATH;
+    FILE* corpus = fopen(path, "r");
+    if (!corpus) ERROR("Couldn't open corpus %s: %s", path, strerror(errno));
+
+    static struct mascot_prototype mascot_prototype;
+    static struct mascot mascots[TEST_MASCOTS];
+    struct mascot* batch[TEST_MASCOTS];
+    expression_corpus_mascots(&mascot_prototype, mascots, TEST_MASCOTS);
+    for (int k = 0; k < TEST_MASCOTS; k++) batch[k] = &mascots[k];
+
+    uint32_t programs = 0, optimized = 0, jitted = 0;
+    struct expression_corpus_program program = {0};
+    while (expression_corpus_read(corpus, &program)) {
+        programs++;
+        struct expression_arena* arena = expression_arena_new();
+        struct expression_arena* jit_arena = expression_arena_new();
+        support_expression_jit = 0;
+        struct expression_prototype* prototype = expression_arena_load(arena, &program.source);
+        support_expression_jit = 1;
+        struct expression_prototype* jit_prototype = expression_arena_load(jit_arena, &program.source);
+        support_expression_jit = 0;
+
+        EXPECT(prototype && jit_prototype, "%s: compiled program was rejected", program.text);
+        if (prototype && jit_prototype) {
+            prototype->memoizable = false;
+            jit_prototype->memoizable = false;
+            optimized += prototype->code_size < prototype->bytecode_size / 2;
+            jitted += jit_prototype->jit != NULL;
+
+            for (int start = 0; start < TEST_MASCOTS; start += EXPRESSION_BATCH_LANES) {
+                int count = TEST_MASCOTS - start < EXPRESSION_BATCH_LANES ? TEST_MASCOTS - start : EXPRESSION_BATCH_LANES;
+                float batch_results[EXPRESSION_BATCH_LANES];
+                uint32_t done = expression_batch_execute(prototype, &batch[start], count, batch_results);
+                for (int l = 0; l < count; l++) {
+                    struct mascot* mascot = &mascots[start + l];
+                    float expected = 0, vm_result = 0, jit_result = 0;
+                    enum expression_execution_result expected_status = expression_reference_execute(prototype, mascot, &expected);
+                    enum expression_execution_result vm_status = expression_vm_execute(prototype, mascot, &vm_result);
+                    enum expression_execution_result jit_status = expression_vm_execute(jit_prototype, mascot, &jit_result);
+                    enum expression_execution_result batch_status = (done >> l) & 1 ? EXPRESSION_EXECUTION_OK : EXPRESSION_EXECUTION_ERROR;
+
+                    EXPECT(same_result(expected_status, expected, vm_status, vm_result),
+                        "%s, mascot %d: unfolded %d %a, VM %d %a", program.text, start + l, expected_status, expected, vm_status, vm_result);
+                    EXPECT(same_result(expected_status, expected, jit_status, jit_result),
+                        "%s, mascot %d: unfolded %d %a, JIT %d %a", program.text, start + l, expected_status, expected, jit_status, jit_result);
+                    EXPECT(same_result(expected_status, expected, batch_status, batch_results[l]),
+                        "%s, mascot %d: unfolded %d %a, batch %d %a", program.text, start + l, expected_status, expected, batch_status, batch_results[l]);
+                }
+            }
+        }
+
+        expression_arena_free(arena);
+        expression_arena_free(jit_arena);
+    }
+    fclose(corpus);
+
+    // Corpus is only useful if optimizer actually rewrites its programs
+    EXPECT(programs > 0, "corpus %s is empty", path);
+    EXPECT(optimized > 0, "optimizer didn't shorten any of corpus programs");
+
+    printf("%u programs, %u shortened by optimizer, %u compiled to native code\n", programs, optimized, jitted);
+    return support_finish("test_expression_corpus");
+}
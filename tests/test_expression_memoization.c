@@ -0,0 +1,275 @@
+/*
+    test_expression_memoization.c - Checks memoized results are recomputed once their inputs change
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Every getter counts its calls, so a test can tell whether program was executed or its result was reused
+
+#include "support.h"
+#include "mascot.h"
+#include "expressions.h"
+#include "expression_opcodes.h"
+
+#define TEST_MASCOTS 12
+#define TEST_VARIABLES 8
+
+enum test_getter {
+    GETTER_ENVIRONMENT,
+    GETTER_POPULATION,
+    GETTER_POSITION,
+    GETTER_VOLATILE,
+    GETTER_COUNT
+};
+
+static uint32_t getter_calls[GETTER_COUNT];
+static float environment_value = 10.0f;
+static float population_value = 3.0f;
+
+static bool getter_environment(struct expression_vm_state* state)
+{
+    getter_calls[GETTER_ENVIRONMENT]++;
+    state->stack[state->sp++] = environment_value;
+    return true;
+}
+
+static bool getter_population(struct expression_vm_state* state)
+{
+    getter_calls[GETTER_POPULATION]++;
+    state->stack[state->sp++] = population_value;
+    return true;
+}
+
+// Like mascot.anchor.x, reads mascot's X variable without loading it
+static bool getter_position(struct expression_vm_state* state)
+{
+    getter_calls[GETTER_POSITION]++;
+    state->stack[state->sp++] = state->ref_mascot->local_variables[MASCOT_LOCAL_VARIABLE_X_ID].value.i;
+    return true;
+}
+
+static bool getter_volatile(struct expression_vm_state* state)
+{
+    getter_calls[GETTER_VOLATILE]++;
+    state->stack[state->sp++] = 1.0f;
+    return true;
+}
+
+// Slot i of program's variable table is mascot variable i + 1, slot 0 is X itself
+static uint8_t test_vars[TEST_VARIABLES - 1] = {0, 2, 3, 4, 5, 6, 7};
+static void* test_getters[GETTER_COUNT] = {getter_environment, getter_population, getter_position, getter_volatile};
+static struct expression_stack_effect test_getters_effects[GETTER_COUNT] = {
+    {0, 1, EXPRESSION_SOURCE_ENVIRONMENT},
+    {0, 1, EXPRESSION_SOURCE_POPULATION},
+    {0, 1, EXPRESSION_SOURCE_POSITION},
+    {0, 1, EXPRESSION_SOURCE_VOLATILE},
+};
+
+static struct expression_prototype* load(struct expression_arena* arena, const uint8_t* bytecode, uint16_t bytecode_size)
+{
+    struct expression_source source = {
+        .bytecode = bytecode,
+        .bytecode_size = bytecode_size,
+        .mascot_vars = test_vars,
+        .mascot_vars_size = sizeof(test_vars),
+        .global_getters = test_getters,
+        .global_getters_effects = test_getters_effects,
+        .global_getters_size = GETTER_COUNT,
+    };
+    struct expression_prototype* prototype = expression_arena_load(arena, &source);
+    if (!prototype) ERROR("Test program was rejected");
+    return prototype;
+}
+
+static float execute(struct expression_prototype* prototype, struct mascot* mascot)
+{
+    float result = 0.0;
+    EXPECT(expression_vm_execute(prototype, mascot, &result) == EXPRESSION_EXECUTION_OK, "program failed");
+    return result;
+}
+
+static void setup_mascots(struct mascot_prototype* prototype, struct mascot* mascots, environment_t* environment)
+{
+    prototype->name = "test";
+    prototype->local_variables_count = TEST_VARIABLES;
+    for (uint32_t k = 0; k < TEST_MASCOTS; k++) {
+        struct mascot* mascot = &mascots[k];
+        mascot->id = k;
+        mascot->prototype = prototype;
+        mascot->environment = environment;
+        pthread_mutex_init(&mascot->tick_lock, NULL);
+        for (int v = 0; v < TEST_VARIABLES; v++) {
+            mascot->local_variables[v].kind = mascot_local_variable_int;
+            mascot->local_variables[v].value.i = k * 10 + v;
+        }
+    }
+}
+
+// Variable + environment: reused until either changes, population doesn't matter
+static void test_variables_and_environment(struct expression_arena* arena, struct mascot* mascots)
+{
+    const uint8_t bytecode[] = {OP_LOADL, 1, OP_LOADE, GETTER_ENVIRONMENT, OP_ADD, 0, OP_RET, 0};
+    struct expression_prototype* prototype = load(arena, bytecode, sizeof(bytecode));
+    struct mascot* mascot = &mascots[0];
+    EXPECT(prototype->memoizable, "program reading variable and environment isn't memoizable");
+
+    uint32_t calls = getter_calls[GETTER_ENVIRONMENT];
+    EXPECT(execute(prototype, mascot) == 12.0f, "wrong result");
+    EXPECT(execute(prototype, mascot) == 12.0f, "wrong memoized result");
+    EXPECT(getter_calls[GETTER_ENVIRONMENT] == calls + 1, "result wasn't reused");
+
+    // Other mascot has results of its own
+    EXPECT(execute(prototype, &mascots[1]) == 22.0f, "result of other mascot was reused");
+    EXPECT(getter_calls[GETTER_ENVIRONMENT] == calls + 2, "other mascot wasn't executed");
+
+    mascot->local_variables[2].value.i = 5;
+    EXPECT(execute(prototype, mascot) == 15.0f, "result wasn't recomputed after variable changed");
+    EXPECT(getter_calls[GETTER_ENVIRONMENT] == calls + 3, "program wasn't executed after variable changed");
+
+    // Variable the program doesn't read
+    mascot->local_variables[7].value.i = 100;
+    execute(prototype, mascot);
+    EXPECT(getter_calls[GETTER_ENVIRONMENT] == calls + 3, "unread variable invalidated result");
+
+    environment_value = 20.0f;
+    expression_source_changed(EXPRESSION_SOURCE_ENVIRONMENT);
+    EXPECT(execute(prototype, mascot) == 25.0f, "result wasn't recomputed after environment changed");
+    EXPECT(getter_calls[GETTER_ENVIRONMENT] == calls + 4, "program wasn't executed after environment changed");
+
+    expression_source_changed(EXPRESSION_SOURCE_POPULATION);
+    execute(prototype, mascot);
+    EXPECT(getter_calls[GETTER_ENVIRONMENT] == calls + 4, "population change invalidated result of program not reading it");
+
+    // Moving to other output is an environment change too
+    environment_t* environment = mascot->environment;
+    mascot->environment = (environment_t*)&calls;
+    execute(prototype, mascot);
+    EXPECT(getter_calls[GETTER_ENVIRONMENT] == calls + 5, "program wasn't executed after mascot changed environment");
+    mascot->environment = environment;
+}
+
+static void test_population(struct expression_arena* arena, struct mascot* mascots)
+{
+    const uint8_t bytecode[] = {OP_LOADE, GETTER_POPULATION, OP_RET, 0};
+    struct expression_prototype* prototype = load(arena, bytecode, sizeof(bytecode));
+    struct mascot* mascot = &mascots[2];
+    EXPECT(prototype->memoizable, "program reading population isn't memoizable");
+
+    uint32_t calls = getter_calls[GETTER_POPULATION];
+    execute(prototype, mascot);
+    expression_source_changed(EXPRESSION_SOURCE_ENVIRONMENT);
+    execute(prototype, mascot);
+    EXPECT(getter_calls[GETTER_POPULATION] == calls + 1, "environment change invalidated result of program not reading it");
+
+    population_value = 4.0f;
+    expression_source_changed(EXPRESSION_SOURCE_POPULATION);
+    EXPECT(execute(prototype, mascot) == 4.0f, "result wasn't recomputed after population changed");
+    EXPECT(getter_calls[GETTER_POPULATION] == calls + 2, "program wasn't executed after population changed");
+}
+
+// Position symbols read X and Y, even though program never loads them
+static void test_position(struct expression_arena* arena, struct mascot* mascots)
+{
+    const uint8_t bytecode[] = {OP_LOADE, GETTER_POSITION, OP_RET, 0};
+    struct expression_prototype* prototype = load(arena, bytecode, sizeof(bytecode));
+    struct mascot* mascot = &mascots[3];
+    EXPECT(prototype->memoizable, "program reading position isn't memoizable");
+
+    uint32_t calls = getter_calls[GETTER_POSITION];
+    execute(prototype, mascot);
+    execute(prototype, mascot);
+    EXPECT(getter_calls[GETTER_POSITION] == calls + 1, "result wasn't reused");
+
+    mascot->local_variables[MASCOT_LOCAL_VARIABLE_X_ID].value.i = 640;
+    EXPECT(execute(prototype, mascot) == 640.0f, "result wasn't recomputed after X changed");
+    mascot->local_variables[MASCOT_LOCAL_VARIABLE_Y_ID].value.i = 480;
+    execute(prototype, mascot);
+    EXPECT(getter_calls[GETTER_POSITION] == calls + 3, "program wasn't executed after position changed");
+}
+
+static void test_never_memoized(struct expression_arena* arena, struct mascot* mascots)
+{
+    const uint8_t volatile_bytecode[] = {OP_LOADE, GETTER_VOLATILE, OP_RET, 0};
+    struct expression_prototype* prototype = load(arena, volatile_bytecode, sizeof(volatile_bytecode));
+    EXPECT(!prototype->memoizable, "volatile program is memoizable");
+
+    uint32_t calls = getter_calls[GETTER_VOLATILE];
+    for (int i = 0; i < 3; i++) execute(prototype, &mascots[4]);
+    expression_vm_prefetch(prototype, (struct mascot* const[]){&mascots[4], &mascots[5]}, 2);
+    EXPECT(getter_calls[GETTER_VOLATILE] == calls + 3, "volatile program was cached or prefetched");
+
+    // Sum of more variables than a cache entry holds, plus environment read
+    uint8_t wide_bytecode[64];
+    uint16_t size = 0;
+    for (uint8_t slot = 0; slot < sizeof(test_vars); slot++) {
+        wide_bytecode[size++] = OP_LOADL;
+        wide_bytecode[size++] = slot;
+        if (!slot) continue;
+        wide_bytecode[size++] = OP_ADD;
+        wide_bytecode[size++] = 0;
+    }
+    const uint8_t tail[] = {OP_LOADE, GETTER_ENVIRONMENT, OP_ADD, 0, OP_RET, 0};
+    memcpy(wide_bytecode + size, tail, sizeof(tail));
+    size += sizeof(tail);
+    EXPECT(sizeof(test_vars) > EXPRESSION_CACHE_VARS, "test program doesn't overflow read set");
+
+    prototype = load(arena, wide_bytecode, size);
+    EXPECT(!prototype->memoizable, "program reading more than %d variables is memoizable", EXPRESSION_CACHE_VARS);
+    calls = getter_calls[GETTER_ENVIRONMENT];
+    for (int i = 0; i < 3; i++) execute(prototype, &mascots[4]);
+    EXPECT(getter_calls[GETTER_ENVIRONMENT] == calls + 3, "program with overflowing read set was cached");
+}
+
+// Prefetched results are what execution would return, and execution reuses them
+static void test_prefetch(struct expression_arena* arena, struct mascot* mascots)
+{
+    const uint8_t bytecode[] = {OP_LOADL, 2, OP_LOADE, GETTER_ENVIRONMENT, OP_MUL, 0, OP_RET, 0};
+    struct expression_prototype* prototype = load(arena, bytecode, sizeof(bytecode));
+
+    struct mascot* lanes[TEST_MASCOTS];
+    for (uint32_t k = 0; k < TEST_MASCOTS; k++) lanes[k] = &mascots[k];
+    expression_vm_prefetch(prototype, lanes, TEST_MASCOTS);
+
+    uint32_t calls = getter_calls[GETTER_ENVIRONMENT];
+    for (uint32_t k = 0; k < TEST_MASCOTS; k++) {
+        float expected = mascots[k].local_variables[3].value.i * environment_value;
+        float result = execute(prototype, &mascots[k]);
+        EXPECT(result == expected, "mascot %u: prefetched %g, expected %g", k, result, expected);
+    }
+    EXPECT(getter_calls[GETTER_ENVIRONMENT] == calls, "prefetched results weren't reused");
+
+    mascots[6].local_variables[3].value.i = -1;
+    EXPECT(execute(prototype, &mascots[6]) == -environment_value, "prefetched result wasn't recomputed after variable changed");
+    EXPECT(getter_calls[GETTER_ENVIRONMENT] == calls + 1, "program wasn't executed after variable changed");
+}
+
+int main()
+{
+    static struct mascot_prototype mascot_prototype;
+    static struct mascot mascots[TEST_MASCOTS];
+    static int environment;
+    setup_mascots(&mascot_prototype, mascots, (environment_t*)&environment);
+
+    struct expression_arena* arena = expression_arena_new();
+    test_variables_and_environment(arena, mascots);
+    test_population(arena, mascots);
+    test_position(arena, mascots);
+    test_never_memoized(arena, mascots);
+    test_prefetch(arena, mascots);
+    expression_arena_free(arena);
+
+    return support_finish("test_expression_memoization");
+}
@@ -0,0 +1,214 @@
+/*
+    test_expressions.c - Compares VM, JIT and batch execution of random programs
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: test_expressions [seed] [programs]
+// Every program verifier accepts is executed by VM, JIT (where supported) and batch executor
+// on a set of mascots. All three must fail on the same mascots and return bit-identical results otherwise
+
+#include "support.h"
+#include "mascot.h"
+#include "expressions.h"
+#include "expression_opcodes.h"
+#include "expression_jit.h"
+#include "expression_batch.h"
+
+#define TEST_MASCOTS 19
+#define TEST_MAX_INSTRUCTIONS 48
+
+static bool getter_push(struct expression_vm_state* state)
+{
+    if (state->sp + 1 >= 255) return false;
+    state->stack[state->sp++] = 2.5f;
+    return true;
+}
+
+static bool getter_push2(struct expression_vm_state* state)
+{
+    if (state->sp + 2 >= 255) return false;
+    state->stack[state->sp] = 7.0f;
+    state->stack[state->sp + 1] = -3.0f;
+    state->sp += 2;
+    return true;
+}
+
+static bool function_abs(struct expression_vm_state* state)
+{
+    state->stack[state->sp - 1] = fabsf(state->stack[state->sp - 1]);
+    return true;
+}
+
+static bool function_fail(struct expression_vm_state* state)
+{
+    state->error_message = "function_fail";
+    return false;
+}
+
+static uint8_t test_vars[] = {0, 1, 3};
+static void* test_getters[] = {getter_push, getter_push2, NULL};
+static struct expression_stack_effect test_getters_effects[] = {{0, 1, 0}, {0, 2, 0}, {0, 1, 0}};
+static void* test_functions[] = {function_abs, NULL, function_fail};
+static struct expression_stack_effect test_functions_effects[] = {{1, 1, 0}, {0, 1, 0}, {1, 1, 0}};
+
+// Mostly real opcodes, duplicates raise their odds. 0x99 and OP_X_END are not opcodes at all
+static const uint8_t test_opcodes[] = {
+    OP_RET, OP_LOADL, OP_LOADE, OP_STORE0, OP_STORE1, OP_STORE2, OP_STORE3,
+    OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_POW,
+    OP_AND, OP_OR, OP_XOR, OP_NOT, OP_SHL, OP_SHR,
+    OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+    OP_LAND, OP_LOR, OP_LNOT, OP_BQZ, OP_BNZ, OP_JMP, OP_CALL,
+    OP_PUSH, OP_PUSH, OP_PUSH, OP_STORE0, OP_STORE0, OP_LOADL, OP_LOADL, 0x99, OP_X_END, OP_ERR
+};
+
+static const float test_immediates[] = {0.0f, -0.0f, 1.0f, -1.0f, 0.5f, 3.0f, 31.0f, 1e30f, -7.25f, 255.0f};
+
+static uint16_t emit(uint8_t* bytecode, uint16_t size, uint8_t opcode, uint8_t argument)
+{
+    bytecode[size] = opcode;
+    bytecode[size + 1] = argument;
+    return size + 2;
+}
+
+// Half of programs are plain random instructions. Other half uses only complete float immediates,
+// so optimizer may treat them as pure and fold or fuse them
+static uint16_t generate(uint32_t* rng, uint8_t* bytecode)
+{
+    bool immediates = support_random(rng) & 1;
+    uint32_t count = 1 + support_random(rng) % TEST_MAX_INSTRUCTIONS;
+    uint16_t size = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint8_t opcode = test_opcodes[support_random(rng) % sizeof(test_opcodes)];
+        uint8_t argument = support_random(rng);
+        if (opcode == OP_LOADL || opcode == OP_LOADE || opcode == OP_CALL) argument %= 3;
+        if (opcode >= OP_BQZ && opcode <= OP_JMP) argument = (support_random(rng) % 12) * 2;
+        if (immediates && ((opcode >= OP_STORE0 && opcode <= OP_STORE3) || opcode == OP_PUSH)) {
+            float value = test_immediates[support_random(rng) % (sizeof(test_immediates) / sizeof(float))];
+            uint8_t bytes[4];
+            memcpy(bytes, &value, sizeof(bytes));
+            for (uint8_t b = 0; b < 4; b++) size = emit(bytecode, size, OP_STORE0 + b, bytes[b]);
+            size = emit(bytecode, size, OP_PUSH, 0);
+            continue;
+        }
+        size = emit(bytecode, size, opcode, argument);
+    }
+    return size;
+}
+
+static struct expression_prototype* load(struct expression_arena* arena, uint8_t* bytecode, uint16_t size)
+{
+    struct expression_source source = {
+        .bytecode = bytecode,
+        .bytecode_size = size,
+        .mascot_vars = test_vars,
+        .mascot_vars_size = sizeof(test_vars),
+        .global_getters = test_getters,
+        .global_getters_effects = test_getters_effects,
+        .global_getters_size = sizeof(test_getters) / sizeof(void*),
+        .function_ptrs = test_functions,
+        .function_ptrs_effects = test_functions_effects,
+        .function_ptrs_size = sizeof(test_functions) / sizeof(void*),
+    };
+    struct expression_prototype* prototype = expression_arena_load(arena, &source);
+    if (prototype) prototype->memoizable = false;
+    return prototype;
+}
+
+// Variables mix ints, floats, signed zeroes, values out of int range and one of unknown kind, which fails
+static void setup_mascots(struct mascot_prototype* prototype, struct mascot* mascots)
+{
+    prototype->name = "test";
+    prototype->local_variables_count = 4;
+    for (int k = 0; k < TEST_MASCOTS; k++) {
+        struct mascot* mascot = &mascots[k];
+        mascot->prototype = prototype;
+        for (int v = 0; v < 4; v++) {
+            mascot->local_variables[v].kind = v & 1 ? mascot_local_variable_float : mascot_local_variable_int;
+        }
+        mascot->local_variables[0].value.i = (k % 4) - 1;
+        mascot->local_variables[1].value.f = (k % 3) * 0.5f - 0.5f;
+        mascot->local_variables[2].value.i = k & 1;
+        mascot->local_variables[3].value.f = k % 5 == 4 ? 3e9f : (k % 3 ? -0.0f : 2.0f);
+        if (k % 7 == 5) mascot->local_variables[3].kind = 2;
+    }
+}
+
+static void print_program(const uint8_t* bytecode, uint16_t size)
+{
+    for (uint16_t i = 0; i < size; i++) fprintf(stderr, "%02x", bytecode[i]);
+    fprintf(stderr, "\n");
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t seed = argc > 1 ? strtoul(argv[1], NULL, 0) : 0x5eed;
+    uint32_t programs = argc > 2 ? strtoul(argv[2], NULL, 0) : 20000;
+    uint32_t rng = seed ? seed : 1;
+
+    static struct mascot_prototype mascot_prototype;
+    static struct mascot mascots[TEST_MASCOTS];
+    struct mascot* batch[TEST_MASCOTS];
+    setup_mascots(&mascot_prototype, mascots);
+    for (int k = 0; k < TEST_MASCOTS; k++) batch[k] = &mascots[k];
+
+    uint32_t accepted = 0, jitted = 0, succeeded = 0;
+    for (uint32_t p = 0; p < programs; p++) {
+        uint8_t bytecode[TEST_MAX_INSTRUCTIONS * 10];
+        uint16_t size = generate(&rng, bytecode);
+
+        // Arenas dedup identical programs, so JIT needs one of its own
+        struct expression_arena* vm_arena = expression_arena_new();
+        struct expression_arena* jit_arena = expression_arena_new();
+        support_expression_jit = 0;
+        struct expression_prototype* vm = load(vm_arena, bytecode, size);
+        support_expression_jit = 1;
+        struct expression_prototype* jit = load(jit_arena, bytecode, size);
+        support_expression_jit = 0;
+
+        EXPECT(!vm == !jit, "program %u accepted only with JIT enabled or disabled", p);
+        if (vm && jit) {
+            accepted++;
+            jitted += jit->jit != NULL;
+            for (int start = 0; start < TEST_MASCOTS; start += EXPRESSION_BATCH_LANES) {
+                int count = TEST_MASCOTS - start < EXPRESSION_BATCH_LANES ? TEST_MASCOTS - start : EXPRESSION_BATCH_LANES;
+                float batch_results[EXPRESSION_BATCH_LANES];
+                uint32_t done = expression_batch_execute(vm, &batch[start], count, batch_results);
+                for (int l = 0; l < count; l++) {
+                    float vm_result = 0, jit_result = 0;
+                    enum expression_execution_result vm_status = expression_vm_execute(vm, &mascots[start + l], &vm_result);
+                    enum expression_execution_result jit_status = expression_vm_execute(jit, &mascots[start + l], &jit_result);
+                    bool vm_ok = vm_status == EXPRESSION_EXECUTION_OK;
+                    bool batch_ok = (done >> l) & 1;
+                    succeeded += vm_ok;
+
+                    bool same_jit = vm_status == jit_status && (!vm_ok || !memcmp(&vm_result, &jit_result, sizeof(float)));
+                    bool same_batch = vm_ok == batch_ok && (!vm_ok || !memcmp(&vm_result, &batch_results[l], sizeof(float)));
+                    EXPECT(same_jit, "program %u mascot %d: VM %d %a, JIT %d %a", p, start + l, vm_status, vm_result, jit_status, jit_result);
+                    EXPECT(same_batch, "program %u mascot %d: VM %d %a, batch %d %a", p, start + l, vm_ok, vm_result, batch_ok, batch_results[l]);
+                    if ((!same_jit || !same_batch) && support_failures <= 16) print_program(bytecode, size);
+                }
+            }
+        }
+
+        expression_arena_free(vm_arena);
+        expression_arena_free(jit_arena);
+    }
+
+    printf("seed %#x: %u programs, %u accepted, %u compiled to native code, %u successful runs\n",
+        seed, programs, accepted, jitted, succeeded);
+    return support_finish("test_expressions");
+}
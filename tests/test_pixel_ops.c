@@ -0,0 +1,150 @@
+/*
+    test_pixel_ops.c - Compares SIMD pixel kernels with the scalar ones
+
+    Copyright (C) 2024  CluelessCatBurger <github.com/CluelessCatBurger>
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License
+    as published by the Free Software Foundation; either version 2
+    of the License, or (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Usage: test_pixel_ops [seed]
+// Every kernel this CPU supports must produce output identical to the scalar path for all widths
+// around vector sizes, so both vector body and scalar tails are covered. Rows are allocated exactly,
+// so reads or writes past the end show up under sanitizers
+
+#include "support.h"
+
+// Kernels are static, the test reaches them by including the implementation
+#include "../src/pixel_ops.c"
+
+#define TEST_MAX_WIDTH 131
+
+struct test_kernel {
+    const char* name;
+    void (*convert)(const uint8_t*, uint8_t*, uint8_t*, uint32_t);
+    uint32_t (*find)(const uint8_t*, uint32_t, uint32_t);
+    uint32_t (*rfind)(const uint8_t*, uint32_t, uint32_t);
+};
+
+static uint32_t collect_kernels(struct test_kernel* kernels)
+{
+    uint32_t count = 0;
+#ifdef PIXEL_OPS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        kernels[count++] = (struct test_kernel){"sse2", pixel_ops_convert_row_sse2, pixel_ops_find_opaque_sse2, pixel_ops_rfind_opaque_sse2};
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        kernels[count++] = (struct test_kernel){"avx2", pixel_ops_convert_row_avx2, pixel_ops_find_opaque_avx2, pixel_ops_rfind_opaque_avx2};
+    }
+#endif
+#ifdef PIXEL_OPS_NEON
+    kernels[count++] = (struct test_kernel){"neon", pixel_ops_convert_row_neon, pixel_ops_find_opaque_neon, pixel_ops_rfind_opaque_neon};
+#endif
+    return count;
+}
+
+// Alpha is biased to fully transparent and fully opaque pixels, as in real sprites
+static void fill_row(uint32_t* rng, uint8_t* row, uint32_t width, uint32_t opaque_odds)
+{
+    for (uint32_t x = 0; x < width; x++) {
+        uint32_t bits = support_random(rng);
+        row[x * 4] = bits;
+        row[x * 4 + 1] = bits >> 8;
+        row[x * 4 + 2] = bits >> 16;
+        uint32_t kind = support_random(rng) % opaque_odds;
+        row[x * 4 + 3] = kind == 0 ? bits >> 24 : kind == 1 ? 255 : 0;
+    }
+}
+
+static void test_convert(const struct test_kernel* kernel, uint32_t* rng)
+{
+    for (uint32_t width = 0; width <= TEST_MAX_WIDTH; width++) {
+        size_t size = width * 4;
+        uint8_t* src = malloc(size ? size : 1);
+        uint8_t* expected = malloc(size ? size : 1);
+        uint8_t* expected_mirror = malloc(size ? size : 1);
+        uint8_t* actual = malloc(size ? size : 1);
+        uint8_t* actual_mirror = malloc(size ? size : 1);
+        for (int round = 0; round < 8; round++) {
+            fill_row(rng, src, width, 3);
+            pixel_ops_convert_row_scalar(src, expected, expected_mirror, width);
+
+            kernel->convert(src, actual, actual_mirror, width);
+            EXPECT(!memcmp(expected, actual, size), "%s: converted row of width %u differs", kernel->name, width);
+            EXPECT(!memcmp(expected_mirror, actual_mirror, size), "%s: mirrored row of width %u differs", kernel->name, width);
+
+            memset(actual, 0, size);
+            kernel->convert(src, actual, NULL, width);
+            EXPECT(!memcmp(expected, actual, size), "%s: converted row of width %u without mirror differs", kernel->name, width);
+        }
+        free(src);
+        free(expected);
+        free(expected_mirror);
+        free(actual);
+        free(actual_mirror);
+    }
+
+    // Every channel and alpha combination, to cover rounding of the shift form
+    uint8_t src[256 * 4], expected[256 * 4], actual[256 * 4];
+    for (uint32_t channel = 0; channel < 256; channel++) {
+        for (uint32_t alpha = 0; alpha < 256; alpha++) {
+            src[alpha * 4] = channel;
+            src[alpha * 4 + 1] = 255 - channel;
+            src[alpha * 4 + 2] = channel ^ 0x5a;
+            src[alpha * 4 + 3] = alpha;
+        }
+        pixel_ops_convert_row_scalar(src, expected, NULL, 256);
+        kernel->convert(src, actual, NULL, 256);
+        EXPECT(!memcmp(expected, actual, sizeof(actual)), "%s: premultiplication of channel %u differs", kernel->name, channel);
+    }
+}
+
+static void test_find(const struct test_kernel* kernel, uint32_t* rng)
+{
+    for (uint32_t width = 0; width <= TEST_MAX_WIDTH; width++) {
+        uint8_t* row = malloc(width ? width * 4 : 1);
+        for (int round = 0; round < 16; round++) {
+            // Mostly transparent rows, so there is something to scan past
+            fill_row(rng, row, width, round % 4 ? 4 * width + 2 : 40);
+            uint32_t from = width ? support_random(rng) % (width + 1) : 0;
+            uint32_t to = from + (width - from ? support_random(rng) % (width - from + 1) : 0);
+            if (round == 0) from = 0, to = width;
+
+            uint32_t expected = pixel_ops_find_opaque_scalar(row, from, to);
+            uint32_t actual = kernel->find(row, from, to);
+            EXPECT(expected == actual, "%s: find in [%u, %u) of width %u returned %u, expected %u", kernel->name, from, to, width, actual, expected);
+
+            expected = pixel_ops_rfind_opaque_scalar(row, from, to);
+            actual = kernel->rfind(row, from, to);
+            EXPECT(expected == actual, "%s: rfind in [%u, %u) of width %u returned %u, expected %u", kernel->name, from, to, width, actual, expected);
+        }
+        free(row);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t seed = argc > 1 ? strtoul(argv[1], NULL, 0) : 0x5eed;
+    uint32_t rng = seed ? seed : 1;
+
+    struct test_kernel kernels[3];
+    uint32_t count = collect_kernels(kernels);
+    for (uint32_t i = 0; i < count; i++) {
+        test_convert(&kernels[i], &rng);
+        test_find(&kernels[i], &rng);
+        printf("seed %#x: checked %s kernels\n", seed, kernels[i].name);
+    }
+    if (!count) printf("No SIMD kernels on this CPU, nothing to compare\n");
+    return support_finish("test_pixel_ops");
+}